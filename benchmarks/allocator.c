@@ -0,0 +1,335 @@
+#include "common.h"
+
+// -- Arena API ----------------------------------------------------------------
+
+// Pushes between every clear of the arena.
+#define ARENA_PUSH_BATCH 4096
+
+typedef struct ArenaCase ArenaCase;
+struct ArenaCase {
+    SP_Arena* arena;
+    // Chained arena with small blocks so pushes cross into new blocks.
+    SP_Arena* chained;
+    // Virtual memory arena where every push commits new pages.
+    SP_Arena* virtual_memory;
+};
+
+static void arena_case_setup(void* userdata) {
+    ArenaCase* c = userdata;
+    c->arena = sp_arena_create();
+    c->chained = sp_arena_create_configurable((SP_ArenaDesc) {
+            .block_size = sp_kib(64),
+            .virtual_memory = false,
+            .alignment = sizeof(void*),
+            .chaining = true,
+        });
+    c->virtual_memory = sp_arena_create_configurable((SP_ArenaDesc) {
+            .block_size = sp_gib(1),
+            .virtual_memory = true,
+            .alignment = sizeof(void*),
+            .chaining = false,
+        });
+}
+
+static void arena_case_teardown(void* userdata) {
+    ArenaCase* c = userdata;
+    sp_arena_destroy(c->virtual_memory);
+    sp_arena_destroy(c->chained);
+    sp_arena_destroy(c->arena);
+}
+
+// Push 'size' bytes per iteration, clearing the arena every 'batch' pushes.
+// The clears are part of the measurement since that's how arenas get reused.
+static void arena_push_batched(SP_Bench* bench, SP_Arena* arena, u64 size, u32 batch, b8 zero) {
+    sp_bench_set_bytes_per_iteration(bench, size);
+    for (u64 i = 0; i < sp_bench_iterations(bench); i++) {
+        void* ptr = zero ? sp_arena_push(arena, size) : sp_arena_push_no_zero(arena, size);
+        sp_bench_do_not_optimize(ptr);
+        if ((i + 1) % batch == 0) {
+            sp_arena_clear(arena);
+        }
+    }
+    sp_arena_clear(arena);
+}
+
+static void arena_push_64(SP_Bench* bench, void* userdata) {
+    ArenaCase* c = userdata;
+    arena_push_batched(bench, c->arena, 64, ARENA_PUSH_BATCH, true);
+}
+
+static void arena_push_no_zero_64(SP_Bench* bench, void* userdata) {
+    ArenaCase* c = userdata;
+    arena_push_batched(bench, c->arena, 64, ARENA_PUSH_BATCH, false);
+}
+
+static void arena_push_4k(SP_Bench* bench, void* userdata) {
+    ArenaCase* c = userdata;
+    arena_push_batched(bench, c->arena, 4096, ARENA_PUSH_BATCH, true);
+}
+
+static void arena_push_no_zero_4k(SP_Bench* bench, void* userdata) {
+    ArenaCase* c = userdata;
+    arena_push_batched(bench, c->arena, 4096, ARENA_PUSH_BATCH, false);
+}
+
+static void arena_temp_begin_end(SP_Bench* bench, void* userdata) {
+    ArenaCase* c = userdata;
+    for (u64 i = 0; i < sp_bench_iterations(bench); i++) {
+        SP_Temp temp = sp_temp_begin(c->arena);
+        void* ptr = sp_arena_push_no_zero(c->arena, 256);
+        sp_bench_do_not_optimize(ptr);
+        sp_temp_end(temp);
+    }
+}
+
+static void arena_scratch_begin_end(SP_Bench* bench, void* userdata) {
+    (void) userdata;
+    for (u64 i = 0; i < sp_bench_iterations(bench); i++) {
+        SP_Scratch scratch = sp_scratch_begin(NULL, 0);
+        void* ptr = sp_arena_push_no_zero(scratch.arena, 256);
+        sp_bench_do_not_optimize(ptr);
+        sp_scratch_end(scratch);
+    }
+}
+
+// Every push is a bit over half a block, so all but the first one start a new
+// block.
+static void arena_chained_block_crossing(SP_Bench* bench, void* userdata) {
+    ArenaCase* c = userdata;
+    arena_push_batched(bench, c->chained, sp_kib(32) + 1, 64, false);
+}
+
+// Every push needs four new pages committed and every clear decommits them.
+static void arena_virtual_memory_commit(SP_Bench* bench, void* userdata) {
+    ArenaCase* c = userdata;
+    arena_push_batched(bench, c->virtual_memory, sp_kib(16), 1024, false);
+}
+
+// -- Allocation patterns ------------------------------------------------------
+
+typedef enum FreeOrder {
+    FREE_ORDER_FIFO,
+    FREE_ORDER_LIFO,
+    FREE_ORDER_RANDOM,
+} FreeOrder;
+
+typedef struct AllocPattern AllocPattern;
+struct AllocPattern {
+    const char* name;
+    u64 min_size;
+    u64 max_size;
+    // Allocations alive at once. Everything is freed before the next batch.
+    u32 batch;
+    FreeOrder order;
+};
+
+static const AllocPattern ALLOC_PATTERNS[] = {
+    {"small", 32, 32, 1024, FREE_ORDER_FIFO},
+    {"mixed", 16, 4096, 1024, FREE_ORDER_FIFO},
+    {"large", sp_kib(64), sp_mib(1), 32, FREE_ORDER_FIFO},
+    {"lifo", 16, 4096, 1024, FREE_ORDER_LIFO},
+    {"random_free", 16, 4096, 1024, FREE_ORDER_RANDOM},
+};
+
+typedef enum AllocKind {
+    ALLOC_KIND_LIBC,
+    ALLOC_KIND_ARENA,
+} AllocKind;
+
+// State of one allocating thread.
+typedef struct AllocWorker AllocWorker;
+struct AllocWorker {
+    const AllocPattern* pattern;
+    const u64* sizes;
+    // Index of the allocation freed at each step.
+    const u32* free_order;
+    // NULL for the libc allocator.
+    SP_Arena* arena;
+    void** ptrs;
+    u64 ops;
+};
+
+// All patterns for one allocator and thread count.
+typedef struct AllocCase AllocCase;
+struct AllocCase {
+    AllocKind kind;
+    u32 thread_count;
+    // Per pattern, 'batch' entries each.
+    u64* sizes[sp_arrlen(ALLOC_PATTERNS)];
+    u32* free_orders[sp_arrlen(ALLOC_PATTERNS)];
+    // 'thread_count' workers.
+    AllocWorker* workers;
+    void** worker_ptrs;
+};
+
+static u64 alloc_random(u64* state) {
+    *state = *state * 6364136223846793005llu + 1442695040888963407llu;
+    return *state >> 33;
+}
+
+static AllocCase* alloc_case_create(SP_Arena* arena, AllocKind kind, u32 thread_count) {
+    AllocCase* c = sp_arena_push(arena, sizeof(AllocCase));
+    c->kind = kind;
+    c->thread_count = thread_count;
+
+    u64 state = 0xa110c;
+    u32 max_batch = 0;
+    for (u32 p = 0; p < sp_arrlen(ALLOC_PATTERNS); p++) {
+        const AllocPattern* pattern = &ALLOC_PATTERNS[p];
+        max_batch = sp_max(max_batch, pattern->batch);
+        c->sizes[p] = sp_arena_push(arena, pattern->batch * sizeof(u64));
+        c->free_orders[p] = sp_arena_push(arena, pattern->batch * sizeof(u32));
+        for (u32 i = 0; i < pattern->batch; i++) {
+            // Log-uniform so small sizes are as common as they are in practice.
+            f64 t = (f64) alloc_random(&state) / (1llu << 31);
+            c->sizes[p][i] = pattern->min_size * pow((f64) pattern->max_size / pattern->min_size, t);
+            switch (pattern->order) {
+                case FREE_ORDER_FIFO: c->free_orders[p][i] = i; break;
+                case FREE_ORDER_LIFO: c->free_orders[p][i] = pattern->batch - 1 - i; break;
+                case FREE_ORDER_RANDOM: c->free_orders[p][i] = i; break;
+            }
+        }
+        if (pattern->order == FREE_ORDER_RANDOM) {
+            for (u32 i = pattern->batch - 1; i > 0; i--) {
+                u32 j = alloc_random(&state) % (i + 1);
+                u32 tmp = c->free_orders[p][i];
+                c->free_orders[p][i] = c->free_orders[p][j];
+                c->free_orders[p][j] = tmp;
+            }
+        }
+    }
+
+    c->workers = sp_arena_push(arena, thread_count * sizeof(AllocWorker));
+    c->worker_ptrs = sp_arena_push(arena, thread_count * sizeof(void*));
+    for (u32 i = 0; i < thread_count; i++) {
+        c->workers[i].ptrs = sp_arena_push(arena, max_batch * sizeof(void*));
+        c->worker_ptrs[i] = &c->workers[i];
+    }
+    return c;
+}
+
+// Arenas aren't thread safe so every thread gets its own.
+static void alloc_case_setup(void* userdata) {
+    AllocCase* c = userdata;
+    if (c->kind == ALLOC_KIND_ARENA) {
+        for (u32 i = 0; i < c->thread_count; i++) {
+            c->workers[i].arena = sp_arena_create();
+        }
+    }
+}
+
+static void alloc_case_teardown(void* userdata) {
+    AllocCase* c = userdata;
+    if (c->kind == ALLOC_KIND_ARENA) {
+        for (u32 i = 0; i < c->thread_count; i++) {
+            sp_arena_destroy(c->workers[i].arena);
+            c->workers[i].arena = NULL;
+        }
+    }
+}
+
+// One op is an allocation and its free. Every allocation is touched once.
+// Arenas only free the most recent allocation, so they're cleared after each
+// batch.
+static void alloc_worker_run(void* userdata) {
+    AllocWorker* w = userdata;
+    const AllocPattern* pattern = w->pattern;
+    SP_Allocator allocator = w->arena != NULL ? sp_arena_allocator(w->arena) : sp_libc_allocator();
+
+    u64 done = 0;
+    while (done < w->ops) {
+        u32 batch = sp_min(pattern->batch, w->ops - done);
+        for (u32 i = 0; i < batch; i++) {
+            u8* ptr = sp_alloc(allocator, w->sizes[i]);
+            ptr[0] = i;
+            w->ptrs[i] = ptr;
+        }
+        for (u32 i = 0; i < pattern->batch; i++) {
+            u32 index = w->free_order[i];
+            if (index < batch) {
+                sp_free(allocator, w->ptrs[index], w->sizes[index]);
+            }
+        }
+        if (w->arena != NULL) {
+            sp_arena_clear(w->arena);
+        }
+        done += batch;
+    }
+}
+
+typedef struct AllocBench AllocBench;
+struct AllocBench {
+    AllocCase* c;
+    u32 pattern;
+};
+
+static void alloc_pattern(SP_Bench* bench, void* userdata) {
+    AllocBench* b = userdata;
+    AllocCase* c = b->c;
+    u64 iterations = sp_bench_iterations(bench);
+
+    for (u32 i = 0; i < c->thread_count; i++) {
+        AllocWorker* w = &c->workers[i];
+        w->pattern = &ALLOC_PATTERNS[b->pattern];
+        w->sizes = c->sizes[b->pattern];
+        w->free_order = c->free_orders[b->pattern];
+        // Split the work so ns/op stays comparable between thread counts.
+        w->ops = iterations / c->thread_count + (i < iterations % c->thread_count);
+    }
+
+    if (c->thread_count == 1) {
+        alloc_worker_run(&c->workers[0]);
+    } else {
+        bench_run_threads(bench, c->thread_count, alloc_worker_run, c->worker_ptrs);
+    }
+}
+
+static void register_alloc_group(SP_BenchSuite* suite, const BenchOptions* options, AllocKind kind, u32 thread_count) {
+    SP_Allocator allocator = sp_arena_allocator(options->arena);
+    const char* kind_name = kind == ALLOC_KIND_LIBC ? "libc" : "arena";
+    SP_Str name;
+    if (thread_count == 1) {
+        name = sp_str_pushf(allocator, "Allocator (%s)", kind_name);
+    } else {
+        name = sp_str_pushf(allocator, "Allocator (%s, %u threads)", kind_name, thread_count);
+    }
+    if (!bench_filter(options, name)) {
+        return;
+    }
+
+    AllocCase* c = alloc_case_create(options->arena, kind, thread_count);
+    u32 group = sp_bench_group_register(suite, name);
+    sp_bench_group_fixture(suite, group, alloc_case_setup, alloc_case_teardown, c);
+    for (u32 p = 0; p < sp_arrlen(ALLOC_PATTERNS); p++) {
+        AllocBench* b = sp_arena_push(options->arena, sizeof(AllocBench));
+        b->c = c;
+        b->pattern = p;
+        sp_bench_register_named(suite, group, alloc_pattern, sp_cstr(ALLOC_PATTERNS[p].name), b);
+    }
+}
+
+void bench_allocator(SP_BenchSuite* suite, const BenchOptions* options) {
+    SP_Str name = sp_str_lit("Arena");
+    if (bench_filter(options, name)) {
+        ArenaCase* c = sp_arena_push(options->arena, sizeof(ArenaCase));
+        u32 group = sp_bench_group_register(suite, name);
+        sp_bench_group_fixture(suite, group, arena_case_setup, arena_case_teardown, c);
+        sp_bench_register(suite, group, arena_push_64, c);
+        sp_bench_register(suite, group, arena_push_no_zero_64, c);
+        sp_bench_register(suite, group, arena_push_4k, c);
+        sp_bench_register(suite, group, arena_push_no_zero_4k, c);
+        sp_bench_register(suite, group, arena_temp_begin_end, c);
+        sp_bench_register(suite, group, arena_scratch_begin_end, c);
+        sp_bench_register(suite, group, arena_chained_block_crossing, c);
+        sp_bench_register(suite, group, arena_virtual_memory_commit, c);
+    }
+
+    register_alloc_group(suite, options, ALLOC_KIND_LIBC, 1);
+    register_alloc_group(suite, options, ALLOC_KIND_ARENA, 1);
+
+    u32 threads = sp_min(sp_os_get_system_info().logical_cores, 8u);
+    if (threads > 1) {
+        register_alloc_group(suite, options, ALLOC_KIND_LIBC, threads);
+        register_alloc_group(suite, options, ALLOC_KIND_ARENA, threads);
+    }
+}
@@ -0,0 +1,255 @@
+#include "common.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef SP_OS_WINDOWS
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+const u64 BENCH_SIZES[6] = {
+    1000,
+    10000,
+    100000,
+    1000000,
+    10000000,
+    100000000,
+};
+
+const BenchResolution BENCH_RESOLUTIONS[4] = {
+    {SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING, "Open Addressing"},
+    {SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING, "Separate Chaining"},
+    {SP_HASH_COLLISION_RESOLUTION_SWISS_TABLE, "Swiss Table"},
+    {SP_HASH_COLLISION_RESOLUTION_ROBIN_HOOD, "Robin Hood"},
+};
+
+// https://prng.di.unimi.it/splitmix64.c
+// A bijection on u64, so distinct inputs give distinct keys.
+static u64 splitmix64(u64 x) {
+    x += 0x9e3779b97f4a7c15llu;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9llu;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebllu;
+    return x ^ (x >> 31);
+}
+
+static f64 random_f64(u64* state) {
+    *state = splitmix64(*state);
+    return (*state >> 11) * (1.0 / (1llu << 53));
+}
+
+BenchKeys bench_keys_create(BenchKeyType type, u64 count) {
+    SP_Allocator allocator = sp_libc_allocator();
+    BenchKeys keys = {
+        .type = type,
+        .count = count,
+    };
+
+    switch (type) {
+        case BENCH_KEY_U64: {
+            keys.key_size = sizeof(u64);
+            u64* values = sp_alloc(allocator, 2 * count * sizeof(u64));
+            for (u64 i = 0; i < 2 * count; i++) {
+                values[i] = splitmix64(i);
+            }
+            keys.keys = values;
+        } break;
+        case BENCH_KEY_STR: {
+            // "key:" followed by 16 hex digits.
+            const u32 len = 20;
+            keys.key_size = sizeof(SP_Str);
+            keys.string_data_size = 2 * count * (len + 1);
+            keys.string_data = sp_alloc(allocator, keys.string_data_size);
+            SP_Str* strs = sp_alloc(allocator, 2 * count * sizeof(SP_Str));
+            for (u64 i = 0; i < 2 * count; i++) {
+                char* data = keys.string_data + i * (len + 1);
+                snprintf(data, len + 1, "key:%016llx", (unsigned long long) splitmix64(i));
+                strs[i] = sp_str((const u8*) data, len);
+            }
+            keys.keys = strs;
+        } break;
+    }
+
+    return keys;
+}
+
+void bench_keys_destroy(BenchKeys* keys) {
+    SP_Allocator allocator = sp_libc_allocator();
+    sp_free(allocator, keys->keys, 2 * keys->count * keys->key_size);
+    if (keys->string_data != NULL) {
+        sp_free(allocator, keys->string_data, keys->string_data_size);
+    }
+    *keys = (BenchKeys) {0};
+}
+
+const char* bench_key_type_name(BenchKeyType type) {
+    switch (type) {
+        case BENCH_KEY_U64: return "u64";
+        case BENCH_KEY_STR: return "SP_Str";
+    }
+    return "";
+}
+
+SP_HashFunc bench_key_hash(BenchKeyType type) {
+    switch (type) {
+        case BENCH_KEY_U64: return sp_hash_u64;
+        case BENCH_KEY_STR: return sp_hash_map_helper_hash_str;
+    }
+    return NULL;
+}
+
+SP_EqualFunc bench_key_equal(BenchKeyType type) {
+    switch (type) {
+        case BENCH_KEY_U64: return sp_hash_map_helper_equal_generic;
+        case BENCH_KEY_STR: return sp_hash_map_helper_equal_str;
+    }
+    return NULL;
+}
+
+u32* bench_access_uniform(u64 count) {
+    u32* access = sp_alloc(sp_libc_allocator(), BENCH_ACCESS_COUNT * sizeof(u32));
+    u64 state = 0x5eed;
+    for (u32 i = 0; i < BENCH_ACCESS_COUNT; i++) {
+        access[i] = random_f64(&state) * count;
+    }
+    return access;
+}
+
+// Gray et al. "Quickly Generating Billion-Record Synthetic Databases", the
+// same generator YCSB uses.
+u32* bench_access_zipfian(u64 count) {
+    const f64 theta = 0.99;
+    f64 zetan = 0.0;
+    for (u64 i = 1; i <= count; i++) {
+        zetan += 1.0 / pow((f64) i, theta);
+    }
+    f64 zeta2 = 1.0 + 1.0 / pow(2.0, theta);
+    f64 alpha = 1.0 / (1.0 - theta);
+    f64 eta = (1.0 - pow(2.0 / count, 1.0 - theta)) / (1.0 - zeta2 / zetan);
+
+    u32* access = sp_alloc(sp_libc_allocator(), BENCH_ACCESS_COUNT * sizeof(u32));
+    u64 state = 0x21bf;
+    for (u32 i = 0; i < BENCH_ACCESS_COUNT; i++) {
+        f64 u = random_f64(&state);
+        f64 uz = u * zetan;
+        u64 rank;
+        if (uz < 1.0) {
+            rank = 0;
+        } else if (uz < zeta2) {
+            rank = 1;
+        } else {
+            rank = count * pow(eta * u - eta + 1.0, alpha);
+        }
+        // Scramble so the hot keys aren't neighbours in insertion order.
+        access[i] = splitmix64(sp_min(rank, count - 1)) % count;
+    }
+    return access;
+}
+
+void bench_access_destroy(u32* access) {
+    sp_free(sp_libc_allocator(), access, BENCH_ACCESS_COUNT * sizeof(u32));
+}
+
+b8 bench_filter(const BenchOptions* options, SP_Str name) {
+    if (options->filter == NULL) {
+        return true;
+    }
+
+    SP_Str filter = sp_cstr(options->filter);
+    for (u32 i = 0; i + filter.len <= name.len; i++) {
+        if (sp_str_equal(sp_str_substr(name, i, i + filter.len), filter)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+SP_Str bench_size_name(SP_Arena* arena, u64 size) {
+    SP_Allocator allocator = sp_arena_allocator(arena);
+    if (size >= 1000000 && size % 1000000 == 0) {
+        return sp_str_pushf(allocator, "%lluM", (unsigned long long) size / 1000000);
+    }
+    if (size >= 1000 && size % 1000 == 0) {
+        return sp_str_pushf(allocator, "%lluK", (unsigned long long) size / 1000);
+    }
+    return sp_str_pushf(allocator, "%llu", (unsigned long long) size);
+}
+
+typedef struct BenchThread BenchThread;
+struct BenchThread {
+    BenchThreadFunc func;
+    void* userdata;
+    volatile b8* start;
+#ifdef SP_OS_WINDOWS
+    HANDLE handle;
+#else
+    pthread_t handle;
+#endif
+};
+
+static void bench_thread_run(BenchThread* thread) {
+    // Spin instead of blocking so every thread starts as soon as possible.
+#ifdef SP_COMP_MSVC
+    while (!*thread->start) {
+        YieldProcessor();
+    }
+#else
+    while (!__atomic_load_n(thread->start, __ATOMIC_ACQUIRE)) {
+    }
+#endif
+    thread->func(thread->userdata);
+}
+
+#ifdef SP_OS_WINDOWS
+static DWORD WINAPI bench_thread_entry(LPVOID userdata) {
+    bench_thread_run(userdata);
+    return 0;
+}
+#else
+static void* bench_thread_entry(void* userdata) {
+    bench_thread_run(userdata);
+    return NULL;
+}
+#endif
+
+void bench_run_threads(SP_Bench* bench, u32 count, BenchThreadFunc func, void* const* userdata) {
+    SP_Allocator allocator = sp_libc_allocator();
+    BenchThread* threads = sp_alloc(allocator, count * sizeof(BenchThread));
+    volatile b8 start = false;
+
+    sp_bench_pause(bench);
+    for (u32 i = 0; i < count; i++) {
+        threads[i] = (BenchThread) {
+            .func = func,
+            .userdata = userdata[i],
+            .start = &start,
+        };
+#ifdef SP_OS_WINDOWS
+        threads[i].handle = CreateThread(NULL, 0, bench_thread_entry, &threads[i], 0, NULL);
+        sp_ensure(threads[i].handle != NULL, "Failed to create benchmark thread.");
+#else
+        i32 result = pthread_create(&threads[i].handle, NULL, bench_thread_entry, &threads[i]);
+        sp_ensure(result == 0, "Failed to create benchmark thread.");
+#endif
+    }
+    sp_bench_resume(bench);
+
+#ifdef SP_COMP_MSVC
+    start = true;
+#else
+    __atomic_store_n(&start, true, __ATOMIC_RELEASE);
+#endif
+
+    for (u32 i = 0; i < count; i++) {
+#ifdef SP_OS_WINDOWS
+        WaitForSingleObject(threads[i].handle, INFINITE);
+        CloseHandle(threads[i].handle);
+#else
+        pthread_join(threads[i].handle, NULL);
+#endif
+    }
+
+    sp_free(allocator, threads, count * sizeof(BenchThread));
+}
@@ -0,0 +1,82 @@
+#ifndef BENCH_COMMON_H_
+#define BENCH_COMMON_H_ 1
+
+#include "spire.h"
+
+typedef struct BenchOptions BenchOptions;
+struct BenchOptions {
+    // Largest container size to benchmark.
+    u64 max_size;
+    // Only register groups whose name contains this string. NULL registers
+    // everything.
+    const char* filter;
+    // Arena for everything that lives as long as the suite.
+    SP_Arena* arena;
+};
+
+// Container sizes, from 1K up to 100M entries. Sizes above
+// 'BenchOptions.max_size' are skipped.
+extern const u64 BENCH_SIZES[6];
+
+typedef struct BenchResolution BenchResolution;
+struct BenchResolution {
+    SP_HashCollisionResolution resolution;
+    const char* name;
+};
+
+// Every collision resolution mode benchmarked.
+extern const BenchResolution BENCH_RESOLUTIONS[4];
+
+typedef enum BenchKeyType {
+    BENCH_KEY_U64,
+    BENCH_KEY_STR,
+} BenchKeyType;
+
+// Generated keys. The first 'count' keys are inserted into containers, the
+// next 'count' keys are never inserted and used for misses.
+typedef struct BenchKeys BenchKeys;
+struct BenchKeys {
+    BenchKeyType type;
+    u64 count;
+    u64 key_size;
+    // 2 * 'count' keys of 'key_size' bytes.
+    void* keys;
+    // Backing memory for string keys.
+    char* string_data;
+    u64 string_data_size;
+};
+
+BenchKeys bench_keys_create(BenchKeyType type, u64 count);
+void bench_keys_destroy(BenchKeys* keys);
+const char* bench_key_type_name(BenchKeyType type);
+SP_HashFunc bench_key_hash(BenchKeyType type);
+SP_EqualFunc bench_key_equal(BenchKeyType type);
+
+static inline const void* bench_key(const BenchKeys* keys, u64 index) {
+    return (const u8*) keys->keys + index * keys->key_size;
+}
+
+// Number of precomputed accesses in an access sequence.
+#define BENCH_ACCESS_COUNT (1u << 20)
+
+// Indices in [0, count) drawn uniformly.
+u32* bench_access_uniform(u64 count);
+// Indices in [0, count) drawn from a scrambled Zipfian distribution with
+// theta = 0.99, so a few hot keys get most of the accesses.
+u32* bench_access_zipfian(u64 count);
+void bench_access_destroy(u32* access);
+
+// Should a group with this name be registered?
+b8 bench_filter(const BenchOptions* options, SP_Str name);
+
+// Human readable size like 1K, 10M.
+SP_Str bench_size_name(SP_Arena* arena, u64 size);
+
+typedef void (*BenchThreadFunc)(void* userdata);
+
+// Run 'func' on 'count' threads at the same time, one 'userdata' each. Thread
+// creation happens while the benchmark timer is paused so only the work and
+// joining the threads is measured.
+void bench_run_threads(SP_Bench* bench, u32 count, BenchThreadFunc func, void* const* userdata);
+
+#endif // BENCH_COMMON_H_
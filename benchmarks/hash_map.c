@@ -0,0 +1,345 @@
+#include "common.h"
+
+// One group of map benchmarks: a collision resolution mode, key type and size.
+// The keys, access sequences and a prefilled map are built by the group
+// fixture so only one group's data is alive at a time.
+typedef struct MapCase MapCase;
+struct MapCase {
+    SP_HashCollisionResolution resolution;
+    BenchKeyType key_type;
+    u64 size;
+
+    BenchKeys keys;
+    u32* uniform;
+    u32* zipfian;
+    // Holds keys [0, size) unless a benchmark says otherwise.
+    SP_HashMap* map;
+    // Map being filled by the insert benchmarks.
+    SP_HashMap* fill;
+    u64 fill_pos;
+    u64 access_pos;
+    u64 churn_pos;
+};
+
+static SP_HashMap* map_case_create_map(const MapCase* c, u32 capacity) {
+    return sp_hash_map_create((SP_HashMapDesc) {
+            .allocator = sp_libc_allocator(),
+            .capacity = capacity,
+            .collision_resolution = c->resolution,
+            .hash = bench_key_hash(c->key_type),
+            .equal = bench_key_equal(c->key_type),
+            .key_size = c->keys.key_size,
+            .value_size = sizeof(u64),
+        });
+}
+
+// Capacity with room for every key without growing.
+static u32 map_case_presized_capacity(const MapCase* c) {
+    return c->size * 2;
+}
+
+static void map_case_setup(void* userdata) {
+    MapCase* c = userdata;
+    c->keys = bench_keys_create(c->key_type, c->size);
+    c->uniform = bench_access_uniform(c->size);
+    c->zipfian = bench_access_zipfian(c->size);
+    c->map = map_case_create_map(c, map_case_presized_capacity(c));
+    for (u64 i = 0; i < c->size; i++) {
+        sp_hash_map_insert(c->map, bench_key(&c->keys, i), &i);
+    }
+    c->fill_pos = 0;
+    c->access_pos = 0;
+    c->churn_pos = 0;
+}
+
+static void map_case_teardown(void* userdata) {
+    MapCase* c = userdata;
+    if (c->fill != NULL) {
+        sp_hash_map_destroy(c->fill);
+        c->fill = NULL;
+    }
+    sp_hash_map_destroy(c->map);
+    bench_access_destroy(c->zipfian);
+    bench_access_destroy(c->uniform);
+    bench_keys_destroy(&c->keys);
+}
+
+// Inserting keeps filling the same map and starts over with an empty one once
+// every key is in it. Each sample therefore covers a slice of the fill and
+// growth shows up in the tail of the distribution.
+static void map_fill(SP_Bench* bench, MapCase* c, u32 capacity) {
+    for (u64 i = 0; i < sp_bench_iterations(bench); i++) {
+        if (c->fill == NULL || c->fill_pos == c->size) {
+            sp_bench_pause(bench);
+            if (c->fill != NULL) {
+                sp_hash_map_destroy(c->fill);
+            }
+            c->fill = map_case_create_map(c, capacity);
+            c->fill_pos = 0;
+            sp_bench_resume(bench);
+        }
+        b8 inserted = sp_hash_map_insert(c->fill, bench_key(&c->keys, c->fill_pos), &c->fill_pos);
+        sp_bench_do_not_optimize(inserted);
+        c->fill_pos++;
+    }
+}
+
+static void map_insert(SP_Bench* bench, void* userdata) {
+    MapCase* c = userdata;
+    map_fill(bench, c, 16);
+}
+
+static void map_insert_presized(SP_Bench* bench, void* userdata) {
+    MapCase* c = userdata;
+    if (c->fill != NULL) {
+        sp_bench_pause(bench);
+        sp_hash_map_destroy(c->fill);
+        c->fill = NULL;
+        sp_bench_resume(bench);
+    }
+    map_fill(bench, c, map_case_presized_capacity(c));
+    sp_bench_pause(bench);
+    sp_hash_map_destroy(c->fill);
+    c->fill = NULL;
+    sp_bench_resume(bench);
+}
+
+static void map_set(SP_Bench* bench, MapCase* c, const u32* access) {
+    for (u64 i = 0; i < sp_bench_iterations(bench); i++) {
+        u64 index = access[c->access_pos++ % BENCH_ACCESS_COUNT];
+        b8 set = sp_hash_map_set(c->map, bench_key(&c->keys, index), &index);
+        sp_bench_do_not_optimize(set);
+    }
+}
+
+static void map_set_uniform(SP_Bench* bench, void* userdata) {
+    MapCase* c = userdata;
+    map_set(bench, c, c->uniform);
+}
+
+static void map_set_zipfian(SP_Bench* bench, void* userdata) {
+    MapCase* c = userdata;
+    map_set(bench, c, c->zipfian);
+}
+
+static void map_get(SP_Bench* bench, MapCase* c, const u32* access, u64 offset) {
+    for (u64 i = 0; i < sp_bench_iterations(bench); i++) {
+        u64 index = access[c->access_pos++ % BENCH_ACCESS_COUNT] + offset;
+        u64 value = 0;
+        b8 found = sp_hash_map_get(c->map, bench_key(&c->keys, index), &value);
+        sp_bench_do_not_optimize(found);
+        sp_bench_do_not_optimize(value);
+    }
+}
+
+static void map_get_hit_uniform(SP_Bench* bench, void* userdata) {
+    MapCase* c = userdata;
+    map_get(bench, c, c->uniform, 0);
+}
+
+static void map_get_hit_zipfian(SP_Bench* bench, void* userdata) {
+    MapCase* c = userdata;
+    map_get(bench, c, c->zipfian, 0);
+}
+
+static void map_get_miss(SP_Bench* bench, void* userdata) {
+    MapCase* c = userdata;
+    map_get(bench, c, c->uniform, c->size);
+}
+
+// One iteration visits one entry.
+static void map_iterate(SP_Bench* bench, void* userdata) {
+    MapCase* c = userdata;
+    sp_bench_set_bytes_per_iteration(bench, c->keys.key_size + sizeof(u64));
+    u64 visited = 0;
+    SP_HashMapIter iter = sp_hash_map_iter_init(c->map);
+    while (visited < sp_bench_iterations(bench)) {
+        if (!sp_hash_map_iter_valid(iter)) {
+            iter = sp_hash_map_iter_init(c->map);
+            continue;
+        }
+        u64 value = *(u64*) sp_hash_map_iter_get_valuep(iter);
+        sp_bench_do_not_optimize(value);
+        iter = sp_hash_map_iter_next(iter);
+        visited++;
+    }
+}
+
+// One iteration removes a key and inserts another, keeping the count
+// constant. Every pass over the keys swaps the present half with the missing
+// half. Runs last since it leaves the map in a different state.
+static void map_churn(SP_Bench* bench, void* userdata) {
+    MapCase* c = userdata;
+    for (u64 i = 0; i < sp_bench_iterations(bench); i++) {
+        u64 slot = c->churn_pos % c->size;
+        b8 odd = (c->churn_pos / c->size) % 2;
+        u64 removed = odd ? slot + c->size : slot;
+        u64 inserted = odd ? slot : slot + c->size;
+        sp_hash_map_remove(c->map, bench_key(&c->keys, removed), NULL);
+        sp_hash_map_insert(c->map, bench_key(&c->keys, inserted), &inserted);
+        c->churn_pos++;
+    }
+}
+
+// -- Typed map ----------------------------------------------------------------
+// The same u64 workload on a map from 'SP_HASH_MAP_DEFINE', to compare against
+// the open addressing 'SP_HashMap' groups. Benchmarks keep the generic names.
+
+SP_HASH_MAP_DEFINE(BenchU64Map, u64, u64, sp_hash_int, sp_equal_value)
+
+typedef struct TypedCase TypedCase;
+struct TypedCase {
+    u64 size;
+
+    BenchKeys keys;
+    u32* uniform;
+    // Holds keys [0, size).
+    BenchU64Map map;
+    BenchU64Map fill;
+    u64 fill_pos;
+    u64 access_pos;
+    u64 churn_pos;
+};
+
+static inline u64 typed_key(const TypedCase* c, u64 index) {
+    return *(const u64*) bench_key(&c->keys, index);
+}
+
+static void typed_case_setup(void* userdata) {
+    TypedCase* c = userdata;
+    c->keys = bench_keys_create(BENCH_KEY_U64, c->size);
+    c->uniform = bench_access_uniform(c->size);
+    c->map = BenchU64Map_create(sp_libc_allocator(), c->size * 2, 0);
+    for (u64 i = 0; i < c->size; i++) {
+        BenchU64Map_insert(&c->map, typed_key(c, i), i);
+    }
+    c->fill = BenchU64Map_create(sp_libc_allocator(), 16, 0);
+    c->fill_pos = 0;
+    c->access_pos = 0;
+    c->churn_pos = 0;
+}
+
+static void typed_case_teardown(void* userdata) {
+    TypedCase* c = userdata;
+    BenchU64Map_destroy(&c->fill);
+    BenchU64Map_destroy(&c->map);
+    bench_access_destroy(c->uniform);
+    bench_keys_destroy(&c->keys);
+}
+
+// See 'map_fill'.
+static void typed_insert(SP_Bench* bench, void* userdata) {
+    TypedCase* c = userdata;
+    for (u64 i = 0; i < sp_bench_iterations(bench); i++) {
+        if (c->fill_pos == c->size) {
+            sp_bench_pause(bench);
+            BenchU64Map_destroy(&c->fill);
+            c->fill = BenchU64Map_create(sp_libc_allocator(), 16, 0);
+            c->fill_pos = 0;
+            sp_bench_resume(bench);
+        }
+        b8 inserted = BenchU64Map_insert(&c->fill, typed_key(c, c->fill_pos), c->fill_pos);
+        sp_bench_do_not_optimize(inserted);
+        c->fill_pos++;
+    }
+}
+
+static void typed_get(SP_Bench* bench, TypedCase* c, u64 offset) {
+    for (u64 i = 0; i < sp_bench_iterations(bench); i++) {
+        u64 index = c->uniform[c->access_pos++ % BENCH_ACCESS_COUNT] + offset;
+        u64 value = 0;
+        b8 found = BenchU64Map_get(&c->map, typed_key(c, index), &value);
+        sp_bench_do_not_optimize(found);
+        sp_bench_do_not_optimize(value);
+    }
+}
+
+static void typed_get_hit_uniform(SP_Bench* bench, void* userdata) {
+    typed_get(bench, userdata, 0);
+}
+
+static void typed_get_miss(SP_Bench* bench, void* userdata) {
+    TypedCase* c = userdata;
+    typed_get(bench, c, c->size);
+}
+
+// See 'map_churn'.
+static void typed_churn(SP_Bench* bench, void* userdata) {
+    TypedCase* c = userdata;
+    for (u64 i = 0; i < sp_bench_iterations(bench); i++) {
+        u64 slot = c->churn_pos % c->size;
+        b8 odd = (c->churn_pos / c->size) % 2;
+        u64 removed = odd ? slot + c->size : slot;
+        u64 inserted = odd ? slot : slot + c->size;
+        BenchU64Map_remove(&c->map, typed_key(c, removed), NULL);
+        BenchU64Map_insert(&c->map, typed_key(c, inserted), inserted);
+        c->churn_pos++;
+    }
+}
+
+void bench_hash_map(SP_BenchSuite* suite, const BenchOptions* options) {
+    SP_Allocator allocator = sp_arena_allocator(options->arena);
+    const BenchKeyType key_types[] = {BENCH_KEY_U64, BENCH_KEY_STR};
+
+    for (u32 r = 0; r < sp_arrlen(BENCH_RESOLUTIONS); r++) {
+        for (u32 k = 0; k < sp_arrlen(key_types); k++) {
+            for (u32 s = 0; s < sp_arrlen(BENCH_SIZES); s++) {
+                u64 size = BENCH_SIZES[s];
+                if (size > options->max_size) {
+                    continue;
+                }
+
+                SP_Str size_name = bench_size_name(options->arena, size);
+                SP_Str name = sp_str_pushf(allocator, "Hash Map (%s, %s, %.*s)",
+                        BENCH_RESOLUTIONS[r].name,
+                        bench_key_type_name(key_types[k]),
+                        size_name.len, size_name.data);
+                if (!bench_filter(options, name)) {
+                    continue;
+                }
+
+                MapCase* c = sp_arena_push(options->arena, sizeof(MapCase));
+                c->resolution = BENCH_RESOLUTIONS[r].resolution;
+                c->key_type = key_types[k];
+                c->size = size;
+
+                u32 group = sp_bench_group_register(suite, name);
+                sp_bench_group_fixture(suite, group, map_case_setup, map_case_teardown, c);
+                sp_bench_register(suite, group, map_insert, c);
+                sp_bench_register(suite, group, map_insert_presized, c);
+                sp_bench_register(suite, group, map_set_uniform, c);
+                sp_bench_register(suite, group, map_set_zipfian, c);
+                sp_bench_register(suite, group, map_get_hit_uniform, c);
+                sp_bench_register(suite, group, map_get_hit_zipfian, c);
+                sp_bench_register(suite, group, map_get_miss, c);
+                sp_bench_register(suite, group, map_iterate, c);
+                sp_bench_register(suite, group, map_churn, c);
+            }
+        }
+    }
+
+    for (u32 s = 0; s < sp_arrlen(BENCH_SIZES); s++) {
+        u64 size = BENCH_SIZES[s];
+        if (size > options->max_size) {
+            continue;
+        }
+
+        SP_Str size_name = bench_size_name(options->arena, size);
+        SP_Str name = sp_str_pushf(allocator, "Hash Map (Typed, %s, %.*s)",
+                bench_key_type_name(BENCH_KEY_U64),
+                size_name.len, size_name.data);
+        if (!bench_filter(options, name)) {
+            continue;
+        }
+
+        TypedCase* c = sp_arena_push(options->arena, sizeof(TypedCase));
+        c->size = size;
+
+        u32 group = sp_bench_group_register(suite, name);
+        sp_bench_group_fixture(suite, group, typed_case_setup, typed_case_teardown, c);
+        sp_bench_register_named(suite, group, typed_insert, sp_str_lit("map_insert"), c);
+        sp_bench_register_named(suite, group, typed_get_hit_uniform, sp_str_lit("map_get_hit_uniform"), c);
+        sp_bench_register_named(suite, group, typed_get_miss, sp_str_lit("map_get_miss"), c);
+        sp_bench_register_named(suite, group, typed_churn, sp_str_lit("map_churn"), c);
+    }
+}
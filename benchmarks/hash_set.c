@@ -0,0 +1,165 @@
+#include "common.h"
+
+// Same layout as the map benchmarks, see hash_map.c.
+typedef struct SetCase SetCase;
+struct SetCase {
+    SP_HashCollisionResolution resolution;
+    BenchKeyType key_type;
+    u64 size;
+
+    BenchKeys keys;
+    u32* uniform;
+    u32* zipfian;
+    SP_HashSet* set;
+    SP_HashSet* fill;
+    u64 fill_pos;
+    u64 access_pos;
+    u64 churn_pos;
+};
+
+static SP_HashSet* set_case_create_set(const SetCase* c, u32 capacity) {
+    return sp_hash_set_create((SP_HashSetDesc) {
+            .allocator = sp_libc_allocator(),
+            .capacity = capacity,
+            .collision_resolution = c->resolution,
+            .hash = bench_key_hash(c->key_type),
+            .equal = bench_key_equal(c->key_type),
+            .value_size = c->keys.key_size,
+        });
+}
+
+static void set_case_setup(void* userdata) {
+    SetCase* c = userdata;
+    c->keys = bench_keys_create(c->key_type, c->size);
+    c->uniform = bench_access_uniform(c->size);
+    c->zipfian = bench_access_zipfian(c->size);
+    c->set = set_case_create_set(c, c->size * 2);
+    for (u64 i = 0; i < c->size; i++) {
+        sp_hash_set_insert(c->set, bench_key(&c->keys, i));
+    }
+    c->fill_pos = 0;
+    c->access_pos = 0;
+    c->churn_pos = 0;
+}
+
+static void set_case_teardown(void* userdata) {
+    SetCase* c = userdata;
+    if (c->fill != NULL) {
+        sp_hash_set_destroy(c->fill);
+        c->fill = NULL;
+    }
+    sp_hash_set_destroy(c->set);
+    bench_access_destroy(c->zipfian);
+    bench_access_destroy(c->uniform);
+    bench_keys_destroy(&c->keys);
+}
+
+static void set_insert(SP_Bench* bench, void* userdata) {
+    SetCase* c = userdata;
+    for (u64 i = 0; i < sp_bench_iterations(bench); i++) {
+        if (c->fill == NULL || c->fill_pos == c->size) {
+            sp_bench_pause(bench);
+            if (c->fill != NULL) {
+                sp_hash_set_destroy(c->fill);
+            }
+            c->fill = set_case_create_set(c, 16);
+            c->fill_pos = 0;
+            sp_bench_resume(bench);
+        }
+        b8 inserted = sp_hash_set_insert(c->fill, bench_key(&c->keys, c->fill_pos));
+        sp_bench_do_not_optimize(inserted);
+        c->fill_pos++;
+    }
+}
+
+static void set_has(SP_Bench* bench, SetCase* c, const u32* access, u64 offset) {
+    for (u64 i = 0; i < sp_bench_iterations(bench); i++) {
+        u64 index = access[c->access_pos++ % BENCH_ACCESS_COUNT] + offset;
+        b8 found = sp_hash_set_has(c->set, bench_key(&c->keys, index));
+        sp_bench_do_not_optimize(found);
+    }
+}
+
+static void set_has_hit_uniform(SP_Bench* bench, void* userdata) {
+    SetCase* c = userdata;
+    set_has(bench, c, c->uniform, 0);
+}
+
+static void set_has_hit_zipfian(SP_Bench* bench, void* userdata) {
+    SetCase* c = userdata;
+    set_has(bench, c, c->zipfian, 0);
+}
+
+static void set_has_miss(SP_Bench* bench, void* userdata) {
+    SetCase* c = userdata;
+    set_has(bench, c, c->uniform, c->size);
+}
+
+static void set_iterate(SP_Bench* bench, void* userdata) {
+    SetCase* c = userdata;
+    sp_bench_set_bytes_per_iteration(bench, c->keys.key_size);
+    u64 visited = 0;
+    SP_HashSetIter iter = sp_hash_set_iter_init(c->set);
+    while (visited < sp_bench_iterations(bench)) {
+        if (!sp_hash_set_iter_valid(iter)) {
+            iter = sp_hash_set_iter_init(c->set);
+            continue;
+        }
+        void* key = sp_hash_set_iter_get_valuep(iter);
+        sp_bench_do_not_optimize(key);
+        iter = sp_hash_set_iter_next(iter);
+        visited++;
+    }
+}
+
+static void set_churn(SP_Bench* bench, void* userdata) {
+    SetCase* c = userdata;
+    for (u64 i = 0; i < sp_bench_iterations(bench); i++) {
+        u64 slot = c->churn_pos % c->size;
+        b8 odd = (c->churn_pos / c->size) % 2;
+        u64 removed = odd ? slot + c->size : slot;
+        u64 inserted = odd ? slot : slot + c->size;
+        sp_hash_set_remove(c->set, bench_key(&c->keys, removed));
+        sp_hash_set_insert(c->set, bench_key(&c->keys, inserted));
+        c->churn_pos++;
+    }
+}
+
+void bench_hash_set(SP_BenchSuite* suite, const BenchOptions* options) {
+    SP_Allocator allocator = sp_arena_allocator(options->arena);
+    const BenchKeyType key_types[] = {BENCH_KEY_U64, BENCH_KEY_STR};
+
+    for (u32 r = 0; r < sp_arrlen(BENCH_RESOLUTIONS); r++) {
+        for (u32 k = 0; k < sp_arrlen(key_types); k++) {
+            for (u32 s = 0; s < sp_arrlen(BENCH_SIZES); s++) {
+                u64 size = BENCH_SIZES[s];
+                if (size > options->max_size) {
+                    continue;
+                }
+
+                SP_Str size_name = bench_size_name(options->arena, size);
+                SP_Str name = sp_str_pushf(allocator, "Hash Set (%s, %s, %.*s)",
+                        BENCH_RESOLUTIONS[r].name,
+                        bench_key_type_name(key_types[k]),
+                        size_name.len, size_name.data);
+                if (!bench_filter(options, name)) {
+                    continue;
+                }
+
+                SetCase* c = sp_arena_push(options->arena, sizeof(SetCase));
+                c->resolution = BENCH_RESOLUTIONS[r].resolution;
+                c->key_type = key_types[k];
+                c->size = size;
+
+                u32 group = sp_bench_group_register(suite, name);
+                sp_bench_group_fixture(suite, group, set_case_setup, set_case_teardown, c);
+                sp_bench_register(suite, group, set_insert, c);
+                sp_bench_register(suite, group, set_has_hit_uniform, c);
+                sp_bench_register(suite, group, set_has_hit_zipfian, c);
+                sp_bench_register(suite, group, set_has_miss, c);
+                sp_bench_register(suite, group, set_iterate, c);
+                sp_bench_register(suite, group, set_churn, c);
+            }
+        }
+    }
+}
@@ -0,0 +1,68 @@
+#include "spire.h"
+#include "common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern void bench_hash_map(SP_BenchSuite* suite, const BenchOptions* options);
+extern void bench_hash_set(SP_BenchSuite* suite, const BenchOptions* options);
+extern void bench_allocator(SP_BenchSuite* suite, const BenchOptions* options);
+
+static void print_usage(const char* program) {
+    printf("Usage: %s [options]\n", program);
+    printf("  --max-size N       Largest container size, default 1000000. Up to 100000000.\n");
+    printf("  --filter TEXT      Only run groups whose name contains TEXT.\n");
+    printf("  --json PATH        Write results as JSON to PATH.\n");
+    printf("  --baseline PATH    Compare against JSON results from an earlier run.\n");
+    printf("  --perf             Report hardware performance counters.\n");
+    printf("  --quick            Shorter warmup and fewer samples.\n");
+}
+
+i32 main(i32 argc, char** argv) {
+    sp_init(SP_CONFIG_DEFAULT);
+    SP_Arena* arena = sp_arena_create();
+
+    BenchOptions options = {
+        .max_size = 1000000,
+        .filter = NULL,
+        .arena = arena,
+    };
+    SP_BenchConfig config = SP_BENCH_CONFIG_DEFAULT;
+    config.memory_stats = true;
+
+    for (i32 i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        b8 has_value = i + 1 < argc;
+        if (strcmp(arg, "--max-size") == 0 && has_value) {
+            options.max_size = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(arg, "--filter") == 0 && has_value) {
+            options.filter = argv[++i];
+        } else if (strcmp(arg, "--json") == 0 && has_value) {
+            config.json_path = argv[++i];
+        } else if (strcmp(arg, "--baseline") == 0 && has_value) {
+            config.baseline_path = argv[++i];
+        } else if (strcmp(arg, "--perf") == 0) {
+            config.perf_counters = true;
+        } else if (strcmp(arg, "--quick") == 0) {
+            config.warmup_ns = 20000000;
+            config.samples = 20;
+        } else {
+            print_usage(argv[0]);
+            sp_arena_destroy(arena);
+            sp_terminate();
+            return strcmp(arg, "--help") == 0 ? 0 : 1;
+        }
+    }
+
+    SP_BenchSuite* suite = sp_bench_suite_create(sp_libc_allocator());
+    bench_hash_map(suite, &options);
+    bench_hash_set(suite, &options);
+    bench_allocator(suite, &options);
+    sp_bench_suite_run(suite, config);
+    sp_bench_suite_destroy(suite);
+
+    sp_arena_destroy(arena);
+    sp_terminate();
+    return 0;
+}
@@ -0,0 +1,21 @@
+#include "spire.h"
+
+#include <stdio.h>
+
+// Turns a binary log written with 'SP_Config.logging.binary_path' back into
+// text.
+//
+// Usage:
+// log_decode <binary log> [output]
+i32 main(i32 argc, char** argv) {
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "usage: %s <binary log> [output]\n", argv[0]);
+        return 1;
+    }
+
+    if (!sp_log_decode(argv[1], argc == 3 ? argv[2] : NULL)) {
+        fprintf(stderr, "failed to decode '%s', it may be truncated or not a binary log\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
@@ -9,12 +9,17 @@
 // - Logging
 // - Math
 // - Hash map
+// - Typed hash map generator
 // - Linked list macros
 // - Color
+// - Histogram
+// - Profiling
 // - OS abstraction layer
 //      - Memory management
 //      - Time
 //      - Page size
+//      - System information
+//      - Process memory and performance counters
 //      - Dynamic library
 //
 // =============================================================================
@@ -39,8 +44,9 @@
 #endif // __unix__
 
 #ifdef SP_UNIX
-// Needed for clock_gettime
+// Needed for clock_gettime and MAP_ANONYMOUS
 #define _POSIX_C_SOURCE 199309L
+#define _DEFAULT_SOURCE
 #include <unistd.h>
 #ifdef _POSIX_VERSION
 #define SP_POSIX
@@ -72,6 +78,7 @@
 #endif
 
 #ifdef SP_COMP_MSVC
+#include <intrin.h>
 #define SP_THREAD_LOCAL __declspec(thread)
 #define SP_INLINE __forceinline
 #elif defined(SP_COMP_GCC)
@@ -140,12 +147,81 @@ struct SP_ArenaDesc {
     b8 chaining;
 };
 
+typedef enum SP_LogLevel {
+    SP_LOG_LEVEL_FATAL,
+    SP_LOG_LEVEL_ERROR,
+    SP_LOG_LEVEL_WARN,
+    SP_LOG_LEVEL_INFO,
+    SP_LOG_LEVEL_DEBUG,
+    SP_LOG_LEVEL_TRACE,
+
+    SP_LOG_LEVEL_COUNT,
+} SP_LogLevel;
+
+// What an asynchronous log call does when its thread's buffer is full.
+typedef enum SP_LogOverflow {
+    // Drop the line. Dropped lines are counted, see 'sp_log_get_dropped'.
+    SP_LOG_OVERFLOW_DROP,
+    // Wait for the writer thread to make room.
+    SP_LOG_OVERFLOW_BLOCK,
+} SP_LogOverflow;
+
 typedef struct SP_Config SP_Config;
 struct SP_Config {
     SP_ArenaDesc default_arena_desc;
     struct {
+        // Color the level and location of every line. Ignored when logging to
+        // a file through 'path'.
         b8 colorful;
+        // Least severe level that gets logged, see 'sp_log_set_level'. It's
+        // SP_LOG_LEVEL_TRACE in SP_CONFIG_DEFAULT, a zeroed config only logs
+        // fatal lines. 'sp_init' fails if it isn't one of the levels.
+        SP_LogLevel level;
+        // Format lines on the calling thread but write them from a background
+        // thread. Every thread that logs gets a ring buffer which the writer
+        // drains in batches.
+        b8 async;
+        // Bytes in the ring buffer of each thread. Rounded up to a power of
+        // two. Default is 64 KB.
+        u32 buffer_size;
+        // Default is SP_LOG_OVERFLOW_DROP.
+        SP_LogOverflow overflow;
+        // File lines are appended to instead of stdout. Default is NULL.
+        const char* path;
+        // Write 'sp_info', 'sp_debug' and 'sp_trace' to this file as binary
+        // records instead of formatting them. Uses the same buffers and writer
+        // thread as 'async'. The file is truncated by 'sp_init', read it back
+        // with 'sp_log_decode'. Default is NULL.
+        const char* binary_path;
     } logging;
+    // Per thread scratch arenas. They're created lazily the first time a
+    // thread begins a scratch arena.
+    struct {
+        // Number of scratch arenas per thread. Default is 2.
+        u32 arena_count;
+        // Block size of each scratch arena. Default is the block size of
+        // 'default_arena_desc'.
+        u64 arena_size;
+        // Committed bytes a scratch arena keeps once its last scratch scope
+        // ends. Anything committed above it is given back to the OS. Default
+        // is 1 MB.
+        u64 retain_size;
+    } scratch;
+    // Profile guided arena presizing. When enabled, the peak usage of every
+    // tagged arena is written to 'path' during 'sp_terminate'. In the next run,
+    // tagging an arena with the same tag pre-commits and prefaults that much
+    // memory up front so the warm-up phase doesn't pay for page faults.
+    struct {
+        b8 enabled;
+        // Default is "spire_arena_profile.txt".
+        const char* path;
+    } arena_profile;
+    // Zone recording, see PROFILING. Only used when built with SP_PROFILE.
+    struct {
+        // Events kept per thread before the oldest ones are overwritten.
+        // Rounded up to a power of two. Default is 65536.
+        u32 events_per_thread;
+    } profiler;
 };
 
 // Basic configuration for desktop applications.
@@ -158,6 +234,24 @@ static const SP_Config SP_CONFIG_DEFAULT = {
     },
     .logging = {
         .colorful = true,
+        .level = SP_LOG_LEVEL_TRACE,
+        .async = false,
+        .buffer_size = 64 << 10, // 64 KB
+        .overflow = SP_LOG_OVERFLOW_DROP,
+        .path = NULL,
+        .binary_path = NULL,
+    },
+    .scratch = {
+        .arena_count = 2,
+        .arena_size = 4llu << 30, // 4 GB
+        .retain_size = 1llu << 20, // 1 MB
+    },
+    .arena_profile = {
+        .enabled = false,
+        .path = NULL,
+    },
+    .profiler = {
+        .events_per_thread = 65536,
     },
 };
 
@@ -197,9 +291,67 @@ SP_API void sp_dump_arena_metrics(void);
 // Byte offset of struct member.
 #define sp_offset(S, M) ((u64) &((S*) 0)->M)
 
-// Simple hashing function. Not the most efficient or causes the least
-// collisions but it's small.
-SP_API u64 sp_fvn1a_hash(const void* data, u64 len);
+// Paste two tokens together after expanding them.
+#define sp_concat(A, B) _sp_concat(A, B)
+#define _sp_concat(A, B) A##B
+
+// 64 bit FNV-1a, with the seed mixed into the offset basis. Small, but slow
+// since it only takes a byte per step.
+SP_API u64 sp_fvn1a_hash(const void* data, u64 len, u64 seed);
+
+// wyhash, a fast 64 bit hash taking up to 48 bytes per step. Different seeds
+// give unrelated hashes.
+// https://github.com/wangyi-fudan/wyhash
+SP_API u64 sp_hash_bytes(const void* data, u64 len, u64 seed);
+
+// Hash a single u32 or u64 without looking at 'len'. Same quality as
+// 'sp_hash_bytes', minus the work of handling arbitrary lengths.
+SP_API u64 sp_hash_u32(const void* data, u64 len, u64 seed);
+SP_API u64 sp_hash_u64(const void* data, u64 len, u64 seed);
+
+// Random non-zero seed for hashing, different on every call. Derived from
+// random bits drawn from the OS once per process, so seeds can't be guessed
+// to build colliding keys. 'salt' is usually the address of the container
+// it's for and mixed in as well.
+SP_API u64 sp_hash_random_seed(const void* salt);
+
+// Full 128 bit product of 'a' and 'b'. Returns the low half and stores the
+// high half in 'high'.
+SP_INLINE u64 sp_mul_u128(u64 a, u64 b, u64* high) {
+#if defined(__SIZEOF_INT128__)
+    __extension__ unsigned __int128 r = (unsigned __int128) a * b;
+    *high = (u64) (r >> 64);
+    return (u64) r;
+#elif defined(SP_COMP_MSVC) && defined(_M_X64)
+    return _umul128(a, b, high);
+#else
+    u64 ha = a >> 32, hb = b >> 32, la = (u32) a, lb = (u32) b;
+    u64 rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    u64 t = rl + (rm0 << 32);
+    u64 carry = t < rl;
+    u64 lo = t + (rm1 << 32);
+    carry += lo < t;
+    *high = rh + (rm0 >> 32) + (rm1 >> 32) + carry;
+    return lo;
+#endif
+}
+
+// Default secret of wyhash final version 4, shared by 'sp_hash_bytes' and
+// 'sp_hash_int'.
+#define _SP_HASH_SECRET_0 0x2d358dccaa6c78a5ull
+#define _SP_HASH_SECRET_1 0x8bb84b93962eacc9ull
+#define _SP_HASH_SECRET_2 0x4b33a62ed433d4a3ull
+#define _SP_HASH_SECRET_3 0x4d5a2da51de1aa47ull
+
+// Hash an integer key, what 'sp_hash_u32' and 'sp_hash_u64' do after loading
+// it. This is wyhash's 'wyhash64'. Inline so typed maps get it down to two
+// multiplies.
+SP_INLINE u64 sp_hash_int(u64 key, u64 seed) {
+    u64 high;
+    u64 low = sp_mul_u128(key ^ _SP_HASH_SECRET_0, seed ^ _SP_HASH_SECRET_1, &high);
+    low = sp_mul_u128(low ^ _SP_HASH_SECRET_0, high ^ _SP_HASH_SECRET_1, &high);
+    return low ^ high;
+}
 
 // Ensure some condition is always true. If it's not, print a message and
 // segfault. A message must always be supplied as the first variadic argument.
@@ -240,6 +392,21 @@ SP_API SP_Allocator sp_libc_allocator(void);
 #define sp_free(ALLOCATOR, PTR, SIZE) ((ALLOCATOR).free((PTR), (SIZE), (ALLOCATOR).userdata))
 #define sp_realloc(ALLOCATOR, PTR, OLD_SIZE, NEW_SIZE) ((ALLOCATOR).realloc((PTR), (OLD_SIZE), (NEW_SIZE), (ALLOCATOR).userdata))
 
+// Allocations made by the calling thread through the libc allocator and arena
+// pushes since it started. Counting is per thread so it costs no more than an
+// increment.
+typedef struct SP_AllocStats SP_AllocStats;
+struct SP_AllocStats {
+    // Calls to alloc and realloc of 'sp_libc_allocator' and bytes requested.
+    u64 heap_allocs;
+    u64 heap_bytes;
+    // Pushes onto any arena and bytes pushed, after alignment.
+    u64 arena_pushes;
+    u64 arena_bytes;
+};
+
+SP_API SP_AllocStats sp_get_thread_alloc_stats(void);
+
 SP_API void* _sp_libc_alloc_stub(u64 size, void* userdata);
 SP_API void _sp_libc_free_stub(void* ptr, u64 size, void* userdata);
 SP_API void* _sp_libc_realloc_stub(void* ptr, u64 old_size, u64 new_size, void* userdata);
@@ -347,9 +514,17 @@ struct SP_ArenaMetrics {
     u64 pop_operations;
     u64 total_pushed_bytes;
     u64 total_popped_bytes;
+    // Address space reserved, committed and actually backed by physical
+    // memory across all blocks of the arena. Resident bytes are queried from
+    // the OS on every call, which costs time linear in the committed size.
+    u64 reserved_bytes;
+    u64 committed_bytes;
+    u64 resident_bytes;
 };
 
 // Gives an arena a 'tag' which makes arenas easier to recognize when debugging.
+// If arena profiling is enabled and a previous run recorded a peak usage for
+// this tag, that much memory is committed and prefaulted right away.
 SP_API void sp_arena_tag(SP_Arena* arena, SP_Str tag);
 
 // Get usage metrics of an arena.
@@ -380,10 +555,11 @@ SP_API void    sp_temp_end(SP_Temp temp);
 // THREAD CONTEXT
 //
 // The thread context provides per thread scratch arenas. These functions should
-// rarely be used. They're used during initialization.
+// rarely be used. A context is created automatically the first time a thread
+// begins a scratch arena, and when that thread exits the context is cleared and
+// kept around for the next thread to reuse.
 //
-// Currently threading isn't implemented, so creating and setting a context per
-// new thread needs to be done manually, for now.
+// All threads using Spire must have exited before calling 'sp_terminate'.
 // =============================================================================
 
 typedef struct SP_ThreadCtx SP_ThreadCtx;
@@ -398,6 +574,12 @@ SP_API void          sp_thread_ctx_set(SP_ThreadCtx* ctx);
 // Scratch arenas are per thread temporary arenas. They're useful when you need
 // to dynamically allocate something *during* an operation, but not need it to
 // be persistant.
+//
+// Pass every arena the caller allocates its results on as 'conflicts'. The
+// scratch arena returned is never one of them. Arenas still in use by outer
+// scratch scopes are avoided as long as there are enough scratch arenas, see
+// 'SP_Config.scratch.arena_count'. Scratch scopes must be ended in reverse
+// order of beginning them.
 // =============================================================================
 
 typedef SP_Temp SP_Scratch;
@@ -408,37 +590,171 @@ SP_API void       sp_scratch_end(SP_Scratch scratch);
 // =============================================================================
 // LOGGING
 //
-// This is a very bare bones logging system right now. It only supports printing
-// to stdout with some extra nice information like file and line.
+// This is a very bare bones logging system right now. It prints to stdout, or
+// a file set in 'SP_Config.logging', with some extra nice information like
+// file and line. Every line is written in one go so lines from different
+// threads never interleave.
+//
+// With 'SP_Config.logging.async' set, the calling thread only formats the line
+// into its own ring buffer and a background thread writes them out. Lines are
+// ordered per thread but not across threads.
+//
+// Fatal lines are flushed before returning so they're out before 'sp_ensure'
+// aborts.
+//
+// With 'SP_Config.logging.binary_path' set, 'sp_info', 'sp_debug' and
+// 'sp_trace' skip formatting altogether. Each callsite gets an id the first
+// time it runs and a log call only copies the id, a timestamp and the raw
+// arguments. Strings are copied, pointers are logged as addresses. Format
+// strings must be literals. Callsites using '%n' or a long double fall back
+// to text. Binary files are in the byte order of the machine that wrote them.
+//
+// Levels can be filtered twice. Defining SP_LOG_MIN_LEVEL as the number of the
+// least severe level to keep, 0 for fatal up to 5 for trace, turns the macros
+// of every level below it into nothing. The runtime level from
+// 'SP_Config.logging.level' or 'sp_log_set_level' is checked inline before any
+// argument is evaluated. Fatal lines are never filtered.
 //
 // Log format:
 // TYPE file:line: message
+//
+// Usage:
+// sp_info("loaded %u assets", count);
+//
+// // At most one line per second from this callsite.
+// sp_warn_per_second("frame took %llu ns", frame_ns);
 // =============================================================================
 
+#ifndef SP_LOG_MIN_LEVEL
+#define SP_LOG_MIN_LEVEL 5
+#endif
+
 // All macros work the same, only with a different log level. The first argument
 // ALWAYS needs to be a printf style format string.
 #define sp_fatal(...) _sp_log_internal(SP_LOG_LEVEL_FATAL, __FILE__, __LINE__, __VA_ARGS__)
-#define sp_error(...) _sp_log_internal(SP_LOG_LEVEL_ERROR, __FILE__, __LINE__, __VA_ARGS__)
-#define sp_warn(...) _sp_log_internal(SP_LOG_LEVEL_WARN, __FILE__, __LINE__, __VA_ARGS__)
-#define sp_info(...) _sp_log_internal(SP_LOG_LEVEL_INFO, __FILE__, __LINE__, __VA_ARGS__)
-#define sp_debug(...) _sp_log_internal(SP_LOG_LEVEL_DEBUG, __FILE__, __LINE__, __VA_ARGS__)
-#define sp_trace(...) _sp_log_internal(SP_LOG_LEVEL_TRACE, __FILE__, __LINE__, __VA_ARGS__)
 
-typedef enum SP_LogLevel {
-    SP_LOG_LEVEL_FATAL,
-    SP_LOG_LEVEL_ERROR,
-    SP_LOG_LEVEL_WARN,
-    SP_LOG_LEVEL_INFO,
-    SP_LOG_LEVEL_DEBUG,
-    SP_LOG_LEVEL_TRACE,
+#if SP_LOG_MIN_LEVEL >= 1
+#define sp_error(...) _sp_log_text(SP_LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define sp_error(...) _sp_log_discard(__VA_ARGS__)
+#endif
 
-    SP_LOG_LEVEL_COUNT,
-} SP_LogLevel;
+#if SP_LOG_MIN_LEVEL >= 2
+#define sp_warn(...) _sp_log_text(SP_LOG_LEVEL_WARN, __VA_ARGS__)
+// Log the first of every N calls from this callsite.
+#define sp_warn_every_n(N, ...) _sp_log_static(volatile u64 _sp_log_calls = 0, \
+    if (_sp_log_enabled(SP_LOG_LEVEL_WARN) && _sp_log_every_n(&_sp_log_calls, N)) { \
+        _sp_log_internal(SP_LOG_LEVEL_WARN, __FILE__, __LINE__, __VA_ARGS__); \
+    })
+// Log at most once per second from this callsite.
+#define sp_warn_per_second(...) _sp_log_static(volatile u64 _sp_log_last_ns = 0, \
+    if (_sp_log_enabled(SP_LOG_LEVEL_WARN) && _sp_log_per_second(&_sp_log_last_ns)) { \
+        _sp_log_internal(SP_LOG_LEVEL_WARN, __FILE__, __LINE__, __VA_ARGS__); \
+    })
+#else
+#define sp_warn(...) _sp_log_discard(__VA_ARGS__)
+#define sp_warn_every_n(N, ...) _sp_log_discard(__VA_ARGS__)
+#define sp_warn_per_second(...) _sp_log_discard(__VA_ARGS__)
+#endif
+
+#if SP_LOG_MIN_LEVEL >= 3
+#define sp_info(...) _sp_log_callsite(SP_LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define sp_info(...) _sp_log_discard(__VA_ARGS__)
+#endif
+
+#if SP_LOG_MIN_LEVEL >= 4
+#define sp_debug(...) _sp_log_callsite(SP_LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define sp_debug(...) _sp_log_discard(__VA_ARGS__)
+#endif
+
+#if SP_LOG_MIN_LEVEL >= 5
+#define sp_trace(...) _sp_log_callsite(SP_LOG_LEVEL_TRACE, __VA_ARGS__)
+#else
+#define sp_trace(...) _sp_log_discard(__VA_ARGS__)
+#endif
+
+#ifdef SP_COMP_MSVC
+#define _sp_log_enabled(LEVEL) ((u32) (LEVEL) <= _sp_log_level)
+#else
+#define _sp_log_enabled(LEVEL) ((u32) (LEVEL) <= __atomic_load_n(&_sp_log_level, __ATOMIC_RELAXED))
+#endif
+
+// Compiled out lines. The dead call keeps the arguments type checked and
+// variables only used by logging from warning about being unused.
+#define _sp_log_discard(...) (0 ? _sp_log_internal(SP_LOG_LEVEL_TRACE, __FILE__, __LINE__, __VA_ARGS__) : (void) 0)
+
+#define _sp_log_text(LEVEL, ...) (_sp_log_enabled(LEVEL) ? _sp_log_internal(LEVEL, __FILE__, __LINE__, __VA_ARGS__) : (void) 0)
+
+#define _sp_log_callsite(LEVEL, ...) _sp_log_static(_SP_LogCallsite _sp_log_site = {0}, \
+    if (_sp_log_enabled(LEVEL)) { \
+        _sp_log_deferred(&_sp_log_site, LEVEL, __FILE__, __LINE__, __VA_ARGS__); \
+    })
+
+// Run 'BODY' with a static 'DECL' of its own, which needs a block. GCC and
+// Clang get one from a statement expression so the macros using this stay
+// void expressions like 'sp_fatal'. With MSVC they're statements and can't be
+// used with '?:' or ','.
+#ifdef SP_COMP_GCC
+#define _sp_log_static(DECL, BODY) (__extension__ ({ \
+    static DECL; \
+    BODY \
+    (void) 0; \
+}))
+#else
+#define _sp_log_static(DECL, BODY) do { \
+    static DECL; \
+    BODY \
+} while (0)
+#endif
+
+// Least severe level logged at runtime. Lines below it are skipped without
+// evaluating their arguments. Returns false and keeps the current level if
+// 'level' isn't one of the levels.
+SP_API b8 sp_log_set_level(SP_LogLevel level);
+SP_API SP_LogLevel sp_log_get_level(void);
+
+// Read by the log macros, use 'sp_log_set_level' to change it. Any thread may
+// change it, so it's accessed atomically.
+SP_API volatile u32 _sp_log_level;
+
+SP_API b8 _sp_log_every_n(volatile u64* calls, u64 n);
+SP_API b8 _sp_log_per_second(volatile u64* last_ns);
 
 // Internal function. You can call it manually if you want, it's just cumbersome
 // to do so.
 SP_API void _sp_log_internal(SP_LogLevel level, const char* file, u32 line, const char* msg, ...);
 
+#define _SP_LOG_MAX_ARGS 16
+
+// State of one 'sp_info', 'sp_debug' or 'sp_trace' call in the source. Filled
+// in the first time the callsite logs in binary mode.
+typedef struct _SP_LogCallsite _SP_LogCallsite;
+struct _SP_LogCallsite {
+    // 0 until registered. The upper half is the 'sp_init' it registered in.
+    volatile u64 id;
+    const char* msg;
+    b8 text_only;
+    u8 arg_count;
+    u8 arg_types[_SP_LOG_MAX_ARGS];
+    // Longest string a '%s' argument prints, from a literal precision. 0 if
+    // unbounded.
+    u32 arg_limits[_SP_LOG_MAX_ARGS];
+};
+
+SP_API void _sp_log_deferred(_SP_LogCallsite* site, SP_LogLevel level, const char* file, u32 line, const char* msg, ...);
+
+// Wait until every line logged so far has been written.
+SP_API void sp_log_flush(void);
+// Lines dropped because a ring buffer was full or the line didn't fit in one.
+SP_API u64 sp_log_get_dropped(void);
+
+// Turn a binary log written through 'SP_Config.logging.binary_path' back into
+// text, one line per record prefixed with seconds since 'sp_init'. A NULL
+// 'out_path' writes to stdout. Doesn't need 'sp_init'.
+SP_API b8 sp_log_decode(const char* binary_path, const char* out_path);
+
 // =============================================================================
 // MATH
 //
@@ -688,18 +1004,53 @@ SP_INLINE SP_Mat4 sp_m4_inv_ortho_projection(f32 left, f32 right, f32 top, f32 b
 
 typedef enum HashCollisionResolution {
     SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING,
+    // Buckets of linked nodes, each holding one element. Growing and shrinking
+    // relinks the nodes without moving them, so pointers from
+    // 'sp_hash_map_getp' stay valid until their element is removed or
+    // 'sp_hash_map_shrink_to_fit' packs the nodes into a new allocation.
     SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING,
+    // Open addressing with a byte of metadata per slot, probed 16 slots at a
+    // time with SSE2 or NEON. Lookups, misses in particular, touch far less
+    // memory than the other modes. The capacity is rounded up to a power of
+    // two of at least 16 and keys are rehashed when the table grows.
+    SP_HASH_COLLISION_RESOLUTION_SWISS_TABLE,
+    // Linear probing which keeps every element's distance from its home slot
+    // even, and lets misses stop early. Removing shifts elements back instead
+    // of leaving tombstones, so probe lengths stay short under heavy removal
+    // even at a load factor of 0.9. The capacity is rounded up to a power of
+    // two.
+    SP_HASH_COLLISION_RESOLUTION_ROBIN_HOOD,
 } SP_HashCollisionResolution;
 
-typedef u64 (*SP_HashFunc)(const void* data, u64 len);
+// Largest power of two slot count a u32 holds. Asking for more is fatal.
+#define _SP_HASH_MAX_CAPACITY (1u << 31)
+
+typedef u64 (*SP_HashFunc)(const void* data, u64 len, u64 seed);
 typedef b8 (*SP_EqualFunc)(const void* a, const void* b, u64 size);
 
 typedef struct SP_HashMapDesc SP_HashMapDesc;
 struct SP_HashMapDesc {
     SP_Allocator allocator;
+    // Rounded up to a power of two.
     u32 capacity;
+    // Fraction of the slots which may be used before the map grows. 0 picks
+    // the default of the collision resolution, 0.75 for open addressing and
+    // separate chaining, 0.875 for Swiss tables and 0.9 for Robin Hood.
+    f32 load_factor;
+    // Open addressing only. Resize into a new table without moving the
+    // elements right away, instead each insert and set moves a few of them
+    // until the old table is drained. Bounds the latency of the insert
+    // which triggers growth, at the cost of both tables being alive for a
+    // while. Lookups and iterators cover both tables until then.
+    b8 incremental_resize;
     SP_HashCollisionResolution collision_resolution;
+    // NULL picks 'sp_hash_u32' or 'sp_hash_u64' for 4 and 8 byte keys and
+    // 'sp_hash_bytes' for anything else.
     SP_HashFunc hash;
+    // Passed on to 'hash'. 0 picks a random seed for every map, so which keys
+    // collide can't be worked out ahead of time. Set one to get the same
+    // layout and iteration order on every run.
+    u64 seed;
     SP_EqualFunc equal;
 
     u64 key_size;
@@ -712,10 +1063,23 @@ SP_API SP_HashMap* sp_hash_map_create(SP_HashMapDesc desc);
 SP_API void sp_hash_map_destroy(SP_HashMap* map);
 SP_API b8 sp_hash_map_insert(SP_HashMap* map, const void* key, const void* value);
 SP_API b8 sp_hash_map_set(SP_HashMap* map, const void* key, const void* value);
+// Never resizes or moves other elements, so pointers from 'sp_hash_map_getp'
+// to them and iterators stay valid. Except with Robin Hood hashing, which
+// shifts the following elements back. A map left mostly empty shrinks on its
+// next insert instead.
 SP_API b8 sp_hash_map_remove(SP_HashMap* map, const void* key, void* out_value);
 SP_API b8 sp_hash_map_get(SP_HashMap* map, const void* key, void* out_value);
 SP_API void* sp_hash_map_getp(SP_HashMap* map, const void* key);
 SP_API u32 sp_hash_map_count(const SP_HashMap* map);
+// Make room for 'count' elements so inserting them doesn't rehash or allocate.
+SP_API void sp_hash_map_reserve(SP_HashMap* map, u32 count);
+// Shrink to the smallest capacity holding the current elements, dropping any
+// tombstones and finishing an incremental resize. Separate chaining also packs
+// its nodes into a single allocation, which moves them. Invalidates iterators
+// and pointers from 'sp_hash_map_getp' in every mode. Inserting into a map
+// left under a quarter of its maximum load by removals shrinks it as well,
+// but not below the capacity it was created with.
+SP_API void sp_hash_map_shrink_to_fit(SP_HashMap* map);
 
 typedef struct SP_HashMapIter SP_HashMapIter;
 struct SP_HashMapIter {
@@ -732,7 +1096,7 @@ SP_API void sp_hash_map_iter_get_value(SP_HashMapIter iter, void* out_value);
 SP_API void* sp_hash_map_iter_get_valuep(SP_HashMapIter iter);
 
 // Helper functions
-SP_API u64 sp_hash_map_helper_hash_str(const void* key, u64 size);
+SP_API u64 sp_hash_map_helper_hash_str(const void* key, u64 size, u64 seed);
 SP_API b8  sp_hash_map_helper_equal_str(const void* a, const void* b, u64 len);
 SP_API b8  sp_hash_map_helper_equal_generic(const void* a, const void* b, u64 len);
 
@@ -740,7 +1104,6 @@ SP_API b8  sp_hash_map_helper_equal_generic(const void* a, const void* b, u64 le
         .allocator = (ALLOCATOR), \
         .capacity = (CAPACITY), \
         .collision_resolution = (COLLISION_RESOLUTION), \
-        .hash = sp_fvn1a_hash, \
         .equal = sp_hash_map_helper_equal_generic, \
         .key_size = sizeof(KEY_TYPE), \
         .value_size = sizeof(VALUE_TYPE), \
@@ -763,9 +1126,15 @@ SP_API b8  sp_hash_map_helper_equal_generic(const void* a, const void* b, u64 le
 typedef struct SP_HashSetDesc SP_HashSetDesc;
 struct SP_HashSetDesc {
     SP_Allocator allocator;
+    // See 'SP_HashMapDesc'.
     u32 capacity;
+    f32 load_factor;
+    b8 incremental_resize;
     SP_HashCollisionResolution collision_resolution;
     SP_HashFunc hash;
+    // Passed on to 'hash'. 0 picks a random seed for every set, set one to get
+    // the same layout and iteration order on every run.
+    u64 seed;
     SP_EqualFunc equal;
     u64 value_size;
 };
@@ -775,9 +1144,13 @@ typedef struct SP_HashSet SP_HashSet;
 SP_API SP_HashSet* sp_hash_set_create(SP_HashSetDesc desc);
 SP_API void sp_hash_set_destroy(SP_HashSet* set);
 SP_API b8 sp_hash_set_insert(SP_HashSet* set, const void* value);
+// See 'sp_hash_map_remove'.
 SP_API b8 sp_hash_set_remove(SP_HashSet* set, const void* value);
 SP_API b8 sp_hash_set_has(SP_HashSet* set, const void* value);
 SP_API u32 sp_hash_set_count(const SP_HashSet* set);
+// See 'sp_hash_map_reserve' and 'sp_hash_map_shrink_to_fit'.
+SP_API void sp_hash_set_reserve(SP_HashSet* set, u32 count);
+SP_API void sp_hash_set_shrink_to_fit(SP_HashSet* set);
 
 typedef struct SP_HashSetIter SP_HashSetIter;
 struct SP_HashSetIter {
@@ -793,6 +1166,260 @@ SP_API void sp_hash_set_iter_get_key(SP_HashSetIter iter, void* out_key);
 SP_API void sp_hash_set_iter_get_value(SP_HashSetIter iter, void* out_value);
 SP_API void* sp_hash_set_iter_get_valuep(SP_HashSetIter iter);
 
+// =============================================================================
+// TYPED HASH MAP
+//
+// SP_HASH_MAP_DEFINE generates a hash map for one key and value type. Hashing
+// and comparing keys are direct calls and keys and values are copied by
+// assignment, so maps of integers inline down to a few loads, compares and
+// multiplies.
+//
+// It works like 'SP_HashMap' with open addressing: same return values, same
+// power of two capacities, triangular probing and tombstones, plus a 7 bit tag
+// of the hash per slot which is checked before the keys are compared. It only
+// covers part of what 'SP_HashMapDesc' offers though. The load factor is fixed
+// at 0.75, resizes are never incremental and inserts don't shrink a map left
+// sparse by removals, use shrink_to_fit for that. Removing never moves other
+// elements.
+//
+// HASH_FN(K key, u64 seed) returns the u64 hash of a key and
+// EQUAL_FN(K a, K b) whether two keys match. Both can be functions or
+// function-like macros.
+//
+// Usage:
+// SP_HASH_MAP_DEFINE(U32Map, u32, u32, sp_hash_int, sp_equal_value)
+// ...
+// // Capacity 0 picks the minimum, seed 0 a random one.
+// U32Map map = U32Map_create(sp_libc_allocator(), 0, 0);
+// U32Map_insert(&map, 42, 7);
+// u32* value = U32Map_getp(&map, 42);
+// for (u32 i = U32Map_iter_begin(&map); i < map.capacity; i = U32Map_iter_next(&map, i)) {
+//     sp_info("%u -> %u", map.keys[i], map.values[i]);
+// }
+// U32Map_destroy(&map);
+// =============================================================================
+
+// Equality of anything that works with ==.
+#define sp_equal_value(A, B) ((A) == (B))
+
+// Control bytes of a typed map. Full slots are 0x80 or above.
+#define _SP_HASH_TYPED_EMPTY 0
+#define _SP_HASH_TYPED_DEAD 1
+
+#define SP_HASH_MAP_DEFINE(NAME, K, V, HASH_FN, EQUAL_FN) \
+    typedef struct NAME NAME; \
+    struct NAME { \
+        SP_Allocator allocator; \
+        u64 seed; \
+        /* See '_SP_HASH_TYPED_EMPTY'. */ \
+        u8* ctrl; \
+        K* keys; \
+        V* values; \
+        u32 capacity; \
+        u32 count; \
+        /* Count of live and dead slots */ \
+        u32 used; \
+    }; \
+    \
+    static inline u8 NAME##_tag(u64 hash) { \
+        return (u8) (0x80 | (hash >> 57)); \
+    } \
+    \
+    /* Smallest capacity holding 'count' elements without a rehash. */ \
+    static inline u32 NAME##_capacity_for(u32 count) { \
+        u32 capacity = 8; \
+        while (capacity - capacity / 4 < count) { \
+            sp_ensure(capacity < _SP_HASH_MAX_CAPACITY, "Hash map capacity too big."); \
+            capacity *= 2; \
+        } \
+        return capacity; \
+    } \
+    \
+    /* Move all live elements into 'capacity' slots, dropping tombstones. */ \
+    static inline void NAME##_rehash(NAME* map, u32 capacity) { \
+        NAME old = *map; \
+        map->ctrl = sp_alloc(map->allocator, capacity * sizeof(u8)); \
+        map->keys = sp_alloc(map->allocator, capacity * sizeof(K)); \
+        map->values = sp_alloc(map->allocator, capacity * sizeof(V)); \
+        map->capacity = capacity; \
+        map->used = map->count; \
+        for (u32 i = 0; i < capacity; i++) { \
+            map->ctrl[i] = _SP_HASH_TYPED_EMPTY; \
+        } \
+        \
+        u32 mask = capacity - 1; \
+        for (u32 i = 0; i < old.capacity; i++) { \
+            if (old.ctrl[i] < 0x80) { \
+                continue; \
+            } \
+            u64 hash = HASH_FN(old.keys[i], map->seed); \
+            u32 index = (u32) hash & mask; \
+            for (u32 step = 1; map->ctrl[index] != _SP_HASH_TYPED_EMPTY; step++) { \
+                index = (index + step) & mask; \
+            } \
+            map->ctrl[index] = NAME##_tag(hash); \
+            map->keys[index] = old.keys[i]; \
+            map->values[index] = old.values[i]; \
+        } \
+        \
+        if (old.capacity != 0) { \
+            sp_free(map->allocator, old.ctrl, old.capacity * sizeof(u8)); \
+            sp_free(map->allocator, old.keys, old.capacity * sizeof(K)); \
+            sp_free(map->allocator, old.values, old.capacity * sizeof(V)); \
+        } \
+    } \
+    \
+    /* 'capacity' is rounded up to a power of two, a 'seed' of 0 picks a \
+     * random one. */ \
+    static inline NAME NAME##_create(SP_Allocator allocator, u32 capacity, u64 seed) { \
+        NAME map = { \
+            .allocator = allocator, \
+            .seed = seed, \
+        }; \
+        u32 slots = 8; \
+        while (slots < capacity) { \
+            sp_ensure(slots < _SP_HASH_MAX_CAPACITY, "Hash map capacity too big."); \
+            slots *= 2; \
+        } \
+        NAME##_rehash(&map, slots); \
+        /* Salted by the slots, 'map' is a copy at the same address on \
+         * every call. */ \
+        if (map.seed == 0) { \
+            map.seed = sp_hash_random_seed(map.ctrl); \
+        } \
+        return map; \
+    } \
+    \
+    static inline void NAME##_destroy(NAME* map) { \
+        sp_free(map->allocator, map->ctrl, map->capacity * sizeof(u8)); \
+        sp_free(map->allocator, map->keys, map->capacity * sizeof(K)); \
+        sp_free(map->allocator, map->values, map->capacity * sizeof(V)); \
+        *map = (NAME) {0}; \
+    } \
+    \
+    /* Slot of a live key, or ~0u. */ \
+    static inline u32 NAME##_find(const NAME* map, K key, u64 hash) { \
+        u32 mask = map->capacity - 1; \
+        u32 index = (u32) hash & mask; \
+        u8 tag = NAME##_tag(hash); \
+        for (u32 step = 1; map->ctrl[index] != _SP_HASH_TYPED_EMPTY; step++) { \
+            if (map->ctrl[index] == tag && EQUAL_FN(map->keys[index], key)) { \
+                return index; \
+            } \
+            index = (index + step) & mask; \
+        } \
+        return ~0u; \
+    } \
+    \
+    /* Claim a slot for a key which isn't in the map, reusing tombstones. Only \
+     * the control byte is written. */ \
+    static inline u32 NAME##_prepare_insert(NAME* map, u64 hash) { \
+        u32 max_load = map->capacity - map->capacity / 4; \
+        if (map->used >= max_load) { \
+            b8 grow = map->count >= max_load / 2; \
+            sp_ensure(!grow || map->capacity < _SP_HASH_MAX_CAPACITY, "Hash map capacity too big."); \
+            NAME##_rehash(map, grow ? map->capacity * 2 : map->capacity); \
+        } \
+        \
+        u32 mask = map->capacity - 1; \
+        u32 index = (u32) hash & mask; \
+        for (u32 step = 1; map->ctrl[index] >= 0x80; step++) { \
+            index = (index + step) & mask; \
+        } \
+        if (map->ctrl[index] == _SP_HASH_TYPED_EMPTY) { \
+            map->used++; \
+        } \
+        map->ctrl[index] = NAME##_tag(hash); \
+        map->count++; \
+        return index; \
+    } \
+    \
+    static inline b8 NAME##_insert(NAME* map, K key, V value) { \
+        u64 hash = HASH_FN(key, map->seed); \
+        if (NAME##_find(map, key, hash) != ~0u) { \
+            return false; \
+        } \
+        u32 index = NAME##_prepare_insert(map, hash); \
+        map->keys[index] = key; \
+        map->values[index] = value; \
+        return true; \
+    } \
+    \
+    static inline b8 NAME##_set(NAME* map, K key, V value) { \
+        u64 hash = HASH_FN(key, map->seed); \
+        u32 index = NAME##_find(map, key, hash); \
+        b8 new_key = index == ~0u; \
+        if (new_key) { \
+            index = NAME##_prepare_insert(map, hash); \
+            map->keys[index] = key; \
+        } \
+        map->values[index] = value; \
+        return new_key; \
+    } \
+    \
+    static inline b8 NAME##_remove(NAME* map, K key, V* out_value) { \
+        u32 index = NAME##_find(map, key, HASH_FN(key, map->seed)); \
+        if (index == ~0u) { \
+            return false; \
+        } \
+        if (out_value != NULL) { \
+            *out_value = map->values[index]; \
+        } \
+        map->ctrl[index] = _SP_HASH_TYPED_DEAD; \
+        map->count--; \
+        return true; \
+    } \
+    \
+    static inline b8 NAME##_get(const NAME* map, K key, V* out_value) { \
+        u32 index = NAME##_find(map, key, HASH_FN(key, map->seed)); \
+        if (index == ~0u) { \
+            return false; \
+        } \
+        if (out_value != NULL) { \
+            *out_value = map->values[index]; \
+        } \
+        return true; \
+    } \
+    \
+    static inline V* NAME##_getp(const NAME* map, K key) { \
+        u32 index = NAME##_find(map, key, HASH_FN(key, map->seed)); \
+        return index == ~0u ? NULL : &map->values[index]; \
+    } \
+    \
+    static inline u32 NAME##_count(const NAME* map) { \
+        return map->count; \
+    } \
+    \
+    static inline void NAME##_reserve(NAME* map, u32 count) { \
+        u32 capacity = NAME##_capacity_for(count); \
+        if (capacity > map->capacity) { \
+            NAME##_rehash(map, capacity); \
+        } \
+    } \
+    \
+    static inline void NAME##_shrink_to_fit(NAME* map) { \
+        u32 capacity = sp_min(NAME##_capacity_for(map->count), map->capacity); \
+        if (capacity < map->capacity || map->used != map->count) { \
+            NAME##_rehash(map, capacity); \
+        } \
+    } \
+    \
+    /* First live slot at or after 'index', or 'capacity'. */ \
+    static inline u32 NAME##_iter_skip(const NAME* map, u32 index) { \
+        while (index < map->capacity && map->ctrl[index] < 0x80) { \
+            index++; \
+        } \
+        return index; \
+    } \
+    \
+    static inline u32 NAME##_iter_begin(const NAME* map) { \
+        return NAME##_iter_skip(map, 0); \
+    } \
+    \
+    static inline u32 NAME##_iter_next(const NAME* map, u32 index) { \
+        return NAME##_iter_skip(map, index + 1); \
+    }
+
 // =============================================================================
 // LINKED LISTS
 //
@@ -966,11 +1593,36 @@ SP_API SP_Color sp_color_hsv(f32 hue, f32 saturation, f32 value);
 // groups, and a group contains tests.
 //
 // When running a suite all groups will be run in sequential order.
+//
+// Every test reports its wall time and the allocations it made, see
+// 'SP_AllocStats'. Budgets turn those into assertions. Time budgets depend on
+// the machine so keep them generous and use them to catch order of magnitude
+// regressions.
+//
+// Usage:
+// SP_TestResult test_insert_budget(void* userdata) {
+//     SP_HashMap* map = userdata;
+//     SP_TestBudget budget = sp_test_budget_begin();
+//     for (u32 i = 0; i < 1000; i++) {
+//         sp_hash_map_insert(map, &i, &i);
+//     }
+//     sp_test_assert_max_ns(budget, 1000000);
+//     sp_test_assert_max_allocs(budget, 16);
+//     sp_test_success();
+// }
+//
+// With 'workers' set in SP_TestConfig, tests run in separate worker processes
+// instead. A test that crashes or hangs only fails itself, the worker is
+// replaced and the suite carries on. Only supported on POSIX, elsewhere the
+// suite runs in process. Workers are forked from the calling thread, so other
+// threads, like the asynchronous log writer, don't exist inside them.
 // =============================================================================
 
 typedef struct SP_TestResult SP_TestResult;
 struct SP_TestResult {
     b8 successful;
+    // Set by 'sp_test_skip'. Skipped tests count as passed.
+    b8 skipped;
     const char* file;
     u32 line;
     const char* reason;
@@ -980,9 +1632,26 @@ typedef SP_TestResult (*SP_TestFunc)(void* userdata);
 
 typedef struct SP_TestSuite SP_TestSuite;
 
+typedef struct SP_TestConfig SP_TestConfig;
+struct SP_TestConfig {
+    // Number of worker processes running tests in parallel. 0 runs every test
+    // in the calling process.
+    u32 workers;
+    // Tests running longer than this in a worker are killed and fail. 0
+    // disables the timeout. Default is 30 seconds.
+    u64 timeout_ns;
+};
+
+static const SP_TestConfig SP_TEST_CONFIG_DEFAULT = {
+    .workers = 0,
+    .timeout_ns = 30000000000llu,
+};
+
 extern SP_TestSuite* sp_test_suite_create(SP_Allocator allocator);
 extern void sp_test_suite_destroy(SP_TestSuite* suite);
 extern void sp_test_suite_run(SP_TestSuite* suite);
+// Returns true if every test passed.
+extern b8 sp_test_suite_run_configurable(SP_TestSuite* suite, SP_TestConfig config);
 extern u32 sp_test_group_register(SP_TestSuite* suite, SP_Str name);
 #define sp_test_register(SUITE, GROUP, FUNC, USERDATA) _sp_test_register(SUITE, GROUP, FUNC, sp_str_lit(#FUNC), USERDATA)
 
@@ -997,9 +1666,271 @@ extern u32 sp_test_group_register(SP_TestSuite* suite, SP_Str name);
     } \
 } while (0)
 #define sp_test_success() return (SP_TestResult) { .successful = true, }
+// Pass without checking anything, for tests needing something the machine or
+// build doesn't have. 'REASON' is printed next to the test.
+#define sp_test_skip(REASON) return (SP_TestResult) { \
+    .successful = true, \
+    .skipped = true, \
+    .file = __FILE__, \
+    .line = __LINE__, \
+    .reason = REASON, \
+}
+
+// Start of a measured region for the budget assertions below.
+typedef struct SP_TestBudget SP_TestBudget;
+struct SP_TestBudget {
+    u64 start_ns;
+    SP_AllocStats start_allocs;
+};
+
+extern SP_TestBudget sp_test_budget_begin(void);
+
+// Fail if more than 'MAX_NS' nanoseconds passed since 'BUDGET' began.
+#define sp_test_assert_max_ns(BUDGET, MAX_NS) \
+    _sp_test_assert_budget(sp_os_get_time_ns() - (BUDGET).start_ns, MAX_NS, "ns")
+// Fail if the calling thread made more than 'MAX_ALLOCS' heap allocations and
+// arena pushes since 'BUDGET' began.
+#define sp_test_assert_max_allocs(BUDGET, MAX_ALLOCS) \
+    _sp_test_assert_budget(_sp_test_budget_allocs(BUDGET), MAX_ALLOCS, "allocations")
+// Fail if the calling thread allocated or pushed more than 'MAX_BYTES' bytes
+// since 'BUDGET' began.
+#define sp_test_assert_max_bytes(BUDGET, MAX_BYTES) \
+    _sp_test_assert_budget(_sp_test_budget_bytes(BUDGET), MAX_BYTES, "bytes")
+
+#define _sp_test_assert_budget(USED, MAX, UNIT) do { \
+    u64 _sp_test_used = (USED); \
+    u64 _sp_test_max = (MAX); \
+    if (_sp_test_used > _sp_test_max) { \
+        return (SP_TestResult) { \
+            .successful = false, \
+            .file = __FILE__, \
+            .line = __LINE__, \
+            .reason = _sp_test_budget_reason(_sp_test_used, _sp_test_max, UNIT), \
+        }; \
+    } \
+} while (0)
+
+extern u64 _sp_test_budget_allocs(SP_TestBudget budget);
+extern u64 _sp_test_budget_bytes(SP_TestBudget budget);
+// Formats into a per thread buffer which stays valid until the next call.
+extern const char* _sp_test_budget_reason(u64 used, u64 max, const char* unit);
 
 extern void _sp_test_register(SP_TestSuite* suite, u32 group, SP_TestFunc func, SP_Str name, void* userdata);
 
+// =============================================================================
+// BENCHMARKING
+//
+// Benchmarks are organized like tests, a suite contains groups and a group
+// contains benchmarks.
+//
+// A benchmark function runs the measured operation 'sp_bench_iterations' times.
+// The runner warms it up, calibrates the iteration count so one call takes at
+// least 'min_sample_ns', and then collects 'samples' calls to compute the
+// statistics per iteration.
+//
+// Usage:
+// void bench_push(SP_Bench* bench, void* userdata) {
+//     SP_Arena* arena = userdata;
+//     for (u64 i = 0; i < sp_bench_iterations(bench); i++) {
+//         void* ptr = sp_arena_push(arena, 64);
+//         sp_bench_do_not_optimize(ptr);
+//     }
+//     sp_bench_pause(bench);
+//     sp_arena_clear(arena);
+//     sp_bench_resume(bench);
+// }
+// =============================================================================
+
+typedef struct SP_Bench SP_Bench;
+typedef void (*SP_BenchFunc)(SP_Bench* bench, void* userdata);
+typedef void (*SP_BenchFixtureFunc)(void* userdata);
+
+typedef struct SP_BenchSuite SP_BenchSuite;
+
+typedef struct SP_BenchConfig SP_BenchConfig;
+struct SP_BenchConfig {
+    // Time spent running each benchmark before measuring. Default is 100 ms.
+    u64 warmup_ns;
+    // Shortest time one sample may take. Default is 1 ms.
+    u64 min_sample_ns;
+    // Number of samples collected per benchmark. Default is 50.
+    u32 samples;
+    // Write the results as JSON to this file. NULL disables JSON output.
+    const char* json_path;
+    // JSON results of an earlier run to compare the median against. NULL
+    // disables the comparison.
+    const char* baseline_path;
+    // Also report OS memory calls and page faults per iteration, and the peak
+    // resident size of the process while each benchmark ran. See
+    // 'sp_os_get_process_memory'.
+    b8 memory_stats;
+    // Also report hardware performance counters per iteration, see
+    // 'sp_os_read_perf_counters'. Only the thread running the benchmark
+    // function is counted.
+    b8 perf_counters;
+};
+
+static const SP_BenchConfig SP_BENCH_CONFIG_DEFAULT = {
+    .warmup_ns = 100000000,
+    .min_sample_ns = 1000000,
+    .samples = 50,
+    .json_path = NULL,
+    .baseline_path = NULL,
+    .memory_stats = false,
+    .perf_counters = false,
+};
+
+SP_API SP_BenchSuite* sp_bench_suite_create(SP_Allocator allocator);
+SP_API void sp_bench_suite_destroy(SP_BenchSuite* suite);
+SP_API void sp_bench_suite_run(SP_BenchSuite* suite, SP_BenchConfig config);
+SP_API u32 sp_bench_group_register(SP_BenchSuite* suite, SP_Str name);
+// Run 'setup' before the first benchmark of a group and 'teardown' after the
+// last one. Useful for data shared by the whole group that is too expensive to
+// keep around for the entire suite. Either function can be NULL.
+SP_API void sp_bench_group_fixture(SP_BenchSuite* suite, u32 group, SP_BenchFixtureFunc setup, SP_BenchFixtureFunc teardown, void* userdata);
+#define sp_bench_register(SUITE, GROUP, FUNC, USERDATA) _sp_bench_register(SUITE, GROUP, FUNC, sp_str_lit(#FUNC), USERDATA)
+// Same as 'sp_bench_register' but with a custom name. Useful when registering
+// the same function several times with different userdata.
+#define sp_bench_register_named(SUITE, GROUP, FUNC, NAME, USERDATA) _sp_bench_register(SUITE, GROUP, FUNC, NAME, USERDATA)
+
+// Number of times the benchmark function should run its operation.
+SP_API u64 sp_bench_iterations(const SP_Bench* bench);
+// Bytes processed by one iteration, used to report throughput.
+SP_API void sp_bench_set_bytes_per_iteration(SP_Bench* bench, u64 bytes);
+// Exclude setup or cleanup from the measurement.
+SP_API void sp_bench_pause(SP_Bench* bench);
+SP_API void sp_bench_resume(SP_Bench* bench);
+
+// Keep the compiler from optimizing away the computation of 'VALUE', which
+// must be an lvalue.
+#ifdef SP_COMP_GCC
+#define sp_bench_do_not_optimize(VALUE) __asm__ __volatile__("" : : "r,m"(VALUE) : "memory")
+#else
+#define sp_bench_do_not_optimize(VALUE) _sp_bench_do_not_optimize(&(VALUE))
+#endif
+// Force all pending memory writes to be treated as observable.
+#ifdef SP_COMP_GCC
+#define sp_bench_clobber() __asm__ __volatile__("" : : : "memory")
+#else
+#define sp_bench_clobber() _sp_bench_do_not_optimize(NULL)
+#endif
+
+SP_API void _sp_bench_register(SP_BenchSuite* suite, u32 group, SP_BenchFunc func, SP_Str name, void* userdata);
+SP_API void _sp_bench_do_not_optimize(const void* ptr);
+
+// =============================================================================
+// HISTOGRAM
+//
+// Log-linear histogram over u64 values, meant for latencies and sizes recorded
+// on hot paths. Every power of two is split into 2^precision equally sized
+// buckets so values are kept with a relative error of at most 2^-precision.
+// Values below 2^(precision + 1) are exact.
+//
+// Recording is lock-free. Each thread records into its own shard with a single
+// atomic increment and queries merge the shards when they run. All storage is
+// pushed onto the arena passed at creation, nothing is freed until the arena
+// is.
+//
+// Usage:
+// SP_Histogram* latency = sp_histogram_create(arena, (SP_HistogramDesc) {0});
+// u64 start = sp_os_get_time_ns();
+// handle_request(request);
+// sp_histogram_record(latency, sp_os_get_time_ns() - start);
+//
+// sp_info("p99 %llu ns", sp_histogram_percentile(latency, 99.0));
+// =============================================================================
+
+typedef struct SP_HistogramDesc SP_HistogramDesc;
+struct SP_HistogramDesc {
+    // Buckets per power of two as an exponent of two. Default is 7, which is
+    // a relative error below 1%. Capped at 16.
+    u32 precision;
+    // Values above this are recorded as 'max_value'. Lowering it saves the
+    // memory of the buckets above. Default is UINT64_MAX.
+    u64 max_value;
+    // Number of shards threads spread their recordings over. More threads than
+    // shards still works, they just share cache lines. Default is the number
+    // of logical cores.
+    u32 shards;
+};
+
+typedef struct SP_Histogram SP_Histogram;
+
+SP_API SP_Histogram* sp_histogram_create(SP_Arena* arena, SP_HistogramDesc desc);
+SP_API void sp_histogram_record(SP_Histogram* histogram, u64 value);
+// Same as 'sp_histogram_record' but records 'value' 'count' times.
+SP_API void sp_histogram_record_n(SP_Histogram* histogram, u64 value, u64 count);
+
+// Queries merge all shards so they're linear in the number of buckets. Except
+// for 'sp_histogram_min', values returned are the highest value of the bucket
+// they were found in. All of them return 0 if nothing was recorded.
+SP_API u64 sp_histogram_count(const SP_Histogram* histogram);
+SP_API u64 sp_histogram_min(const SP_Histogram* histogram);
+SP_API u64 sp_histogram_max(const SP_Histogram* histogram);
+SP_API f64 sp_histogram_mean(const SP_Histogram* histogram);
+// Smallest value at least 'percentile' percent of the recordings are less than
+// or equal to. 'percentile' goes from 0 to 100.
+SP_API u64 sp_histogram_percentile(const SP_Histogram* histogram, f64 percentile);
+
+// Add every recording of 'src' to 'dst'. The histograms don't need to share a
+// description, although 'src' values are only kept to the precision of both.
+SP_API void sp_histogram_merge(SP_Histogram* dst, const SP_Histogram* src);
+// Forget all recordings. Recordings made concurrently with a reset may
+// survive it.
+SP_API void sp_histogram_reset(SP_Histogram* histogram);
+
+// =============================================================================
+// PROFILING
+//
+// Instrumentation for finding out where time goes. Zones record a begin and an
+// end event into a ring buffer owned by the calling thread, the oldest events
+// are overwritten once it's full. 'sp_prof_flush' writes the recorded events as
+// a Chrome trace which can be opened in chrome://tracing or Perfetto.
+//
+// When a thread exits its ring buffer goes to the next thread that starts
+// recording, along with its thread context. Threads running one after the
+// other share a row in the trace.
+//
+// Zones are only compiled in when SP_PROFILE is defined, which the SPIRE_PROFILE
+// CMake option does. Otherwise the macros expand to nothing. Spire itself has
+// zones around arena growth, hash container growth and logging.
+//
+// Zone names must outlive the profiler, string literals work best.
+//
+// Usage:
+// sp_prof_zone("update") {
+//     update_world(world);
+// }
+//
+// sp_prof_zone_begin("render");
+// render_world(world);
+// sp_prof_zone_end();
+//
+// sp_prof_flush("trace.json");
+// =============================================================================
+
+#ifdef SP_PROFILE
+#define sp_prof_zone_begin(NAME) _sp_prof_zone_begin(NAME)
+#define sp_prof_zone_end() _sp_prof_zone_end()
+// Wrap a block in a zone. Leaving the block with 'break', 'return' or 'goto'
+// skips the end event.
+#define sp_prof_zone(NAME) \
+    for (b8 sp_concat(_sp_prof_done_, __LINE__) = (_sp_prof_zone_begin(NAME), false); \
+            !sp_concat(_sp_prof_done_, __LINE__); \
+            sp_concat(_sp_prof_done_, __LINE__) = true, _sp_prof_zone_end())
+#else
+#define sp_prof_zone_begin(NAME) ((void) 0)
+#define sp_prof_zone_end() ((void) 0)
+#define sp_prof_zone(NAME)
+#endif // SP_PROFILE
+
+// Write every event recorded since the last flush to 'path' as Chrome trace
+// JSON. Must not be called from several threads at once.
+SP_API b8 sp_prof_flush(const char* path);
+
+SP_API void _sp_prof_zone_begin(const char* name);
+SP_API void _sp_prof_zone_end(void);
+
 // =============================================================================
 // OS
 //
@@ -1010,11 +1941,169 @@ SP_API void* sp_os_reserve_memory(u64 size);
 SP_API void  sp_os_commit_memory(void* ptr, u64 size);
 SP_API void  sp_os_decommit_memory(void* ptr, u64 size);
 SP_API void  sp_os_release_memory(void* ptr, u64 size);
+// Works before 'sp_init', so arenas can be created before it.
 SP_API u32   sp_os_get_page_size(void);
 
 // Get time in seconds since initialization.
 SP_API f32 sp_os_get_time(void);
 
+// Monotonic clock in nanoseconds. The starting point is unspecified, only the
+// difference between two readings is meaningful.
+SP_API u64 sp_os_get_time_ns(void);
+
+// Read the CPU cycle counter, rdtsc on x86 and cntvct on ARM64. Falls back to
+// the nanosecond clock on other architectures.
+SP_INLINE u64 sp_os_get_cycles(void) {
+#if defined(SP_COMP_MSVC)
+    return __rdtsc();
+#elif defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+    u64 cycles;
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(cycles));
+    return cycles;
+#else
+    return sp_os_get_time_ns();
+#endif
+}
+
+// Frequency of 'sp_os_get_cycles' in Hz. On x86 it's calibrated against the
+// nanosecond clock the first time it's needed, which sleeps until at least
+// 10 ms have passed since 'sp_init'.
+SP_API u64 sp_os_get_cycle_frequency(void);
+SP_API u64 sp_os_cycles_to_ns(u64 cycles);
+
+// Time a block of code, adding the elapsed time to 'OUT'. Leaving the block
+// with 'break', 'return' or 'goto' skips the measurement.
+// Usage:
+//      u64 elapsed_ns = 0;
+//      sp_time_scope_ns(elapsed_ns) {
+//          do_work();
+//      }
+#define sp_time_scope_ns(OUT) _sp_time_scope(OUT, sp_os_get_time_ns)
+#define sp_time_scope_cycles(OUT) _sp_time_scope(OUT, sp_os_get_cycles)
+
+#define _sp_time_scope(OUT, CLOCK) \
+    for (u64 sp_concat(_sp_time_start_, __LINE__) = CLOCK(), sp_concat(_sp_time_done_, __LINE__) = 0; \
+            !sp_concat(_sp_time_done_, __LINE__); \
+            sp_concat(_sp_time_done_, __LINE__) = 1, (OUT) += CLOCK() - sp_concat(_sp_time_start_, __LINE__))
+
+typedef struct SP_SystemInfo SP_SystemInfo;
+struct SP_SystemInfo {
+    u32 page_size;
+    // 0 if huge pages aren't supported.
+    u64 huge_page_size;
+    u32 cache_line_size;
+    // Cache sizes in bytes, 0 if the cache level doesn't exist or couldn't be
+    // detected. L1 is the data cache of one core.
+    u64 l1_cache_size;
+    u64 l2_cache_size;
+    u64 l3_cache_size;
+    u32 logical_cores;
+    u32 physical_cores;
+    u32 numa_nodes;
+    // SIMD instruction sets supported by both the CPU and the OS.
+    struct {
+        b8 sse2;
+        b8 sse42;
+        b8 avx2;
+        b8 avx512f;
+        b8 neon;
+    } simd;
+};
+
+// Information about the machine. It's probed once during 'sp_init' so this is
+// cheap to call. Before 'sp_init' every call probes again.
+SP_API SP_SystemInfo sp_os_get_system_info(void);
+
+typedef struct SP_ProcessMemory SP_ProcessMemory;
+struct SP_ProcessMemory {
+    // Bytes of physical memory mapped by the process right now. 0 if it
+    // couldn't be determined.
+    u64 resident;
+    // Highest 'resident' since the process started or since the last
+    // 'sp_os_reset_peak_resident'.
+    u64 peak_resident;
+    // Page faults served without and with disk I/O. Windows doesn't tell them
+    // apart and counts every fault as minor.
+    u64 minor_faults;
+    u64 major_faults;
+    // Calls to reserve, commit, decommit and release memory made through this
+    // layer. Each one is a system call.
+    u64 memory_calls;
+};
+
+// Memory usage of the whole process. Reads procfs on Linux so don't call it in
+// a hot loop.
+SP_API SP_ProcessMemory sp_os_get_process_memory(void);
+// Let 'peak_resident' start over from the current resident size. Only
+// supported on Linux, elsewhere the peak covers the lifetime of the process.
+SP_API void sp_os_reset_peak_resident(void);
+// Bytes of the range backed by physical memory. The range gets expanded to
+// whole pages and may include reserved but uncommitted memory. Asks the OS
+// about every page so it's linear in 'size'.
+SP_API u64 sp_os_get_resident_memory(const void* ptr, u64 size);
+
+typedef enum SP_PerfCounter {
+    SP_PERF_COUNTER_CYCLES,
+    SP_PERF_COUNTER_INSTRUCTIONS,
+    SP_PERF_COUNTER_CACHE_REFERENCES,
+    SP_PERF_COUNTER_CACHE_MISSES,
+    SP_PERF_COUNTER_BRANCH_MISSES,
+    SP_PERF_COUNTER_PAGE_FAULTS,
+
+    SP_PERF_COUNTER_COUNT,
+} SP_PerfCounter;
+
+typedef struct SP_PerfCounters SP_PerfCounters;
+struct SP_PerfCounters {
+    u64 values[SP_PERF_COUNTER_COUNT];
+    // Which of 'values' were measured. Hardware counters are often missing in
+    // containers and virtual machines, or blocked by perf_event_paranoid.
+    b8 available[SP_PERF_COUNTER_COUNT];
+};
+
+// Read the hardware performance counters of the calling thread, only counting
+// user space. Uses perf_event_open on Linux, where page faults fall back to
+// getrusage when perf events are blocked. Nothing is available on other
+// platforms. The counters are opened the first time a thread reads them and
+// a read costs a few system calls, so measure regions rather than single
+// operations. Only the difference between two readings is meaningful.
+SP_API SP_PerfCounters sp_os_read_perf_counters(void);
+
+// Name of a counter, like "cycles".
+SP_API const char* sp_os_perf_counter_name(SP_PerfCounter counter);
+
+// Whether the calling thread can read 'counter'. Opens the counters if the
+// thread hasn't read them yet.
+SP_API b8 sp_os_perf_counter_available(SP_PerfCounter counter);
+
+// Measure a block of code, adding the counter differences to the
+// 'SP_PerfCounters' 'OUT'. Counters missing at either end of the block add
+// nothing. 'OUT.available' is left alone since a scope can't tell what earlier
+// scopes added up, check 'sp_os_perf_counter_available' instead. Leaving the
+// block with 'break', 'return' or 'goto' skips the measurement.
+// Usage:
+//      SP_PerfCounters counters = {0};
+//      sp_perf_scope(counters) {
+//          do_work();
+//      }
+//      if (sp_os_perf_counter_available(SP_PERF_COUNTER_CACHE_MISSES)) {
+//          sp_info("%llu cache misses", counters.values[SP_PERF_COUNTER_CACHE_MISSES]);
+//      }
+#define sp_perf_scope(OUT) \
+    for (_SP_PerfScope sp_concat(_sp_perf_scope_, __LINE__) = {sp_os_read_perf_counters(), false}; \
+            !sp_concat(_sp_perf_scope_, __LINE__).done; \
+            _sp_perf_scope_end(&sp_concat(_sp_perf_scope_, __LINE__), &(OUT)))
+
+typedef struct _SP_PerfScope _SP_PerfScope;
+struct _SP_PerfScope {
+    SP_PerfCounters start;
+    b8 done;
+};
+
+SP_API void _sp_perf_scope_end(_SP_PerfScope* scope, SP_PerfCounters* out);
+
 // =============================================================================
 // DYNAMIC LIBRARY
 //
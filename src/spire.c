@@ -3,26 +3,152 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdarg.h>
+#include <stddef.h>
+
+#ifdef SP_COMP_MSVC
+#include <intrin.h>
+#endif
 
 typedef struct _SP_PlatformState _SP_PlatformState;
 static b8 _sp_platform_init(void);
 static b8 _sp_platform_termiante(void);
+// Lock protecting the global state shared between threads.
+static void _sp_platform_lock(void);
+static void _sp_platform_unlock(void);
+// Hand 'ctx' back through '_sp_thread_ctx_release' when the calling thread
+// exits.
+static void _sp_platform_thread_ctx_register(SP_ThreadCtx* ctx);
+// Performance counters of the calling thread. Handles that couldn't be opened
+// are -1.
+static void _sp_platform_perf_open(i64* handles);
+static void _sp_platform_perf_close(i64* handles);
+static void _sp_platform_perf_read(const i64* handles, SP_PerfCounters* counters);
+
+typedef struct _SP_LogSegment _SP_LogSegment;
+struct _SP_LogSegment {
+    const void* data;
+    u64 size;
+};
+
+// Log output for the writer thread. A NULL path opens stdout, which is never
+// closed. Returns -1 on failure.
+static i64 _sp_platform_log_open(const char* path, b8 truncate);
+static void _sp_platform_log_close(i64 handle);
+// Write all segments in order with as few system calls as possible.
+static void _sp_platform_log_write(i64 handle, const _SP_LogSegment* segments, u32 count);
+// Run '_sp_log_writer_main' on a background thread.
+static b8 _sp_platform_log_thread_start(void);
+static void _sp_platform_log_thread_join(void);
+static void _sp_log_writer_main(void);
+// Block the writer thread until '_sp_platform_log_wake' is called. A wake
+// that comes before the wait isn't lost, the wait returns right away.
+static void _sp_platform_log_wait(void);
+static void _sp_platform_log_wake(void);
+static void _sp_platform_sleep_ms(u32 ms);
+static void _sp_platform_yield(void);
+// Fill 'buffer' with random bytes from the OS. Works without 'sp_init'.
+static b8 _sp_platform_random(void* buffer, u64 size);
+
+typedef struct _SP_TestOutcome _SP_TestOutcome;
+// Run every test of 'suite' in worker processes, writing one outcome per test
+// in suite order. Returns false if isolation isn't supported or the workers
+// couldn't be started. Tests not run because the workers stopped later on
+// fail.
+static b8 _sp_platform_test_run_isolated(SP_TestSuite* suite, SP_TestConfig config, _SP_TestOutcome* outcomes);
+
+typedef struct _SP_ArenaProfileEntry _SP_ArenaProfileEntry;
+struct _SP_ArenaProfileEntry {
+    SP_Str tag;
+    u64 peak_usage;
+    // Has an arena with this tag reported its peak usage during this run?
+    b8 recorded;
+};
+
+typedef struct _SP_ProfBuffer _SP_ProfBuffer;
+typedef struct _SP_LogRing _SP_LogRing;
 
 typedef struct _SP_State _SP_State;
 struct _SP_State {
     SP_Config cfg;
     _SP_PlatformState *platform;
-    SP_ThreadCtx* main_ctx;
+
+    struct {
+        u64 start_ns;
+        u64 start_cycles;
+        // Calibrated lazily.
+        u64 cycle_frequency;
+    } clock;
+
+    struct {
+        SP_ThreadCtx* first;
+        SP_ThreadCtx* last;
+        // Contexts of exited threads, ready to be reused.
+        SP_ThreadCtx* free_list;
+    } thread_ctxs;
 
     struct {
         SP_Arena* first;
         SP_Arena* last;
         u32 curr_id;
     } arenas;
+
+    struct {
+        _SP_ArenaProfileEntry* entries;
+        u32 count;
+        u32 capacity;
+    } arena_profile;
+
+    struct {
+        // Reserve, commit, decommit and release calls. Updated atomically.
+        u64 memory_calls;
+    } os;
+
+    struct {
+        // Output of synchronous logging when a path is set.
+        FILE* file;
+        // The rest is only used by asynchronous and binary logging.
+        b8 async;
+        b8 binary;
+        SP_Arena* arena;
+        // Ring buffers, newest first. Each belongs to a thread context and is
+        // reused along with it. Never removed before 'sp_terminate'.
+        _SP_LogRing* rings;
+        _SP_LogRing* binary_rings;
+        i64 handle;
+        i64 binary_handle;
+        // Binary log callsites handed an id so far.
+        u64 callsite_count;
+        // Cleared to stop the writer thread.
+        volatile u64 running;
+        // Set while the writer is about to wait or waiting for lines.
+        volatile u64 sleeping;
+        // Dropped lines the writer has already reported.
+        u64 dropped_reported;
+    } log;
+
+    struct {
+        // Threads that have recorded into a histogram. Updated atomically.
+        u64 thread_count;
+    } histogram;
+
+    struct {
+        // Only created when built with SP_PROFILE.
+        SP_Arena* arena;
+        // Event buffers, newest first. Each belongs to a thread context and is
+        // reused along with it. Never removed before 'sp_terminate'.
+        _SP_ProfBuffer* buffers;
+        u32 thread_count;
+    } prof;
 };
 
 static _SP_State _sp_state = {0};
 
+static void _sp_arena_profile_load(void);
+static void _sp_arena_profile_save(void);
+static void _sp_prof_terminate(void);
+static b8 _sp_log_init(void);
+static void _sp_log_terminate(void);
+
 static SP_Config _config_set_defaults(SP_Config config) {
     if (config.default_arena_desc.block_size == 0) {
         if (config.default_arena_desc.virtual_memory) {
@@ -36,6 +162,30 @@ static SP_Config _config_set_defaults(SP_Config config) {
         config.default_arena_desc.alignment = sizeof(void*);
     }
 
+    if (config.scratch.arena_count == 0) {
+        config.scratch.arena_count = 2;
+    }
+
+    if (config.scratch.arena_size == 0) {
+        config.scratch.arena_size = config.default_arena_desc.block_size;
+    }
+
+    if (config.scratch.retain_size == 0) {
+        config.scratch.retain_size = sp_mib(1);
+    }
+
+    if (config.arena_profile.path == NULL) {
+        config.arena_profile.path = "spire_arena_profile.txt";
+    }
+
+    if (config.logging.buffer_size == 0) {
+        config.logging.buffer_size = 64 << 10;
+    }
+
+    if (config.profiler.events_per_thread == 0) {
+        config.profiler.events_per_thread = 65536;
+    }
+
     return config;
 }
 
@@ -44,32 +194,254 @@ b8 sp_init(SP_Config config) {
         return false;
     }
     _sp_state.cfg = _config_set_defaults(config);
-    _sp_state.main_ctx = sp_thread_ctx_create();
-    sp_thread_ctx_set(_sp_state.main_ctx);
+    _sp_state.clock.start_ns = sp_os_get_time_ns();
+    _sp_state.clock.start_cycles = sp_os_get_cycles();
+    _sp_state.clock.cycle_frequency = 0;
+    if (_sp_state.cfg.arena_profile.enabled) {
+        _sp_arena_profile_load();
+    }
+#ifdef SP_PROFILE
+    // Created up front since creating an arena takes the platform lock, which
+    // is held while handing out event buffers.
+    _sp_state.prof.arena = sp_arena_create();
+    sp_arena_tag(_sp_state.prof.arena, sp_str_lit("profiler"));
+#endif
+    if (!sp_log_set_level(_sp_state.cfg.logging.level) || !_sp_log_init()) {
+        return false;
+    }
     return true;
 }
 
 b8 sp_terminate(void) {
+    if (_sp_state.cfg.arena_profile.enabled) {
+        _sp_arena_profile_save();
+    }
+    // Stopped first since the writer thread hands its context back on exit.
+    _sp_log_terminate();
+    sp_thread_ctx_set(NULL);
+    while (_sp_state.thread_ctxs.first != NULL) {
+        sp_thread_ctx_destroy(_sp_state.thread_ctxs.first);
+    }
+    _sp_state.thread_ctxs.free_list = NULL;
+    _sp_prof_terminate();
     if (!_sp_platform_termiante()) {
         return false;
     }
-    sp_thread_ctx_set(NULL);
-    sp_thread_ctx_destroy(_sp_state.main_ctx);
     return true;
 }
 
 // -- Utils --------------------------------------------------------------------
 
-u64 sp_fvn1a_hash(const void* data, u64 len) {
+u64 sp_fvn1a_hash(const void* data, u64 len, u64 seed) {
     const u8* _data = data;
-    u64 hash = 2166136261u;
+    u64 hash = 14695981039346656037ull ^ seed;
     for (u64 i = 0; i < len; i++) {
         hash ^= *(_data + i);
-        hash *= 16777619;
+        hash *= 1099511628211ull;
     }
     return hash;
 }
 
+// See '_SP_HASH_SECRET_0'.
+static const u64 _sp_wyp[4] = {
+    _SP_HASH_SECRET_0,
+    _SP_HASH_SECRET_1,
+    _SP_HASH_SECRET_2,
+    _SP_HASH_SECRET_3,
+};
+
+static inline u64 _sp_wymix(u64 a, u64 b) {
+    u64 high;
+    u64 low = sp_mul_u128(a, b, &high);
+    return low ^ high;
+}
+
+static inline u64 _sp_wyr8(const u8* p) {
+    u64 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline u64 _sp_wyr4(const u8* p) {
+    u32 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// 1 to 3 bytes.
+static inline u64 _sp_wyr3(const u8* p, u64 len) {
+    return ((u64) p[0] << 16) | ((u64) p[len >> 1] << 8) | p[len - 1];
+}
+
+u64 sp_hash_bytes(const void* data, u64 len, u64 seed) {
+    const u8* p = data;
+    seed ^= _sp_wymix(seed ^ _sp_wyp[0], _sp_wyp[1]);
+    u64 a, b;
+    if (len <= 16) {
+        if (len >= 4) {
+            u64 mid = (len >> 3) << 2;
+            a = (_sp_wyr4(p) << 32) | _sp_wyr4(p + mid);
+            b = (_sp_wyr4(p + len - 4) << 32) | _sp_wyr4(p + len - 4 - mid);
+        } else if (len > 0) {
+            a = _sp_wyr3(p, len);
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        u64 i = len;
+        if (i > 48) {
+            u64 see1 = seed, see2 = seed;
+            do {
+                seed = _sp_wymix(_sp_wyr8(p) ^ _sp_wyp[1], _sp_wyr8(p + 8) ^ seed);
+                see1 = _sp_wymix(_sp_wyr8(p + 16) ^ _sp_wyp[2], _sp_wyr8(p + 24) ^ see1);
+                see2 = _sp_wymix(_sp_wyr8(p + 32) ^ _sp_wyp[3], _sp_wyr8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = _sp_wymix(_sp_wyr8(p) ^ _sp_wyp[1], _sp_wyr8(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        a = _sp_wyr8(p + i - 16);
+        b = _sp_wyr8(p + i - 8);
+    }
+    a = sp_mul_u128(a ^ _sp_wyp[1], b ^ seed, &b);
+    return _sp_wymix(a ^ _sp_wyp[0] ^ len, b ^ _sp_wyp[1]);
+}
+
+u64 sp_hash_u32(const void* data, u64 len, u64 seed) {
+    (void) len;
+    return sp_hash_int(_sp_wyr4(data), seed);
+}
+
+u64 sp_hash_u64(const void* data, u64 len, u64 seed) {
+    (void) len;
+    return sp_hash_int(_sp_wyr8(data), seed);
+}
+
+static u32 _sp_next_pow2(u32 value) {
+    // Anything larger would wrap around to 0 and never end the loop.
+    sp_ensure(value <= 1u << 31, "Value too big to round up to a power of two.");
+    u32 pow2 = 1;
+    while (pow2 < value) {
+        pow2 <<= 1;
+    }
+    return pow2;
+}
+
+// Index of the highest set bit. 'value' must not be 0.
+static inline u32 _sp_msb_u64(u64 value) {
+#ifdef SP_COMP_MSVC
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return index;
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+}
+
+// Index of the lowest set bit. 'value' must not be 0.
+static inline u32 _sp_lsb_u32(u32 value) {
+#ifdef SP_COMP_MSVC
+    unsigned long index;
+    _BitScanForward(&index, value);
+    return index;
+#else
+    return __builtin_ctz(value);
+#endif
+}
+
+// Counters only need relaxed adds. Loads acquire and stores release so data
+// written before a store is visible to whoever loads the stored value.
+static inline u64 _sp_atomic_add_u64(volatile u64* ptr, u64 value) {
+#ifdef SP_COMP_MSVC
+    return _InterlockedExchangeAdd64((volatile i64*) ptr, value);
+#else
+    return __atomic_fetch_add(ptr, value, __ATOMIC_RELAXED);
+#endif
+}
+
+static inline u64 _sp_atomic_load_u64(volatile u64* ptr) {
+#ifdef SP_COMP_MSVC
+    return _InterlockedOr64((volatile i64*) ptr, 0);
+#else
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#endif
+}
+
+// Replace '*ptr' with 'desired' if it's still 'expected'. Returns true if it
+// was replaced.
+static inline b8 _sp_atomic_cas_u64(volatile u64* ptr, u64 expected, u64 desired) {
+#ifdef SP_COMP_MSVC
+    return (u64) _InterlockedCompareExchange64((volatile i64*) ptr, desired, expected) == expected;
+#else
+    return __atomic_compare_exchange_n(ptr, &expected, desired, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+#endif
+}
+
+static inline void _sp_atomic_store_u64(volatile u64* ptr, u64 value) {
+#ifdef SP_COMP_MSVC
+    _InterlockedExchange64((volatile i64*) ptr, value);
+#else
+    __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+#endif
+}
+
+static inline u32 _sp_atomic_load_u32(volatile u32* ptr) {
+#ifdef SP_COMP_MSVC
+    return _InterlockedOr((volatile long*) ptr, 0);
+#else
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static inline void _sp_atomic_store_u32(volatile u32* ptr, u32 value) {
+#ifdef SP_COMP_MSVC
+    _InterlockedExchange((volatile long*) ptr, value);
+#else
+    __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+#endif
+}
+
+// Keep stores before the fence from moving past loads after it. The
+// interlocked operations used with MSVC are full barriers already.
+static inline void _sp_atomic_fence(void) {
+#ifdef SP_COMP_MSVC
+    _ReadWriteBarrier();
+#else
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#endif
+}
+
+// Random bits drawn from the OS for the first seed, 0 until then. Every seed
+// mixes it with a count of the seeds handed out, so no two are the same and
+// none can be predicted without the secret.
+static volatile u64 _sp_hash_secret = 0;
+static volatile u64 _sp_hash_seed_count = 0;
+
+u64 sp_hash_random_seed(const void* salt) {
+    u64 secret = _sp_atomic_load_u64(&_sp_hash_secret);
+    if (secret == 0) {
+        // Only if the OS has no randomness to give, which is as weak as it
+        // gets but still differs between runs.
+        if (!_sp_platform_random(&secret, sizeof(secret))) {
+            secret = sp_hash_int(sp_os_get_cycles(), (u64) (uintptr_t) &secret);
+        }
+        secret = secret != 0 ? secret : 1;
+        // Threads racing here all draw one, the first stored is kept.
+        _sp_atomic_cas_u64(&_sp_hash_secret, 0, secret);
+        secret = _sp_atomic_load_u64(&_sp_hash_secret);
+    }
+
+    u64 count = _sp_atomic_add_u64(&_sp_hash_seed_count, 1);
+    u64 seed = sp_hash_int((u64) (uintptr_t) salt, sp_hash_int(count, secret));
+    return seed != 0 ? seed : 1;
+}
+
 // -- Allocator interface ------------------------------------------------------
 
 SP_Allocator sp_libc_allocator(void) {
@@ -81,8 +453,16 @@ SP_Allocator sp_libc_allocator(void) {
     };
 }
 
+static SP_THREAD_LOCAL SP_AllocStats _sp_alloc_stats = {0};
+
+SP_AllocStats sp_get_thread_alloc_stats(void) {
+    return _sp_alloc_stats;
+}
+
 void* _sp_libc_alloc_stub(u64 size, void* userdata) {
     (void) userdata;
+    _sp_alloc_stats.heap_allocs++;
+    _sp_alloc_stats.heap_bytes += size;
     return malloc(size);
 }
 
@@ -95,6 +475,8 @@ void _sp_libc_free_stub(void* ptr, u64 size, void* userdata) {
 void* _sp_libc_realloc_stub(void* ptr, u64 old_size, u64 new_size, void* userdata) {
     (void) userdata;
     (void) old_size;
+    _sp_alloc_stats.heap_allocs++;
+    _sp_alloc_stats.heap_bytes += new_size;
     return realloc(ptr, new_size);
 }
 
@@ -145,6 +527,12 @@ struct SP_Arena {
     _SP_ArenaBlock* last_block;
     // Current 'index' of the chain.
     u32 chain_index;
+    // Popping never decommits the first block below this many bytes. Set when
+    // the arena gets presized from a profile.
+    u64 min_commit;
+    // Pops don't decommit memory, '_sp_arena_decommit' has to be called
+    // instead. Used by scratch arenas to avoid commit churn while in use.
+    b8 deferred_decommit;
 
     // Metrics
     SP_Str tag;
@@ -163,8 +551,6 @@ SP_Arena* sp_arena_create_configurable(SP_ArenaDesc desc) {
     _SP_ArenaBlock* block = _sp_arena_block_alloc(desc.block_size, desc.virtual_memory);
     SP_Arena* arena = (SP_Arena*) block->memory;
     *arena = (SP_Arena) {
-        .prev = _sp_state.arenas.last,
-        .id = _sp_state.arenas.curr_id++,
         .desc = desc,
         .chain_index = 0,
         .pos = _align_value(sizeof(SP_Arena), desc.alignment),
@@ -173,26 +559,31 @@ SP_Arena* sp_arena_create_configurable(SP_ArenaDesc desc) {
         .last_block = block,
     };
 
-    if (_sp_state.arenas.first == NULL) {
-        _sp_state.arenas.first = arena;
-        _sp_state.arenas.last = arena;
-    }
-
-    _sp_state.arenas.last->next = arena;
-    _sp_state.arenas.last = arena;
+    _sp_platform_lock();
+    arena->id = _sp_state.arenas.curr_id++;
+    sp_dll_push_back(_sp_state.arenas.first, _sp_state.arenas.last, arena);
+    _sp_platform_unlock();
 
     return arena;
 }
 
+static void _sp_arena_profile_record(const SP_Arena* arena);
+
 void sp_arena_destroy(SP_Arena* arena) {
-    if (arena->prev != NULL) {
-        arena->prev->next = arena->next;
+    _sp_platform_lock();
+    if (_sp_state.cfg.arena_profile.enabled) {
+        _sp_arena_profile_record(arena);
     }
-    if (arena->next != NULL) {
-        arena->next->prev = arena->prev;
+    sp_dll_remove(_sp_state.arenas.first, _sp_state.arenas.last, arena);
+    _sp_platform_unlock();
+
+    // Chained blocks first, the arena itself lives in the first block.
+    while (arena->last_block != arena->first_block) {
+        _SP_ArenaBlock* last = arena->last_block;
+        arena->last_block = last->prev;
+        _sp_arena_block_dealloc(last, arena->desc.block_size);
     }
-
-    sp_os_release_memory(arena, arena->desc.block_size);
+    _sp_arena_block_dealloc(arena->first_block, arena->desc.block_size);
 }
 
 SP_Allocator sp_arena_allocator(SP_Arena* arena) {
@@ -223,6 +614,8 @@ void* sp_arena_push_no_zero(SP_Arena* arena, u64 size) {
     arena->peak_usage = sp_max(arena->peak_usage, arena->pos);
     arena->total_pushed_bytes += aligned_size;
     arena->push_operations++;
+    _sp_alloc_stats.arena_pushes++;
+    _sp_alloc_stats.arena_bytes += aligned_size;
 
     if (arena->pos > (arena->chain_index + 1) * arena->desc.block_size) {
         // Crash on OOM if we can't grow.
@@ -230,13 +623,18 @@ void* sp_arena_push_no_zero(SP_Arena* arena, u64 size) {
             sp_ensure(false, "Arena is out of memory.");
         }
 
-        _SP_ArenaBlock* block = _sp_arena_block_alloc(arena->desc.block_size, arena->desc.block_size);
+        sp_prof_zone_begin("sp_arena_grow");
+        _SP_ArenaBlock* block = _sp_arena_block_alloc(arena->desc.block_size, arena->desc.virtual_memory);
+        sp_prof_zone_end();
         block->prev = arena->last_block;
         arena->last_block->next = block;
         arena->last_block = block;
 
         arena->chain_index++;
         start_pos = arena->chain_index * arena->desc.block_size;
+        // The allocation starts over at the beginning of the new block.
+        arena->pos = start_pos + aligned_size;
+        arena->peak_usage = sp_max(arena->peak_usage, arena->pos);
     }
 
     _SP_ArenaBlock* block = arena->last_block;
@@ -248,7 +646,9 @@ void* sp_arena_push_no_zero(SP_Arena* arena, u64 size) {
         u64 page_aligned_pos = _align_value(block_pos_end + sizeof(_SP_ArenaBlock), sp_os_get_page_size());
         if (page_aligned_pos > block->commit) {
             block->commit = page_aligned_pos;
+            sp_prof_zone_begin("sp_arena_commit");
             sp_os_commit_memory(block, page_aligned_pos);
+            sp_prof_zone_end();
         }
     }
 
@@ -257,6 +657,28 @@ void* sp_arena_push_no_zero(SP_Arena* arena, u64 size) {
     return memory;
 }
 
+// Decommit the memory of the last block above 'keep' bytes. Memory below the
+// arena position or 'min_commit' is always kept.
+static void _sp_arena_decommit(SP_Arena* arena, u64 keep) {
+    if (!arena->desc.virtual_memory) {
+        return;
+    }
+
+    _SP_ArenaBlock* block = arena->last_block;
+    u64 block_pos = arena->pos - arena->chain_index * arena->desc.block_size;
+    // Add the size of a block since that also resides on the same allocated
+    // memory region.
+    u64 page_aligned_pos = _align_value(sp_max(block_pos + sizeof(_SP_ArenaBlock), keep), sp_os_get_page_size());
+    if (arena->chain_index == 0) {
+        page_aligned_pos = sp_max(page_aligned_pos, arena->min_commit);
+    }
+    if (page_aligned_pos < block->commit) {
+        u64 unused_size = block->commit - page_aligned_pos;
+        sp_os_decommit_memory((u8*) block + page_aligned_pos, unused_size);
+        block->commit = page_aligned_pos;
+    }
+}
+
 void sp_arena_pop(SP_Arena* arena, u64 size) {
     sp_assert(arena->pos >= size, "Popping more than what has been allocated.");
     sp_arena_pop_to(arena, arena->pos - size);
@@ -281,17 +703,8 @@ void sp_arena_pop_to(SP_Arena* arena, u64 pos) {
         }
     }
 
-    if (arena->desc.virtual_memory) {
-        _SP_ArenaBlock* block = arena->last_block;
-        u64 block_pos = arena->pos - arena->chain_index * arena->desc.block_size;
-        // Add the size of a block since that also resides on the same allocated
-        // memory region.
-        u64 page_aligned_pos = _align_value(block_pos + sizeof(_SP_ArenaBlock), sp_os_get_page_size());
-        if (page_aligned_pos < block->commit) {
-            u64 unused_size = block->commit - page_aligned_pos;
-            sp_os_decommit_memory((u8*) block + page_aligned_pos, unused_size);
-            block->commit = page_aligned_pos;
-        }
+    if (!arena->deferred_decommit) {
+        _sp_arena_decommit(arena, 0);
     }
 }
 
@@ -336,11 +749,37 @@ void sp_temp_end(SP_Temp temp) {
     sp_arena_pop_to(temp.arena, temp.pos);
 }
 
+static void _sp_arena_presize(SP_Arena* arena, u64 size);
+static _SP_ArenaProfileEntry* _sp_arena_profile_find(SP_Str tag);
+
 void sp_arena_tag(SP_Arena* arena, SP_Str tag) {
     arena->tag = tag;
+
+    if (_sp_state.cfg.arena_profile.enabled) {
+        _sp_platform_lock();
+        _SP_ArenaProfileEntry* entry = _sp_arena_profile_find(tag);
+        u64 peak_usage = entry != NULL ? entry->peak_usage : 0;
+        _sp_platform_unlock();
+        if (peak_usage != 0) {
+            _sp_arena_presize(arena, peak_usage);
+        }
+    }
 }
 
 SP_ArenaMetrics sp_arena_get_metrics(const SP_Arena* arena) {
+    u64 block_size = arena->desc.block_size + sizeof(_SP_ArenaBlock);
+    u64 reserved = 0;
+    u64 committed = 0;
+    u64 resident = 0;
+    for (const _SP_ArenaBlock* block = arena->first_block; block != NULL; block = block->next) {
+        // Only committed memory can be resident, so there's no need to ask the
+        // OS about the rest of the reservation.
+        u64 block_committed = arena->desc.virtual_memory ? block->commit : block_size;
+        reserved += block_size;
+        committed += block_committed;
+        resident += sp_os_get_resident_memory(block, block_committed);
+    }
+
     return (SP_ArenaMetrics) {
         .id = arena->id,
         .tag = arena->tag,
@@ -350,6 +789,9 @@ SP_ArenaMetrics sp_arena_get_metrics(const SP_Arena* arena) {
         .pop_operations = arena->pop_operations,
         .total_pushed_bytes = arena->total_pushed_bytes,
         .total_popped_bytes = arena->total_popped_bytes,
+        .reserved_bytes = reserved,
+        .committed_bytes = committed,
+        .resident_bytes = resident,
     };
 }
 
@@ -365,9 +807,20 @@ static void print_arena_metrics(SP_ArenaMetrics metrics) {
     sp_info("    Number of pop operations     %llu", metrics.pop_operations);
     sp_info("    Total bytes pushed           %llu bytes", metrics.total_pushed_bytes);
     sp_info("    Total bytes popped           %llu bytes", metrics.total_popped_bytes);
+    sp_info("    Reserved                     %llu bytes", metrics.reserved_bytes);
+    sp_info("    Committed                    %llu bytes", metrics.committed_bytes);
+    sp_info("    Resident                     %llu bytes", metrics.resident_bytes);
 }
 
 void sp_dump_arena_metrics(void) {
+    SP_ProcessMemory memory = sp_os_get_process_memory();
+    sp_info("Process");
+    sp_info("    Resident                     %llu bytes", memory.resident);
+    sp_info("    Peak resident                %llu bytes", memory.peak_resident);
+    sp_info("    Minor page faults            %llu", memory.minor_faults);
+    sp_info("    Major page faults            %llu", memory.major_faults);
+    sp_info("    Memory system calls          %llu", memory.memory_calls);
+
     SP_Arena* curr = _sp_state.arenas.first;
     while (curr != NULL) {
         print_arena_metrics(sp_arena_get_metrics(curr));
@@ -375,1577 +828,6176 @@ void sp_dump_arena_metrics(void) {
     }
 }
 
+// -- Arena profile ------------------------------------------------------------
+// Profile file format, one arena tag per line:
+// <peak usage in bytes> <tag>
+
+static void _sp_arena_presize(SP_Arena* arena, u64 size) {
+    // Only the first block is presized, it's the one every run starts with.
+    if (arena->chain_index != 0) {
+        return;
+    }
+
+    _SP_ArenaBlock* block = arena->first_block;
+    u64 page_size = sp_os_get_page_size();
+    u64 commit = _align_value(sp_min(size, arena->desc.block_size) + sizeof(_SP_ArenaBlock), page_size);
+    if (arena->desc.virtual_memory && commit > block->commit) {
+        sp_os_commit_memory(block, commit);
+        block->commit = commit;
+    }
+    arena->min_commit = commit;
+
+    // Touch every page past the arena position so the page faults happen now
+    // instead of during the first pushes. Memory below the position is in use
+    // and has already been faulted in.
+    volatile u8* memory = (volatile u8*) block;
+    u64 offset = arena->pos + sizeof(_SP_ArenaBlock);
+    while (offset < commit) {
+        memory[offset] = 0;
+        offset = _align_value(offset + 1, page_size);
+    }
+}
+
+static _SP_ArenaProfileEntry* _sp_arena_profile_find(SP_Str tag) {
+    for (u32 i = 0; i < _sp_state.arena_profile.count; i++) {
+        if (sp_str_equal(_sp_state.arena_profile.entries[i].tag, tag)) {
+            return &_sp_state.arena_profile.entries[i];
+        }
+    }
+    return NULL;
+}
+
+static _SP_ArenaProfileEntry* _sp_arena_profile_add(SP_Str tag) {
+    SP_Allocator allocator = sp_libc_allocator();
+    if (_sp_state.arena_profile.count == _sp_state.arena_profile.capacity) {
+        u32 new_capacity = sp_max(_sp_state.arena_profile.capacity * 2, 16);
+        _sp_state.arena_profile.entries = sp_realloc(allocator,
+                _sp_state.arena_profile.entries,
+                _sp_state.arena_profile.capacity * sizeof(_SP_ArenaProfileEntry),
+                new_capacity * sizeof(_SP_ArenaProfileEntry));
+        _sp_state.arena_profile.capacity = new_capacity;
+    }
+
+    // The tag is copied since it might live on the arena it's tagging.
+    u8* tag_data = sp_alloc(allocator, tag.len);
+    memcpy(tag_data, tag.data, tag.len);
+
+    _SP_ArenaProfileEntry* entry = &_sp_state.arena_profile.entries[_sp_state.arena_profile.count++];
+    *entry = (_SP_ArenaProfileEntry) {
+        .tag = sp_str(tag_data, tag.len),
+    };
+    return entry;
+}
+
+static void _sp_arena_profile_record(const SP_Arena* arena) {
+    if (arena->tag.len == 0) {
+        return;
+    }
+
+    _SP_ArenaProfileEntry* entry = _sp_arena_profile_find(arena->tag);
+    if (entry == NULL) {
+        entry = _sp_arena_profile_add(arena->tag);
+    }
+
+    // Several arenas can share a tag, keep the largest one from this run.
+    // Entries from previous runs are replaced so the profile can shrink.
+    if (entry->recorded) {
+        entry->peak_usage = sp_max(entry->peak_usage, arena->peak_usage);
+    } else {
+        entry->peak_usage = arena->peak_usage;
+        entry->recorded = true;
+    }
+}
+
+static void _sp_arena_profile_load(void) {
+    FILE* file = fopen(_sp_state.cfg.arena_profile.path, "rb");
+    if (file == NULL) {
+        return;
+    }
+
+    // Tags can be any length, the buffer grows to fit the longest one.
+    SP_Allocator allocator = sp_libc_allocator();
+    u32 capacity = 256;
+    u8* tag = sp_alloc(allocator, capacity);
+    unsigned long long peak_usage;
+    while (fscanf(file, "%llu ", &peak_usage) == 1) {
+        u32 len = 0;
+        i32 c;
+        while ((c = fgetc(file)) != EOF && c != '\n') {
+            if (len == capacity) {
+                tag = sp_realloc(allocator, tag, capacity, capacity * 2);
+                capacity *= 2;
+            }
+            tag[len++] = c;
+        }
+        if (len == 0) {
+            continue;
+        }
+
+        SP_Str tag_str = sp_str(tag, len);
+        _SP_ArenaProfileEntry* entry = _sp_arena_profile_find(tag_str);
+        if (entry == NULL) {
+            entry = _sp_arena_profile_add(tag_str);
+        }
+        entry->peak_usage = peak_usage;
+    }
+
+    sp_free(allocator, tag, capacity);
+    fclose(file);
+}
+
+static void _sp_arena_profile_save(void) {
+    SP_Arena* curr = _sp_state.arenas.first;
+    while (curr != NULL) {
+        _sp_arena_profile_record(curr);
+        curr = curr->next;
+    }
+
+    FILE* file = fopen(_sp_state.cfg.arena_profile.path, "wb");
+    if (file == NULL) {
+        sp_warn("Failed to write arena profile to '%s'.", _sp_state.cfg.arena_profile.path);
+    }
+
+    SP_Allocator allocator = sp_libc_allocator();
+    for (u32 i = 0; i < _sp_state.arena_profile.count; i++) {
+        _SP_ArenaProfileEntry entry = _sp_state.arena_profile.entries[i];
+        if (file != NULL) {
+            fprintf(file, "%llu %.*s\n", (unsigned long long) entry.peak_usage, entry.tag.len, entry.tag.data);
+        }
+        sp_free(allocator, (u8*) entry.tag.data, entry.tag.len);
+    }
+    sp_free(allocator,
+            _sp_state.arena_profile.entries,
+            _sp_state.arena_profile.capacity * sizeof(_SP_ArenaProfileEntry));
+    _sp_state.arena_profile.entries = NULL;
+    _sp_state.arena_profile.count = 0;
+    _sp_state.arena_profile.capacity = 0;
+
+    if (file != NULL) {
+        fclose(file);
+    }
+
+    // Arenas destroyed after this point aren't part of the profile.
+    _sp_state.cfg.arena_profile.enabled = false;
+}
+
 // -- Thread context -----------------------------------------------------------
 
-#define SCRATCH_ARENA_COUNT 2
+typedef struct _SP_ScratchSlot _SP_ScratchSlot;
+struct _SP_ScratchSlot {
+    // Created on first use.
+    SP_Arena* arena;
+    // Position right after the arena's own allocations, like its tag.
+    u64 base;
+    // Number of scratch scopes currently open on this arena.
+    u32 active;
+    // Value of the context tick when this arena was last handed out.
+    u64 last_used;
+};
 
 struct SP_ThreadCtx {
-    SP_Arena *scratch_arenas[SCRATCH_ARENA_COUNT];
+    SP_ThreadCtx* next;
+    SP_ThreadCtx* prev;
+    // Next context in the reuse pool.
+    SP_ThreadCtx* next_free;
+
+    // Counters are per thread, so they're closed when the thread exits and
+    // opened again by the next thread using this context.
+    b8 perf_opened;
+    i64 perf_handles[SP_PERF_COUNTER_COUNT];
+
+    // Profiler events of the threads using this context. It stays with the
+    // context when it's recycled, so threads coming and going don't grow the
+    // profiler arena.
+    _SP_ProfBuffer* prof_buffer;
+    // Log rings, kept with the context for the same reason.
+    _SP_LogRing* log_ring;
+    _SP_LogRing* log_binary_ring;
+
+    u64 scratch_tick;
+    u32 scratch_count;
+    _SP_ScratchSlot scratch[];
 };
 
 SP_THREAD_LOCAL SP_ThreadCtx* _sp_thread_ctx = NULL;
 
 SP_ThreadCtx* sp_thread_ctx_create(void) {
-    SP_Arena* scratch_arenas[SCRATCH_ARENA_COUNT] = {0};
-    for (u32 i = 0; i < SCRATCH_ARENA_COUNT; i++) {
-        scratch_arenas[i] = sp_arena_create();
-        sp_arena_tag(scratch_arenas[i], sp_str_pushf(sp_arena_allocator(scratch_arenas[i]), "scratch-%u", i));
-    }
+    u32 count = _sp_state.cfg.scratch.arena_count;
+    u64 size = sizeof(SP_ThreadCtx) + count * sizeof(_SP_ScratchSlot);
+    SP_ThreadCtx* ctx = sp_alloc(sp_libc_allocator(), size);
+    memset(ctx, 0, size);
+    ctx->scratch_count = count;
 
-    SP_ThreadCtx* ctx = sp_arena_push(scratch_arenas[0], sizeof(SP_ThreadCtx));
-    for (u32 i = 0; i < SCRATCH_ARENA_COUNT; i++) {
-        ctx->scratch_arenas[i] = scratch_arenas[i];
-    }
+    _sp_platform_lock();
+    sp_dll_push_back(_sp_state.thread_ctxs.first, _sp_state.thread_ctxs.last, ctx);
+    _sp_platform_unlock();
 
     return ctx;
 }
 
 void sp_thread_ctx_destroy(SP_ThreadCtx* ctx) {
-    // Destroy the arenas in reverse order since the thread context lives on
-    // the first arena.
-    for (i32 i = sp_arrlen(ctx->scratch_arenas) - 1; i >= 0; i--) {
-        sp_arena_destroy(ctx->scratch_arenas[i]);
+    for (u32 i = 0; i < ctx->scratch_count; i++) {
+        if (ctx->scratch[i].arena != NULL) {
+            sp_arena_destroy(ctx->scratch[i].arena);
+        }
     }
+
+    if (ctx->perf_opened) {
+        _sp_platform_perf_close(ctx->perf_handles);
+    }
+
+    _sp_platform_lock();
+    sp_dll_remove(_sp_state.thread_ctxs.first, _sp_state.thread_ctxs.last, ctx);
+    _sp_platform_unlock();
+
+    sp_free(sp_libc_allocator(), ctx, sizeof(SP_ThreadCtx) + ctx->scratch_count * sizeof(_SP_ScratchSlot));
 }
 
 void sp_thread_ctx_set(SP_ThreadCtx* ctx) {
     _sp_thread_ctx = ctx;
 }
 
-// -- Scratch arena ------------------------------------------------------------
+// Called by the platform layer when a thread with an automatically created
+// context exits.
+static void _sp_thread_ctx_release(SP_ThreadCtx* ctx) {
+    for (u32 i = 0; i < ctx->scratch_count; i++) {
+        _SP_ScratchSlot* slot = &ctx->scratch[i];
+        if (slot->arena != NULL) {
+            sp_arena_pop_to(slot->arena, slot->base);
+            _sp_arena_decommit(slot->arena, _sp_state.cfg.scratch.retain_size);
+            slot->active = 0;
+        }
+    }
 
-static SP_Arena* get_non_conflicting_scratch_arena(SP_Arena* const* conflicts, u32 count) {
-    if (_sp_thread_ctx == NULL) {
-        return NULL;
+    if (ctx->perf_opened) {
+        _sp_platform_perf_close(ctx->perf_handles);
+        ctx->perf_opened = false;
     }
 
-    if (count == 0) {
-        return _sp_thread_ctx->scratch_arenas[0];
+    _sp_platform_lock();
+    ctx->next_free = _sp_state.thread_ctxs.free_list;
+    _sp_state.thread_ctxs.free_list = ctx;
+    _sp_platform_unlock();
+}
+
+// Get the context of the calling thread, creating or reusing one if the thread
+// doesn't have one yet.
+static SP_ThreadCtx* _sp_thread_ctx_get(void) {
+    if (_sp_thread_ctx != NULL) {
+        return _sp_thread_ctx;
+    }
+
+    _sp_platform_lock();
+    SP_ThreadCtx* ctx = _sp_state.thread_ctxs.free_list;
+    if (ctx != NULL) {
+        _sp_state.thread_ctxs.free_list = ctx->next_free;
+        ctx->next_free = NULL;
     }
+    _sp_platform_unlock();
+
+    if (ctx == NULL) {
+        ctx = sp_thread_ctx_create();
+    }
+
+    _sp_platform_thread_ctx_register(ctx);
+    sp_thread_ctx_set(ctx);
+    return ctx;
+}
+
+static SP_Arena* _sp_thread_ctx_get_scratch_arena(SP_ThreadCtx* ctx, u32 index) {
+    _SP_ScratchSlot* slot = &ctx->scratch[index];
+    if (slot->arena == NULL) {
+        SP_ArenaDesc desc = _sp_state.cfg.default_arena_desc;
+        desc.block_size = _sp_state.cfg.scratch.arena_size;
+        slot->arena = sp_arena_create_configurable(desc);
+        slot->arena->deferred_decommit = true;
+        sp_arena_tag(slot->arena, sp_str_pushf(sp_arena_allocator(slot->arena), "scratch-%u", index));
+        slot->base = sp_arena_get_pos(slot->arena);
+    }
+    return slot->arena;
+}
 
+// -- Scratch arena ------------------------------------------------------------
+
+static b8 _sp_scratch_is_conflicting(SP_Arena* arena, SP_Arena* const* conflicts, u32 count) {
     for (u32 i = 0; i < count; i++) {
-        for (u32 j = 0; j < sp_arrlen(_sp_thread_ctx->scratch_arenas); j++) {
-            if (conflicts[i] != _sp_thread_ctx->scratch_arenas[j]) {
-                return _sp_thread_ctx->scratch_arenas[j];
+        if (conflicts[i] == arena) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Pick a scratch arena not in 'conflicts', in order of preference:
+// 1. The least recently used idle arena.
+// 2. An arena that hasn't been created yet.
+// 3. The least recently used arena that is still in use further up the stack.
+// Returns ~0u if every arena conflicts.
+static u32 _sp_scratch_pick(SP_ThreadCtx* ctx, SP_Arena* const* conflicts, u32 count) {
+    u32 idle = ~0u;
+    u32 unused = ~0u;
+    u32 active = ~0u;
+    for (u32 i = 0; i < ctx->scratch_count; i++) {
+        _SP_ScratchSlot* slot = &ctx->scratch[i];
+        if (slot->arena == NULL) {
+            if (unused == ~0u) {
+                unused = i;
             }
+            continue;
+        }
+
+        if (_sp_scratch_is_conflicting(slot->arena, conflicts, count)) {
+            continue;
+        }
+
+        u32* best = slot->active == 0 ? &idle : &active;
+        if (*best == ~0u || slot->last_used < ctx->scratch[*best].last_used) {
+            *best = i;
         }
     }
 
-    return NULL;
+    if (idle != ~0u) {
+        return idle;
+    }
+    if (unused != ~0u) {
+        return unused;
+    }
+    return active;
 }
 
 SP_Scratch sp_scratch_begin(SP_Arena* const* conflicts, u32 count) {
-    SP_Arena* scratch = get_non_conflicting_scratch_arena(conflicts, count);
-    if (scratch == NULL) {
+    SP_ThreadCtx* ctx = _sp_thread_ctx_get();
+    u32 index = _sp_scratch_pick(ctx, conflicts, count);
+    if (index == ~0u) {
         return (SP_Scratch) {0};
     }
+
+    SP_Arena* scratch = _sp_thread_ctx_get_scratch_arena(ctx, index);
+    _SP_ScratchSlot* slot = &ctx->scratch[index];
+    slot->active++;
+    slot->last_used = ++ctx->scratch_tick;
     return sp_temp_begin(scratch);
 }
 
 void sp_scratch_end(SP_Scratch scratch) {
     sp_temp_end(scratch);
-}
 
-// -- Logging ------------------------------------------------------------------
+    SP_ThreadCtx* ctx = _sp_thread_ctx;
+    if (ctx == NULL) {
+        return;
+    }
 
-void _sp_log_internal(SP_LogLevel level, const char* file, u32 line, const char* msg, ...) {
-    const char* const level_color[SP_LOG_LEVEL_COUNT] = {
-        "\033[101;30m",
-        "\033[0;91m",
-        "\033[0;93m",
-        "\033[0;92m",
-        "\033[0;94m",
-        "\033[0;95m",
-    };
-    const char* const level_str[SP_LOG_LEVEL_COUNT] = {
-        "FATAL",
-        "ERROR",
-        "WARN ",
-        "INFO ",
-        "DEBUG",
-        "TRACE",
-    };
+    for (u32 i = 0; i < ctx->scratch_count; i++) {
+        _SP_ScratchSlot* slot = &ctx->scratch[i];
+        if (slot->arena != scratch.arena) {
+            continue;
+        }
 
-    if (_sp_state.cfg.logging.colorful) {
-        printf("%s%s\033[0;90m %s:%u: \033[0m", level_color[level], level_str[level], file, line);
-    } else {
-        printf("%s %s:%u: ", level_str[level], file, line);
+        sp_assert(slot->active > 0, "Ending a scratch arena that was never begun.");
+        slot->active--;
+        // Trim the arena once it's idle. Everything up to its high-water mark
+        // stays committed while in use so nested scopes don't commit and
+        // decommit the same pages over and over.
+        if (slot->active == 0) {
+            _sp_arena_decommit(slot->arena, _sp_state.cfg.scratch.retain_size);
+        }
+        break;
     }
-
-    va_list args;
-    va_start(args, msg);
-    vprintf(msg, args);
-    va_end(args);
-    printf("\n");
 }
 
-// -- String -------------------------------------------------------------------
+// -- Logging ------------------------------------------------------------------
 
-SP_Str sp_str(const u8* data, u32 len) {
-    return (SP_Str) {
-        .data = data,
-        .len = len,
-    };
-}
+static const char* const _sp_log_level_color[SP_LOG_LEVEL_COUNT] = {
+    "\033[101;30m",
+    "\033[0;91m",
+    "\033[0;93m",
+    "\033[0;92m",
+    "\033[0;94m",
+    "\033[0;95m",
+};
 
-u32 sp_str_cstrlen(const u8* cstr) {
-    u32 len = 0;
-    while (cstr[len] != 0) {
-        len++;
-    }
-    return len;
-}
+static const char* const _sp_log_level_str[SP_LOG_LEVEL_COUNT] = {
+    "FATAL",
+    "ERROR",
+    "WARN ",
+    "INFO ",
+    "DEBUG",
+    "TRACE",
+};
 
-char* sp_str_to_cstr(SP_Allocator allocator, SP_Str str)  {
-    char* cstr = allocator.alloc(str.len + 1, allocator.userdata);
-    memcpy(cstr, str.data, str.len);
-    cstr[str.len] = 0;
-    return cstr;
-}
+// Single producer ring buffer of formatted lines or binary records. Only the
+// owning thread moves 'head' and only the writer thread moves 'tail'.
+struct _SP_LogRing {
+    _SP_LogRing* next;
+    u64 mask;
+    volatile u64 head;
+    volatile u64 tail;
+    volatile u64 dropped;
+    u8 data[];
+};
 
-b8 sp_str_equal(SP_Str a, SP_Str b) {
-    if (a.len != b.len) {
-        return false;
-    }
+volatile u32 _sp_log_level = SP_LOG_LEVEL_TRACE;
+
+// Dropped lines counted before any ring exists.
+static volatile u64 _sp_log_dropped = 0;
+
+// Bumped by every 'sp_init' with binary logging. Callsite ids carry it in
+// their upper half so callsites registered before a restart register again.
+static u32 _sp_log_generation = 0;
+
+// Binary log format. The file starts with '_SP_LOG_BINARY_MAGIC' followed by
+// records in native byte order, all starting with:
+// u16 size (whole record), u8 type
+//
+// _SP_LOG_RECORD_CALLSITE:
+// u32 id, u8 level, u32 line, u16 file_len, u16 msg_len, file, msg
+// 'msg' includes its null terminator.
+//
+// _SP_LOG_RECORD_ENTRY:
+// u32 id, u64 ns since 'sp_init', arguments
+// Each argument of the callsite's format in order. Strings are stored as a u16
+// length and their bytes, everything else as 8 bytes.
+//
+// Callsites are written by the thread registering them, so another thread's
+// entries can come before the callsite in the file.
+#define _SP_LOG_BINARY_MAGIC "SPLOGB01"
+#define _SP_LOG_RECORD_HEADER_SIZE 3
+#define _SP_LOG_RECORD_MAX_SIZE 1024
+// Callsite ids are handed out one after the other, a decoded file with ids
+// past this is corrupt rather than from a program with that many callsites.
+#define _SP_LOG_DECODE_MAX_CALLSITES (1u << 20)
+// Callsite records cut the file name to this many bytes and the format to
+// whatever room is left.
+#define _SP_LOG_MAX_FILE_LEN 256
+// Callsite record fields before the file name.
+#define _SP_LOG_CALLSITE_FIXED_SIZE (_SP_LOG_RECORD_HEADER_SIZE + sizeof(u32) + sizeof(u8) + sizeof(u32) + 2 * sizeof(u16))
+
+typedef enum _SP_LogRecordType {
+    _SP_LOG_RECORD_CALLSITE = 1,
+    _SP_LOG_RECORD_ENTRY = 2,
+} _SP_LogRecordType;
+
+typedef enum _SP_LogArgType {
+    _SP_LOG_ARG_INT,
+    _SP_LOG_ARG_LONG,
+    _SP_LOG_ARG_LLONG,
+    _SP_LOG_ARG_SIZE,
+    _SP_LOG_ARG_PTRDIFF,
+    _SP_LOG_ARG_INTMAX,
+    _SP_LOG_ARG_DOUBLE,
+    // Logged as text, a double would lose precision.
+    _SP_LOG_ARG_LDOUBLE,
+    _SP_LOG_ARG_PTR,
+    _SP_LOG_ARG_STR,
+    // '%s' with a '*' precision, which is the argument before it.
+    _SP_LOG_ARG_STR_STAR,
+    // '%%', doesn't take an argument.
+    _SP_LOG_ARG_NONE,
+    // '%n', wide strings and anything malformed.
+    _SP_LOG_ARG_INVALID,
+} _SP_LogArgType;
+
+typedef struct _SP_LogSpec _SP_LogSpec;
+struct _SP_LogSpec {
+    // One past the last character of the conversion.
+    const char* end;
+    _SP_LogArgType type;
+    // Number of '*' width and precision arguments before the value.
+    u32 stars;
+    // Literal precision, 0 if there is none.
+    u32 limit;
+};
 
-    return memcmp(a.data, b.data, a.len) == 0;
-}
+// Parse the printf conversion 'spec' points at, starting with the '%'.
+static _SP_LogSpec _sp_log_parse_spec(const char* spec) {
+    _SP_LogSpec result = {0};
+    const char* c = spec + 1;
+    if (*c == '%') {
+        result.type = _SP_LOG_ARG_NONE;
+        result.end = c + 1;
+        return result;
+    }
 
-SP_Str sp_str_pushf(SP_Allocator allocator, const void* fmt, ...) {
-    va_list args;
-    va_start(args, fmt);
-    va_list len_args;
-    va_copy(len_args, args);
-    u64 len = vsnprintf(NULL, 0, fmt, len_args);
-    va_end(len_args);
+    while (*c == '-' || *c == '+' || *c == ' ' || *c == '#' || *c == '0' || *c == '\'') {
+        c++;
+    }
+    if (*c == '*') {
+        result.stars++;
+        c++;
+    }
+    while (*c >= '0' && *c <= '9') {
+        c++;
+    }
+    b8 star_precision = false;
+    if (*c == '.') {
+        c++;
+        if (*c == '*') {
+            result.stars++;
+            star_precision = true;
+            c++;
+        }
+        while (*c >= '0' && *c <= '9') {
+            result.limit = result.limit * 10 + (*c - '0');
+            c++;
+        }
+    }
 
-    u8* buffer = allocator.alloc(len + 1, allocator.userdata);
-    vsnprintf((char*) buffer, len + 1, fmt, args);
-    va_end(args);
-    buffer = allocator.realloc(buffer, len + 1, len, allocator.userdata);
-    return sp_str(buffer, len);
+    char length = 0;
+    b8 twice = false;
+    if (*c == 'h' || *c == 'l' || *c == 'j' || *c == 'z' || *c == 't' || *c == 'L' || *c == 'q') {
+        length = *c++;
+        if ((length == 'h' || length == 'l') && *c == length) {
+            twice = true;
+            c++;
+        }
+    }
+
+    result.end = c + (*c != 0);
+    switch (*c) {
+        case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c':
+            if (length == 'l' && twice) {
+                result.type = _SP_LOG_ARG_LLONG;
+            } else if (length == 'q') {
+                result.type = _SP_LOG_ARG_LLONG;
+            } else if (length == 'l') {
+                result.type = *c == 'c' ? _SP_LOG_ARG_INVALID : _SP_LOG_ARG_LONG;
+            } else if (length == 'z') {
+                result.type = _SP_LOG_ARG_SIZE;
+            } else if (length == 't') {
+                result.type = _SP_LOG_ARG_PTRDIFF;
+            } else if (length == 'j') {
+                result.type = _SP_LOG_ARG_INTMAX;
+            } else {
+                // 'h' and 'hh' arguments are promoted to int.
+                result.type = _SP_LOG_ARG_INT;
+            }
+            break;
+        case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+            result.type = length == 'L' ? _SP_LOG_ARG_LDOUBLE : _SP_LOG_ARG_DOUBLE;
+            break;
+        case 'p':
+            result.type = _SP_LOG_ARG_PTR;
+            break;
+        case 's':
+            if (length != 0) {
+                result.type = _SP_LOG_ARG_INVALID;
+            } else {
+                result.type = star_precision ? _SP_LOG_ARG_STR_STAR : _SP_LOG_ARG_STR;
+            }
+            break;
+        default:
+            result.type = _SP_LOG_ARG_INVALID;
+            break;
+    }
+    return result;
 }
 
-SP_Str sp_str_substr(SP_Str source, u32 start, u32 end) {
-    sp_assert(end >= start, "Substring end must come after start.");
-    return sp_str(source.data + start, end - start);
+static i64 _sp_log_open(const char* path, b8 truncate, b8* ok) {
+    i64 handle = _sp_platform_log_open(path, truncate);
+    if (handle == -1) {
+        *ok = false;
+    }
+    return handle;
 }
 
-// =============================================================================
-// HASH CONTAINER BACKEND
-// =============================================================================
+static b8 _sp_log_writer_start(void) {
+    _sp_atomic_store_u64(&_sp_state.log.running, true);
+    if (!_sp_platform_log_thread_start()) {
+        _sp_atomic_store_u64(&_sp_state.log.running, false);
+        return false;
+    }
+    return true;
+}
 
-enum {
-    _SP_HASH_BUCKET_STATE_EMPTY = 0,
-    _SP_HASH_BUCKET_STATE_ALIVE = 1,
-    _SP_HASH_BUCKET_STATE_DEAD = 2,
-    _SP_HASH_BUCKET_STATE_MAP = 3,
-};
+static void _sp_log_writer_stop(void) {
+    // The writer drains every ring one last time before exiting.
+    _sp_atomic_store_u64(&_sp_state.log.running, false);
+    _sp_platform_log_wake();
+    _sp_platform_log_thread_join();
+}
 
-// https://en.wikipedia.org/wiki/Quadratic_probing#Quadratic_function
-static inline u32 _sp_hash_probe(u64 hash, u32 i, u32 m) {
-    const f32 c1 = 0.5f;
-    // Set c2 to 0 for a linear probe.
-    const f32 c2 = 0.5f;
-    u32 offset = c1*i + c2*i*i;
-    return (u64) (hash + offset) % m;
+static b8 _sp_log_init(void) {
+    if (!_sp_state.cfg.logging.async && _sp_state.cfg.logging.path != NULL) {
+        _sp_state.log.file = fopen(_sp_state.cfg.logging.path, "ab");
+        if (_sp_state.log.file == NULL) {
+            return false;
+        }
+    }
+    if (!_sp_state.cfg.logging.async && _sp_state.cfg.logging.binary_path == NULL) {
+        return true;
+    }
+
+    b8 ok = true;
+    if (_sp_state.cfg.logging.async) {
+        _sp_state.log.handle = _sp_log_open(_sp_state.cfg.logging.path, false, &ok);
+        _sp_state.log.async = ok;
+    }
+    if (_sp_state.cfg.logging.binary_path != NULL) {
+        _sp_state.log.binary_handle = _sp_log_open(_sp_state.cfg.logging.binary_path, true, &ok);
+        if (_sp_state.log.binary_handle != -1) {
+            _sp_state.log.binary = true;
+            _sp_log_generation++;
+            _SP_LogSegment magic = {_SP_LOG_BINARY_MAGIC, strlen(_SP_LOG_BINARY_MAGIC)};
+            _sp_platform_log_write(_sp_state.log.binary_handle, &magic, 1);
+        }
+    }
+
+    if (ok) {
+        // Created up front for the same reason as the profiler arena.
+        _sp_state.log.arena = sp_arena_create();
+        sp_arena_tag(_sp_state.log.arena, sp_str_lit("logging"));
+        if (_sp_log_writer_start()) {
+            return true;
+        }
+        sp_arena_destroy(_sp_state.log.arena);
+        _sp_state.log.arena = NULL;
+    }
+
+    if (_sp_state.log.async) {
+        _sp_platform_log_close(_sp_state.log.handle);
+    }
+    if (_sp_state.log.binary) {
+        _sp_platform_log_close(_sp_state.log.binary_handle);
+    }
+    _sp_state.log.async = false;
+    _sp_state.log.binary = false;
+    return false;
 }
 
-static u32 _sp_hash_container_get_index(
-        const void* key,
-        u64 key_size,
-        u64 hash,
-        const u8* states,
-        const u64* hashes,
-        const void* keys,
-        b8 accept_dead,
-        u32 count,
-        SP_EqualFunc equal_func
-    ) {
-    for (u32 i = 0; i < count; i++) {
-        u32 index = _sp_hash_probe(hash, i, count);
-        if (states[index] == _SP_HASH_BUCKET_STATE_EMPTY ||
-            (states[index] == _SP_HASH_BUCKET_STATE_DEAD && accept_dead) ||
-            (states[index] == _SP_HASH_BUCKET_STATE_ALIVE &&
-            hash == hashes[index] &&
-            equal_func(key, (u8*) keys + index * key_size, key_size))) {
-            return index;
+static void _sp_log_terminate(void) {
+    if (_sp_state.log.file != NULL) {
+        fclose(_sp_state.log.file);
+    }
+    if (_sp_state.log.arena != NULL) {
+        if (_sp_atomic_load_u64(&_sp_state.log.running)) {
+            _sp_log_writer_stop();
+        }
+        if (_sp_state.log.async) {
+            _sp_platform_log_close(_sp_state.log.handle);
         }
+        if (_sp_state.log.binary) {
+            _sp_platform_log_close(_sp_state.log.binary_handle);
+        }
+        sp_arena_destroy(_sp_state.log.arena);
     }
-    return ~0u;
+    _sp_state.log.file = NULL;
+    _sp_state.log.arena = NULL;
+    _sp_state.log.rings = NULL;
+    _sp_state.log.binary_rings = NULL;
+    _sp_state.log.async = false;
+    _sp_state.log.binary = false;
+    _sp_state.log.callsite_count = 0;
+    _sp_state.log.dropped_reported = 0;
 }
 
-typedef struct _SP_HashContainerChainNode _SP_HashContainerChainNode;
-struct _SP_HashContainerChainNode {
-    _SP_HashContainerChainNode* next;
-    _SP_HashContainerChainNode* prev;
-    u8 state;
-    u64 hash;
-};
+// A forked process only gets the calling thread, while the writer may hold a
+// lock at that moment. The writer is stopped around forks and every child
+// starts its own.
+static b8 _sp_log_fork_begin(void) {
+    if (!_sp_atomic_load_u64(&_sp_state.log.running)) {
+        return false;
+    }
+    _sp_log_writer_stop();
+    return true;
+}
+
+// Start the writer again after '_sp_log_fork_begin' returned true, in the
+// parent as well as in every child. Lines are written by the logging thread
+// itself if that fails.
+static void _sp_log_fork_end(void) {
+    if (_sp_log_writer_start()) {
+        return;
+    }
+    if (_sp_state.log.async) {
+        _sp_platform_log_close(_sp_state.log.handle);
+        if (_sp_state.cfg.logging.path != NULL) {
+            _sp_state.log.file = fopen(_sp_state.cfg.logging.path, "ab");
+        }
+    }
+    if (_sp_state.log.binary) {
+        _sp_platform_log_close(_sp_state.log.binary_handle);
+    }
+    _sp_state.log.async = false;
+    _sp_state.log.binary = false;
+}
+
+// Get the calling thread's ring out of 'local', a field of its context,
+// creating it and adding it to 'rings' if the context doesn't have one yet.
+static _SP_LogRing* _sp_log_get_ring(_SP_LogRing** local, _SP_LogRing** rings) {
+    if (*local != NULL) {
+        return *local;
+    }
+
+    u32 capacity = _sp_next_pow2(sp_max(_sp_state.cfg.logging.buffer_size, _SP_LOG_RECORD_MAX_SIZE));
+    _sp_platform_lock();
+    _SP_LogRing* ring = sp_arena_push(_sp_state.log.arena, sizeof(_SP_LogRing) + capacity);
+    ring->mask = capacity - 1;
+    ring->next = *rings;
+    *rings = ring;
+    _sp_platform_unlock();
+
+    *local = ring;
+    return ring;
+}
+
+// Wake the writer if it's waiting. Called after pushing a line or counting a
+// dropped one.
+static void _sp_log_wake_writer(void) {
+    // Pairs with the fence in '_sp_log_writer_main'. Either the writer sees
+    // what was stored before this or this sees the writer sleeping.
+    _sp_atomic_fence();
+    if (_sp_atomic_load_u64(&_sp_state.log.sleeping)) {
+        _sp_platform_log_wake();
+    }
+}
+
+static void _sp_log_push(_SP_LogRing* ring, const void* data, u32 len, SP_LogOverflow overflow) {
+    u64 capacity = ring->mask + 1;
+    if (len > capacity) {
+        _sp_atomic_add_u64(&ring->dropped, 1);
+        _sp_log_wake_writer();
+        return;
+    }
+
+    u64 head = ring->head;
+    while (head + len - _sp_atomic_load_u64(&ring->tail) > capacity) {
+        if (overflow == SP_LOG_OVERFLOW_DROP) {
+            _sp_atomic_add_u64(&ring->dropped, 1);
+            _sp_log_wake_writer();
+            return;
+        }
+        _sp_platform_yield();
+    }
+
+    u64 offset = head & ring->mask;
+    u64 first = sp_min(len, capacity - offset);
+    memcpy(ring->data + offset, data, first);
+    memcpy(ring->data, (const u8*) data + first, len - first);
+    _sp_atomic_store_u64(&ring->head, head + len);
+    _sp_log_wake_writer();
+}
 
-typedef struct _SP_HashContainerGetNodeResult _SP_HashContainerGetNodeResult;
-struct _SP_HashContainerGetNodeResult {
-    b8 new_key;
-    _SP_HashContainerChainNode* node;
+// Lines gathered by '_sp_log_drain_rings' but not yet written.
+typedef struct _SP_LogBatch _SP_LogBatch;
+struct _SP_LogBatch {
+    i64 handle;
+    _SP_LogSegment segments[32];
+    u32 segment_count;
+    // Rings in the batch and the head their tail moves to once written.
+    _SP_LogRing* rings[32];
+    u64 heads[32];
+    u32 ring_count;
 };
 
-static _SP_HashContainerGetNodeResult _sp_hash_container_get_node(
-        const void* key,
-        u64 key_size,
-        u64 hash,
-        _SP_HashContainerChainNode* nodes,
-        u64 node_size,
-        u32 count,
-        SP_EqualFunc equal_func,
-        b8 create_new,
-        _SP_HashContainerChainNode** free_list,
-        SP_Allocator allocator) {
-    u32 index = hash % count;
-    _SP_HashContainerChainNode* node = (_SP_HashContainerChainNode*) ((u8*) nodes + node_size * index);
-    while (node != NULL) {
-        if (node->state == _SP_HASH_BUCKET_STATE_EMPTY) {
-            return (_SP_HashContainerGetNodeResult) {
-                .new_key = true,
-                .node = node,
-            };
+static void _sp_log_batch_write(_SP_LogBatch* batch) {
+    if (batch->segment_count == 0) {
+        return;
+    }
+    _sp_platform_log_write(batch->handle, batch->segments, batch->segment_count);
+    for (u32 i = 0; i < batch->ring_count; i++) {
+        _sp_atomic_store_u64(&batch->rings[i]->tail, batch->heads[i]);
+    }
+    batch->segment_count = 0;
+    batch->ring_count = 0;
+}
+
+// Write out everything in 'rings' to 'handle'. Returns false if they were all
+// empty.
+static b8 _sp_log_drain_rings(_SP_LogRing* rings, i64 handle) {
+    _SP_LogBatch batch;
+    batch.handle = handle;
+    batch.segment_count = 0;
+    batch.ring_count = 0;
+    b8 wrote = false;
+
+    for (_SP_LogRing* ring = rings; ring != NULL; ring = ring->next) {
+        u64 tail = ring->tail;
+        u64 head = _sp_atomic_load_u64(&ring->head);
+        if (head == tail) {
+            continue;
         }
+        wrote = true;
 
-        if (node->state == _SP_HASH_BUCKET_STATE_ALIVE &&
-            hash == node->hash &&
-            equal_func(key, &node[1], key_size)) {
-            return (_SP_HashContainerGetNodeResult) {
-                .new_key = false,
-                .node = node,
-            };
+        // A wrapped range takes two segments.
+        if (batch.segment_count + 2 > sp_arrlen(batch.segments)) {
+            _sp_log_batch_write(&batch);
+        }
+        u64 capacity = ring->mask + 1;
+        u64 offset = tail & ring->mask;
+        u64 first = sp_min(head - tail, capacity - offset);
+        batch.segments[batch.segment_count++] = (_SP_LogSegment) {ring->data + offset, first};
+        if (first < head - tail) {
+            batch.segments[batch.segment_count++] = (_SP_LogSegment) {ring->data, head - tail - first};
         }
+        batch.rings[batch.ring_count] = ring;
+        batch.heads[batch.ring_count] = head;
+        batch.ring_count++;
+    }
+    _sp_log_batch_write(&batch);
 
-        if (!create_new && node->next == NULL) {
-            return (_SP_HashContainerGetNodeResult) {
-                .new_key = true,
-                .node = NULL,
-            };
+    return wrote;
+}
+
+// Write out everything in the rings. Returns false if they were all empty.
+static b8 _sp_log_drain(void) {
+    // Reported like any other line, from the writer's own ring. It's drained
+    // right below.
+    u64 dropped = sp_log_get_dropped();
+    if (dropped > _sp_state.log.dropped_reported) {
+        u64 count = dropped - _sp_state.log.dropped_reported;
+        _sp_state.log.dropped_reported = dropped;
+        _sp_log_internal(SP_LOG_LEVEL_WARN, __FILE__, __LINE__, "%llu log lines dropped", (unsigned long long) count);
+    }
+
+    _sp_platform_lock();
+    _SP_LogRing* rings = _sp_state.log.rings;
+    _SP_LogRing* binary_rings = _sp_state.log.binary_rings;
+    _sp_platform_unlock();
+
+    b8 wrote = false;
+    if (_sp_state.log.async) {
+        wrote |= _sp_log_drain_rings(rings, _sp_state.log.handle);
+    }
+    if (_sp_state.log.binary) {
+        wrote |= _sp_log_drain_rings(binary_rings, _sp_state.log.binary_handle);
+    }
+    return wrote;
+}
+
+static void _sp_log_writer_main(void) {
+    while (_sp_atomic_load_u64(&_sp_state.log.running)) {
+        if (_sp_log_drain()) {
+            continue;
+        }
+        // Producers only wake the writer while it's sleeping, so the rings
+        // are checked once more after saying so. Lines pushed in between are
+        // either seen here or wake the wait below.
+        _sp_atomic_store_u64(&_sp_state.log.sleeping, true);
+        _sp_atomic_fence();
+        if (!_sp_log_drain() && _sp_atomic_load_u64(&_sp_state.log.running)) {
+            _sp_platform_log_wait();
         }
+        _sp_atomic_store_u64(&_sp_state.log.sleeping, false);
+    }
+    _sp_log_drain();
+}
 
-        if (create_new && node->next == NULL) {
-            _SP_HashContainerChainNode* new_node;
-            if (*free_list != NULL) {
-                new_node = *free_list;
-                *free_list = (*free_list)->next;
-            } else {
-                new_node = sp_alloc(allocator, node_size);
-            }
-            memset(new_node, 0, node_size);
-            *new_node = (_SP_HashContainerChainNode) {
-                .next = NULL,
-                .prev = node,
-                .state = _SP_HASH_BUCKET_STATE_ALIVE,
-                .hash = hash,
-            };
-            node->next = new_node;
-            return (_SP_HashContainerGetNodeResult) {
-                .new_key = true,
-                .node = new_node,
-            };
+static void _sp_log_wait_rings(_SP_LogRing* rings) {
+    for (_SP_LogRing* ring = rings; ring != NULL; ring = ring->next) {
+        u64 head = _sp_atomic_load_u64(&ring->head);
+        while (_sp_atomic_load_u64(&ring->tail) < head) {
+            _sp_platform_yield();
         }
+    }
+}
 
-        node = node->next;
+void sp_log_flush(void) {
+    if (!_sp_state.log.async) {
+        fflush(_sp_state.log.file != NULL ? _sp_state.log.file : stdout);
+    }
+    if (_sp_state.log.arena == NULL) {
+        return;
     }
 
-    sp_ensure(false, "Unreachable!");
-    return (_SP_HashContainerGetNodeResult) {0};
+    _sp_platform_lock();
+    _SP_LogRing* rings = _sp_state.log.rings;
+    _SP_LogRing* binary_rings = _sp_state.log.binary_rings;
+    _sp_platform_unlock();
+
+    _sp_log_wait_rings(rings);
+    _sp_log_wait_rings(binary_rings);
 }
 
-// -- Hash map -----------------------------------------------------------------
+u64 sp_log_get_dropped(void) {
+    u64 dropped = _sp_atomic_load_u64(&_sp_log_dropped);
+    if (_sp_state.log.arena == NULL) {
+        return dropped;
+    }
 
-struct SP_HashMap {
-    SP_HashMapDesc desc;
-    u32 capacity;
-    // Count of active elements in set
-    u32 count;
-    union {
-        // Struct of Arrays
-        // Used for open addressing
-        struct {
-            u8* state;
-            u64* hashes;
-            void* keys;
-            void* values;
-            // Count of used or dead slots
-            u32 count;
-        } soa;
-        // Array of Structs
-        // Used for separate chaining
-        struct {
-            _SP_HashContainerChainNode* nodes;
-            _SP_HashContainerChainNode* free_list;
-        } aos;
-    };
-};
+    _sp_platform_lock();
+    _SP_LogRing* rings = _sp_state.log.rings;
+    _SP_LogRing* binary_rings = _sp_state.log.binary_rings;
+    _sp_platform_unlock();
 
-static void _sp_hash_map_grow(SP_HashMap* map) {
-    const f32 GROWTH_FACTOR = 2.0f;
-    u32 new_cap = map->capacity * GROWTH_FACTOR;
+    for (_SP_LogRing* ring = rings; ring != NULL; ring = ring->next) {
+        dropped += _sp_atomic_load_u64(&ring->dropped);
+    }
+    for (_SP_LogRing* ring = binary_rings; ring != NULL; ring = ring->next) {
+        dropped += _sp_atomic_load_u64(&ring->dropped);
+    }
+    return dropped;
+}
 
-    u8* new_state = sp_alloc(map->desc.allocator, new_cap * sizeof(u8));
-    u64* new_hashes = sp_alloc(map->desc.allocator, new_cap * sizeof(u64));
-    void* new_keys = sp_alloc(map->desc.allocator, new_cap * map->desc.key_size);
-    void* new_values = sp_alloc(map->desc.allocator, new_cap * map->desc.value_size);
-    memset(new_state, 0, new_cap * sizeof(u8));
+b8 sp_log_set_level(SP_LogLevel level) {
+    if ((u32) level >= SP_LOG_LEVEL_COUNT) {
+        return false;
+    }
+    _sp_atomic_store_u32(&_sp_log_level, level);
+    return true;
+}
 
-    for (u32 i = 0; i < map->capacity; i++) {
-        if (map->soa.state[i] == _SP_HASH_BUCKET_STATE_ALIVE) {
-            const void* key = (u8*) map->soa.keys + map->desc.key_size * i;
-            u32 new_index = _sp_hash_container_get_index(key,
-                    map->desc.key_size,
-                    map->soa.hashes[i],
-                    new_state,
-                    new_hashes,
-                    new_keys,
-                    true,
-                    new_cap,
-                    map->desc.equal);
-            u64 value_size = map->desc.value_size;
-            u64 key_size = map->desc.key_size;
+SP_LogLevel sp_log_get_level(void) {
+    return _sp_atomic_load_u32(&_sp_log_level);
+}
 
-            new_state[new_index] = _SP_HASH_BUCKET_STATE_ALIVE;
-            new_hashes[new_index] = map->soa.hashes[i];
-            memcpy((u8*) new_keys + key_size * new_index,
-                    (u8*) map->soa.keys + key_size * i,
-                    key_size);
-            memcpy((u8*) new_values + value_size * new_index,
-                    (u8*) map->soa.values + value_size * i,
-                    value_size);
+b8 _sp_log_every_n(volatile u64* calls, u64 n) {
+    return _sp_atomic_add_u64(calls, 1) % sp_max(n, 1) == 0;
+}
+
+b8 _sp_log_per_second(volatile u64* last_ns) {
+    // Offset by a second so the very first call always logs.
+    u64 now = sp_os_get_time_ns() + 1000000000llu;
+    u64 last = _sp_atomic_load_u64(last_ns);
+    if (now - last < 1000000000llu) {
+        return false;
+    }
+    // Only one of the threads racing for the slot gets to log.
+    return _sp_atomic_cas_u64(last_ns, last, now);
+}
+
+static void _sp_log_format(SP_LogLevel level, const char* file, u32 line, const char* msg, va_list args) {
+    // The whole line is formatted up front so it can be written at once.
+    // Lines too long for the stack buffer are formatted again on the heap.
+    char stack_buffer[1024];
+    char* buffer = stack_buffer;
+    u64 size = sizeof(stack_buffer);
+    u64 len = 0;
+    // Color codes only make sense on a terminal, never in a log file.
+    b8 colorful = _sp_state.cfg.logging.colorful && _sp_state.cfg.logging.path == NULL;
+    for (u32 attempt = 0; attempt < 2; attempt++) {
+        i32 prefix_len;
+        if (colorful) {
+            prefix_len = snprintf(buffer, size, "%s%s\033[0;90m %s:%u: \033[0m", _sp_log_level_color[level], _sp_log_level_str[level], file, line);
+        } else {
+            prefix_len = snprintf(buffer, size, "%s %s:%u: ", _sp_log_level_str[level], file, line);
+        }
+        va_list args_copy;
+        va_copy(args_copy, args);
+        u64 prefix_end = sp_min((u64) sp_max(prefix_len, 0), size);
+        i32 msg_len = vsnprintf(buffer + prefix_end, size - prefix_end, msg, args_copy);
+        va_end(args_copy);
+
+        // An encoding error or a line longer than INT_MAX.
+        if (prefix_len < 0 || msg_len < 0) {
+            if (buffer != stack_buffer) {
+                free(buffer);
+            }
+            _sp_atomic_add_u64(&_sp_log_dropped, 1);
+            _sp_log_wake_writer();
+            return;
+        }
+        len = (u64) prefix_len + msg_len;
+
+        // Room for the newline.
+        if (len + 1 < size) {
+            break;
+        }
+        size = len + 2;
+        buffer = malloc(size);
+        if (buffer == NULL) {
+            _sp_atomic_add_u64(&_sp_log_dropped, 1);
+            _sp_log_wake_writer();
+            return;
+        }
+    }
+    buffer[len++] = '\n';
+
+    if (_sp_state.log.async) {
+        SP_ThreadCtx* ctx = _sp_thread_ctx_get();
+        _SP_LogRing* ring = _sp_log_get_ring(&ctx->log_ring, &_sp_state.log.rings);
+        _sp_log_push(ring, buffer, len, _sp_state.cfg.logging.overflow);
+    } else {
+        fwrite(buffer, 1, len, _sp_state.log.file != NULL ? _sp_state.log.file : stdout);
+    }
+    if (level == SP_LOG_LEVEL_FATAL) {
+        sp_log_flush();
+    }
+
+    if (buffer != stack_buffer) {
+        free(buffer);
+    }
+}
+
+void _sp_log_internal(SP_LogLevel level, const char* file, u32 line, const char* msg, ...) {
+    sp_prof_zone_begin("sp_log");
+    va_list args;
+    va_start(args, msg);
+    _sp_log_format(level, file, line, msg, args);
+    va_end(args);
+    sp_prof_zone_end();
+}
+
+static void _sp_log_put(u8* record, u32* pos, const void* data, u32 size) {
+    memcpy(record + *pos, data, size);
+    *pos += size;
+}
+
+static void _sp_log_put_header(u8* record, u32 size, _SP_LogRecordType type) {
+    u16 size_u16 = size;
+    u8 type_u8 = type;
+    memcpy(record, &size_u16, sizeof(size_u16));
+    memcpy(record + sizeof(size_u16), &type_u8, sizeof(type_u8));
+}
+
+// Give 'site' an id and write its callsite record. Returns false if the
+// callsite can't be logged in binary.
+static b8 _sp_log_register(_SP_LogCallsite* site, SP_LogLevel level, const char* file, u32 line, const char* msg) {
+    SP_ThreadCtx* ctx = _sp_thread_ctx_get();
+    _SP_LogRing* ring = _sp_log_get_ring(&ctx->log_binary_ring, &_sp_state.log.binary_rings);
+
+    u64 id = 0;
+    _sp_platform_lock();
+    if (site->id >> 32 != _sp_log_generation) {
+        site->msg = msg;
+        site->arg_count = 0;
+        site->text_only = false;
+        const char* c = msg;
+        while (*c != 0) {
+            if (*c != '%') {
+                c++;
+                continue;
+            }
+            _SP_LogSpec spec = _sp_log_parse_spec(c);
+            c = spec.end;
+            if (spec.type == _SP_LOG_ARG_NONE) {
+                continue;
+            }
+            if (spec.type == _SP_LOG_ARG_INVALID || spec.type == _SP_LOG_ARG_LDOUBLE ||
+                site->arg_count + spec.stars + 1 > _SP_LOG_MAX_ARGS) {
+                site->text_only = true;
+                break;
+            }
+            for (u32 i = 0; i < spec.stars; i++) {
+                site->arg_limits[site->arg_count] = 0;
+                site->arg_types[site->arg_count++] = _SP_LOG_ARG_INT;
+            }
+            site->arg_limits[site->arg_count] = spec.limit;
+            site->arg_types[site->arg_count++] = spec.type;
+        }
+
+        id = ++_sp_state.log.callsite_count;
+        _sp_atomic_store_u64(&site->id, (u64) _sp_log_generation << 32 | id);
+    }
+    // Read under the lock, another thread may be registering the callsite
+    // for a newer 'sp_init'.
+    b8 text_only = site->text_only;
+    _sp_platform_unlock();
+
+    // Only the thread handing out the id writes the record. Outside the lock
+    // since waiting for room needs the writer, which takes the lock.
+    if (id != 0 && !text_only) {
+        u8 record[_SP_LOG_RECORD_MAX_SIZE];
+        u32 file_len = sp_min(strlen(file), _SP_LOG_MAX_FILE_LEN);
+        u32 msg_len = sp_min(strlen(msg) + 1, sizeof(record) - _SP_LOG_CALLSITE_FIXED_SIZE - file_len);
+        u32 pos = _SP_LOG_RECORD_HEADER_SIZE;
+        u32 id_u32 = id;
+        u8 level_u8 = level;
+        u16 file_len_u16 = file_len;
+        u16 msg_len_u16 = msg_len;
+        _sp_log_put(record, &pos, &id_u32, sizeof(id_u32));
+        _sp_log_put(record, &pos, &level_u8, sizeof(level_u8));
+        _sp_log_put(record, &pos, &line, sizeof(line));
+        _sp_log_put(record, &pos, &file_len_u16, sizeof(file_len_u16));
+        _sp_log_put(record, &pos, &msg_len_u16, sizeof(msg_len_u16));
+        _sp_log_put(record, &pos, file, file_len);
+        _sp_log_put(record, &pos, msg, msg_len);
+        record[pos - 1] = 0;
+        _sp_log_put_header(record, pos, _SP_LOG_RECORD_CALLSITE);
+        // Every entry of the callsite is useless without it, never drop it.
+        _sp_log_push(ring, record, pos, SP_LOG_OVERFLOW_BLOCK);
+    }
+
+    return !text_only;
+}
+
+static void _sp_log_binary(const _SP_LogCallsite* site, va_list args) {
+    u8 record[_SP_LOG_RECORD_MAX_SIZE];
+    u32 pos = _SP_LOG_RECORD_HEADER_SIZE;
+    u32 id = (u32) site->id;
+    u64 time_ns = sp_os_get_time_ns() - _sp_state.clock.start_ns;
+    _sp_log_put(record, &pos, &id, sizeof(id));
+    _sp_log_put(record, &pos, &time_ns, sizeof(time_ns));
+
+    i64 last_int = -1;
+    for (u32 i = 0; i < site->arg_count; i++) {
+        u64 value = 0;
+        switch (site->arg_types[i]) {
+            case _SP_LOG_ARG_INT:
+                last_int = va_arg(args, int);
+                value = last_int;
+                break;
+            case _SP_LOG_ARG_LONG:
+                value = va_arg(args, long);
+                break;
+            case _SP_LOG_ARG_LLONG:
+                value = va_arg(args, long long);
+                break;
+            case _SP_LOG_ARG_SIZE:
+                value = va_arg(args, size_t);
+                break;
+            case _SP_LOG_ARG_PTRDIFF:
+                value = va_arg(args, ptrdiff_t);
+                break;
+            case _SP_LOG_ARG_INTMAX:
+                value = va_arg(args, intmax_t);
+                break;
+            case _SP_LOG_ARG_DOUBLE: {
+                f64 f = va_arg(args, double);
+                memcpy(&value, &f, sizeof(f));
+            } break;
+            case _SP_LOG_ARG_PTR:
+                value = (uintptr_t) va_arg(args, void*);
+                break;
+            case _SP_LOG_ARG_STR:
+            case _SP_LOG_ARG_STR_STAR: {
+                const char* str = va_arg(args, const char*);
+                if (str == NULL) {
+                    str = "(null)";
+                }
+                // Leave room for the arguments after this one.
+                u64 limit = sizeof(record) - pos - sizeof(u16) - (site->arg_count - i - 1) * (sizeof(u64) + sizeof(u16));
+                if (site->arg_types[i] == _SP_LOG_ARG_STR_STAR && last_int >= 0) {
+                    limit = sp_min(limit, (u64) last_int);
+                } else if (site->arg_limits[i] != 0) {
+                    limit = sp_min(limit, site->arg_limits[i]);
+                }
+                u16 len = 0;
+                while (len < limit && str[len] != 0) {
+                    len++;
+                }
+                _sp_log_put(record, &pos, &len, sizeof(len));
+                _sp_log_put(record, &pos, str, len);
+            } continue;
+            default:
+                break;
         }
+        _sp_log_put(record, &pos, &value, sizeof(value));
+    }
+
+    _sp_log_put_header(record, pos, _SP_LOG_RECORD_ENTRY);
+    SP_ThreadCtx* ctx = _sp_thread_ctx_get();
+    _SP_LogRing* ring = _sp_log_get_ring(&ctx->log_binary_ring, &_sp_state.log.binary_rings);
+    _sp_log_push(ring, record, pos, _sp_state.cfg.logging.overflow);
+}
+
+void _sp_log_deferred(_SP_LogCallsite* site, SP_LogLevel level, const char* file, u32 line, const char* msg, ...) {
+    sp_prof_zone_begin("sp_log");
+    va_list args;
+    va_start(args, msg);
+    b8 binary = false;
+    if (_sp_state.log.binary) {
+        if (_sp_atomic_load_u64(&site->id) >> 32 != _sp_log_generation) {
+            binary = _sp_log_register(site, level, file, line, msg);
+        } else {
+            binary = !site->text_only;
+        }
+        // The format changed since the callsite registered, it's not a literal.
+        binary = binary && site->msg == msg;
+    }
+    if (binary) {
+        _sp_log_binary(site, args);
+    } else {
+        _sp_log_format(level, file, line, msg, args);
+    }
+    va_end(args);
+    sp_prof_zone_end();
+}
+
+// -- Binary log decoding ------------------------------------------------------
+
+typedef struct _SP_LogDecodeSite _SP_LogDecodeSite;
+struct _SP_LogDecodeSite {
+    b8 defined;
+    u8 level;
+    u32 line;
+    u16 file_len;
+    const char* file;
+    const char* msg;
+};
+
+// Print one argument with its original conversion spec, passing the '*'
+// arguments before it.
+#define _SP_LOG_DECODE_PRINT(VALUE) do { \
+    switch (spec.stars) { \
+        case 0: fprintf(out, format, VALUE); break; \
+        case 1: fprintf(out, format, stars[0], VALUE); break; \
+        default: fprintf(out, format, stars[0], stars[1], VALUE); break; \
+    } \
+} while (0)
+
+static b8 _sp_log_decode_entry(FILE* out, const _SP_LogDecodeSite* site, u64 time_ns, const u8* args, const u8* end) {
+    fprintf(out, "[%12.6f] %s %.*s:%u: ", time_ns / 1e9, _sp_log_level_str[site->level], site->file_len, site->file, site->line);
+
+    const char* c = site->msg;
+    while (*c != 0) {
+        if (*c != '%') {
+            fputc(*c++, out);
+            continue;
+        }
+
+        _SP_LogSpec spec = _sp_log_parse_spec(c);
+        char format[64];
+        u64 format_len = sp_min((u64) (spec.end - c), sizeof(format) - 1);
+        memcpy(format, c, format_len);
+        format[format_len] = 0;
+        c = spec.end;
+        if (spec.type == _SP_LOG_ARG_NONE) {
+            fputc('%', out);
+            continue;
+        }
+
+        int stars[2] = {0};
+        for (u32 i = 0; i < spec.stars; i++) {
+            u64 star;
+            if (args + sizeof(star) > end) {
+                return false;
+            }
+            memcpy(&star, args, sizeof(star));
+            args += sizeof(star);
+            stars[sp_min(i, 1)] = (int) star;
+        }
+
+        if (spec.type == _SP_LOG_ARG_STR || spec.type == _SP_LOG_ARG_STR_STAR) {
+            u16 len;
+            if (args + sizeof(len) > end) {
+                return false;
+            }
+            memcpy(&len, args, sizeof(len));
+            args += sizeof(len);
+            char str[_SP_LOG_RECORD_MAX_SIZE];
+            if (args + len > end || len >= sizeof(str)) {
+                return false;
+            }
+            memcpy(str, args, len);
+            str[len] = 0;
+            args += len;
+            _SP_LOG_DECODE_PRINT(str);
+            continue;
+        }
+
+        u64 value;
+        if (args + sizeof(value) > end) {
+            return false;
+        }
+        memcpy(&value, args, sizeof(value));
+        args += sizeof(value);
+        f64 f;
+        memcpy(&f, &value, sizeof(f));
+        switch (spec.type) {
+            case _SP_LOG_ARG_INT: _SP_LOG_DECODE_PRINT((int) value); break;
+            case _SP_LOG_ARG_LONG: _SP_LOG_DECODE_PRINT((long) value); break;
+            case _SP_LOG_ARG_LLONG: _SP_LOG_DECODE_PRINT((long long) value); break;
+            case _SP_LOG_ARG_SIZE: _SP_LOG_DECODE_PRINT((size_t) value); break;
+            case _SP_LOG_ARG_PTRDIFF: _SP_LOG_DECODE_PRINT((ptrdiff_t) value); break;
+            case _SP_LOG_ARG_INTMAX: _SP_LOG_DECODE_PRINT((intmax_t) value); break;
+            case _SP_LOG_ARG_DOUBLE: _SP_LOG_DECODE_PRINT(f); break;
+            case _SP_LOG_ARG_PTR: _SP_LOG_DECODE_PRINT((void*) (uintptr_t) value); break;
+            default: return false;
+        }
+    }
+    fputc('\n', out);
+    return true;
+}
+
+b8 sp_log_decode(const char* binary_path, const char* out_path) {
+    FILE* in = fopen(binary_path, "rb");
+    if (in == NULL) {
+        return false;
+    }
+    fseek(in, 0, SEEK_END);
+    long size = ftell(in);
+    fseek(in, 0, SEEK_SET);
+    u8* data = size > 0 ? malloc(size) : NULL;
+    b8 read = data != NULL && fread(data, 1, size, in) == (u64) size;
+    fclose(in);
+
+    u64 magic_len = strlen(_SP_LOG_BINARY_MAGIC);
+    if (!read || (u64) size < magic_len || memcmp(data, _SP_LOG_BINARY_MAGIC, magic_len) != 0) {
+        free(data);
+        return false;
+    }
+
+    FILE* out = out_path != NULL ? fopen(out_path, "wb") : stdout;
+    if (out == NULL) {
+        free(data);
+        return false;
+    }
+
+    // Entries can come before their callsite, so callsites are gathered first.
+    _SP_LogDecodeSite* sites = NULL;
+    u32 site_capacity = 0;
+    b8 ok = true;
+    const u8* end = data + size;
+    for (u32 pass = 0; pass < 2 && ok; pass++) {
+        const u8* record = data + magic_len;
+        while (record < end) {
+            u16 record_size;
+            u8 type;
+            u32 id;
+            if (end - record < _SP_LOG_RECORD_HEADER_SIZE + (i64) sizeof(id)) {
+                ok = false;
+                break;
+            }
+            memcpy(&record_size, record, sizeof(record_size));
+            memcpy(&type, record + sizeof(record_size), sizeof(type));
+            memcpy(&id, record + _SP_LOG_RECORD_HEADER_SIZE, sizeof(id));
+            // The writer never produces records over the maximum size.
+            if (record_size > end - record ||
+                record_size > _SP_LOG_RECORD_MAX_SIZE ||
+                record_size < _SP_LOG_RECORD_HEADER_SIZE + sizeof(id)) {
+                ok = false;
+                break;
+            }
+            const u8* fields = record + _SP_LOG_RECORD_HEADER_SIZE + sizeof(id);
+            const u8* record_end = record + record_size;
+
+            if (pass == 0 && type == _SP_LOG_RECORD_CALLSITE) {
+                _SP_LogDecodeSite site = {.defined = true};
+                u16 msg_len;
+                if (record_end - fields < 11) {
+                    ok = false;
+                    break;
+                }
+                memcpy(&site.level, fields, sizeof(site.level));
+                memcpy(&site.line, fields + 1, sizeof(site.line));
+                memcpy(&site.file_len, fields + 5, sizeof(site.file_len));
+                memcpy(&msg_len, fields + 7, sizeof(msg_len));
+                site.file = (const char*) fields + 9;
+                site.msg = site.file + site.file_len;
+                if ((const u8*) site.msg + msg_len > record_end ||
+                    msg_len == 0 ||
+                    site.msg[msg_len - 1] != 0 ||
+                    site.level >= SP_LOG_LEVEL_COUNT ||
+                    id >= _SP_LOG_DECODE_MAX_CALLSITES) {
+                    ok = false;
+                    break;
+                }
+
+                if (id >= site_capacity) {
+                    u32 new_capacity = sp_max(_sp_next_pow2(id + 1), 64);
+                    _SP_LogDecodeSite* new_sites = realloc(sites, new_capacity * sizeof(_SP_LogDecodeSite));
+                    if (new_sites == NULL) {
+                        ok = false;
+                        break;
+                    }
+                    memset(new_sites + site_capacity, 0, (new_capacity - site_capacity) * sizeof(_SP_LogDecodeSite));
+                    sites = new_sites;
+                    site_capacity = new_capacity;
+                }
+                sites[id] = site;
+            } else if (pass == 1 && type == _SP_LOG_RECORD_ENTRY) {
+                u64 time_ns;
+                if (record_end - fields < (i64) sizeof(time_ns) || id >= site_capacity || !sites[id].defined) {
+                    ok = false;
+                    break;
+                }
+                memcpy(&time_ns, fields, sizeof(time_ns));
+                if (!_sp_log_decode_entry(out, &sites[id], time_ns, fields + sizeof(time_ns), record_end)) {
+                    ok = false;
+                    break;
+                }
+            }
+
+            record = record_end;
+        }
+    }
+
+    free(sites);
+    free(data);
+    if (out != stdout) {
+        fclose(out);
+    } else {
+        fflush(out);
+    }
+    return ok;
+}
+
+// -- String -------------------------------------------------------------------
+
+SP_Str sp_str(const u8* data, u32 len) {
+    return (SP_Str) {
+        .data = data,
+        .len = len,
+    };
+}
+
+u32 sp_str_cstrlen(const u8* cstr) {
+    u32 len = 0;
+    while (cstr[len] != 0) {
+        len++;
+    }
+    return len;
+}
+
+char* sp_str_to_cstr(SP_Allocator allocator, SP_Str str)  {
+    char* cstr = allocator.alloc(str.len + 1, allocator.userdata);
+    memcpy(cstr, str.data, str.len);
+    cstr[str.len] = 0;
+    return cstr;
+}
+
+b8 sp_str_equal(SP_Str a, SP_Str b) {
+    if (a.len != b.len) {
+        return false;
+    }
+
+    return memcmp(a.data, b.data, a.len) == 0;
+}
+
+SP_Str sp_str_pushf(SP_Allocator allocator, const void* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    va_list len_args;
+    va_copy(len_args, args);
+    u64 len = vsnprintf(NULL, 0, fmt, len_args);
+    va_end(len_args);
+
+    u8* buffer = allocator.alloc(len + 1, allocator.userdata);
+    vsnprintf((char*) buffer, len + 1, fmt, args);
+    va_end(args);
+    buffer = allocator.realloc(buffer, len + 1, len, allocator.userdata);
+    return sp_str(buffer, len);
+}
+
+SP_Str sp_str_substr(SP_Str source, u32 start, u32 end) {
+    sp_assert(end >= start, "Substring end must come after start.");
+    return sp_str(source.data + start, end - start);
+}
+
+// =============================================================================
+// HASH CONTAINER BACKEND
+// =============================================================================
+
+enum {
+    _SP_HASH_BUCKET_STATE_EMPTY = 0,
+    _SP_HASH_BUCKET_STATE_ALIVE = 1,
+    _SP_HASH_BUCKET_STATE_DEAD = 2,
+    _SP_HASH_BUCKET_STATE_MAP = 3,
+};
+
+// Quadratic probing with triangular numbers, offsets 0, 1, 3, 6 and so on from
+// the home slot. With a power of two capacity this visits every slot exactly
+// once.
+// https://en.wikipedia.org/wiki/Quadratic_probing#Quadratic_function
+static u32 _sp_hash_container_get_index(
+        const void* key,
+        u64 key_size,
+        u64 hash,
+        const u8* states,
+        const u64* hashes,
+        const void* keys,
+        b8 accept_dead,
+        u32 capacity,
+        SP_EqualFunc equal_func
+    ) {
+    u32 mask = capacity - 1;
+    u32 index = hash & mask;
+    for (u32 i = 1; i <= capacity; i++) {
+        if (states[index] == _SP_HASH_BUCKET_STATE_EMPTY ||
+            (states[index] == _SP_HASH_BUCKET_STATE_DEAD && accept_dead) ||
+            (states[index] == _SP_HASH_BUCKET_STATE_ALIVE &&
+            hash == hashes[index] &&
+            equal_func(key, (u8*) keys + index * key_size, key_size))) {
+            return index;
+        }
+        index = (index + i) & mask;
+    }
+    return ~0u;
+}
+
+static void _sp_hash_swap_bytes(void* a, void* b, u64 size) {
+    u8* x = a;
+    u8* y = b;
+    for (u64 i = 0; i < size; i++) {
+        u8 tmp = x[i];
+        x[i] = y[i];
+        y[i] = tmp;
+    }
+}
+
+// Drop the tombstones of an open addressing table without allocating a second
+// one. Live elements are marked dead until they're placed, tombstones become
+// empty. Each element then goes to the first slot of its probe sequence not
+// taken by a placed element, swapping with an unplaced one if need be. Placed
+// elements never move again, so every slot before one in its probe sequence
+// stays full and lookups still find it.
+static void _sp_hash_container_purge(u8* states, u64* hashes, void* keys, u64 key_size, void* values, u64 value_size, u32 capacity) {
+    for (u32 i = 0; i < capacity; i++) {
+        states[i] = states[i] == _SP_HASH_BUCKET_STATE_ALIVE ? _SP_HASH_BUCKET_STATE_DEAD : _SP_HASH_BUCKET_STATE_EMPTY;
+    }
+
+    u32 mask = capacity - 1;
+    for (u32 i = 0; i < capacity; i++) {
+        while (states[i] == _SP_HASH_BUCKET_STATE_DEAD) {
+            // Slot 'i' itself isn't placed, so probing ends.
+            u32 index = hashes[i] & mask;
+            for (u32 step = 1; states[index] == _SP_HASH_BUCKET_STATE_ALIVE; step++) {
+                index = (index + step) & mask;
+            }
+            if (index == i) {
+                states[i] = _SP_HASH_BUCKET_STATE_ALIVE;
+                break;
+            }
+
+            // An unplaced element swapped into 'i' is handled next.
+            if (states[index] == _SP_HASH_BUCKET_STATE_EMPTY) {
+                states[i] = _SP_HASH_BUCKET_STATE_EMPTY;
+            }
+            states[index] = _SP_HASH_BUCKET_STATE_ALIVE;
+            _sp_hash_swap_bytes(&hashes[i], &hashes[index], sizeof(u64));
+            _sp_hash_swap_bytes((u8*) keys + key_size * i, (u8*) keys + key_size * index, key_size);
+            _sp_hash_swap_bytes((u8*) values + value_size * i, (u8*) values + value_size * index, value_size);
+        }
+    }
+}
+
+// Load factors are kept in fixed point with 1.0 at 1024.
+enum { _SP_HASH_LOAD_FACTOR_ONE = 1024 };
+
+// Slots which may be used or dead before a table is rehashed. At least one
+// slot always stays empty so probing terminates.
+static inline u32 _sp_hash_max_load(u32 capacity, u32 load_factor) {
+    return sp_min((u64) capacity * load_factor / _SP_HASH_LOAD_FACTOR_ONE, capacity - 1);
+}
+
+// Capacity to rehash a table into once its load limit is hit. If tombstones
+// make up most of the load, rehashing at the same size gets rid of them without
+// growing.
+static inline u32 _sp_hash_grow_capacity(u32 count, u32 max_load, u32 capacity) {
+    if (count < max_load / 2) {
+        return capacity;
+    }
+    sp_ensure(capacity < _SP_HASH_MAX_CAPACITY, "Hash table capacity too big.");
+    return capacity * 2;
+}
+
+// Removing never resizes a table, so pointers to and iterators over the
+// remaining elements stay valid. Instead the next insert shrinks tables left
+// under a quarter of their maximum load, but never below the capacity they
+// were created with.
+static inline b8 _sp_hash_should_shrink(u32 count, u32 max_load, u32 capacity, u32 min_capacity) {
+    return count < max_load / 4 && capacity / 2 >= min_capacity;
+}
+
+// Old slots moved per operation during an incremental resize. At the default
+// load factor this drains the old table well before the new one fills up, very
+// low load factors finish the move early instead.
+enum { _SP_HASH_MIGRATE_STEP = 8 };
+
+static SP_HashFunc _sp_hash_default_func(u64 key_size) {
+    switch (key_size) {
+        case sizeof(u32): return sp_hash_u32;
+        case sizeof(u64): return sp_hash_u64;
+        default: return sp_hash_bytes;
+    }
+}
+
+// Everything the chained, Swiss and Robin Hood tables need to know about
+// their container.
+typedef struct _SP_HashTableLayout _SP_HashTableLayout;
+struct _SP_HashTableLayout {
+    SP_Allocator allocator;
+    SP_HashFunc hash;
+    u64 seed;
+    SP_EqualFunc equal;
+    u64 key_size;
+    // 0 for sets.
+    u64 value_size;
+    // See '_sp_hash_max_load'.
+    u32 load_factor;
+};
+
+// -- Chained table ------------------------------------------------------------
+// Buckets point to singly linked lists of nodes which hold the hash, key and
+// value. Nodes are carved out of slabs and never move, so growing the bucket
+// array only relinks them. Removed nodes go on a free list for reuse.
+
+typedef struct _SP_HashChainNode _SP_HashChainNode;
+struct _SP_HashChainNode {
+    _SP_HashChainNode* next;
+    u64 hash;
+    // Key and value follow, see '_sp_hash_chain_node_size'.
+};
+
+typedef struct _SP_HashChainSlab _SP_HashChainSlab;
+struct _SP_HashChainSlab {
+    _SP_HashChainSlab* next;
+    u32 capacity;
+    // Nodes handed out so far, the rest are untouched.
+    u32 used;
+};
+
+// Slabs double in size between these node counts.
+enum {
+    _SP_HASH_CHAIN_SLAB_MIN = 16,
+    _SP_HASH_CHAIN_SLAB_MAX = 4096,
+};
+
+typedef struct _SP_HashChain _SP_HashChain;
+struct _SP_HashChain {
+    _SP_HashChainNode** buckets;
+    _SP_HashChainNode* free_list;
+    u32 free_count;
+    // Newest first, new nodes only come from the head.
+    _SP_HashChainSlab* slabs;
+};
+
+// Keys and values are padded to 8 bytes so nodes and values stay aligned.
+static inline u64 _sp_hash_chain_value_offset(const _SP_HashTableLayout* layout) {
+    return sizeof(_SP_HashChainNode) + _align_value(layout->key_size, 8);
+}
+
+static inline u64 _sp_hash_chain_node_size(const _SP_HashTableLayout* layout) {
+    return _sp_hash_chain_value_offset(layout) + _align_value(layout->value_size, 8);
+}
+
+static inline void* _sp_hash_chain_key(_SP_HashChainNode* node) {
+    return &node[1];
+}
+
+static inline void* _sp_hash_chain_value(_SP_HashChainNode* node, const _SP_HashTableLayout* layout) {
+    return (u8*) node + _sp_hash_chain_value_offset(layout);
+}
+
+static void _sp_hash_chain_alloc(_SP_HashChain* table, const _SP_HashTableLayout* layout, u32 capacity) {
+    *table = (_SP_HashChain) {
+        .buckets = sp_alloc(layout->allocator, capacity * sizeof(_SP_HashChainNode*)),
+    };
+    memset(table->buckets, 0, capacity * sizeof(_SP_HashChainNode*));
+}
+
+static void _sp_hash_chain_free(_SP_HashChain* table, const _SP_HashTableLayout* layout, u32 capacity) {
+    u64 node_size = _sp_hash_chain_node_size(layout);
+    _SP_HashChainSlab* slab = table->slabs;
+    while (slab != NULL) {
+        _SP_HashChainSlab* next = slab->next;
+        sp_free(layout->allocator, slab, sizeof(_SP_HashChainSlab) + slab->capacity * node_size);
+        slab = next;
+    }
+    sp_free(layout->allocator, table->buckets, capacity * sizeof(_SP_HashChainNode*));
+}
+
+// Start a new slab of 'capacity' nodes. Whatever is left of the previous one
+// goes on the free list.
+static void _sp_hash_chain_add_slab(_SP_HashChain* table, const _SP_HashTableLayout* layout, u32 capacity) {
+    u64 node_size = _sp_hash_chain_node_size(layout);
+    _SP_HashChainSlab* head = table->slabs;
+    if (head != NULL) {
+        for (u32 i = head->used; i < head->capacity; i++) {
+            _SP_HashChainNode* node = (_SP_HashChainNode*) ((u8*) &head[1] + node_size * i);
+            node->next = table->free_list;
+            table->free_list = node;
+            table->free_count++;
+        }
+        head->used = head->capacity;
+    }
+
+    _SP_HashChainSlab* slab = sp_alloc(layout->allocator, sizeof(_SP_HashChainSlab) + capacity * node_size);
+    *slab = (_SP_HashChainSlab) {
+        .next = head,
+        .capacity = capacity,
+        .used = 0,
+    };
+    table->slabs = slab;
+}
+
+static _SP_HashChainNode* _sp_hash_chain_take_node(_SP_HashChain* table, const _SP_HashTableLayout* layout) {
+    if (table->free_list != NULL) {
+        _SP_HashChainNode* node = table->free_list;
+        table->free_list = node->next;
+        table->free_count--;
+        return node;
+    }
+
+    _SP_HashChainSlab* slab = table->slabs;
+    if (slab == NULL || slab->used == slab->capacity) {
+        u32 capacity = slab == NULL ? _SP_HASH_CHAIN_SLAB_MIN : slab->capacity * 2;
+        _sp_hash_chain_add_slab(table, layout, sp_clamp(capacity, _SP_HASH_CHAIN_SLAB_MIN, _SP_HASH_CHAIN_SLAB_MAX));
+        slab = table->slabs;
+    }
+    u64 node_size = _sp_hash_chain_node_size(layout);
+    return (_SP_HashChainNode*) ((u8*) &slab[1] + node_size * slab->used++);
+}
+
+// Make sure 'count' nodes can be taken without allocating.
+static void _sp_hash_chain_reserve_nodes(_SP_HashChain* table, const _SP_HashTableLayout* layout, u32 count) {
+    u32 spare = table->free_count;
+    if (table->slabs != NULL) {
+        spare += table->slabs->capacity - table->slabs->used;
+    }
+    if (count > spare) {
+        _sp_hash_chain_add_slab(table, layout, count - spare);
+    }
+}
+
+static _SP_HashChainNode* _sp_hash_chain_find(const _SP_HashChain* table, const _SP_HashTableLayout* layout, u32 capacity, const void* key, u64 hash) {
+    _SP_HashChainNode* node = table->buckets[hash & (capacity - 1)];
+    while (node != NULL) {
+        if (node->hash == hash && layout->equal(key, _sp_hash_chain_key(node), layout->key_size)) {
+            return node;
+        }
+        node = node->next;
+    }
+    return NULL;
+}
+
+// Relink every node into 'new_capacity' buckets, keys and values stay where
+// they are.
+static void _sp_hash_chain_resize(_SP_HashChain* table, const _SP_HashTableLayout* layout, u32* capacity, u32 new_capacity) {
+    sp_prof_zone_begin("sp_hash_chain_resize");
+    _SP_HashChainNode** buckets = sp_alloc(layout->allocator, new_capacity * sizeof(_SP_HashChainNode*));
+    memset(buckets, 0, new_capacity * sizeof(_SP_HashChainNode*));
+
+    u32 mask = new_capacity - 1;
+    for (u32 i = 0; i < *capacity; i++) {
+        _SP_HashChainNode* node = table->buckets[i];
+        while (node != NULL) {
+            _SP_HashChainNode* next = node->next;
+            u32 index = node->hash & mask;
+            node->next = buckets[index];
+            buckets[index] = node;
+            node = next;
+        }
+    }
+
+    sp_free(layout->allocator, table->buckets, *capacity * sizeof(_SP_HashChainNode*));
+    table->buckets = buckets;
+    *capacity = new_capacity;
+    sp_prof_zone_end();
+}
+
+// Link a node for a key which isn't in the table at the head of its bucket.
+// Only the hash is written.
+static _SP_HashChainNode* _sp_hash_chain_prepare_insert(_SP_HashChain* table, const _SP_HashTableLayout* layout, u32* capacity, u32 count, u64 hash) {
+    u32 max_load = _sp_hash_max_load(*capacity, layout->load_factor);
+    if (count >= max_load) {
+        _sp_hash_chain_resize(table, layout, capacity, _sp_hash_grow_capacity(count, max_load, *capacity));
+    }
+
+    _SP_HashChainNode* node = _sp_hash_chain_take_node(table, layout);
+    u32 index = hash & (*capacity - 1);
+    node->hash = hash;
+    node->next = table->buckets[index];
+    table->buckets[index] = node;
+    return node;
+}
+
+// Unlink the node of 'key' and put it on the free list, its key and value stay
+// readable until the next insert. NULL if the key isn't in the table.
+static _SP_HashChainNode* _sp_hash_chain_erase(_SP_HashChain* table, const _SP_HashTableLayout* layout, u32 capacity, const void* key, u64 hash) {
+    _SP_HashChainNode** link = &table->buckets[hash & (capacity - 1)];
+    while (*link != NULL) {
+        _SP_HashChainNode* node = *link;
+        if (node->hash == hash && layout->equal(key, _sp_hash_chain_key(node), layout->key_size)) {
+            *link = node->next;
+            node->next = table->free_list;
+            table->free_list = node;
+            table->free_count++;
+            return node;
+        }
+        link = &node->next;
+    }
+    return NULL;
+}
+
+// Copy the 'count' live nodes into one slab of exactly that size, relinked into
+// 'new_capacity' buckets, and release everything else.
+static void _sp_hash_chain_compact(_SP_HashChain* table, const _SP_HashTableLayout* layout, u32* capacity, u32 count, u32 new_capacity) {
+    sp_prof_zone_begin("sp_hash_chain_compact");
+    _SP_HashChain new_table;
+    _sp_hash_chain_alloc(&new_table, layout, new_capacity);
+    if (count != 0) {
+        _sp_hash_chain_add_slab(&new_table, layout, count);
+    }
+
+    u64 node_size = _sp_hash_chain_node_size(layout);
+    u32 mask = new_capacity - 1;
+    for (u32 i = 0; i < *capacity; i++) {
+        for (_SP_HashChainNode* node = table->buckets[i]; node != NULL; node = node->next) {
+            _SP_HashChainNode* new_node = _sp_hash_chain_take_node(&new_table, layout);
+            memcpy(new_node, node, node_size);
+            u32 index = node->hash & mask;
+            new_node->next = new_table.buckets[index];
+            new_table.buckets[index] = new_node;
+        }
+    }
+
+    _sp_hash_chain_free(table, layout, *capacity);
+    *table = new_table;
+    *capacity = new_capacity;
+    sp_prof_zone_end();
+}
+
+// -- Swiss table --------------------------------------------------------------
+// https://abseil.io/about/design/swisstables
+//
+// Every slot has a control byte, kept apart from the keys. A full slot stores
+// the low 7 bits of its hash (h2) while the remaining bits (h1) pick the first
+// group of 16 slots to probe. All control bytes of a group are compared
+// against h2 at once, so only keys with a matching fingerprint are compared and
+// a miss usually stops after the first group.
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define _SP_HASH_SWISS_SSE2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define _SP_HASH_SWISS_NEON
+#endif
+
+enum {
+    _SP_HASH_SWISS_GROUP_SIZE = 16,
+    // Full slots have the high bit cleared.
+    _SP_HASH_SWISS_EMPTY = 0x80,
+    _SP_HASH_SWISS_DELETED = 0xfe,
+};
+
+typedef struct _SP_HashSwiss _SP_HashSwiss;
+struct _SP_HashSwiss {
+    u8* ctrl;
+    void* keys;
+    // NULL for sets.
+    void* values;
+    // Empty slots which can still be filled before the table has to be
+    // rehashed. Reusing a deleted slot doesn't count.
+    u32 growth_left;
+};
+
+#ifdef _SP_HASH_SWISS_NEON
+// NEON has no movemask, weigh every lane by its bit and add them up per half.
+static inline u32 _sp_hash_swiss_neon_mask(uint8x16_t matches) {
+    static const u8 bits[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t weighted = vandq_u8(matches, vld1q_u8(bits));
+    return vaddv_u8(vget_low_u8(weighted)) | (u32) vaddv_u8(vget_high_u8(weighted)) << 8;
+}
+#endif
+
+// Bit i is set if control byte i of the group equals 'value'.
+static inline u32 _sp_hash_swiss_match(const u8* group, u8 value) {
+#if defined(_SP_HASH_SWISS_SSE2)
+    __m128i ctrl = _mm_loadu_si128((const __m128i*) group);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char) value)));
+#elif defined(_SP_HASH_SWISS_NEON)
+    return _sp_hash_swiss_neon_mask(vceqq_u8(vld1q_u8(group), vdupq_n_u8(value)));
+#else
+    u32 mask = 0;
+    for (u32 i = 0; i < _SP_HASH_SWISS_GROUP_SIZE; i++) {
+        mask |= (u32) (group[i] == value) << i;
+    }
+    return mask;
+#endif
+}
+
+// Bit i is set if slot i of the group is empty or deleted.
+static inline u32 _sp_hash_swiss_match_free(const u8* group) {
+#if defined(_SP_HASH_SWISS_SSE2)
+    return _mm_movemask_epi8(_mm_loadu_si128((const __m128i*) group));
+#elif defined(_SP_HASH_SWISS_NEON)
+    return _sp_hash_swiss_neon_mask(vtstq_u8(vld1q_u8(group), vdupq_n_u8(0x80)));
+#else
+    u32 mask = 0;
+    for (u32 i = 0; i < _SP_HASH_SWISS_GROUP_SIZE; i++) {
+        mask |= (u32) (group[i] >> 7) << i;
+    }
+    return mask;
+#endif
+}
+
+static inline b8 _sp_hash_swiss_is_full(u8 ctrl) {
+    return (ctrl & 0x80) == 0;
+}
+
+static void _sp_hash_swiss_alloc(_SP_HashSwiss* table, const _SP_HashTableLayout* layout, u32 capacity) {
+    *table = (_SP_HashSwiss) {
+        .ctrl = sp_alloc(layout->allocator, capacity),
+        .keys = sp_alloc(layout->allocator, capacity * layout->key_size),
+        .values = NULL,
+        .growth_left = _sp_hash_max_load(capacity, layout->load_factor),
+    };
+    if (layout->value_size != 0) {
+        table->values = sp_alloc(layout->allocator, capacity * layout->value_size);
+    }
+    memset(table->ctrl, _SP_HASH_SWISS_EMPTY, capacity);
+}
+
+static void _sp_hash_swiss_free(_SP_HashSwiss* table, const _SP_HashTableLayout* layout, u32 capacity) {
+    sp_free(layout->allocator, table->ctrl, capacity);
+    sp_free(layout->allocator, table->keys, capacity * layout->key_size);
+    if (table->values != NULL) {
+        sp_free(layout->allocator, table->values, capacity * layout->value_size);
+    }
+}
+
+// Groups are probed in triangular steps, which visits every group once since
+// the group count is a power of two.
+static u32 _sp_hash_swiss_find(const _SP_HashSwiss* table, const _SP_HashTableLayout* layout, u32 capacity, const void* key, u64 hash) {
+    u32 group_mask = capacity / _SP_HASH_SWISS_GROUP_SIZE - 1;
+    u32 group = (hash >> 7) & group_mask;
+    u8 h2 = hash & 0x7f;
+    for (u32 i = 1; i <= group_mask + 1; i++) {
+        const u8* ctrl = table->ctrl + group * _SP_HASH_SWISS_GROUP_SIZE;
+        u32 matches = _sp_hash_swiss_match(ctrl, h2);
+        while (matches != 0) {
+            u32 index = group * _SP_HASH_SWISS_GROUP_SIZE + _sp_lsb_u32(matches);
+            if (layout->equal(key, (u8*) table->keys + index * layout->key_size, layout->key_size)) {
+                return index;
+            }
+            matches &= matches - 1;
+        }
+
+        // The key would have been placed in this group.
+        if (_sp_hash_swiss_match(ctrl, _SP_HASH_SWISS_EMPTY) != 0) {
+            return ~0u;
+        }
+        group = (group + i) & group_mask;
+    }
+    return ~0u;
+}
+
+// First empty or deleted slot on the probe sequence of 'hash'.
+static u32 _sp_hash_swiss_find_free(const u8* ctrl, u32 capacity, u64 hash) {
+    u32 group_mask = capacity / _SP_HASH_SWISS_GROUP_SIZE - 1;
+    u32 group = (hash >> 7) & group_mask;
+    for (u32 i = 1; i <= group_mask + 1; i++) {
+        u32 free = _sp_hash_swiss_match_free(ctrl + group * _SP_HASH_SWISS_GROUP_SIZE);
+        if (free != 0) {
+            return group * _SP_HASH_SWISS_GROUP_SIZE + _sp_lsb_u32(free);
+        }
+        group = (group + i) & group_mask;
+    }
+
+    sp_ensure(false, "Unreachable!");
+    return ~0u;
+}
+
+// Deleted slots still count against the load.
+static inline u32 _sp_hash_swiss_deleted(const _SP_HashSwiss* table, const _SP_HashTableLayout* layout, u32 capacity, u32 count) {
+    return _sp_hash_max_load(capacity, layout->load_factor) - count - table->growth_left;
+}
+
+// Move every element into a new table of 'new_capacity' slots, dropping deleted
+// slots.
+static void _sp_hash_swiss_resize(_SP_HashSwiss* table, const _SP_HashTableLayout* layout, u32* capacity, u32 count, u32 new_capacity) {
+    sp_prof_zone_begin("sp_hash_swiss_resize");
+    _SP_HashSwiss new_table;
+    _sp_hash_swiss_alloc(&new_table, layout, new_capacity);
+    for (u32 i = 0; i < *capacity; i++) {
+        if (!_sp_hash_swiss_is_full(table->ctrl[i])) {
+            continue;
+        }
+
+        const void* key = (u8*) table->keys + i * layout->key_size;
+        u64 hash = layout->hash(key, layout->key_size, layout->seed);
+        u32 index = _sp_hash_swiss_find_free(new_table.ctrl, new_capacity, hash);
+        new_table.ctrl[index] = hash & 0x7f;
+        memcpy((u8*) new_table.keys + index * layout->key_size, key, layout->key_size);
+        if (layout->value_size != 0) {
+            memcpy((u8*) new_table.values + index * layout->value_size,
+                    (u8*) table->values + i * layout->value_size,
+                    layout->value_size);
+        }
+    }
+    new_table.growth_left -= count;
+
+    _sp_hash_swiss_free(table, layout, *capacity);
+    *table = new_table;
+    *capacity = new_capacity;
+    sp_prof_zone_end();
+}
+
+// Claim a slot for a key which isn't in the table, rehashing if needed. Only
+// the control byte is written.
+static u32 _sp_hash_swiss_prepare_insert(_SP_HashSwiss* table, const _SP_HashTableLayout* layout, u32* capacity, u32 count, u64 hash) {
+    u32 index = _sp_hash_swiss_find_free(table->ctrl, *capacity, hash);
+    if (table->growth_left == 0 && table->ctrl[index] == _SP_HASH_SWISS_EMPTY) {
+        u32 new_capacity = _sp_hash_grow_capacity(count, _sp_hash_max_load(*capacity, layout->load_factor), *capacity);
+        _sp_hash_swiss_resize(table, layout, capacity, count, new_capacity);
+        index = _sp_hash_swiss_find_free(table->ctrl, *capacity, hash);
+    }
+
+    if (table->ctrl[index] == _SP_HASH_SWISS_EMPTY) {
+        table->growth_left--;
+    }
+    table->ctrl[index] = hash & 0x7f;
+    return index;
+}
+
+// A group which still has an empty slot has never been full, so no probe
+// sequence continues past it and the slot can go back to empty. Otherwise it
+// has to stay deleted to keep later groups reachable.
+static void _sp_hash_swiss_erase(_SP_HashSwiss* table, u32 index) {
+    const u8* group = table->ctrl + (index & ~(u32) (_SP_HASH_SWISS_GROUP_SIZE - 1));
+    if (_sp_hash_swiss_match(group, _SP_HASH_SWISS_EMPTY) != 0) {
+        table->ctrl[index] = _SP_HASH_SWISS_EMPTY;
+        table->growth_left++;
+    } else {
+        table->ctrl[index] = _SP_HASH_SWISS_DELETED;
+    }
+}
+
+// -- Robin Hood table ---------------------------------------------------------
+// https://codecapsule.com/2013/11/11/robin-hood-hashing/
+//
+// Linear probing where every slot knows how far it is from its home slot. An
+// insert takes the slot of the first element closer to home than itself, so
+// probe lengths stay short and even, and a lookup can stop as soon as it sees
+// an element closer to home than the key would be. Removing shifts the rest of
+// the cluster back by one, which means there are no tombstones.
+
+typedef struct _SP_HashRobin _SP_HashRobin;
+struct _SP_HashRobin {
+    // Distance from the home slot plus one, 0 for empty slots.
+    u32* dists;
+    u64* hashes;
+    void* keys;
+    // NULL for sets.
+    void* values;
+};
+
+static void _sp_hash_robin_alloc(_SP_HashRobin* table, const _SP_HashTableLayout* layout, u32 capacity) {
+    *table = (_SP_HashRobin) {
+        .dists = sp_alloc(layout->allocator, capacity * sizeof(u32)),
+        .hashes = sp_alloc(layout->allocator, capacity * sizeof(u64)),
+        .keys = sp_alloc(layout->allocator, capacity * layout->key_size),
+        .values = NULL,
+    };
+    if (layout->value_size != 0) {
+        table->values = sp_alloc(layout->allocator, capacity * layout->value_size);
+    }
+    memset(table->dists, 0, capacity * sizeof(u32));
+}
+
+static void _sp_hash_robin_free(_SP_HashRobin* table, const _SP_HashTableLayout* layout, u32 capacity) {
+    sp_free(layout->allocator, table->dists, capacity * sizeof(u32));
+    sp_free(layout->allocator, table->hashes, capacity * sizeof(u64));
+    sp_free(layout->allocator, table->keys, capacity * layout->key_size);
+    if (table->values != NULL) {
+        sp_free(layout->allocator, table->values, capacity * layout->value_size);
+    }
+}
+
+// Copy the hash, key and value of slot 'from' into slot 'to' of 'dst'.
+static inline void _sp_hash_robin_copy(_SP_HashRobin* dst, u32 to, const _SP_HashRobin* src, u32 from, const _SP_HashTableLayout* layout) {
+    dst->hashes[to] = src->hashes[from];
+    memcpy((u8*) dst->keys + to * layout->key_size,
+            (u8*) src->keys + from * layout->key_size,
+            layout->key_size);
+    if (layout->value_size != 0) {
+        memcpy((u8*) dst->values + to * layout->value_size,
+                (u8*) src->values + from * layout->value_size,
+                layout->value_size);
+    }
+}
+
+static u32 _sp_hash_robin_find(const _SP_HashRobin* table, const _SP_HashTableLayout* layout, u32 capacity, const void* key, u64 hash) {
+    u32 mask = capacity - 1;
+    u32 index = hash & mask;
+    for (u32 dist = 1; dist <= table->dists[index]; dist++) {
+        if (table->hashes[index] == hash &&
+            layout->equal(key, (u8*) table->keys + index * layout->key_size, layout->key_size)) {
+            return index;
+        }
+        index = (index + 1) & mask;
+    }
+    return ~0u;
+}
+
+// Claim a slot for a key which isn't in the table by shifting the rest of its
+// cluster back one slot. Only the distance and hash are written.
+static u32 _sp_hash_robin_place(_SP_HashRobin* table, const _SP_HashTableLayout* layout, u32 capacity, u64 hash) {
+    u32 mask = capacity - 1;
+    u32 index = hash & mask;
+    u32 dist = 1;
+    while (table->dists[index] >= dist) {
+        index = (index + 1) & mask;
+        dist++;
+    }
+
+    u32 end = index;
+    while (table->dists[end] != 0) {
+        end = (end + 1) & mask;
+    }
+    while (end != index) {
+        u32 prev = (end - 1) & mask;
+        _sp_hash_robin_copy(table, end, table, prev, layout);
+        table->dists[end] = table->dists[prev] + 1;
+        end = prev;
+    }
+
+    table->dists[index] = dist;
+    table->hashes[index] = hash;
+    return index;
+}
+
+static void _sp_hash_robin_resize(_SP_HashRobin* table, const _SP_HashTableLayout* layout, u32* capacity, u32 new_capacity) {
+    sp_prof_zone_begin("sp_hash_robin_resize");
+    _SP_HashRobin new_table;
+    _sp_hash_robin_alloc(&new_table, layout, new_capacity);
+    for (u32 i = 0; i < *capacity; i++) {
+        if (table->dists[i] != 0) {
+            u32 index = _sp_hash_robin_place(&new_table, layout, new_capacity, table->hashes[i]);
+            _sp_hash_robin_copy(&new_table, index, table, i, layout);
+        }
+    }
+
+    _sp_hash_robin_free(table, layout, *capacity);
+    *table = new_table;
+    *capacity = new_capacity;
+    sp_prof_zone_end();
+}
+
+static u32 _sp_hash_robin_prepare_insert(_SP_HashRobin* table, const _SP_HashTableLayout* layout, u32* capacity, u32 count, u64 hash) {
+    u32 max_load = _sp_hash_max_load(*capacity, layout->load_factor);
+    if (count >= max_load) {
+        _sp_hash_robin_resize(table, layout, capacity, _sp_hash_grow_capacity(count, max_load, *capacity));
+    }
+    return _sp_hash_robin_place(table, layout, *capacity, hash);
+}
+
+// Backward shift deletion, pull every following element of the cluster which
+// isn't in its home slot one step closer.
+static void _sp_hash_robin_erase(_SP_HashRobin* table, const _SP_HashTableLayout* layout, u32 capacity, u32 index) {
+    u32 mask = capacity - 1;
+    u32 next = (index + 1) & mask;
+    while (table->dists[next] > 1) {
+        _sp_hash_robin_copy(table, index, table, next, layout);
+        table->dists[index] = table->dists[next] - 1;
+        index = next;
+        next = (next + 1) & mask;
+    }
+    table->dists[index] = 0;
+}
+
+// -- Capacity -----------------------------------------------------------------
+
+static u32 _sp_hash_min_capacity(SP_HashCollisionResolution resolution) {
+    return resolution == SP_HASH_COLLISION_RESOLUTION_SWISS_TABLE ? _SP_HASH_SWISS_GROUP_SIZE : 8;
+}
+
+// Power of two slot count for a requested capacity.
+static u32 _sp_hash_capacity(SP_HashCollisionResolution resolution, u32 capacity) {
+    return sp_max(_sp_next_pow2(capacity), _sp_hash_min_capacity(resolution));
+}
+
+// Smallest capacity holding 'count' elements without a rehash.
+static u32 _sp_hash_capacity_for(SP_HashCollisionResolution resolution, u32 count, u32 load_factor) {
+    u32 capacity = _sp_hash_min_capacity(resolution);
+    while (_sp_hash_max_load(capacity, load_factor) < count) {
+        sp_ensure(capacity < _SP_HASH_MAX_CAPACITY, "Hash table capacity too big.");
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+// Fixed point load factor from 'SP_HashMapDesc.load_factor', where 0 picks the
+// default of the collision resolution.
+static u32 _sp_hash_load_factor(SP_HashCollisionResolution resolution, f32 load_factor) {
+    if (load_factor <= 0.0f) {
+        switch (resolution) {
+            case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING:
+            case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING:
+                load_factor = 0.75f;
+                break;
+            case SP_HASH_COLLISION_RESOLUTION_SWISS_TABLE:
+                load_factor = 0.875f;
+                break;
+            case SP_HASH_COLLISION_RESOLUTION_ROBIN_HOOD:
+                load_factor = 0.9f;
+                break;
+        }
+    }
+    return sp_clamp(load_factor, 0.05f, 1.0f) * _SP_HASH_LOAD_FACTOR_ONE;
+}
+
+// -- Hash map -----------------------------------------------------------------
+
+struct SP_HashMap {
+    SP_HashMapDesc desc;
+    u32 capacity;
+    // See '_sp_hash_max_load'.
+    u32 load_factor;
+    // Count of active elements in set
+    u32 count;
+    // Set by removals, lets the next insert shrink a sparse map. Cleared by
+    // a reserve so the room it made stays.
+    b8 removed;
+    union {
+        // Struct of Arrays
+        // Used for open addressing
+        struct {
+            u8* state;
+            u64* hashes;
+            void* keys;
+            void* values;
+            // Count of used or dead slots
+            u32 count;
+            // Count of dead slots
+            u32 dead;
+            // Table being drained by an incremental resize, 'state' is NULL
+            // when none is in progress.
+            struct {
+                u8* state;
+                u64* hashes;
+                void* keys;
+                void* values;
+                u32 capacity;
+                // Count of live elements left
+                u32 count;
+                // Next slot to move
+                u32 cursor;
+            } old;
+        } soa;
+        // Used for separate chaining
+        _SP_HashChain chain;
+        // Used for Swiss tables
+        _SP_HashSwiss swiss;
+        // Used for Robin Hood hashing
+        _SP_HashRobin robin;
+    };
+};
+
+// Move the next 'slots' slots of the table being drained by an incremental
+// resize into the current one, freeing it once it's empty. Inserts and sets
+// call this, removes don't so they never move the elements an iterator has
+// yet to reach.
+static void _sp_hash_map_migrate(SP_HashMap* map, u32 slots) {
+    if (map->soa.old.state == NULL) {
+        return;
+    }
+
+    u64 key_size = map->desc.key_size;
+    u64 value_size = map->desc.value_size;
+    u32 end = sp_min(map->soa.old.cursor + slots, map->soa.old.capacity);
+    for (u32 i = map->soa.old.cursor; i < end; i++) {
+        if (map->soa.old.state[i] != _SP_HASH_BUCKET_STATE_ALIVE) {
+            continue;
+        }
+
+        const void* key = (u8*) map->soa.old.keys + key_size * i;
+        u64 hash = map->soa.old.hashes[i];
+        u32 index = _sp_hash_container_get_index(key,
+                key_size,
+                hash,
+                map->soa.state,
+                map->soa.hashes,
+                map->soa.keys,
+                true,
+                map->capacity,
+                map->desc.equal);
+        if (map->soa.state[index] == _SP_HASH_BUCKET_STATE_EMPTY) {
+            map->soa.count++;
+        } else {
+            map->soa.dead--;
+        }
+        map->soa.state[index] = _SP_HASH_BUCKET_STATE_ALIVE;
+        map->soa.hashes[index] = hash;
+        memcpy((u8*) map->soa.keys + key_size * index, key, key_size);
+        memcpy((u8*) map->soa.values + value_size * index,
+                (u8*) map->soa.old.values + value_size * i,
+                value_size);
+        // Dead rather than empty, probes for the rest of the old table
+        // still need to pass it.
+        map->soa.old.state[i] = _SP_HASH_BUCKET_STATE_DEAD;
+        map->soa.old.count--;
+    }
+    map->soa.old.cursor = end;
+
+    if (end == map->soa.old.capacity) {
+        u32 capacity = map->soa.old.capacity;
+        sp_free(map->desc.allocator, map->soa.old.state, capacity * sizeof(u8));
+        sp_free(map->desc.allocator, map->soa.old.hashes, capacity * sizeof(u64));
+        sp_free(map->desc.allocator, map->soa.old.keys, capacity * key_size);
+        sp_free(map->desc.allocator, map->soa.old.values, capacity * value_size);
+        memset(&map->soa.old, 0, sizeof(map->soa.old));
+    }
+}
+
+// Move all live elements of an open addressing map into 'new_cap' slots,
+// dropping tombstones.
+static void _sp_hash_map_rehash(SP_HashMap* map, u32 new_cap) {
+    sp_prof_zone_begin("sp_hash_map_rehash");
+    _sp_hash_map_migrate(map, map->soa.old.capacity);
+
+    if (new_cap == map->capacity) {
+        _sp_hash_container_purge(map->soa.state,
+                map->soa.hashes,
+                map->soa.keys,
+                map->desc.key_size,
+                map->soa.values,
+                map->desc.value_size,
+                map->capacity);
+        map->soa.count = map->count;
+        map->soa.dead = 0;
+        sp_prof_zone_end();
+        return;
+    }
+
+    u8* new_state = sp_alloc(map->desc.allocator, new_cap * sizeof(u8));
+    u64* new_hashes = sp_alloc(map->desc.allocator, new_cap * sizeof(u64));
+    void* new_keys = sp_alloc(map->desc.allocator, new_cap * map->desc.key_size);
+    void* new_values = sp_alloc(map->desc.allocator, new_cap * map->desc.value_size);
+    memset(new_state, 0, new_cap * sizeof(u8));
+
+    for (u32 i = 0; i < map->capacity; i++) {
+        if (map->soa.state[i] == _SP_HASH_BUCKET_STATE_ALIVE) {
+            const void* key = (u8*) map->soa.keys + map->desc.key_size * i;
+            u32 new_index = _sp_hash_container_get_index(key,
+                    map->desc.key_size,
+                    map->soa.hashes[i],
+                    new_state,
+                    new_hashes,
+                    new_keys,
+                    true,
+                    new_cap,
+                    map->desc.equal);
+            u64 value_size = map->desc.value_size;
+            u64 key_size = map->desc.key_size;
+
+            new_state[new_index] = _SP_HASH_BUCKET_STATE_ALIVE;
+            new_hashes[new_index] = map->soa.hashes[i];
+            memcpy((u8*) new_keys + key_size * new_index,
+                    (u8*) map->soa.keys + key_size * i,
+                    key_size);
+            memcpy((u8*) new_values + value_size * new_index,
+                    (u8*) map->soa.values + value_size * i,
+                    value_size);
+        }
+    }
+
+    sp_free(map->desc.allocator, map->soa.state, map->capacity * sizeof(u8));
+    sp_free(map->desc.allocator, map->soa.hashes, map->capacity * sizeof(u64));
+    sp_free(map->desc.allocator, map->soa.keys, map->capacity * map->desc.key_size);
+    sp_free(map->desc.allocator, map->soa.values, map->capacity * map->desc.value_size);
+
+    map->soa.state = new_state;
+    map->soa.hashes = new_hashes;
+    map->soa.keys = new_keys;
+    map->soa.values = new_values;
+    map->capacity = new_cap;
+    map->soa.count = map->count;
+    map->soa.dead = 0;
+    sp_prof_zone_end();
+}
+
+// Resize an open addressing map. With 'incremental_resize' this only swaps in
+// an empty table, the elements follow in '_sp_hash_map_migrate'. That includes
+// clearing tombstones at the same capacity, which would otherwise rehash the
+// whole table in place at once.
+static void _sp_hash_map_resize(SP_HashMap* map, u32 new_cap) {
+    if (!map->desc.incremental_resize) {
+        _sp_hash_map_rehash(map, new_cap);
+        return;
+    }
+
+    // Only one table can be drained at a time.
+    _sp_hash_map_migrate(map, map->soa.old.capacity);
+
+    map->soa.old.state = map->soa.state;
+    map->soa.old.hashes = map->soa.hashes;
+    map->soa.old.keys = map->soa.keys;
+    map->soa.old.values = map->soa.values;
+    map->soa.old.capacity = map->capacity;
+    map->soa.old.count = map->count;
+    map->soa.old.cursor = 0;
+
+    map->soa.state = sp_alloc(map->desc.allocator, new_cap * sizeof(u8));
+    map->soa.hashes = sp_alloc(map->desc.allocator, new_cap * sizeof(u64));
+    map->soa.keys = sp_alloc(map->desc.allocator, new_cap * map->desc.key_size);
+    map->soa.values = sp_alloc(map->desc.allocator, new_cap * map->desc.value_size);
+    memset(map->soa.state, 0, new_cap * sizeof(u8));
+    map->capacity = new_cap;
+    map->soa.count = 0;
+    map->soa.dead = 0;
+}
+
+// Slot of a live key, or ~0u.
+static u32 _sp_hash_map_open_find(SP_HashMap* map, const void* key, u64 hash) {
+    u32 index = _sp_hash_container_get_index(key,
+            map->desc.key_size,
+            hash,
+            map->soa.state,
+            map->soa.hashes,
+            map->soa.keys,
+            false,
+            map->capacity,
+            map->desc.equal);
+    if (index == ~0u || map->soa.state[index] != _SP_HASH_BUCKET_STATE_ALIVE) {
+        return ~0u;
+    }
+    return index;
+}
+
+// Slot of a live key in the table being drained by an incremental resize, or
+// ~0u.
+static u32 _sp_hash_map_open_find_old(SP_HashMap* map, const void* key, u64 hash) {
+    if (map->soa.old.state == NULL) {
+        return ~0u;
+    }
+
+    u32 index = _sp_hash_container_get_index(key,
+            map->desc.key_size,
+            hash,
+            map->soa.old.state,
+            map->soa.old.hashes,
+            map->soa.old.keys,
+            false,
+            map->soa.old.capacity,
+            map->desc.equal);
+    if (index == ~0u || map->soa.old.state[index] != _SP_HASH_BUCKET_STATE_ALIVE) {
+        return ~0u;
+    }
+    return index;
+}
+
+// Claim a slot for a key which isn't in the map, reusing tombstones. Only the
+// state and hash are written.
+static u32 _sp_hash_map_open_prepare_insert(SP_HashMap* map, const void* key, u64 hash) {
+    // Elements still in the old table count against the new one, so they
+    // always fit once moved.
+    if (map->soa.count + map->soa.old.count >= _sp_hash_max_load(map->capacity, map->load_factor)) {
+        _sp_hash_map_resize(map, _sp_hash_grow_capacity(map->count,
+                    _sp_hash_max_load(map->capacity, map->load_factor),
+                    map->capacity));
+    }
+
+    u32 index = _sp_hash_container_get_index(key,
+            map->desc.key_size,
+            hash,
+            map->soa.state,
+            map->soa.hashes,
+            map->soa.keys,
+            true,
+            map->capacity,
+            map->desc.equal);
+    if (map->soa.state[index] == _SP_HASH_BUCKET_STATE_EMPTY) {
+        map->soa.count++;
+    } else {
+        map->soa.dead--;
+    }
+    map->soa.state[index] = _SP_HASH_BUCKET_STATE_ALIVE;
+    map->soa.hashes[index] = hash;
+    return index;
+}
+
+static inline b8 _sp_hash_map_should_shrink(const SP_HashMap* map) {
+    return _sp_hash_should_shrink(map->count,
+            _sp_hash_max_load(map->capacity, map->load_factor),
+            map->capacity,
+            _sp_hash_capacity(map->desc.collision_resolution, map->desc.capacity));
+}
+
+static inline _SP_HashTableLayout _sp_hash_map_layout(const SP_HashMap* map) {
+    return (_SP_HashTableLayout) {
+        .allocator = map->desc.allocator,
+        .hash = map->desc.hash,
+        .seed = map->desc.seed,
+        .equal = map->desc.equal,
+        .key_size = map->desc.key_size,
+        .value_size = map->desc.value_size,
+        .load_factor = map->load_factor,
+    };
+}
+
+// Shrink a map left mostly empty by removals, called before inserting a new
+// key. Leaves room for twice the current count.
+static void _sp_hash_map_shrink_sparse(SP_HashMap* map) {
+    if (!map->removed || !_sp_hash_map_should_shrink(map)) {
+        return;
+    }
+    map->removed = false;
+
+    SP_HashCollisionResolution resolution = map->desc.collision_resolution;
+    u32 capacity = sp_max(_sp_hash_capacity_for(resolution, map->count * 2, map->load_factor),
+            _sp_hash_capacity(resolution, map->desc.capacity));
+    if (capacity >= map->capacity) {
+        return;
+    }
+    _SP_HashTableLayout layout = _sp_hash_map_layout(map);
+    switch (resolution) {
+        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING:
+            // Only one table can be drained at a time.
+            if (map->soa.old.state == NULL) {
+                _sp_hash_map_resize(map, capacity);
+            }
+            break;
+        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING:
+            _sp_hash_chain_resize(&map->chain, &layout, &map->capacity, capacity);
+            break;
+        case SP_HASH_COLLISION_RESOLUTION_SWISS_TABLE:
+            _sp_hash_swiss_resize(&map->swiss, &layout, &map->capacity, map->count, capacity);
+            break;
+        case SP_HASH_COLLISION_RESOLUTION_ROBIN_HOOD:
+            _sp_hash_robin_resize(&map->robin, &layout, &map->capacity, capacity);
+            break;
+    }
+}
+
+SP_HashMap* sp_hash_map_create(SP_HashMapDesc desc) {
+    SP_HashMap* map = sp_alloc(desc.allocator, sizeof(SP_HashMap));
+    if (desc.hash == NULL) {
+        desc.hash = _sp_hash_default_func(desc.key_size);
+    }
+    if (desc.seed == 0) {
+        desc.seed = sp_hash_random_seed(map);
+    }
+
+    u32 cap = _sp_hash_capacity(desc.collision_resolution, desc.capacity);
+    u32 load_factor = _sp_hash_load_factor(desc.collision_resolution, desc.load_factor);
+    switch (desc.collision_resolution) {
+        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING:
+            *map = (SP_HashMap) {
+                .desc = desc,
+                .capacity = cap,
+                .load_factor = load_factor,
+                .soa = {
+                    .state = sp_alloc(desc.allocator, cap * sizeof(u8)),
+                    .hashes = sp_alloc(desc.allocator, cap * sizeof(u64)),
+                    .keys = sp_alloc(desc.allocator, cap * desc.key_size),
+                    .values = sp_alloc(desc.allocator, cap * desc.value_size),
+                }
+            };
+            memset(map->soa.state, 0, cap * sizeof(u8));
+            break;
+        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
+            *map = (SP_HashMap) {
+                .desc = desc,
+                .capacity = cap,
+                .load_factor = load_factor,
+            };
+            _SP_HashTableLayout layout = _sp_hash_map_layout(map);
+            _sp_hash_chain_alloc(&map->chain, &layout, map->capacity);
+        } break;
+        case SP_HASH_COLLISION_RESOLUTION_SWISS_TABLE: {
+            *map = (SP_HashMap) {
+                .desc = desc,
+                .capacity = cap,
+                .load_factor = load_factor,
+            };
+            _SP_HashTableLayout layout = _sp_hash_map_layout(map);
+            _sp_hash_swiss_alloc(&map->swiss, &layout, map->capacity);
+        } break;
+        case SP_HASH_COLLISION_RESOLUTION_ROBIN_HOOD: {
+            *map = (SP_HashMap) {
+                .desc = desc,
+                .capacity = cap,
+                .load_factor = load_factor,
+            };
+            _SP_HashTableLayout layout = _sp_hash_map_layout(map);
+            _sp_hash_robin_alloc(&map->robin, &layout, map->capacity);
+        } break;
+    }
+
+    return map;
+}
+
+void sp_hash_map_destroy(SP_HashMap* map) {
+    switch (map->desc.collision_resolution) {
+        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING:
+            if (map->soa.old.state != NULL) {
+                u32 capacity = map->soa.old.capacity;
+                sp_free(map->desc.allocator, map->soa.old.state, capacity * sizeof(u8));
+                sp_free(map->desc.allocator, map->soa.old.hashes, capacity * sizeof(u64));
+                sp_free(map->desc.allocator, map->soa.old.keys, capacity * map->desc.key_size);
+                sp_free(map->desc.allocator, map->soa.old.values, capacity * map->desc.value_size);
+            }
+            sp_free(map->desc.allocator, map->soa.state, map->capacity * sizeof(u8));
+            sp_free(map->desc.allocator, map->soa.hashes, map->capacity * sizeof(u64));
+            sp_free(map->desc.allocator, map->soa.keys, map->capacity * map->desc.key_size);
+            sp_free(map->desc.allocator, map->soa.values, map->capacity * map->desc.value_size);
+            break;
+        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
+            _SP_HashTableLayout layout = _sp_hash_map_layout(map);
+            _sp_hash_chain_free(&map->chain, &layout, map->capacity);
+        } break;
+        case SP_HASH_COLLISION_RESOLUTION_SWISS_TABLE: {
+            _SP_HashTableLayout layout = _sp_hash_map_layout(map);
+            _sp_hash_swiss_free(&map->swiss, &layout, map->capacity);
+        } break;
+        case SP_HASH_COLLISION_RESOLUTION_ROBIN_HOOD: {
+            _SP_HashTableLayout layout = _sp_hash_map_layout(map);
+            _sp_hash_robin_free(&map->robin, &layout, map->capacity);
+        } break;
+    }
+    SP_Allocator allocator = map->desc.allocator;
+    *map = (SP_HashMap) {0};
+    sp_free(allocator, map, sizeof(SP_HashMap));
+}
+
+b8 sp_hash_map_insert(SP_HashMap* map, const void* key, const void* value) {
+    u64 hash = map->desc.hash(key, map->desc.key_size, map->desc.seed);
+    switch (map->desc.collision_resolution) {
+        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING: {
+            _sp_hash_map_migrate(map, _SP_HASH_MIGRATE_STEP);
+            if (_sp_hash_map_open_find(map, key, hash) != ~0u ||
+                _sp_hash_map_open_find_old(map, key, hash) != ~0u) {
+                return false;
+            }
+
+            _sp_hash_map_shrink_sparse(map);
+
+            u32 index = _sp_hash_map_open_prepare_insert(map, key, hash);
+            u64 key_size = map->desc.key_size;
+            u64 value_size = map->desc.value_size;
+            memcpy((u8*) map->soa.keys + key_size * index, key, key_size);
+            memcpy((u8*) map->soa.values + value_size * index, value, value_size);
+            map->count++;
+            return true;
+        }
+        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
+            _SP_HashTableLayout layout = _sp_hash_map_layout(map);
+            if (_sp_hash_chain_find(&map->chain, &layout, map->capacity, key, hash) != NULL) {
+                return false;
+            }
+
+            _sp_hash_map_shrink_sparse(map);
+
+            _SP_HashChainNode* node = _sp_hash_chain_prepare_insert(&map->chain, &layout, &map->capacity, map->count, hash);
+            memcpy(_sp_hash_chain_key(node), key, layout.key_size);
+            memcpy(_sp_hash_chain_value(node, &layout), value, layout.value_size);
+            map->count++;
+            return true;
+        }
+        case SP_HASH_COLLISION_RESOLUTION_SWISS_TABLE: {
+            _SP_HashTableLayout layout = _sp_hash_map_layout(map);
+            if (_sp_hash_swiss_find(&map->swiss, &layout, map->capacity, key, hash) != ~0u) {
+                return false;
+            }
+
+            _sp_hash_map_shrink_sparse(map);
+
+            u32 index = _sp_hash_swiss_prepare_insert(&map->swiss, &layout, &map->capacity, map->count, hash);
+            memcpy((u8*) map->swiss.keys + index * layout.key_size, key, layout.key_size);
+            memcpy((u8*) map->swiss.values + index * layout.value_size, value, layout.value_size);
+            map->count++;
+            return true;
+        }
+        case SP_HASH_COLLISION_RESOLUTION_ROBIN_HOOD: {
+            _SP_HashTableLayout layout = _sp_hash_map_layout(map);
+            if (_sp_hash_robin_find(&map->robin, &layout, map->capacity, key, hash) != ~0u) {
+                return false;
+            }
+
+            _sp_hash_map_shrink_sparse(map);
+
+            u32 index = _sp_hash_robin_prepare_insert(&map->robin, &layout, &map->capacity, map->count, hash);
+            memcpy((u8*) map->robin.keys + index * layout.key_size, key, layout.key_size);
+            memcpy((u8*) map->robin.values + index * layout.value_size, value, layout.value_size);
+            map->count++;
+            return true;
+        }
+    }
+
+    sp_assert(false, "Unreachable!");
+    return false;
+}
+
+b8 sp_hash_map_set(SP_HashMap* map, const void* key, const void* value) {
+    u64 hash = map->desc.hash(key, map->desc.key_size, map->desc.seed);
+    switch (map->desc.collision_resolution) {
+        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING: {
+            u64 key_size = map->desc.key_size;
+            u64 value_size = map->desc.value_size;
+            _sp_hash_map_migrate(map, _SP_HASH_MIGRATE_STEP);
+            u32 index = _sp_hash_map_open_find(map, key, hash);
+            if (index == ~0u) {
+                u32 old_index = _sp_hash_map_open_find_old(map, key, hash);
+                if (old_index != ~0u) {
+                    memcpy((u8*) map->soa.old.values + value_size * old_index, value, value_size);
+                    return false;
+                }
+            }
+
+            b8 new_key = index == ~0u;
+            if (new_key) {
+                _sp_hash_map_shrink_sparse(map);
+                index = _sp_hash_map_open_prepare_insert(map, key, hash);
+                map->count++;
+            }
+
+            memcpy((u8*) map->soa.keys + key_size * index, key, key_size);
+            memcpy((u8*) map->soa.values + value_size * index, value, value_size);
+            return new_key;
+        }
+        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
+            _SP_HashTableLayout layout = _sp_hash_map_layout(map);
+            _SP_HashChainNode* node = _sp_hash_chain_find(&map->chain, &layout, map->capacity, key, hash);
+            b8 new_key = node == NULL;
+            if (new_key) {
+                _sp_hash_map_shrink_sparse(map);
+                node = _sp_hash_chain_prepare_insert(&map->chain, &layout, &map->capacity, map->count, hash);
+                memcpy(_sp_hash_chain_key(node), key, layout.key_size);
+                map->count++;
+            }
+            memcpy(_sp_hash_chain_value(node, &layout), value, layout.value_size);
+            return new_key;
+        }
+        case SP_HASH_COLLISION_RESOLUTION_SWISS_TABLE: {
+            _SP_HashTableLayout layout = _sp_hash_map_layout(map);
+            u32 index = _sp_hash_swiss_find(&map->swiss, &layout, map->capacity, key, hash);
+            b8 new_key = index == ~0u;
+            if (new_key) {
+                _sp_hash_map_shrink_sparse(map);
+                index = _sp_hash_swiss_prepare_insert(&map->swiss, &layout, &map->capacity, map->count, hash);
+                map->count++;
+            }
+            memcpy((u8*) map->swiss.keys + index * layout.key_size, key, layout.key_size);
+            memcpy((u8*) map->swiss.values + index * layout.value_size, value, layout.value_size);
+            return new_key;
+        }
+        case SP_HASH_COLLISION_RESOLUTION_ROBIN_HOOD: {
+            _SP_HashTableLayout layout = _sp_hash_map_layout(map);
+            u32 index = _sp_hash_robin_find(&map->robin, &layout, map->capacity, key, hash);
+            b8 new_key = index == ~0u;
+            if (new_key) {
+                _sp_hash_map_shrink_sparse(map);
+                index = _sp_hash_robin_prepare_insert(&map->robin, &layout, &map->capacity, map->count, hash);
+                map->count++;
+            }
+            memcpy((u8*) map->robin.keys + index * layout.key_size, key, layout.key_size);
+            memcpy((u8*) map->robin.values + index * layout.value_size, value, layout.value_size);
+            return new_key;
+        }
+    }
+
+    sp_assert(false, "Unreachable!");
+    return false;
+}
+
+b8 sp_hash_map_remove(SP_HashMap* map, const void* key, void* out_value) {
+    u64 hash = map->desc.hash(key, map->desc.key_size, map->desc.seed);
+    switch (map->desc.collision_resolution) {
+        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING: {
+            void* values = map->soa.values;
+            u32 index = _sp_hash_map_open_find(map, key, hash);
+            if (index != ~0u) {
+                map->soa.state[index] = _SP_HASH_BUCKET_STATE_DEAD;
+                map->soa.dead++;
+            } else {
+                index = _sp_hash_map_open_find_old(map, key, hash);
+                if (index == ~0u) {
+                    return false;
+                }
+                map->soa.old.state[index] = _SP_HASH_BUCKET_STATE_DEAD;
+                map->soa.old.count--;
+                values = map->soa.old.values;
+            }
+
+            if (out_value != NULL) {
+                u64 value_size = map->desc.value_size;
+                memcpy(out_value,
+                    (u8*) values + index * value_size,
+                    value_size);
+            }
+            map->count--;
+            map->removed = true;
+            return true;
+        }
+        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
+            _SP_HashTableLayout layout = _sp_hash_map_layout(map);
+            _SP_HashChainNode* node = _sp_hash_chain_erase(&map->chain, &layout, map->capacity, key, hash);
+            if (node == NULL) {
+                return false;
+            }
+
+            if (out_value != NULL) {
+                memcpy(out_value, _sp_hash_chain_value(node, &layout), layout.value_size);
+            }
+            map->count--;
+            map->removed = true;
+            return true;
+        }
+        case SP_HASH_COLLISION_RESOLUTION_SWISS_TABLE: {
+            _SP_HashTableLayout layout = _sp_hash_map_layout(map);
+            u32 index = _sp_hash_swiss_find(&map->swiss, &layout, map->capacity, key, hash);
+            if (index == ~0u) {
+                return false;
+            }
+
+            if (out_value != NULL) {
+                memcpy(out_value,
+                    (u8*) map->swiss.values + index * layout.value_size,
+                    layout.value_size);
+            }
+            _sp_hash_swiss_erase(&map->swiss, index);
+            map->count--;
+            map->removed = true;
+            return true;
+        }
+        case SP_HASH_COLLISION_RESOLUTION_ROBIN_HOOD: {
+            _SP_HashTableLayout layout = _sp_hash_map_layout(map);
+            u32 index = _sp_hash_robin_find(&map->robin, &layout, map->capacity, key, hash);
+            if (index == ~0u) {
+                return false;
+            }
+
+            if (out_value != NULL) {
+                memcpy(out_value,
+                    (u8*) map->robin.values + index * layout.value_size,
+                    layout.value_size);
+            }
+            _sp_hash_robin_erase(&map->robin, &layout, map->capacity, index);
+            map->count--;
+            map->removed = true;
+            return true;
+        }
+    }
+
+    sp_assert(false, "Unreachable!");
+    return false;
+}
+
+b8 sp_hash_map_get(SP_HashMap* map, const void* key, void* out_value) {
+    u64 hash = map->desc.hash(key, map->desc.key_size, map->desc.seed);
+    switch (map->desc.collision_resolution) {
+        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING: {
+            // Lookups don't move elements of an incremental resize, so
+            // concurrent readers stay safe.
+            const void* values = map->soa.values;
+            u32 index = _sp_hash_map_open_find(map, key, hash);
+            if (index == ~0u) {
+                index = _sp_hash_map_open_find_old(map, key, hash);
+                values = map->soa.old.values;
+            }
+            if (index == ~0u) {
+                return false;
+            }
+
+            if (out_value != NULL) {
+                u64 value_size = map->desc.value_size;
+                memcpy(out_value,
+                    (const u8*) values + index * value_size,
+                    value_size);
+            }
+            return true;
+        }
+        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
+            _SP_HashTableLayout layout = _sp_hash_map_layout(map);
+            _SP_HashChainNode* node = _sp_hash_chain_find(&map->chain, &layout, map->capacity, key, hash);
+            if (node == NULL) {
+                return false;
+            }
+
+            if (out_value != NULL) {
+                memcpy(out_value, _sp_hash_chain_value(node, &layout), layout.value_size);
+            }
+            return true;
+        }
+        case SP_HASH_COLLISION_RESOLUTION_SWISS_TABLE: {
+            _SP_HashTableLayout layout = _sp_hash_map_layout(map);
+            u32 index = _sp_hash_swiss_find(&map->swiss, &layout, map->capacity, key, hash);
+            if (index == ~0u) {
+                return false;
+            }
+
+            if (out_value != NULL) {
+                memcpy(out_value,
+                    (u8*) map->swiss.values + index * layout.value_size,
+                    layout.value_size);
+            }
+            return true;
+        }
+        case SP_HASH_COLLISION_RESOLUTION_ROBIN_HOOD: {
+            _SP_HashTableLayout layout = _sp_hash_map_layout(map);
+            u32 index = _sp_hash_robin_find(&map->robin, &layout, map->capacity, key, hash);
+            if (index == ~0u) {
+                return false;
+            }
+
+            if (out_value != NULL) {
+                memcpy(out_value,
+                    (u8*) map->robin.values + index * layout.value_size,
+                    layout.value_size);
+            }
+            return true;
+        }
+    }
+
+    sp_assert(false, "Unreachable!");
+    return false;
+}
+
+void* sp_hash_map_getp(SP_HashMap* map, const void* key) {
+    u64 hash = map->desc.hash(key, map->desc.key_size, map->desc.seed);
+    switch (map->desc.collision_resolution) {
+        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING: {
+            void* values = map->soa.values;
+            u32 index = _sp_hash_map_open_find(map, key, hash);
+            if (index == ~0u) {
+                index = _sp_hash_map_open_find_old(map, key, hash);
+                values = map->soa.old.values;
+            }
+            if (index == ~0u) {
+                return NULL;
+            }
+            return (u8*) values + index * map->desc.value_size;
+        }
+        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
+            _SP_HashTableLayout layout = _sp_hash_map_layout(map);
+            _SP_HashChainNode* node = _sp_hash_chain_find(&map->chain, &layout, map->capacity, key, hash);
+            if (node == NULL) {
+                return NULL;
+            }
+            return _sp_hash_chain_value(node, &layout);
+        }
+        case SP_HASH_COLLISION_RESOLUTION_SWISS_TABLE: {
+            _SP_HashTableLayout layout = _sp_hash_map_layout(map);
+            u32 index = _sp_hash_swiss_find(&map->swiss, &layout, map->capacity, key, hash);
+            if (index == ~0u) {
+                return NULL;
+            }
+            return (u8*) map->swiss.values + index * layout.value_size;
+        }
+        case SP_HASH_COLLISION_RESOLUTION_ROBIN_HOOD: {
+            _SP_HashTableLayout layout = _sp_hash_map_layout(map);
+            u32 index = _sp_hash_robin_find(&map->robin, &layout, map->capacity, key, hash);
+            if (index == ~0u) {
+                return NULL;
+            }
+            return (u8*) map->robin.values + index * layout.value_size;
+        }
+    }
+
+    sp_assert(false, "Unreachable!");
+    return NULL;
+}
+
+u32 sp_hash_map_count(const SP_HashMap* map) {
+    return map->count;
+}
+
+void sp_hash_map_reserve(SP_HashMap* map, u32 count) {
+    map->removed = false;
+    switch (map->desc.collision_resolution) {
+        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING: {
+            u32 capacity = _sp_hash_capacity_for(map->desc.collision_resolution, count, map->load_factor);
+            if (capacity > map->capacity) {
+                _sp_hash_map_rehash(map, capacity);
+            }
+        } break;
+        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
+            u32 capacity = _sp_hash_capacity_for(map->desc.collision_resolution, count, map->load_factor);
+            _SP_HashTableLayout layout = _sp_hash_map_layout(map);
+            if (capacity > map->capacity) {
+                _sp_hash_chain_resize(&map->chain, &layout, &map->capacity, capacity);
+            }
+            if (count > map->count) {
+                _sp_hash_chain_reserve_nodes(&map->chain, &layout, count - map->count);
+            }
+        } break;
+        case SP_HASH_COLLISION_RESOLUTION_SWISS_TABLE: {
+            u32 capacity = _sp_hash_capacity_for(map->desc.collision_resolution, count, map->load_factor);
+            if (capacity > map->capacity) {
+                _SP_HashTableLayout layout = _sp_hash_map_layout(map);
+                _sp_hash_swiss_resize(&map->swiss, &layout, &map->capacity, map->count, capacity);
+            }
+        } break;
+        case SP_HASH_COLLISION_RESOLUTION_ROBIN_HOOD: {
+            u32 capacity = _sp_hash_capacity_for(map->desc.collision_resolution, count, map->load_factor);
+            if (capacity > map->capacity) {
+                _SP_HashTableLayout layout = _sp_hash_map_layout(map);
+                _sp_hash_robin_resize(&map->robin, &layout, &map->capacity, capacity);
+            }
+        } break;
+    }
+}
+
+void sp_hash_map_shrink_to_fit(SP_HashMap* map) {
+    switch (map->desc.collision_resolution) {
+        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING: {
+            u32 capacity = sp_min(_sp_hash_capacity_for(map->desc.collision_resolution, map->count, map->load_factor), map->capacity);
+            if (capacity < map->capacity || map->soa.dead != 0 || map->soa.old.state != NULL) {
+                _sp_hash_map_rehash(map, capacity);
+            }
+        } break;
+        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
+            _SP_HashTableLayout layout = _sp_hash_map_layout(map);
+            u32 capacity = sp_min(_sp_hash_capacity_for(map->desc.collision_resolution, map->count, map->load_factor), map->capacity);
+            _sp_hash_chain_compact(&map->chain, &layout, &map->capacity, map->count, capacity);
+        } break;
+        case SP_HASH_COLLISION_RESOLUTION_SWISS_TABLE: {
+            _SP_HashTableLayout layout = _sp_hash_map_layout(map);
+            u32 capacity = sp_min(_sp_hash_capacity_for(map->desc.collision_resolution, map->count, map->load_factor), map->capacity);
+            if (capacity < map->capacity || _sp_hash_swiss_deleted(&map->swiss, &layout, map->capacity, map->count) != 0) {
+                _sp_hash_swiss_resize(&map->swiss, &layout, &map->capacity, map->count, capacity);
+            }
+        } break;
+        case SP_HASH_COLLISION_RESOLUTION_ROBIN_HOOD: {
+            u32 capacity = _sp_hash_capacity_for(map->desc.collision_resolution, map->count, map->load_factor);
+            if (capacity < map->capacity) {
+                _SP_HashTableLayout layout = _sp_hash_map_layout(map);
+                _sp_hash_robin_resize(&map->robin, &layout, &map->capacity, capacity);
+            }
+        } break;
+    }
+}
+
+// Iteration
+// Open addressing iterators walk the table and then the one drained by an
+// incremental resize, whose slots are numbered on from 'capacity'. Returns the
+// first live slot from 'index' on, or ~0u.
+static u32 _sp_hash_map_open_iter_find(const SP_HashMap* map, u32 index) {
+    for (; index < map->capacity; index++) {
+        if (map->soa.state[index] == _SP_HASH_BUCKET_STATE_ALIVE) {
+            return index;
+        }
+    }
+    for (; index - map->capacity < map->soa.old.capacity; index++) {
+        if (map->soa.old.state[index - map->capacity] == _SP_HASH_BUCKET_STATE_ALIVE) {
+            return index;
+        }
+    }
+    return ~0u;
+}
+
+static inline void* _sp_hash_map_open_iter_key(const SP_HashMap* map, u32 index) {
+    if (index < map->capacity) {
+        return (u8*) map->soa.keys + index * map->desc.key_size;
+    }
+    return (u8*) map->soa.old.keys + (index - map->capacity) * map->desc.key_size;
+}
+
+static inline void* _sp_hash_map_open_iter_value(const SP_HashMap* map, u32 index) {
+    if (index < map->capacity) {
+        return (u8*) map->soa.values + index * map->desc.value_size;
+    }
+    return (u8*) map->soa.old.values + (index - map->capacity) * map->desc.value_size;
+}
+
+SP_HashMapIter sp_hash_map_iter_init(SP_HashMap* map) {
+    SP_HashMapIter iter = {
+        .map = map,
+        .index = ~0u,
+        .node = NULL,
+    };
+
+    switch (map->desc.collision_resolution) {
+        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING:
+            // Walk both tables rather than finishing an incremental resize,
+            // which would cost as much as the resize it spreads out.
+            iter.index = _sp_hash_map_open_iter_find(map, 0);
+            break;
+        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING:
+            for (u32 i = 0; i < map->capacity; i++) {
+                if (map->chain.buckets[i] != NULL) {
+                    iter.index = i;
+                    iter.node = map->chain.buckets[i];
+                    break;
+                }
+            }
+            break;
+        case SP_HASH_COLLISION_RESOLUTION_SWISS_TABLE:
+            for (u32 i = 0; i < map->capacity; i++) {
+                if (_sp_hash_swiss_is_full(map->swiss.ctrl[i])) {
+                    iter.index = i;
+                    break;
+                }
+            }
+            break;
+        case SP_HASH_COLLISION_RESOLUTION_ROBIN_HOOD:
+            for (u32 i = 0; i < map->capacity; i++) {
+                if (map->robin.dists[i] != 0) {
+                    iter.index = i;
+                    break;
+                }
+            }
+            break;
+    }
+    return iter;
+}
+
+b8 sp_hash_map_iter_valid(SP_HashMapIter iter) {
+    if (iter.map == NULL) {
+        return false;
+    }
+    u32 end = iter.map->capacity;
+    if (iter.map->desc.collision_resolution == SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING) {
+        end += iter.map->soa.old.capacity;
+    }
+    return iter.index < end;
+}
+
+SP_HashMapIter sp_hash_map_iter_next(SP_HashMapIter iter) {
+    sp_assert(sp_hash_map_iter_valid(iter), "Hash map iterator must be valid!");
+
+    SP_HashMap* map = iter.map;
+    switch (map->desc.collision_resolution) {
+        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING:
+            iter.index = _sp_hash_map_open_iter_find(map, iter.index + 1);
+            if (iter.index != ~0u) {
+                return iter;
+            }
+            break;
+        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
+            _SP_HashChainNode* node = iter.node;
+            if (node->next != NULL) {
+                iter.node = node->next;
+                return iter;
+            }
+
+            for (u32 i = iter.index + 1; i < map->capacity; i++) {
+                if (map->chain.buckets[i] != NULL) {
+                    iter.index = i;
+                    iter.node = map->chain.buckets[i];
+                    return iter;
+                }
+            }
+        } break;
+        case SP_HASH_COLLISION_RESOLUTION_SWISS_TABLE:
+            for (u32 i = iter.index + 1; i < map->capacity; i++) {
+                if (_sp_hash_swiss_is_full(map->swiss.ctrl[i])) {
+                    iter.index = i;
+                    return iter;
+                }
+            }
+            break;
+        case SP_HASH_COLLISION_RESOLUTION_ROBIN_HOOD:
+            for (u32 i = iter.index + 1; i < map->capacity; i++) {
+                if (map->robin.dists[i] != 0) {
+                    iter.index = i;
+                    return iter;
+                }
+            }
+            break;
+    }
+    return (SP_HashMapIter) {0};
+}
+
+void sp_hash_map_iter_get_key(SP_HashMapIter iter, void* out_key) {
+    sp_assert(sp_hash_map_iter_valid(iter), "Hash map iterator must be valid!");
+
+    SP_HashMap* map = iter.map;
+    switch (map->desc.collision_resolution) {
+        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING:
+            memcpy(out_key, _sp_hash_map_open_iter_key(map, iter.index), map->desc.key_size);
+            break;
+        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING:
+            memcpy(out_key, _sp_hash_chain_key(iter.node), map->desc.key_size);
+            break;
+        case SP_HASH_COLLISION_RESOLUTION_SWISS_TABLE:
+            memcpy(out_key, (u8*) map->swiss.keys + iter.index * map->desc.key_size, map->desc.key_size);
+            break;
+        case SP_HASH_COLLISION_RESOLUTION_ROBIN_HOOD:
+            memcpy(out_key, (u8*) map->robin.keys + iter.index * map->desc.key_size, map->desc.key_size);
+            break;
+    }
+}
+
+void sp_hash_map_iter_get_value(SP_HashMapIter iter, void* out_value) {
+    sp_assert(sp_hash_map_iter_valid(iter), "Hash map iterator must be valid!");
+
+    SP_HashMap* map = iter.map;
+    switch (map->desc.collision_resolution) {
+        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING:
+            memcpy(out_value, _sp_hash_map_open_iter_value(map, iter.index), map->desc.value_size);
+            break;
+        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
+            _SP_HashTableLayout layout = _sp_hash_map_layout(map);
+            memcpy(out_value, _sp_hash_chain_value(iter.node, &layout), map->desc.value_size);
+        } break;
+        case SP_HASH_COLLISION_RESOLUTION_SWISS_TABLE:
+            memcpy(out_value, (u8*) map->swiss.values + iter.index * map->desc.value_size, map->desc.value_size);
+            break;
+        case SP_HASH_COLLISION_RESOLUTION_ROBIN_HOOD:
+            memcpy(out_value, (u8*) map->robin.values + iter.index * map->desc.value_size, map->desc.value_size);
+            break;
+    }
+}
+
+void* sp_hash_map_iter_get_valuep(SP_HashMapIter iter) {
+    sp_assert(sp_hash_map_iter_valid(iter), "Hash map iterator must be valid!");
+
+    SP_HashMap* map = iter.map;
+    switch (map->desc.collision_resolution) {
+        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING:
+            return _sp_hash_map_open_iter_value(map, iter.index);
+        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
+            _SP_HashTableLayout layout = _sp_hash_map_layout(map);
+            return _sp_hash_chain_value(iter.node, &layout);
+        }
+        case SP_HASH_COLLISION_RESOLUTION_SWISS_TABLE:
+            return (u8*) map->swiss.values + iter.index * map->desc.value_size;
+        case SP_HASH_COLLISION_RESOLUTION_ROBIN_HOOD:
+            return (u8*) map->robin.values + iter.index * map->desc.value_size;
+    }
+
+    return NULL;
+}
+
+// Helper functions
+
+u64 sp_hash_map_helper_hash_str(const void* key, u64 size, u64 seed) {
+    (void) size;
+    const SP_Str* _key = key;
+    return sp_hash_bytes(_key->data, _key->len, seed);
+}
+
+b8 sp_hash_map_helper_equal_str(const void* a, const void* b, u64 len) {
+    (void) len;
+    const SP_Str* _a = a;
+    const SP_Str* _b = b;
+    return sp_str_equal(*_a, *_b);
+}
+
+b8 sp_hash_map_helper_equal_generic(const void* a, const void* b, u64 len) {
+    return memcmp(a, b, len) == 0;
+}
+
+// -- Hash set -----------------------------------------------------------------
+
+struct SP_HashSet {
+    SP_HashSetDesc desc;
+    u32 capacity;
+    // See '_sp_hash_max_load'.
+    u32 load_factor;
+    // Count of active elements in set
+    u32 count;
+    // Set by removals, lets the next insert shrink a sparse set. Cleared by
+    // a reserve so the room it made stays.
+    b8 removed;
+    union {
+        // Struct of Arrays
+        // Used for open addressing
+        struct {
+            u8* state;
+            u64* hashes;
+            void* values;
+            // Count of used or dead slots
+            u32 count;
+            // Count of dead slots
+            u32 dead;
+            // See 'SP_HashMap'.
+            struct {
+                u8* state;
+                u64* hashes;
+                void* values;
+                u32 capacity;
+                u32 count;
+                u32 cursor;
+            } old;
+        } soa;
+        // Used for separate chaining
+        _SP_HashChain chain;
+        // Used for Swiss tables
+        _SP_HashSwiss swiss;
+        // Used for Robin Hood hashing
+        _SP_HashRobin robin;
+    };
+};
+
+// See '_sp_hash_map_migrate'.
+static void _sp_hash_set_migrate(SP_HashSet* set, u32 slots) {
+    if (set->soa.old.state == NULL) {
+        return;
+    }
+
+    u64 value_size = set->desc.value_size;
+    u32 end = sp_min(set->soa.old.cursor + slots, set->soa.old.capacity);
+    for (u32 i = set->soa.old.cursor; i < end; i++) {
+        if (set->soa.old.state[i] != _SP_HASH_BUCKET_STATE_ALIVE) {
+            continue;
+        }
+
+        const void* value = (u8*) set->soa.old.values + value_size * i;
+        u64 hash = set->soa.old.hashes[i];
+        u32 index = _sp_hash_container_get_index(value,
+                value_size,
+                hash,
+                set->soa.state,
+                set->soa.hashes,
+                set->soa.values,
+                true,
+                set->capacity,
+                set->desc.equal);
+        if (set->soa.state[index] == _SP_HASH_BUCKET_STATE_EMPTY) {
+            set->soa.count++;
+        } else {
+            set->soa.dead--;
+        }
+        set->soa.state[index] = _SP_HASH_BUCKET_STATE_ALIVE;
+        set->soa.hashes[index] = hash;
+        memcpy((u8*) set->soa.values + value_size * index, value, value_size);
+        // Dead rather than empty, probes for the rest of the old table
+        // still need to pass it.
+        set->soa.old.state[i] = _SP_HASH_BUCKET_STATE_DEAD;
+        set->soa.old.count--;
+    }
+    set->soa.old.cursor = end;
+
+    if (end == set->soa.old.capacity) {
+        u32 capacity = set->soa.old.capacity;
+        sp_free(set->desc.allocator, set->soa.old.state, capacity * sizeof(u8));
+        sp_free(set->desc.allocator, set->soa.old.hashes, capacity * sizeof(u64));
+        sp_free(set->desc.allocator, set->soa.old.values, capacity * value_size);
+        memset(&set->soa.old, 0, sizeof(set->soa.old));
+    }
+}
+
+// Move all live elements of an open addressing set into 'new_cap' slots,
+// dropping tombstones.
+static void _sp_hash_set_rehash(SP_HashSet* set, u32 new_cap) {
+    sp_prof_zone_begin("sp_hash_set_rehash");
+    _sp_hash_set_migrate(set, set->soa.old.capacity);
+
+    if (new_cap == set->capacity) {
+        _sp_hash_container_purge(set->soa.state,
+                set->soa.hashes,
+                set->soa.values,
+                set->desc.value_size,
+                NULL,
+                0,
+                set->capacity);
+        set->soa.count = set->count;
+        set->soa.dead = 0;
+        sp_prof_zone_end();
+        return;
+    }
+
+    u8* new_state = sp_alloc(set->desc.allocator, new_cap * sizeof(u8));
+    u64* new_hashes = sp_alloc(set->desc.allocator, new_cap * sizeof(u64));
+    void* new_values = sp_alloc(set->desc.allocator, new_cap * set->desc.value_size);
+    memset(new_state, 0, new_cap * sizeof(u8));
+
+    for (u32 i = 0; i < set->capacity; i++) {
+        if (set->soa.state[i] == _SP_HASH_BUCKET_STATE_ALIVE) {
+            const void* value = (u8*) set->soa.values + set->desc.value_size * i;
+            u32 new_index = _sp_hash_container_get_index(value,
+                    set->desc.value_size,
+                    set->soa.hashes[i],
+                    new_state,
+                    new_hashes,
+                    new_values,
+                    true,
+                    new_cap,
+                    set->desc.equal);
+            u64 value_size = set->desc.value_size;
+
+            new_state[new_index] = _SP_HASH_BUCKET_STATE_ALIVE;
+            new_hashes[new_index] = set->soa.hashes[i];
+            memcpy((u8*) new_values + value_size * new_index,
+                    (u8*) set->soa.values + value_size * i,
+                    value_size);
+        }
+    }
+
+    sp_free(set->desc.allocator, set->soa.state, set->capacity * sizeof(u8));
+    sp_free(set->desc.allocator, set->soa.hashes, set->capacity * sizeof(u64));
+    sp_free(set->desc.allocator, set->soa.values, set->capacity * set->desc.value_size);
+
+    set->soa.state = new_state;
+    set->soa.hashes = new_hashes;
+    set->soa.values = new_values;
+    set->capacity = new_cap;
+    set->soa.count = set->count;
+    set->soa.dead = 0;
+    sp_prof_zone_end();
+}
+
+// See '_sp_hash_map_resize'.
+static void _sp_hash_set_resize(SP_HashSet* set, u32 new_cap) {
+    if (!set->desc.incremental_resize) {
+        _sp_hash_set_rehash(set, new_cap);
+        return;
+    }
+
+    _sp_hash_set_migrate(set, set->soa.old.capacity);
+
+    set->soa.old.state = set->soa.state;
+    set->soa.old.hashes = set->soa.hashes;
+    set->soa.old.values = set->soa.values;
+    set->soa.old.capacity = set->capacity;
+    set->soa.old.count = set->count;
+    set->soa.old.cursor = 0;
+
+    set->soa.state = sp_alloc(set->desc.allocator, new_cap * sizeof(u8));
+    set->soa.hashes = sp_alloc(set->desc.allocator, new_cap * sizeof(u64));
+    set->soa.values = sp_alloc(set->desc.allocator, new_cap * set->desc.value_size);
+    memset(set->soa.state, 0, new_cap * sizeof(u8));
+    set->capacity = new_cap;
+    set->soa.count = 0;
+    set->soa.dead = 0;
+}
+
+// Slot of a live key, or ~0u.
+static u32 _sp_hash_set_open_find(SP_HashSet* set, const void* key, u64 hash) {
+    u32 index = _sp_hash_container_get_index(key,
+            set->desc.value_size,
+            hash,
+            set->soa.state,
+            set->soa.hashes,
+            set->soa.values,
+            false,
+            set->capacity,
+            set->desc.equal);
+    if (index == ~0u || set->soa.state[index] != _SP_HASH_BUCKET_STATE_ALIVE) {
+        return ~0u;
+    }
+    return index;
+}
+
+// Slot of a live key in the table being drained by an incremental resize, or
+// ~0u.
+static u32 _sp_hash_set_open_find_old(SP_HashSet* set, const void* key, u64 hash) {
+    if (set->soa.old.state == NULL) {
+        return ~0u;
+    }
+
+    u32 index = _sp_hash_container_get_index(key,
+            set->desc.value_size,
+            hash,
+            set->soa.old.state,
+            set->soa.old.hashes,
+            set->soa.old.values,
+            false,
+            set->soa.old.capacity,
+            set->desc.equal);
+    if (index == ~0u || set->soa.old.state[index] != _SP_HASH_BUCKET_STATE_ALIVE) {
+        return ~0u;
+    }
+    return index;
+}
+
+// Claim a slot for a key which isn't in the set, reusing tombstones. Only the
+// state and hash are written.
+static u32 _sp_hash_set_open_prepare_insert(SP_HashSet* set, const void* key, u64 hash) {
+    if (set->soa.count + set->soa.old.count >= _sp_hash_max_load(set->capacity, set->load_factor)) {
+        _sp_hash_set_resize(set, _sp_hash_grow_capacity(set->count,
+                    _sp_hash_max_load(set->capacity, set->load_factor),
+                    set->capacity));
+    }
+
+    u32 index = _sp_hash_container_get_index(key,
+            set->desc.value_size,
+            hash,
+            set->soa.state,
+            set->soa.hashes,
+            set->soa.values,
+            true,
+            set->capacity,
+            set->desc.equal);
+    if (set->soa.state[index] == _SP_HASH_BUCKET_STATE_EMPTY) {
+        set->soa.count++;
+    } else {
+        set->soa.dead--;
+    }
+    set->soa.state[index] = _SP_HASH_BUCKET_STATE_ALIVE;
+    set->soa.hashes[index] = hash;
+    return index;
+}
+
+static inline b8 _sp_hash_set_should_shrink(const SP_HashSet* set) {
+    return _sp_hash_should_shrink(set->count,
+            _sp_hash_max_load(set->capacity, set->load_factor),
+            set->capacity,
+            _sp_hash_capacity(set->desc.collision_resolution, set->desc.capacity));
+}
+
+static inline _SP_HashTableLayout _sp_hash_set_layout(const SP_HashSet* set) {
+    return (_SP_HashTableLayout) {
+        .allocator = set->desc.allocator,
+        .hash = set->desc.hash,
+        .seed = set->desc.seed,
+        .equal = set->desc.equal,
+        .key_size = set->desc.value_size,
+        .value_size = 0,
+        .load_factor = set->load_factor,
+    };
+}
+
+// See '_sp_hash_map_shrink_sparse'.
+static void _sp_hash_set_shrink_sparse(SP_HashSet* set) {
+    if (!set->removed || !_sp_hash_set_should_shrink(set)) {
+        return;
+    }
+    set->removed = false;
+
+    SP_HashCollisionResolution resolution = set->desc.collision_resolution;
+    u32 capacity = sp_max(_sp_hash_capacity_for(resolution, set->count * 2, set->load_factor),
+            _sp_hash_capacity(resolution, set->desc.capacity));
+    if (capacity >= set->capacity) {
+        return;
+    }
+    _SP_HashTableLayout layout = _sp_hash_set_layout(set);
+    switch (resolution) {
+        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING:
+            if (set->soa.old.state == NULL) {
+                _sp_hash_set_resize(set, capacity);
+            }
+            break;
+        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING:
+            _sp_hash_chain_resize(&set->chain, &layout, &set->capacity, capacity);
+            break;
+        case SP_HASH_COLLISION_RESOLUTION_SWISS_TABLE:
+            _sp_hash_swiss_resize(&set->swiss, &layout, &set->capacity, set->count, capacity);
+            break;
+        case SP_HASH_COLLISION_RESOLUTION_ROBIN_HOOD:
+            _sp_hash_robin_resize(&set->robin, &layout, &set->capacity, capacity);
+            break;
+    }
+}
+
+SP_HashSet* sp_hash_set_create(SP_HashSetDesc desc) {
+    SP_HashSet* set = sp_alloc(desc.allocator, sizeof(SP_HashSet));
+    if (desc.hash == NULL) {
+        desc.hash = _sp_hash_default_func(desc.value_size);
+    }
+    if (desc.seed == 0) {
+        desc.seed = sp_hash_random_seed(set);
+    }
+
+    u32 cap = _sp_hash_capacity(desc.collision_resolution, desc.capacity);
+    u32 load_factor = _sp_hash_load_factor(desc.collision_resolution, desc.load_factor);
+    switch (desc.collision_resolution) {
+        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING:
+            *set = (SP_HashSet) {
+                .desc = desc,
+                .capacity = cap,
+                .load_factor = load_factor,
+                .soa = {
+                    .state = sp_alloc(desc.allocator, cap * sizeof(u8)),
+                    .hashes = sp_alloc(desc.allocator, cap * sizeof(u64)),
+                    .values = sp_alloc(desc.allocator, cap * desc.value_size),
+                }
+            };
+            memset(set->soa.state, 0, cap * sizeof(u8));
+            break;
+        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
+            *set = (SP_HashSet) {
+                .desc = desc,
+                .capacity = cap,
+                .load_factor = load_factor,
+            };
+            _SP_HashTableLayout layout = _sp_hash_set_layout(set);
+            _sp_hash_chain_alloc(&set->chain, &layout, set->capacity);
+        } break;
+        case SP_HASH_COLLISION_RESOLUTION_SWISS_TABLE: {
+            *set = (SP_HashSet) {
+                .desc = desc,
+                .capacity = cap,
+                .load_factor = load_factor,
+            };
+            _SP_HashTableLayout layout = _sp_hash_set_layout(set);
+            _sp_hash_swiss_alloc(&set->swiss, &layout, set->capacity);
+        } break;
+        case SP_HASH_COLLISION_RESOLUTION_ROBIN_HOOD: {
+            *set = (SP_HashSet) {
+                .desc = desc,
+                .capacity = cap,
+                .load_factor = load_factor,
+            };
+            _SP_HashTableLayout layout = _sp_hash_set_layout(set);
+            _sp_hash_robin_alloc(&set->robin, &layout, set->capacity);
+        } break;
+    }
+
+    return set;
+}
+
+void sp_hash_set_destroy(SP_HashSet* set) {
+    switch (set->desc.collision_resolution) {
+        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING:
+            if (set->soa.old.state != NULL) {
+                u32 capacity = set->soa.old.capacity;
+                sp_free(set->desc.allocator, set->soa.old.state, capacity * sizeof(u8));
+                sp_free(set->desc.allocator, set->soa.old.hashes, capacity * sizeof(u64));
+                sp_free(set->desc.allocator, set->soa.old.values, capacity * set->desc.value_size);
+            }
+            sp_free(set->desc.allocator, set->soa.state, set->capacity * sizeof(u8));
+            sp_free(set->desc.allocator, set->soa.hashes, set->capacity * sizeof(u64));
+            sp_free(set->desc.allocator, set->soa.values, set->capacity * set->desc.value_size);
+            break;
+        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
+            _SP_HashTableLayout layout = _sp_hash_set_layout(set);
+            _sp_hash_chain_free(&set->chain, &layout, set->capacity);
+        } break;
+        case SP_HASH_COLLISION_RESOLUTION_SWISS_TABLE: {
+            _SP_HashTableLayout layout = _sp_hash_set_layout(set);
+            _sp_hash_swiss_free(&set->swiss, &layout, set->capacity);
+        } break;
+        case SP_HASH_COLLISION_RESOLUTION_ROBIN_HOOD: {
+            _SP_HashTableLayout layout = _sp_hash_set_layout(set);
+            _sp_hash_robin_free(&set->robin, &layout, set->capacity);
+        } break;
+    }
+    SP_Allocator allocator = set->desc.allocator;
+    *set = (SP_HashSet) {0};
+    sp_free(allocator, set, sizeof(SP_HashSet));
+}
+
+b8 sp_hash_set_insert(SP_HashSet* set, const void* value) {
+    u64 hash = set->desc.hash(value, set->desc.value_size, set->desc.seed);
+    switch (set->desc.collision_resolution) {
+        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING: {
+            _sp_hash_set_migrate(set, _SP_HASH_MIGRATE_STEP);
+            if (_sp_hash_set_open_find(set, value, hash) != ~0u ||
+                _sp_hash_set_open_find_old(set, value, hash) != ~0u) {
+                return false;
+            }
+
+            _sp_hash_set_shrink_sparse(set);
+
+            u32 index = _sp_hash_set_open_prepare_insert(set, value, hash);
+            u64 value_size = set->desc.value_size;
+            memcpy((u8*) set->soa.values + value_size * index, value, value_size);
+            set->count++;
+            return true;
+        }
+        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
+            _SP_HashTableLayout layout = _sp_hash_set_layout(set);
+            if (_sp_hash_chain_find(&set->chain, &layout, set->capacity, value, hash) != NULL) {
+                return false;
+            }
+
+            _sp_hash_set_shrink_sparse(set);
+
+            _SP_HashChainNode* node = _sp_hash_chain_prepare_insert(&set->chain, &layout, &set->capacity, set->count, hash);
+            memcpy(_sp_hash_chain_key(node), value, layout.key_size);
+            set->count++;
+            return true;
+        }
+        case SP_HASH_COLLISION_RESOLUTION_SWISS_TABLE: {
+            _SP_HashTableLayout layout = _sp_hash_set_layout(set);
+            if (_sp_hash_swiss_find(&set->swiss, &layout, set->capacity, value, hash) != ~0u) {
+                return false;
+            }
+
+            _sp_hash_set_shrink_sparse(set);
+
+            u32 index = _sp_hash_swiss_prepare_insert(&set->swiss, &layout, &set->capacity, set->count, hash);
+            memcpy((u8*) set->swiss.keys + index * layout.key_size, value, layout.key_size);
+            set->count++;
+            return true;
+        }
+        case SP_HASH_COLLISION_RESOLUTION_ROBIN_HOOD: {
+            _SP_HashTableLayout layout = _sp_hash_set_layout(set);
+            if (_sp_hash_robin_find(&set->robin, &layout, set->capacity, value, hash) != ~0u) {
+                return false;
+            }
+
+            _sp_hash_set_shrink_sparse(set);
+
+            u32 index = _sp_hash_robin_prepare_insert(&set->robin, &layout, &set->capacity, set->count, hash);
+            memcpy((u8*) set->robin.keys + index * layout.key_size, value, layout.key_size);
+            set->count++;
+            return true;
+        }
+    }
+
+    sp_assert(false, "Unreachable!");
+    return false;
+}
+
+b8 sp_hash_set_remove(SP_HashSet* set, const void* value) {
+    u64 hash = set->desc.hash(value, set->desc.value_size, set->desc.seed);
+    switch (set->desc.collision_resolution) {
+        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING: {
+            u32 index = _sp_hash_set_open_find(set, value, hash);
+            if (index != ~0u) {
+                set->soa.state[index] = _SP_HASH_BUCKET_STATE_DEAD;
+                set->soa.dead++;
+            } else {
+                index = _sp_hash_set_open_find_old(set, value, hash);
+                if (index == ~0u) {
+                    return false;
+                }
+                set->soa.old.state[index] = _SP_HASH_BUCKET_STATE_DEAD;
+                set->soa.old.count--;
+            }
+
+            set->count--;
+            set->removed = true;
+            return true;
+        }
+        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
+            _SP_HashTableLayout layout = _sp_hash_set_layout(set);
+            if (_sp_hash_chain_erase(&set->chain, &layout, set->capacity, value, hash) == NULL) {
+                return false;
+            }
+
+            set->count--;
+            set->removed = true;
+            return true;
+        }
+        case SP_HASH_COLLISION_RESOLUTION_SWISS_TABLE: {
+            _SP_HashTableLayout layout = _sp_hash_set_layout(set);
+            u32 index = _sp_hash_swiss_find(&set->swiss, &layout, set->capacity, value, hash);
+            if (index == ~0u) {
+                return false;
+            }
+
+            _sp_hash_swiss_erase(&set->swiss, index);
+            set->count--;
+            set->removed = true;
+            return true;
+        }
+        case SP_HASH_COLLISION_RESOLUTION_ROBIN_HOOD: {
+            _SP_HashTableLayout layout = _sp_hash_set_layout(set);
+            u32 index = _sp_hash_robin_find(&set->robin, &layout, set->capacity, value, hash);
+            if (index == ~0u) {
+                return false;
+            }
+
+            _sp_hash_robin_erase(&set->robin, &layout, set->capacity, index);
+            set->count--;
+            set->removed = true;
+            return true;
+        }
+    }
+
+    sp_assert(false, "Unreachable!");
+    return false;
+}
+
+b8 sp_hash_set_has(SP_HashSet* set, const void* value) {
+    u64 hash = set->desc.hash(value, set->desc.value_size, set->desc.seed);
+    switch (set->desc.collision_resolution) {
+        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING:
+            return _sp_hash_set_open_find(set, value, hash) != ~0u ||
+                _sp_hash_set_open_find_old(set, value, hash) != ~0u;
+        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
+            _SP_HashTableLayout layout = _sp_hash_set_layout(set);
+            return _sp_hash_chain_find(&set->chain, &layout, set->capacity, value, hash) != NULL;
+        }
+        case SP_HASH_COLLISION_RESOLUTION_SWISS_TABLE: {
+            _SP_HashTableLayout layout = _sp_hash_set_layout(set);
+            return _sp_hash_swiss_find(&set->swiss, &layout, set->capacity, value, hash) != ~0u;
+        }
+        case SP_HASH_COLLISION_RESOLUTION_ROBIN_HOOD: {
+            _SP_HashTableLayout layout = _sp_hash_set_layout(set);
+            return _sp_hash_robin_find(&set->robin, &layout, set->capacity, value, hash) != ~0u;
+        }
+    }
+
+    sp_assert(false, "Unreachable!");
+    return false;
+}
+
+u32 sp_hash_set_count(const SP_HashSet* set) {
+    return set->count;
+}
+
+void sp_hash_set_reserve(SP_HashSet* set, u32 count) {
+    set->removed = false;
+    switch (set->desc.collision_resolution) {
+        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING: {
+            u32 capacity = _sp_hash_capacity_for(set->desc.collision_resolution, count, set->load_factor);
+            if (capacity > set->capacity) {
+                _sp_hash_set_rehash(set, capacity);
+            }
+        } break;
+        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
+            u32 capacity = _sp_hash_capacity_for(set->desc.collision_resolution, count, set->load_factor);
+            _SP_HashTableLayout layout = _sp_hash_set_layout(set);
+            if (capacity > set->capacity) {
+                _sp_hash_chain_resize(&set->chain, &layout, &set->capacity, capacity);
+            }
+            if (count > set->count) {
+                _sp_hash_chain_reserve_nodes(&set->chain, &layout, count - set->count);
+            }
+        } break;
+        case SP_HASH_COLLISION_RESOLUTION_SWISS_TABLE: {
+            u32 capacity = _sp_hash_capacity_for(set->desc.collision_resolution, count, set->load_factor);
+            if (capacity > set->capacity) {
+                _SP_HashTableLayout layout = _sp_hash_set_layout(set);
+                _sp_hash_swiss_resize(&set->swiss, &layout, &set->capacity, set->count, capacity);
+            }
+        } break;
+        case SP_HASH_COLLISION_RESOLUTION_ROBIN_HOOD: {
+            u32 capacity = _sp_hash_capacity_for(set->desc.collision_resolution, count, set->load_factor);
+            if (capacity > set->capacity) {
+                _SP_HashTableLayout layout = _sp_hash_set_layout(set);
+                _sp_hash_robin_resize(&set->robin, &layout, &set->capacity, capacity);
+            }
+        } break;
+    }
+}
+
+void sp_hash_set_shrink_to_fit(SP_HashSet* set) {
+    switch (set->desc.collision_resolution) {
+        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING: {
+            u32 capacity = sp_min(_sp_hash_capacity_for(set->desc.collision_resolution, set->count, set->load_factor), set->capacity);
+            if (capacity < set->capacity || set->soa.dead != 0 || set->soa.old.state != NULL) {
+                _sp_hash_set_rehash(set, capacity);
+            }
+        } break;
+        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
+            _SP_HashTableLayout layout = _sp_hash_set_layout(set);
+            u32 capacity = sp_min(_sp_hash_capacity_for(set->desc.collision_resolution, set->count, set->load_factor), set->capacity);
+            _sp_hash_chain_compact(&set->chain, &layout, &set->capacity, set->count, capacity);
+        } break;
+        case SP_HASH_COLLISION_RESOLUTION_SWISS_TABLE: {
+            _SP_HashTableLayout layout = _sp_hash_set_layout(set);
+            u32 capacity = sp_min(_sp_hash_capacity_for(set->desc.collision_resolution, set->count, set->load_factor), set->capacity);
+            if (capacity < set->capacity || _sp_hash_swiss_deleted(&set->swiss, &layout, set->capacity, set->count) != 0) {
+                _sp_hash_swiss_resize(&set->swiss, &layout, &set->capacity, set->count, capacity);
+            }
+        } break;
+        case SP_HASH_COLLISION_RESOLUTION_ROBIN_HOOD: {
+            u32 capacity = _sp_hash_capacity_for(set->desc.collision_resolution, set->count, set->load_factor);
+            if (capacity < set->capacity) {
+                _SP_HashTableLayout layout = _sp_hash_set_layout(set);
+                _sp_hash_robin_resize(&set->robin, &layout, &set->capacity, capacity);
+            }
+        } break;
+    }
+}
+
+// Iteration
+// See '_sp_hash_map_open_iter_find'.
+static u32 _sp_hash_set_open_iter_find(const SP_HashSet* set, u32 index) {
+    for (; index < set->capacity; index++) {
+        if (set->soa.state[index] == _SP_HASH_BUCKET_STATE_ALIVE) {
+            return index;
+        }
+    }
+    for (; index - set->capacity < set->soa.old.capacity; index++) {
+        if (set->soa.old.state[index - set->capacity] == _SP_HASH_BUCKET_STATE_ALIVE) {
+            return index;
+        }
+    }
+    return ~0u;
+}
+
+static inline void* _sp_hash_set_open_iter_value(const SP_HashSet* set, u32 index) {
+    if (index < set->capacity) {
+        return (u8*) set->soa.values + index * set->desc.value_size;
+    }
+    return (u8*) set->soa.old.values + (index - set->capacity) * set->desc.value_size;
+}
+
+SP_HashSetIter sp_hash_set_iter_init(SP_HashSet* set) {
+    SP_HashSetIter iter = {
+        .set = set,
+        .index = ~0u,
+        .node = NULL,
+    };
+
+    switch (set->desc.collision_resolution) {
+        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING:
+            iter.index = _sp_hash_set_open_iter_find(set, 0);
+            break;
+        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING:
+            for (u32 i = 0; i < set->capacity; i++) {
+                if (set->chain.buckets[i] != NULL) {
+                    iter.index = i;
+                    iter.node = set->chain.buckets[i];
+                    break;
+                }
+            }
+            break;
+        case SP_HASH_COLLISION_RESOLUTION_SWISS_TABLE:
+            for (u32 i = 0; i < set->capacity; i++) {
+                if (_sp_hash_swiss_is_full(set->swiss.ctrl[i])) {
+                    iter.index = i;
+                    break;
+                }
+            }
+            break;
+        case SP_HASH_COLLISION_RESOLUTION_ROBIN_HOOD:
+            for (u32 i = 0; i < set->capacity; i++) {
+                if (set->robin.dists[i] != 0) {
+                    iter.index = i;
+                    break;
+                }
+            }
+            break;
+    }
+    return iter;
+}
+
+b8 sp_hash_set_iter_valid(SP_HashSetIter iter) {
+    if (iter.set == NULL) {
+        return false;
+    }
+    u32 end = iter.set->capacity;
+    if (iter.set->desc.collision_resolution == SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING) {
+        end += iter.set->soa.old.capacity;
+    }
+    return iter.index < end;
+}
+
+SP_HashSetIter sp_hash_set_iter_next(SP_HashSetIter iter) {
+    sp_assert(sp_hash_set_iter_valid(iter), "Hash set iterator must be valid!");
+
+    SP_HashSet* set = iter.set;
+    switch (set->desc.collision_resolution) {
+        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING:
+            iter.index = _sp_hash_set_open_iter_find(set, iter.index + 1);
+            if (iter.index != ~0u) {
+                return iter;
+            }
+            break;
+        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
+            _SP_HashChainNode* node = iter.node;
+            if (node->next != NULL) {
+                iter.node = node->next;
+                return iter;
+            }
+
+            for (u32 i = iter.index + 1; i < set->capacity; i++) {
+                if (set->chain.buckets[i] != NULL) {
+                    iter.index = i;
+                    iter.node = set->chain.buckets[i];
+                    return iter;
+                }
+            }
+        } break;
+        case SP_HASH_COLLISION_RESOLUTION_SWISS_TABLE:
+            for (u32 i = iter.index + 1; i < set->capacity; i++) {
+                if (_sp_hash_swiss_is_full(set->swiss.ctrl[i])) {
+                    iter.index = i;
+                    return iter;
+                }
+            }
+            break;
+        case SP_HASH_COLLISION_RESOLUTION_ROBIN_HOOD:
+            for (u32 i = iter.index + 1; i < set->capacity; i++) {
+                if (set->robin.dists[i] != 0) {
+                    iter.index = i;
+                    return iter;
+                }
+            }
+            break;
+    }
+    return (SP_HashSetIter) {0};
+}
+
+void sp_hash_set_iter_get_value(SP_HashSetIter iter, void* out_value) {
+    sp_assert(sp_hash_set_iter_valid(iter), "Hash set iterator must be valid!");
+
+    SP_HashSet* set = iter.set;
+    switch (set->desc.collision_resolution) {
+        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING:
+            memcpy(out_value, _sp_hash_set_open_iter_value(set, iter.index), set->desc.value_size);
+            break;
+        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING:
+            memcpy(out_value, _sp_hash_chain_key(iter.node), set->desc.value_size);
+            break;
+        case SP_HASH_COLLISION_RESOLUTION_SWISS_TABLE:
+            memcpy(out_value, (u8*) set->swiss.keys + iter.index * set->desc.value_size, set->desc.value_size);
+            break;
+        case SP_HASH_COLLISION_RESOLUTION_ROBIN_HOOD:
+            memcpy(out_value, (u8*) set->robin.keys + iter.index * set->desc.value_size, set->desc.value_size);
+            break;
+    }
+}
+
+void* sp_hash_set_iter_get_valuep(SP_HashSetIter iter) {
+    sp_assert(sp_hash_set_iter_valid(iter), "Hash set iterator must be valid!");
+
+    SP_HashSet* set = iter.set;
+    switch (set->desc.collision_resolution) {
+        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING:
+            return _sp_hash_set_open_iter_value(set, iter.index);
+        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING:
+            return _sp_hash_chain_key(iter.node);
+        case SP_HASH_COLLISION_RESOLUTION_SWISS_TABLE:
+            return (u8*) set->swiss.keys + iter.index * set->desc.value_size;
+        case SP_HASH_COLLISION_RESOLUTION_ROBIN_HOOD:
+            return (u8*) set->robin.keys + iter.index * set->desc.value_size;
+    }
+
+    return NULL;
+}
+
+// -- Color --------------------------------------------------------------------
+
+SP_Color sp_color_rgba_f(f32 r, f32 g, f32 b, f32 a) {
+    return (SP_Color) {r, g, b, a};
+}
+
+SP_Color sp_color_rgba_i(u8 r, u8 g, u8 b, u8 a) {
+    return (SP_Color) {r/255.0f, g/255.0f, b/255.0f, a/255.0f};
+}
+
+SP_Color sp_color_rgba_hex(u32 hex) {
+    return (SP_Color) {
+        .r = (f32) (hex >> 8 * 3 & 0xff) / 0xff,
+        .g = (f32) (hex >> 8 * 2 & 0xff) / 0xff,
+        .b = (f32) (hex >> 8 * 1 & 0xff) / 0xff,
+        .a = (f32) (hex >> 8 * 0 & 0xff) / 0xff,
+    };
+}
+
+SP_Color sp_color_rgb_f(f32 r, f32 g, f32 b) {
+    return (SP_Color) {r, g, b, 1.0f};
+}
+
+SP_Color sp_color_rgb_i(u8 r, u8 g, u8 b) {
+    return (SP_Color) {r/255.0f, g/255.0f, b/255.0f, 1.0f};
+}
+
+SP_Color sp_color_rgb_hex(u32 hex) {
+    return (SP_Color) {
+        .r = (f32) (hex >> 8 * 2 & 0xff) / 0xff,
+        .g = (f32) (hex >> 8 * 1 & 0xff) / 0xff,
+        .b = (f32) (hex >> 8 * 0 & 0xff) / 0xff,
+        .a = 1.0f,
+    };
+}
+
+SP_Color sp_color_hsl(f32 hue, f32 saturation, f32 lightness) {
+    // https://en.wikipedia.org/wiki/HSL_and_HSV#HSL_to_RGB
+    SP_Color color = {0};
+    f32 chroma = (1 - fabsf(2 * lightness - 1)) * saturation;
+    f32 hue_prime = fabsf(fmodf(hue, 360.0f)) / 60.0f;
+    f32 x = chroma * (1.0f - fabsf(fmodf(hue_prime, 2.0f) - 1.0f));
+    if (hue_prime < 1.0f) { color = (SP_Color) { chroma, x, 0.0f, 1.0f, }; }
+    else if (hue_prime < 2.0f) { color = (SP_Color) { x, chroma, 0.0f, 1.0f, }; }
+    else if (hue_prime < 3.0f) { color = (SP_Color) { 0.0f, chroma, x, 1.0f, }; }
+    else if (hue_prime < 4.0f) { color = (SP_Color) { 0.0f, x, chroma, 1.0f, }; }
+    else if (hue_prime < 5.0f) { color = (SP_Color) { x, 0.0f, chroma, 1.0f, }; }
+    else if (hue_prime < 6.0f) { color = (SP_Color) { chroma, 0.0f, x, 1.0f, }; }
+    f32 m = lightness-chroma / 2.0f;
+    color.r += m;
+    color.g += m;
+    color.b += m;
+    return color;
+}
+
+SP_Color sp_color_hsv(f32 hue, f32 saturation, f32 value) {
+    // https://en.wikipedia.org/wiki/HSL_and_HSV#HSV_to_RGB
+    SP_Color color = {0};
+    f32 chroma = value * saturation;
+    f32 hue_prime = fabsf(fmodf(hue, 360.0f)) / 60.0f;
+    f32 x = chroma * (1.0f - fabsf(fmodf(hue_prime, 2.0f) - 1.0f));
+    if (hue_prime < 1.0f) { color = (SP_Color) { chroma, x, 0.0f, 1.0f, }; }
+    else if (hue_prime < 2.0f) { color = (SP_Color) { x, chroma, 0.0f, 1.0f, }; }
+    else if (hue_prime < 3.0f) { color = (SP_Color) { 0.0f, chroma, x, 1.0f, }; }
+    else if (hue_prime < 4.0f) { color = (SP_Color) { 0.0f, x, chroma, 1.0f, }; }
+    else if (hue_prime < 5.0f) { color = (SP_Color) { x, 0.0f, chroma, 1.0f, }; }
+    else if (hue_prime < 6.0f) { color = (SP_Color) { chroma, 0.0f, x, 1.0f, }; }
+    f32 m = value - chroma;
+    color.r += m;
+    color.g += m;
+    color.b += m;
+    return color;
+}
+
+// -- Testing ------------------------------------------------------------------
+
+typedef struct SP_Test SP_Test;
+struct SP_Test {
+    SP_Str name;
+    SP_TestFunc func;
+    void* userdata;
+};
+
+typedef struct SP_TestGroup SP_TestGroup;
+struct SP_TestGroup {
+    SP_Str name;
+    SP_Test* tests;
+    u32 test_capacity;
+    u32 test_count;
+};
+
+struct SP_TestSuite {
+    SP_Allocator allocator;
+    SP_TestGroup* groups;
+    u32 group_capacity;
+    u32 group_count;
+};
+
+SP_TestSuite* sp_test_suite_create(SP_Allocator allocator) {
+    SP_TestSuite* suite = sp_alloc(allocator, sizeof(SP_TestSuite));
+    *suite = (SP_TestSuite) {
+        .allocator = allocator,
+        .groups = sp_alloc(allocator, 8 * sizeof(SP_TestGroup)),
+        .group_capacity = 8,
+        .group_count = 0,
+    };
+    return suite;
+}
+
+void sp_test_suite_destroy(SP_TestSuite* suite) {
+    for (u32 i = 0; i < suite->group_count; i++) {
+        SP_TestGroup* group = &suite->groups[i];
+        sp_free(suite->allocator, group->tests, group->test_capacity * sizeof(SP_Test));
+    }
+    sp_free(suite->allocator, suite->groups, suite->group_capacity * sizeof(SP_TestGroup));
+}
+
+// Result of running one test. Results from worker processes are copied in, so
+// 'file' and 'reason' of 'result' point into the buffers here.
+struct _SP_TestOutcome {
+    SP_TestResult result;
+    // Set once a worker reported the test or died running it.
+    b8 finished;
+    u64 duration_ns;
+    // Heap allocations plus arena pushes, and their bytes.
+    u64 allocs;
+    u64 alloc_bytes;
+    char file[256];
+    char reason[512];
+};
+
+SP_TestBudget sp_test_budget_begin(void) {
+    return (SP_TestBudget) {
+        .start_ns = sp_os_get_time_ns(),
+        .start_allocs = sp_get_thread_alloc_stats(),
+    };
+}
+
+u64 _sp_test_budget_allocs(SP_TestBudget budget) {
+    SP_AllocStats now = sp_get_thread_alloc_stats();
+    return now.heap_allocs - budget.start_allocs.heap_allocs +
+        now.arena_pushes - budget.start_allocs.arena_pushes;
+}
+
+u64 _sp_test_budget_bytes(SP_TestBudget budget) {
+    SP_AllocStats now = sp_get_thread_alloc_stats();
+    return now.heap_bytes - budget.start_allocs.heap_bytes +
+        now.arena_bytes - budget.start_allocs.arena_bytes;
+}
+
+const char* _sp_test_budget_reason(u64 used, u64 max, const char* unit) {
+    static SP_THREAD_LOCAL char reason[128];
+    snprintf(reason, sizeof(reason), "used %llu %s, budget is %llu", (unsigned long long) used, unit, (unsigned long long) max);
+    return reason;
+}
+
+static _SP_TestOutcome _sp_test_run_one(const SP_Test* test) {
+    _SP_TestOutcome outcome = {0};
+    SP_TestBudget budget = sp_test_budget_begin();
+    outcome.result = test->func(test->userdata);
+    outcome.duration_ns = sp_os_get_time_ns() - budget.start_ns;
+    outcome.allocs = _sp_test_budget_allocs(budget);
+    outcome.alloc_bytes = _sp_test_budget_bytes(budget);
+    return outcome;
+}
+
+// Store a copy of 'file' and 'reason' in the outcome itself.
+static void _sp_test_outcome_own(_SP_TestOutcome* outcome, const char* file, u32 line, const char* reason) {
+    snprintf(outcome->file, sizeof(outcome->file), "%s", file != NULL ? file : "");
+    snprintf(outcome->reason, sizeof(outcome->reason), "%s", reason != NULL ? reason : "");
+    outcome->result.file = outcome->file;
+    outcome->result.line = line;
+    outcome->result.reason = outcome->reason;
+}
+
+static u32 _sp_test_count(const SP_TestSuite* suite) {
+    u32 count = 0;
+    for (u32 i = 0; i < suite->group_count; i++) {
+        count += suite->groups[i].test_count;
+    }
+    return count;
+}
+
+// Test number 'index' counting through every group in order.
+static const SP_Test* _sp_test_get(const SP_TestSuite* suite, u32 index) {
+    for (u32 i = 0; i < suite->group_count; i++) {
+        if (index < suite->groups[i].test_count) {
+            return &suite->groups[i].tests[index];
+        }
+        index -= suite->groups[i].test_count;
+    }
+    return NULL;
+}
+
+static void _sp_test_print_group_begin(const SP_TestGroup* group) {
+    printf("--- Running %u tests in group %.*s ---\n", group->test_count, group->name.len, group->name.data);
+}
+
+static void _sp_test_print_outcome(const SP_Test* test, const _SP_TestOutcome* outcome) {
+    char stats[128];
+    snprintf(stats, sizeof(stats), "\033[0;90m(%.3f ms, %llu allocs, %llu bytes)\033[0m",
+            outcome->duration_ns / 1e6,
+            (unsigned long long) outcome->allocs,
+            (unsigned long long) outcome->alloc_bytes);
+    if (outcome->result.skipped) {
+        printf("%.*s ... \033[0;93mSKIPPED\033[0m %s\n", test->name.len, test->name.data, stats);
+        printf("    %s\n", outcome->result.reason);
+    } else if (outcome->result.successful) {
+        printf("%.*s ... \033[0;92mOK\033[0m %s\n", test->name.len, test->name.data, stats);
+    } else {
+        printf("%.*s ... \033[1;91mFAILED\033[0m %s\n", test->name.len, test->name.data, stats);
+        if (outcome->result.file != NULL && outcome->result.file[0] != 0) {
+            printf("    %s:%u: '%s'\n", outcome->result.file, outcome->result.line, outcome->result.reason);
+        } else {
+            // Worker failures aren't tied to a line.
+            printf("    %s\n", outcome->result.reason);
+        }
+    }
+}
+
+static void _sp_test_print_group_end(const SP_TestGroup* group, u32 successful) {
+    printf("\n");
+
+    if (successful == group->test_count) {
+        printf("Result: \033[0;92m%u/%u\033[0m\n", successful, group->test_count);
+    } else {
+        printf("Result: \033[1;91m%u/%u\033[0m\n", successful, group->test_count);
+    }
+
+    printf("\n");
+}
+
+static void _sp_test_print_summary(u32 tests_run, u32 successfully_run_tests, u32 skipped_tests, u64 wall_ns) {
+    printf("--- SUITE RESULT ---\n");
+    const char *status_color;
+    if (successfully_run_tests == tests_run) {
+        status_color = "\033[0;92m";
+    } else {
+        status_color = "\033[0;91m";
+    }
+
+    printf("Tests run: \033[0;94m%u\033[0m\n", tests_run);
+    printf("Tests passed: %s%u\033[0m\n", status_color, successfully_run_tests);
+    printf("Tests failed: %s%u\033[0m\n", status_color, tests_run - successfully_run_tests);
+    if (skipped_tests > 0) {
+        printf("Tests skipped: \033[0;93m%u\033[0m\n", skipped_tests);
+    }
+    printf("Wall time: \033[0;94m%.3f ms\033[0m\n", wall_ns / 1e6);
+    printf("Summary: %s%u/%u\033[0m\n", status_color, successfully_run_tests, tests_run);
+}
+
+void sp_test_suite_run(SP_TestSuite* suite) {
+    sp_test_suite_run_configurable(suite, SP_TEST_CONFIG_DEFAULT);
+}
+
+b8 sp_test_suite_run_configurable(SP_TestSuite* suite, SP_TestConfig config) {
+    u64 start = sp_os_get_time_ns();
+    u32 count = _sp_test_count(suite);
+    _SP_TestOutcome* outcomes = NULL;
+    if (config.workers > 0 && count > 0) {
+        outcomes = sp_alloc(suite->allocator, count * sizeof(_SP_TestOutcome));
+        memset(outcomes, 0, count * sizeof(_SP_TestOutcome));
+        b8 logging = _sp_log_fork_begin();
+        b8 isolated = _sp_platform_test_run_isolated(suite, config, outcomes);
+        if (logging) {
+            _sp_log_fork_end();
+        }
+        if (!isolated) {
+            sp_free(suite->allocator, outcomes, count * sizeof(_SP_TestOutcome));
+            outcomes = NULL;
+        }
+    }
+
+    // Without workers the tests run here, one at a time, printing as they go.
+    u32 tests_run = 0;
+    u32 successfully_run_tests = 0;
+    u32 skipped_tests = 0;
+    for (u32 i = 0; i < suite->group_count; i++) {
+        const SP_TestGroup* group = &suite->groups[i];
+        _sp_test_print_group_begin(group);
+        u32 successful = 0;
+        for (u32 j = 0; j < group->test_count; j++) {
+            const SP_Test* test = &group->tests[j];
+            _SP_TestOutcome outcome;
+            if (outcomes != NULL) {
+                outcome = outcomes[tests_run + j];
+            } else {
+                outcome = _sp_test_run_one(test);
+            }
+            _sp_test_print_outcome(test, &outcome);
+            successful += outcome.result.successful;
+            skipped_tests += outcome.result.skipped;
+        }
+        tests_run += group->test_count;
+        successfully_run_tests += successful;
+        _sp_test_print_group_end(group, successful);
+    }
+
+    _sp_test_print_summary(tests_run, successfully_run_tests, skipped_tests, sp_os_get_time_ns() - start);
+
+    if (outcomes != NULL) {
+        sp_free(suite->allocator, outcomes, count * sizeof(_SP_TestOutcome));
+    }
+    return successfully_run_tests == tests_run;
+}
+
+u32 sp_test_group_register(SP_TestSuite* suite, SP_Str name) {
+    if (suite->group_count == suite->group_capacity) {
+        suite->groups = sp_realloc(suite->allocator,
+                suite->groups,
+                suite->group_capacity * sizeof(SP_TestGroup),
+                suite->group_capacity * 2 * sizeof(SP_TestGroup));
+        suite->group_capacity *= 2;
+    }
+
+    u32 group = suite->group_count;
+    suite->groups[group] = (SP_TestGroup) {
+        .name = name,
+        .tests = sp_alloc(suite->allocator, 8 * sizeof(SP_Test)),
+        .test_capacity = 8,
+        .test_count = 0,
+    };
+
+    suite->group_count++;
+    return group;
+}
+
+void _sp_test_register(SP_TestSuite* suite, u32 group, SP_TestFunc func, SP_Str name, void* userdata) {
+    sp_assert(group < suite->group_count, "Group %u not registered in suite!", group);
+    SP_TestGroup* _group = &suite->groups[group];
+    if (_group->test_count == _group->test_capacity) {
+        _group->tests = sp_realloc(suite->allocator,
+                _group->tests,
+                _group->test_capacity * sizeof(SP_Test),
+                _group->test_capacity * 2 * sizeof(SP_Test));
+        _group->test_capacity *= 2;
+    }
+
+    u32 test = _group->test_count;
+    _group->tests[test] = (SP_Test) {
+        .name = name,
+        .func = func,
+        .userdata = userdata,
+    };
+
+    _group->test_count++;
+}
+
+// -- Benchmarking -------------------------------------------------------------
+
+struct SP_Bench {
+    u64 iterations;
+    u64 bytes_per_iteration;
+    u64 start_ns;
+    u64 elapsed_ns;
+    b8 running;
+};
+
+typedef struct _SP_BenchResult _SP_BenchResult;
+struct _SP_BenchResult {
+    u64 iterations;
+    u32 samples;
+    // Nanoseconds per iteration.
+    f64 median;
+    f64 p99;
+    f64 mean;
+    f64 stddev;
+    f64 min;
+    f64 max;
+    f64 ops_per_second;
+    f64 bytes_per_second;
+    // Only measured with 'SP_BenchConfig.memory_stats'.
+    f64 memory_calls;
+    f64 faults;
+    u64 peak_resident;
+    // Only measured with 'SP_BenchConfig.perf_counters'.
+    f64 perf[SP_PERF_COUNTER_COUNT];
+    b8 perf_available[SP_PERF_COUNTER_COUNT];
+};
+
+typedef struct _SP_BenchEntry _SP_BenchEntry;
+struct _SP_BenchEntry {
+    SP_Str name;
+    SP_BenchFunc func;
+    void* userdata;
+    _SP_BenchResult result;
+};
+
+typedef struct _SP_BenchGroup _SP_BenchGroup;
+struct _SP_BenchGroup {
+    SP_Str name;
+    SP_BenchFixtureFunc setup;
+    SP_BenchFixtureFunc teardown;
+    void* fixture_userdata;
+    _SP_BenchEntry* benches;
+    u32 bench_capacity;
+    u32 bench_count;
+};
+
+struct SP_BenchSuite {
+    SP_Allocator allocator;
+    _SP_BenchGroup* groups;
+    u32 group_capacity;
+    u32 group_count;
+};
+
+u64 sp_bench_iterations(const SP_Bench* bench) {
+    return bench->iterations;
+}
+
+void sp_bench_set_bytes_per_iteration(SP_Bench* bench, u64 bytes) {
+    bench->bytes_per_iteration = bytes;
+}
+
+void sp_bench_pause(SP_Bench* bench) {
+    if (bench->running) {
+        bench->elapsed_ns += sp_os_get_time_ns() - bench->start_ns;
+        bench->running = false;
+    }
+}
+
+void sp_bench_resume(SP_Bench* bench) {
+    if (!bench->running) {
+        bench->running = true;
+        bench->start_ns = sp_os_get_time_ns();
+    }
+}
+
+static const void* volatile _sp_bench_sink;
+
+void _sp_bench_do_not_optimize(const void* ptr) {
+    _sp_bench_sink = ptr;
+}
+
+SP_BenchSuite* sp_bench_suite_create(SP_Allocator allocator) {
+    SP_BenchSuite* suite = sp_alloc(allocator, sizeof(SP_BenchSuite));
+    *suite = (SP_BenchSuite) {
+        .allocator = allocator,
+        .groups = sp_alloc(allocator, 8 * sizeof(_SP_BenchGroup)),
+        .group_capacity = 8,
+        .group_count = 0,
+    };
+    return suite;
+}
+
+void sp_bench_suite_destroy(SP_BenchSuite* suite) {
+    for (u32 i = 0; i < suite->group_count; i++) {
+        _SP_BenchGroup* group = &suite->groups[i];
+        sp_free(suite->allocator, group->benches, group->bench_capacity * sizeof(_SP_BenchEntry));
+    }
+    sp_free(suite->allocator, suite->groups, suite->group_capacity * sizeof(_SP_BenchGroup));
+    sp_free(suite->allocator, suite, sizeof(SP_BenchSuite));
+}
+
+u32 sp_bench_group_register(SP_BenchSuite* suite, SP_Str name) {
+    if (suite->group_count == suite->group_capacity) {
+        suite->groups = sp_realloc(suite->allocator,
+                suite->groups,
+                suite->group_capacity * sizeof(_SP_BenchGroup),
+                suite->group_capacity * 2 * sizeof(_SP_BenchGroup));
+        suite->group_capacity *= 2;
+    }
+
+    u32 group = suite->group_count;
+    suite->groups[group] = (_SP_BenchGroup) {
+        .name = name,
+        .benches = sp_alloc(suite->allocator, 8 * sizeof(_SP_BenchEntry)),
+        .bench_capacity = 8,
+        .bench_count = 0,
+    };
+
+    suite->group_count++;
+    return group;
+}
+
+void sp_bench_group_fixture(SP_BenchSuite* suite, u32 group, SP_BenchFixtureFunc setup, SP_BenchFixtureFunc teardown, void* userdata) {
+    sp_assert(group < suite->group_count, "Group %u not registered in suite!", group);
+    suite->groups[group].setup = setup;
+    suite->groups[group].teardown = teardown;
+    suite->groups[group].fixture_userdata = userdata;
+}
+
+void _sp_bench_register(SP_BenchSuite* suite, u32 group, SP_BenchFunc func, SP_Str name, void* userdata) {
+    sp_assert(group < suite->group_count, "Group %u not registered in suite!", group);
+    _SP_BenchGroup* _group = &suite->groups[group];
+    if (_group->bench_count == _group->bench_capacity) {
+        _group->benches = sp_realloc(suite->allocator,
+                _group->benches,
+                _group->bench_capacity * sizeof(_SP_BenchEntry),
+                _group->bench_capacity * 2 * sizeof(_SP_BenchEntry));
+        _group->bench_capacity *= 2;
     }
 
-    sp_free(map->desc.allocator, map->soa.state, map->capacity * sizeof(u8));
-    sp_free(map->desc.allocator, map->soa.hashes, map->capacity * sizeof(u64));
-    sp_free(map->desc.allocator, map->soa.keys, map->capacity * map->desc.key_size);
-    sp_free(map->desc.allocator, map->soa.values, map->capacity * map->desc.value_size);
+    _group->benches[_group->bench_count] = (_SP_BenchEntry) {
+        .name = name,
+        .func = func,
+        .userdata = userdata,
+    };
+    _group->bench_count++;
+}
 
-    map->soa.state = new_state;
-    map->soa.hashes = new_hashes;
-    map->soa.keys = new_keys;
-    map->soa.values = new_values;
-    map->capacity = new_cap;
+// Run the benchmark once with 'iterations' iterations and return the measured
+// nanoseconds.
+static u64 _sp_bench_run_once(const _SP_BenchEntry* entry, SP_Bench* bench, u64 iterations) {
+    bench->iterations = iterations;
+    bench->elapsed_ns = 0;
+    bench->running = false;
+    sp_bench_resume(bench);
+    entry->func(bench, entry->userdata);
+    sp_bench_pause(bench);
+    return bench->elapsed_ns;
 }
 
-static inline _SP_HashContainerChainNode* _sp_hash_map_get_node(SP_HashMap* map, u32 index) {
-    u64 node_size = sizeof(_SP_HashContainerChainNode) + map->desc.key_size + map->desc.value_size;
-    return (_SP_HashContainerChainNode*) ((u8*) map->aos.nodes + node_size * index);
+static i32 _sp_bench_compare_f64(const void* a, const void* b) {
+    f64 _a = *(const f64*) a;
+    f64 _b = *(const f64*) b;
+    return (_a > _b) - (_a < _b);
 }
 
-SP_HashMap* sp_hash_map_create(SP_HashMapDesc desc) {
-    SP_HashMap* map = sp_alloc(desc.allocator, sizeof(SP_HashMap));
+static _SP_BenchResult _sp_bench_measure(SP_BenchSuite* suite, const _SP_BenchEntry* entry, SP_BenchConfig config) {
+    SP_Bench bench = {0};
 
-    u32 cap = desc.capacity;
-    switch (desc.collision_resolution) {
-        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING:
-            *map = (SP_HashMap) {
-                .desc = desc,
-                .capacity = cap,
-                .soa = {
-                    .state = sp_alloc(desc.allocator, cap * sizeof(u8)),
-                    .hashes = sp_alloc(desc.allocator, cap * sizeof(u64)),
-                    .keys = sp_alloc(desc.allocator, cap * desc.key_size),
-                    .values = sp_alloc(desc.allocator, cap * desc.value_size),
-                }
-            };
-            memset(map->soa.state, 0, cap * sizeof(u8));
+    if (config.memory_stats) {
+        sp_os_reset_peak_resident();
+    }
+
+    // Warm up while calibrating the iteration count. Grow it until a single
+    // run takes at least 'min_sample_ns'.
+    u64 iterations = 1;
+    u64 warmup_start = sp_os_get_time_ns();
+    while (true) {
+        u64 elapsed = _sp_bench_run_once(entry, &bench, iterations);
+        b8 calibrated = elapsed >= config.min_sample_ns;
+        if (calibrated && sp_os_get_time_ns() - warmup_start >= config.warmup_ns) {
             break;
-        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
-            u64 node_size = sizeof(_SP_HashContainerChainNode) + desc.key_size + desc.value_size;
-            *map = (SP_HashMap) {
-                .desc = desc,
-                .capacity = cap,
-                .aos = {
-                    .nodes = sp_alloc(desc.allocator, cap * node_size),
-                    .free_list = NULL,
-                },
-            };
-            memset(map->aos.nodes, 0, cap * node_size);
-        } break;
+        }
+        if (!calibrated) {
+            // Aim a bit over the target, but never grow more than 10x at once
+            // in case the first runs were dominated by cold caches.
+            f64 scale = elapsed == 0 ? 10.0 : 1.2 * config.min_sample_ns / elapsed;
+            iterations = sp_max(iterations + 1, iterations * sp_min(scale, 10.0));
+        }
     }
 
-    return map;
-}
+    f64* samples = sp_alloc(suite->allocator, config.samples * sizeof(f64));
+    SP_ProcessMemory memory_before = {0};
+    if (config.memory_stats) {
+        memory_before = sp_os_get_process_memory();
+    }
+    SP_PerfCounters perf_before = {0};
+    if (config.perf_counters) {
+        perf_before = sp_os_read_perf_counters();
+    }
+    f64 sum = 0.0;
+    for (u32 i = 0; i < config.samples; i++) {
+        samples[i] = (f64) _sp_bench_run_once(entry, &bench, iterations) / iterations;
+        sum += samples[i];
+    }
+    SP_PerfCounters perf_after = {0};
+    if (config.perf_counters) {
+        perf_after = sp_os_read_perf_counters();
+    }
+    SP_ProcessMemory memory_after = {0};
+    if (config.memory_stats) {
+        memory_after = sp_os_get_process_memory();
+    }
+    qsort(samples, config.samples, sizeof(f64), _sp_bench_compare_f64);
 
-void sp_hash_map_destroy(SP_HashMap* map) {
-    switch (map->desc.collision_resolution) {
-        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING:
-            sp_free(map->desc.allocator, map->soa.state, map->capacity * sizeof(u8));
-            sp_free(map->desc.allocator, map->soa.hashes, map->capacity * sizeof(u64));
-            sp_free(map->desc.allocator, map->soa.keys, map->capacity * map->desc.key_size);
-            sp_free(map->desc.allocator, map->soa.values, map->capacity * map->desc.value_size);
-            break;
-        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
-            u64 node_size = sizeof(_SP_HashContainerChainNode) + map->desc.key_size + map->desc.value_size;
-            for (u32 i = 0; i < map->capacity; i++) {
-                _SP_HashContainerChainNode* node = _sp_hash_map_get_node(map, i);
-                while (node != NULL) {
-                    sp_free(map->desc.allocator, node, node_size);
-                    node = node->next;
-                }
+    f64 mean = sum / config.samples;
+    f64 variance = 0.0;
+    for (u32 i = 0; i < config.samples; i++) {
+        variance += (samples[i] - mean) * (samples[i] - mean);
+    }
+    variance /= config.samples;
+
+    u32 middle = config.samples / 2;
+    f64 median = config.samples % 2 == 0 ? (samples[middle - 1] + samples[middle]) / 2.0 : samples[middle];
+    // Nearest rank.
+    u32 p99_rank = (u32) ceil(0.99 * config.samples);
+
+    _SP_BenchResult result = {
+        .iterations = iterations,
+        .samples = config.samples,
+        .median = median,
+        .p99 = samples[sp_clamp(p99_rank, 1u, config.samples) - 1],
+        .mean = mean,
+        .stddev = sqrt(variance),
+        .min = samples[0],
+        .max = samples[config.samples - 1],
+        .ops_per_second = median > 0.0 ? 1e9 / median : 0.0,
+    };
+    result.bytes_per_second = result.ops_per_second * bench.bytes_per_iteration;
+    if (config.memory_stats) {
+        f64 total_iterations = (f64) iterations * config.samples;
+        u64 faults_before = memory_before.minor_faults + memory_before.major_faults;
+        u64 faults_after = memory_after.minor_faults + memory_after.major_faults;
+        result.memory_calls = (memory_after.memory_calls - memory_before.memory_calls) / total_iterations;
+        result.faults = (faults_after - faults_before) / total_iterations;
+        result.peak_resident = memory_after.peak_resident;
+    }
+    if (config.perf_counters) {
+        // Also counts the paused parts of each sample.
+        f64 total_iterations = (f64) iterations * config.samples;
+        for (u32 i = 0; i < SP_PERF_COUNTER_COUNT; i++) {
+            result.perf_available[i] = perf_before.available[i] && perf_after.available[i];
+            if (result.perf_available[i]) {
+                result.perf[i] = (perf_after.values[i] - perf_before.values[i]) / total_iterations;
             }
+        }
+    }
 
-            _SP_HashContainerChainNode* node = map->aos.free_list;
-            while (node != NULL) {
-                sp_free(map->desc.allocator, node, node_size);
-                node = node->next;
-            }
+    sp_free(suite->allocator, samples, config.samples * sizeof(f64));
+    return result;
+}
 
-            sp_free(map->desc.allocator, map->aos.nodes, map->capacity * node_size);
-        } break;
+// Format a quantity with an SI prefix, like 1.23 G.
+static void _sp_bench_format_si(char* buffer, u32 size, f64 value) {
+    const char* const prefixes[] = {"", "k", "M", "G", "T"};
+    u32 prefix = 0;
+    while (value >= 1000.0 && prefix < sp_arrlen(prefixes) - 1) {
+        value /= 1000.0;
+        prefix++;
     }
-    *map = (SP_HashMap) {0};
+    snprintf(buffer, size, "%.2f %s", value, prefixes[prefix]);
 }
 
-b8 sp_hash_map_insert(SP_HashMap* map, const void* key, const void* value) {
-    const f32 LOAD_FACTOR = 0.75f;
-    u64 hash = map->desc.hash(key, map->desc.key_size);
-    switch (map->desc.collision_resolution) {
-        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING: {
-            u32 index = _sp_hash_container_get_index(key,
-                    map->desc.key_size,
-                    hash,
-                    map->soa.state,
-                    map->soa.hashes,
-                    map->soa.keys,
-                    true,
-                    map->capacity,
-                    map->desc.equal);
-            u8 state = map->soa.state[index];
-            if (state == _SP_HASH_BUCKET_STATE_ALIVE) {
-                return false;
-            }
+// Write 'str' as a quoted JSON string, escaping quotes, backslashes and
+// control characters.
+static void _sp_json_write_str(FILE* file, SP_Str str) {
+    fputc('"', file);
+    for (u32 i = 0; i < str.len; i++) {
+        u8 c = str.data[i];
+        if (c == '"' || c == '\\') {
+            fputc('\\', file);
+            fputc(c, file);
+        } else if (c < 0x20) {
+            fprintf(file, "\\u%04x", c);
+        } else {
+            fputc(c, file);
+        }
+    }
+    fputc('"', file);
+}
 
-            if (map->soa.count == map->capacity * LOAD_FACTOR) {
-                _sp_hash_map_grow(map);
-                index = _sp_hash_container_get_index(key,
-                        map->desc.key_size,
-                        hash,
-                        map->soa.state,
-                        map->soa.hashes,
-                        map->soa.keys,
-                        true,
-                        map->capacity,
-                        map->desc.equal);
-            }
+static void _sp_bench_write_json(SP_BenchSuite* suite, const char* path) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        sp_error("Failed to write benchmark results to '%s'.", path);
+        return;
+    }
 
-            if (state == _SP_HASH_BUCKET_STATE_EMPTY) {
-                map->soa.count++;
+    // One benchmark per line, which keeps the output easy to diff.
+    fprintf(file, "{\"benchmarks\": [\n");
+    b8 first = true;
+    for (u32 i = 0; i < suite->group_count; i++) {
+        _SP_BenchGroup group = suite->groups[i];
+        for (u32 j = 0; j < group.bench_count; j++) {
+            _SP_BenchEntry entry = group.benches[j];
+            _SP_BenchResult r = entry.result;
+            fprintf(file, "%s{\"group\": ", first ? "" : ",\n");
+            _sp_json_write_str(file, group.name);
+            fprintf(file, ", \"name\": ");
+            _sp_json_write_str(file, entry.name);
+            fprintf(file,
+                    ", \"iterations\": %llu, \"samples\": %u, "
+                    "\"median_ns\": %.3f, \"p99_ns\": %.3f, \"mean_ns\": %.3f, \"stddev_ns\": %.3f, "
+                    "\"min_ns\": %.3f, \"max_ns\": %.3f, \"ops_per_second\": %.3f, \"bytes_per_second\": %.3f, "
+                    "\"memory_calls_per_op\": %.6f, \"faults_per_op\": %.6f, \"peak_resident_bytes\": %llu",
+                    (unsigned long long) r.iterations, r.samples,
+                    r.median, r.p99, r.mean, r.stddev, r.min, r.max,
+                    r.ops_per_second, r.bytes_per_second,
+                    r.memory_calls, r.faults, (unsigned long long) r.peak_resident);
+            // Counters that weren't measured are null.
+            const char* const perf_keys[SP_PERF_COUNTER_COUNT] = {
+                "cycles_per_op",
+                "instructions_per_op",
+                "cache_references_per_op",
+                "cache_misses_per_op",
+                "branch_misses_per_op",
+                "page_faults_per_op",
+            };
+            for (u32 k = 0; k < SP_PERF_COUNTER_COUNT; k++) {
+                if (r.perf_available[k]) {
+                    fprintf(file, ", \"%s\": %.6f", perf_keys[k], r.perf[k]);
+                } else {
+                    fprintf(file, ", \"%s\": null", perf_keys[k]);
+                }
             }
+            fprintf(file, "}");
+            first = false;
+        }
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+}
 
-            u64 key_size = map->desc.key_size;
-            void* stored_key = (u8*) map->soa.keys + key_size * index;
-            map->soa.state[index] = _SP_HASH_BUCKET_STATE_ALIVE;
-            map->soa.hashes[index] = hash;
-            u64 value_size = map->desc.value_size;
-            memcpy(stored_key, key, key_size);
-            memcpy((u8*) map->soa.values + value_size * index, value, value_size);
-            map->count++;
-            return true;
+typedef struct _SP_BenchBaseline _SP_BenchBaseline;
+struct _SP_BenchBaseline {
+    // Raw file contents, the names point into it.
+    char* data;
+    u64 size;
+    SP_Str* groups;
+    SP_Str* names;
+    f64* medians;
+    u32 count;
+    u32 capacity;
+};
+
+// Extract the string value of 'key' from one line of JSON output, starting
+// at '*cursor'. The value is unescaped in place, which never makes it longer,
+// and '*cursor' is moved past its closing quote.
+static SP_Str _sp_bench_json_str(char** cursor, const char* key) {
+    char* start = strstr(*cursor, key);
+    if (start == NULL) {
+        return (SP_Str) {0};
+    }
+    start += strlen(key);
+
+    char* read = start;
+    char* write = start;
+    while (*read != '"') {
+        if (*read == 0) {
+            return (SP_Str) {0};
         }
-        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
-            u64 node_size = sizeof(_SP_HashContainerChainNode) + map->desc.key_size + map->desc.value_size;
-            _SP_HashContainerGetNodeResult result = _sp_hash_container_get_node(key,
-                    map->desc.key_size,
-                    hash,
-                    map->aos.nodes,
-                    node_size,
-                    map->capacity,
-                    map->desc.equal,
-                    true,
-                    &map->aos.free_list,
-                    map->desc.allocator);
-            if (result.new_key) {
-                result.node->state = _SP_HASH_BUCKET_STATE_ALIVE;
-                result.node->hash = hash;
-                void* node_key = &result.node[1];
-                void* node_value = (u8*) &result.node[1] + map->desc.key_size;
-                memcpy(node_key, key, map->desc.key_size);
-                memcpy(node_value, value, map->desc.value_size);
-                map->count++;
-                return true;
+        if (*read != '\\') {
+            *write++ = *read++;
+            continue;
+        }
+
+        read++;
+        if (*read == 'u') {
+            // Only control characters are written as \u escapes.
+            char hex[5] = {0};
+            for (u32 i = 0; i < 4 && read[i + 1] != 0; i++) {
+                hex[i] = read[i + 1];
             }
-            return false;
+            *write++ = (char) strtoul(hex, NULL, 16);
+            read += 1 + strlen(hex);
+        } else if (*read != 0) {
+            *write++ = *read++;
         }
     }
 
-    sp_assert(false, "Unreachable!");
-    return false;
+    *cursor = read + 1;
+    return sp_str((const u8*) start, write - start);
 }
 
-b8 sp_hash_map_set(SP_HashMap* map, const void* key, const void* value) {
-    const f32 LOAD_FACTOR = 0.75f;
-    u64 hash = map->desc.hash(key, map->desc.key_size);
-    switch (map->desc.collision_resolution) {
-        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING: {
-            if (map->soa.count == map->capacity * LOAD_FACTOR) {
-                _sp_hash_map_grow(map);
-            }
-
-            u32 index = _sp_hash_container_get_index(key,
-                    map->desc.key_size,
-                    hash,
-                    map->soa.state,
-                    map->soa.hashes,
-                    map->soa.keys,
-                    true,
-                    map->capacity,
-                    map->desc.equal);
+// Parse results written by '_sp_bench_write_json'. Only understands that
+// format, one benchmark per line.
+static _SP_BenchBaseline _sp_bench_load_baseline(SP_Allocator allocator, const char* path) {
+    _SP_BenchBaseline baseline = {0};
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        sp_warn("Failed to read benchmark baseline '%s'.", path);
+        return baseline;
+    }
 
-            u64 key_size = map->desc.key_size;
-            void* stored_key = (u8*) map->soa.keys + key_size * index;
-            u8 new_key = map->soa.state[index] == _SP_HASH_BUCKET_STATE_EMPTY;
-            map->soa.state[index] = _SP_HASH_BUCKET_STATE_ALIVE;
-            map->soa.hashes[index] = hash;
-            u64 value_size = map->desc.value_size;
-            memcpy(stored_key, key, key_size);
-            memcpy((u8*) map->soa.values + value_size * index, value, value_size);
-            if (new_key) {
-                map->soa.count++;
-            }
+    fseek(file, 0, SEEK_END);
+    baseline.size = ftell(file) + 1;
+    fseek(file, 0, SEEK_SET);
+    baseline.data = sp_alloc(allocator, baseline.size);
+    u64 len = fread(baseline.data, 1, baseline.size - 1, file);
+    baseline.data[len] = 0;
+    fclose(file);
 
-            return new_key;
+    u32 lines = 0;
+    for (u64 i = 0; i < len; i++) {
+        lines += baseline.data[i] == '\n';
+    }
+    baseline.capacity = lines;
+    baseline.groups = sp_alloc(allocator, lines * sizeof(SP_Str));
+    baseline.names = sp_alloc(allocator, lines * sizeof(SP_Str));
+    baseline.medians = sp_alloc(allocator, lines * sizeof(f64));
+
+    char* line = baseline.data;
+    while (line != NULL && *line != 0 && baseline.count < baseline.capacity) {
+        char* next = strchr(line, '\n');
+        if (next != NULL) {
+            *next = 0;
+            next++;
         }
-        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
-            u64 node_size = sizeof(_SP_HashContainerChainNode) + map->desc.key_size + map->desc.value_size;
-            _SP_HashContainerGetNodeResult result = _sp_hash_container_get_node(key,
-                    map->desc.key_size,
-                    hash,
-                    map->aos.nodes,
-                    node_size,
-                    map->capacity,
-                    map->desc.equal,
-                    true,
-                    &map->aos.free_list,
-                    map->desc.allocator);
-            result.node->state = _SP_HASH_BUCKET_STATE_ALIVE;
-            result.node->hash = hash;
-            void* node_key = &result.node[1];
-            void* node_value = (u8*) &result.node[1] + map->desc.key_size;
-            memcpy(node_key, key, map->desc.key_size);
-            memcpy(node_value, value, map->desc.value_size);
-            return result.new_key;
+
+        // Fields are read in the order they're written so an escaped name
+        // can't be mistaken for a key.
+        char* cursor = line;
+        SP_Str group = _sp_bench_json_str(&cursor, "\"group\": \"");
+        SP_Str name = _sp_bench_json_str(&cursor, "\"name\": \"");
+        const char* median = strstr(cursor, "\"median_ns\": ");
+        if (median != NULL && name.len != 0) {
+            baseline.groups[baseline.count] = group;
+            baseline.names[baseline.count] = name;
+            baseline.medians[baseline.count] = strtod(median + strlen("\"median_ns\": "), NULL);
+            baseline.count++;
         }
+        line = next;
     }
 
-    sp_assert(false, "Unreachable!");
-    return false;
+    return baseline;
 }
 
-b8 sp_hash_map_remove(SP_HashMap* map, const void* key, void* out_value) {
-    u64 hash = map->desc.hash(key, map->desc.key_size);
-    switch (map->desc.collision_resolution) {
-        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING: {
-            u32 index = _sp_hash_container_get_index(key,
-                    map->desc.key_size,
-                    hash,
-                    map->soa.state,
-                    map->soa.hashes,
-                    map->soa.keys,
-                    false,
-                    map->capacity,
-                    map->desc.equal);
-            if (map->soa.state[index] == _SP_HASH_BUCKET_STATE_ALIVE) {
-                map->soa.state[index] = _SP_HASH_BUCKET_STATE_DEAD;
-                if (out_value != NULL) {
-                    u64 value_size = map->desc.value_size;
-                    memcpy(out_value,
-                        (u8*) map->soa.values + index * value_size,
-                        value_size);
-                }
-                map->count--;
-                return true;
-            }
-            return false;
-        }
-        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
-            u64 node_size = sizeof(_SP_HashContainerChainNode) + map->desc.key_size + map->desc.value_size;
-            _SP_HashContainerGetNodeResult result = _sp_hash_container_get_node(key,
-                    map->desc.key_size,
-                    hash,
-                    map->aos.nodes,
-                    node_size,
-                    map->capacity,
-                    map->desc.equal,
-                    false,
-                    &map->aos.free_list,
-                    map->desc.allocator);
-            if (result.new_key) {
-                return false;
-            }
+static void _sp_bench_free_baseline(SP_Allocator allocator, _SP_BenchBaseline baseline) {
+    if (baseline.data == NULL) {
+        return;
+    }
+    sp_free(allocator, baseline.groups, baseline.capacity * sizeof(SP_Str));
+    sp_free(allocator, baseline.names, baseline.capacity * sizeof(SP_Str));
+    sp_free(allocator, baseline.medians, baseline.capacity * sizeof(f64));
+    sp_free(allocator, baseline.data, baseline.size);
+}
 
-            _SP_HashContainerChainNode* node = result.node;
-            if (out_value != NULL) {
-                void* node_value = (u8*) &result.node[1] + map->desc.key_size;
-                memcpy(out_value,
-                    node_value,
-                    map->desc.value_size);
-            }
+static f64 _sp_bench_baseline_median(const _SP_BenchBaseline* baseline, SP_Str group, SP_Str name) {
+    for (u32 i = 0; i < baseline->count; i++) {
+        if (sp_str_equal(baseline->groups[i], group) && sp_str_equal(baseline->names[i], name)) {
+            return baseline->medians[i];
+        }
+    }
+    return 0.0;
+}
 
-            // Root node
-            if (node->prev == NULL) {
-                if (node->next == NULL) {
-                    node->state = _SP_HASH_BUCKET_STATE_EMPTY;
-                } else {
-                    _SP_HashContainerChainNode* free_node = node->next;
-                    memcpy(node, node->next, node_size);
-                    node->prev = NULL;
-                    if (node->next != NULL) {
-                        node->next->prev = node;
-                    }
+void sp_bench_suite_run(SP_BenchSuite* suite, SP_BenchConfig config) {
+    if (config.warmup_ns == 0) {
+        config.warmup_ns = SP_BENCH_CONFIG_DEFAULT.warmup_ns;
+    }
+    if (config.min_sample_ns == 0) {
+        config.min_sample_ns = SP_BENCH_CONFIG_DEFAULT.min_sample_ns;
+    }
+    if (config.samples == 0) {
+        config.samples = SP_BENCH_CONFIG_DEFAULT.samples;
+    }
 
-                    free_node->next = map->aos.free_list;
-                    map->aos.free_list = free_node;
-                }
-            } else {
-                node->prev->next = node->next;
-                if (node->next != NULL) {
-                    node->next->prev = node->prev;
-                }
+    _SP_BenchBaseline baseline = {0};
+    if (config.baseline_path != NULL) {
+        baseline = _sp_bench_load_baseline(suite->allocator, config.baseline_path);
+    }
 
-                node->next = map->aos.free_list;
-                map->aos.free_list = node;
-            }
+    for (u32 i = 0; i < suite->group_count; i++) {
+        _SP_BenchGroup* group = &suite->groups[i];
+        printf("--- Running %u benchmarks in group %.*s ---\n", group->bench_count, group->name.len, group->name.data);
+        printf("%-40s %12s %12s %12s %12s %12s", "name", "median", "p99", "stddev", "ops/s", "bytes/s");
+        if (config.memory_stats) {
+            printf(" %12s %12s %12s", "os calls/op", "faults/op", "peak RSS");
+        }
+        if (config.perf_counters) {
+            printf(" %12s %12s %12s %12s", "cycles/op", "instr/op", "cmiss/op", "bmiss/op");
+        }
+        if (config.baseline_path != NULL) {
+            printf(" %12s", "vs baseline");
+        }
+        printf("\n");
 
-            map->count--;
-            return true;
+        if (group->setup != NULL) {
+            group->setup(group->fixture_userdata);
         }
-    }
 
-    sp_assert(false, "Unreachable!");
-    return false;
-}
+        for (u32 j = 0; j < group->bench_count; j++) {
+            _SP_BenchEntry* entry = &group->benches[j];
+            entry->result = _sp_bench_measure(suite, entry, config);
 
-b8 sp_hash_map_get(SP_HashMap* map, const void* key, void* out_value) {
-    u64 hash = map->desc.hash(key, map->desc.key_size);
-    switch (map->desc.collision_resolution) {
-        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING: {
-            u32 index = _sp_hash_container_get_index(key,
-                    map->desc.key_size,
-                    hash,
-                    map->soa.state,
-                    map->soa.hashes,
-                    map->soa.keys,
-                    false,
-                    map->capacity,
-                    map->desc.equal);
-            if (index == ~0u) {
-                return false;
+            _SP_BenchResult r = entry->result;
+            char ops[32];
+            char bytes[32];
+            _sp_bench_format_si(ops, sizeof(ops), r.ops_per_second);
+            if (r.bytes_per_second > 0.0) {
+                _sp_bench_format_si(bytes, sizeof(bytes), r.bytes_per_second);
+            } else {
+                snprintf(bytes, sizeof(bytes), "-");
+            }
+            printf("%-40.*s %9.2f ns %9.2f ns %9.2f ns %12s %12s",
+                    entry->name.len, entry->name.data,
+                    r.median, r.p99, r.stddev, ops, bytes);
+
+            if (config.memory_stats) {
+                char peak[32];
+                _sp_bench_format_si(peak, sizeof(peak), r.peak_resident);
+                printf(" %12.4f %12.4f %11sB", r.memory_calls, r.faults, peak);
             }
 
-            if (map->soa.state[index] == _SP_HASH_BUCKET_STATE_ALIVE) {
-                if (out_value != NULL) {
-                    u64 value_size = map->desc.value_size;
-                    memcpy(out_value,
-                        (u8*) map->soa.values + index * value_size,
-                        value_size);
+            if (config.perf_counters) {
+                const SP_PerfCounter shown[] = {
+                    SP_PERF_COUNTER_CYCLES,
+                    SP_PERF_COUNTER_INSTRUCTIONS,
+                    SP_PERF_COUNTER_CACHE_MISSES,
+                    SP_PERF_COUNTER_BRANCH_MISSES,
+                };
+                for (u32 k = 0; k < sp_arrlen(shown); k++) {
+                    if (r.perf_available[shown[k]]) {
+                        printf(" %12.2f", r.perf[shown[k]]);
+                    } else {
+                        printf(" %12s", "-");
+                    }
                 }
-                return true;
             }
-            return false;
-        }
-        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
-            u64 node_size = sizeof(_SP_HashContainerChainNode) + map->desc.key_size + map->desc.value_size;
-            _SP_HashContainerGetNodeResult result = _sp_hash_container_get_node(key,
-                    map->desc.key_size,
-                    hash,
-                    map->aos.nodes,
-                    node_size,
-                    map->capacity,
-                    map->desc.equal,
-                    false,
-                    &map->aos.free_list,
-                    map->desc.allocator);
-            if (!result.new_key) {
-                if (out_value != NULL) {
-                    void* node_value = (u8*) &result.node[1] + map->desc.key_size;
-                    memcpy(out_value,
-                        node_value,
-                        map->desc.value_size);
+
+            if (config.baseline_path != NULL) {
+                f64 base = _sp_bench_baseline_median(&baseline, group->name, entry->name);
+                if (base > 0.0) {
+                    // Positive means slower than the baseline.
+                    f64 change = (r.median - base) / base * 100.0;
+                    const char* color = change > 5.0 ? "\033[0;91m" : change < -5.0 ? "\033[0;92m" : "";
+                    printf(" %s%+11.1f%%\033[0m", color, change);
+                } else {
+                    printf(" %12s", "-");
                 }
-                return true;
             }
-            return false;
+            printf("\n");
+        }
+
+        if (group->teardown != NULL) {
+            group->teardown(group->fixture_userdata);
         }
+        printf("\n");
     }
 
-    sp_assert(false, "Unreachable!");
-    return false;
+    _sp_bench_free_baseline(suite->allocator, baseline);
+
+    if (config.json_path != NULL) {
+        _sp_bench_write_json(suite, config.json_path);
+    }
 }
 
-void* sp_hash_map_getp(SP_HashMap* map, const void* key) {
-    u64 hash = map->desc.hash(key, map->desc.key_size);
-    switch (map->desc.collision_resolution) {
-        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING: {
-            u32 index = _sp_hash_container_get_index(key,
-                    map->desc.key_size,
-                    hash,
-                    map->soa.state,
-                    map->soa.hashes,
-                    map->soa.keys,
-                    false,
-                    map->capacity,
-                    map->desc.equal);
-            if (index == ~0u) {
-                return false;
-            }
+// -- Histogram ----------------------------------------------------------------
+// Bucket layout with 'sub' = 2^precision buckets per power of two:
+// - Values below 2 * sub get a bucket each.
+// - Above that, a value with its highest bit at 'msb' is shifted right by
+//   'shift' = msb - precision so 'precision + 1' significant bits are left.
+//   The result lies in [sub, 2 * sub) and the bucket is shift * sub + result.
+
+struct SP_Histogram {
+    u32 precision;
+    u32 shard_count;
+    u64 max_value;
+    u32 bucket_count;
+    // Distance between shards in 'counts', rounded up to whole cache lines.
+    u32 shard_stride;
+    volatile u64* counts;
+};
 
-            if (map->soa.state[index] == _SP_HASH_BUCKET_STATE_ALIVE) {
-                u64 value_size = map->desc.value_size;
-                return (u8*) map->soa.values + index * value_size;
-            }
-            return false;
-        }
-        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
-            u64 node_size = sizeof(_SP_HashContainerChainNode) + map->desc.key_size + map->desc.value_size;
-            _SP_HashContainerGetNodeResult result = _sp_hash_container_get_node(key,
-                    map->desc.key_size,
-                    hash,
-                    map->aos.nodes,
-                    node_size,
-                    map->capacity,
-                    map->desc.equal,
-                    false,
-                    &map->aos.free_list,
-                    map->desc.allocator);
-            if (!result.new_key) {
-                return (u8*) &result.node[1] + map->desc.key_size;
-            }
-            return NULL;
-        }
+static SP_THREAD_LOCAL u32 _sp_histogram_thread = 0;
+
+static u32 _sp_histogram_bucket(const SP_Histogram* histogram, u64 value) {
+    u64 sub = 1llu << histogram->precision;
+    if (value < 2 * sub) {
+        return value;
     }
+    u32 shift = _sp_msb_u64(value) - histogram->precision;
+    return shift * sub + (value >> shift);
+}
 
-    sp_assert(false, "Unreachable!");
-    return NULL;
+static u64 _sp_histogram_bucket_lowest(const SP_Histogram* histogram, u32 bucket) {
+    u64 sub = 1llu << histogram->precision;
+    if (bucket < 2 * sub) {
+        return bucket;
+    }
+    u32 shift = bucket / sub - 1;
+    return (bucket - shift * sub) << shift;
 }
 
-u32 sp_hash_map_count(const SP_HashMap* map) {
-    return map->count;
+static u64 _sp_histogram_bucket_highest(const SP_Histogram* histogram, u32 bucket) {
+    u64 sub = 1llu << histogram->precision;
+    if (bucket < 2 * sub) {
+        return bucket;
+    }
+    u32 shift = bucket / sub - 1;
+    u64 highest = _sp_histogram_bucket_lowest(histogram, bucket) + ((1llu << shift) - 1);
+    return sp_min(highest, histogram->max_value);
 }
 
-// Iteration
-SP_HashMapIter sp_hash_map_iter_init(SP_HashMap* map) {
-    SP_HashMapIter iter = {
-        .map = map,
-        .index = ~0u,
-        .node = NULL,
-    };
+// Count of 'bucket' summed over every shard.
+static u64 _sp_histogram_bucket_count(const SP_Histogram* histogram, u32 bucket) {
+    u64 count = 0;
+    for (u32 i = 0; i < histogram->shard_count; i++) {
+        count += _sp_atomic_load_u64(&histogram->counts[i * histogram->shard_stride + bucket]);
+    }
+    return count;
+}
 
-    switch (map->desc.collision_resolution) {
-        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING:
-            for (u32 i = 0; i < map->capacity; i++) {
-                if (map->soa.state[i] == _SP_HASH_BUCKET_STATE_ALIVE) {
-                    iter.index = i;
-                    break;
-                }
-            }
-            break;
-        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING:
-            for (u32 i = 0; i < map->capacity; i++) {
-                _SP_HashContainerChainNode* node = _sp_hash_map_get_node(map, i);
-                if (node->state == _SP_HASH_BUCKET_STATE_ALIVE) {
-                    iter.index = i;
-                    iter.node = node;
-                    break;
-                }
-            }
-            break;
+SP_Histogram* sp_histogram_create(SP_Arena* arena, SP_HistogramDesc desc) {
+    if (desc.precision == 0) {
+        desc.precision = 7;
+    }
+    desc.precision = sp_min(desc.precision, 16);
+    if (desc.max_value == 0) {
+        desc.max_value = UINT64_MAX;
+    }
+    if (desc.shards == 0) {
+        desc.shards = sp_max(sp_os_get_system_info().logical_cores, 1);
     }
-    return iter;
-}
 
-b8 sp_hash_map_iter_valid(SP_HashMapIter iter) {
-    return iter.map != NULL && iter.index < iter.map->capacity;
+    SP_Histogram* histogram = sp_arena_push(arena, sizeof(SP_Histogram));
+    *histogram = (SP_Histogram) {
+        .precision = desc.precision,
+        .shard_count = desc.shards,
+        .max_value = desc.max_value,
+    };
+    histogram->bucket_count = _sp_histogram_bucket(histogram, desc.max_value) + 1;
+    u32 line_size = sp_max(sp_os_get_system_info().cache_line_size, sizeof(u64));
+    u32 per_line = line_size / sizeof(u64);
+    histogram->shard_stride = (histogram->bucket_count + per_line - 1) / per_line * per_line;
+    // Pad the front as well so the first shard doesn't share a cache line with
+    // whatever was pushed before it.
+    u8* counts = sp_arena_push(arena, (u64) histogram->shard_stride * desc.shards * sizeof(u64) + line_size);
+    histogram->counts = (volatile u64*) _align_value((u64) counts, line_size);
+
+    return histogram;
 }
 
-SP_HashMapIter sp_hash_map_iter_next(SP_HashMapIter iter) {
-    sp_assert(sp_hash_map_iter_valid(iter), "Hash map iterator must be valid!");
-
-    SP_HashMap* map = iter.map;
-    switch (map->desc.collision_resolution) {
-        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING:
-            for (u32 i = iter.index + 1; i < map->capacity; i++) {
-                if (map->soa.state[i] == _SP_HASH_BUCKET_STATE_ALIVE) {
-                    iter.index = i;
-                    return iter;
-                }
-            }
-        break;
-        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
-            _SP_HashContainerChainNode* node = iter.node;
-            if (node->next != NULL) {
-                iter.node = node->next;
-                return iter;
-            }
+void sp_histogram_record(SP_Histogram* histogram, u64 value) {
+    sp_histogram_record_n(histogram, value, 1);
+}
 
-            for (u32 i = iter.index + 1; i < map->capacity; i++) {
-                _SP_HashContainerChainNode* node = _sp_hash_map_get_node(map, i);
-                if (node->state == _SP_HASH_BUCKET_STATE_ALIVE) {
-                    iter.index = i;
-                    iter.node = node;
-                    return iter;
-                }
-            }
-        } break;
+void sp_histogram_record_n(SP_Histogram* histogram, u64 value, u64 count) {
+    if (_sp_histogram_thread == 0) {
+        _sp_histogram_thread = _sp_atomic_add_u64(&_sp_state.histogram.thread_count, 1) + 1;
     }
-    return (SP_HashMapIter) {0};
+    u32 shard = (_sp_histogram_thread - 1) % histogram->shard_count;
+    u32 bucket = _sp_histogram_bucket(histogram, sp_min(value, histogram->max_value));
+    // Atomic since threads can end up sharing a shard. It's uncontended most
+    // of the time so it stays cheap.
+    _sp_atomic_add_u64(&histogram->counts[shard * histogram->shard_stride + bucket], count);
 }
 
-void sp_hash_map_iter_get_key(SP_HashMapIter iter, void* out_key) {
-    sp_assert(sp_hash_map_iter_valid(iter), "Hash map iterator must be valid!");
-
-    SP_HashMap* map = iter.map;
-    switch (map->desc.collision_resolution) {
-        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING:
-            memcpy(out_key, (u8*) map->soa.keys + iter.index * map->desc.key_size, map->desc.key_size);
-            break;
-        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
-            _SP_HashContainerChainNode* node = iter.node;
-            memcpy(out_key, &node[1], map->desc.key_size);
-        } break;
+u64 sp_histogram_count(const SP_Histogram* histogram) {
+    u64 count = 0;
+    for (u32 i = 0; i < histogram->bucket_count; i++) {
+        count += _sp_histogram_bucket_count(histogram, i);
     }
+    return count;
 }
 
-void sp_hash_map_iter_get_value(SP_HashMapIter iter, void* out_value) {
-    sp_assert(sp_hash_map_iter_valid(iter), "Hash map iterator must be valid!");
-
-    SP_HashMap* map = iter.map;
-    switch (map->desc.collision_resolution) {
-        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING:
-            memcpy(out_value, (u8*) map->soa.values + iter.index * map->desc.value_size, map->desc.value_size);
-            break;
-        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
-            _SP_HashContainerChainNode* node = iter.node;
-            memcpy(out_value, (u8*) &node[1] + map->desc.key_size, map->desc.value_size);
-        } break;
+u64 sp_histogram_min(const SP_Histogram* histogram) {
+    for (u32 i = 0; i < histogram->bucket_count; i++) {
+        if (_sp_histogram_bucket_count(histogram, i) != 0) {
+            return _sp_histogram_bucket_lowest(histogram, i);
+        }
     }
+    return 0;
 }
 
-void* sp_hash_map_iter_get_valuep(SP_HashMapIter iter) {
-    sp_assert(sp_hash_map_iter_valid(iter), "Hash map iterator must be valid!");
-
-    SP_HashMap* map = iter.map;
-    switch (map->desc.collision_resolution) {
-        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING:
-            return (u8*) map->soa.values + iter.index * map->desc.value_size;
-        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
-            _SP_HashContainerChainNode* node = iter.node;
-            return (u8*) &node[1] + map->desc.key_size;
+u64 sp_histogram_max(const SP_Histogram* histogram) {
+    for (u32 i = histogram->bucket_count; i > 0; i--) {
+        if (_sp_histogram_bucket_count(histogram, i - 1) != 0) {
+            return _sp_histogram_bucket_highest(histogram, i - 1);
         }
     }
+    return 0;
+}
 
-    return NULL;
+f64 sp_histogram_mean(const SP_Histogram* histogram) {
+    // Every recording counts as the middle of its bucket.
+    f64 sum = 0.0;
+    u64 count = 0;
+    for (u32 i = 0; i < histogram->bucket_count; i++) {
+        u64 bucket_count = _sp_histogram_bucket_count(histogram, i);
+        if (bucket_count == 0) {
+            continue;
+        }
+        u64 lowest = _sp_histogram_bucket_lowest(histogram, i);
+        u64 highest = _sp_histogram_bucket_highest(histogram, i);
+        sum += ((f64) lowest + (f64) (highest - lowest) / 2.0) * bucket_count;
+        count += bucket_count;
+    }
+    if (count == 0) {
+        return 0.0;
+    }
+    return sum / count;
 }
 
-// Helper functions
+u64 sp_histogram_percentile(const SP_Histogram* histogram, f64 percentile) {
+    u64 count = sp_histogram_count(histogram);
+    if (count == 0) {
+        return 0;
+    }
 
-u64 sp_hash_map_helper_hash_str(const void* key, u64 size) {
-    (void) size;
-    const SP_Str* _key = key;
-    return sp_fvn1a_hash(_key->data, _key->len);
+    percentile = sp_clamp(percentile, 0.0, 100.0);
+    u64 target = (u64) ceil(percentile / 100.0 * count);
+    target = sp_clamp(target, 1, count);
+
+    u64 seen = 0;
+    for (u32 i = 0; i < histogram->bucket_count; i++) {
+        seen += _sp_histogram_bucket_count(histogram, i);
+        if (seen >= target) {
+            return _sp_histogram_bucket_highest(histogram, i);
+        }
+    }
+    // Only reached if recordings raced with the count above.
+    return sp_histogram_max(histogram);
 }
 
-b8 sp_hash_map_helper_equal_str(const void* a, const void* b, u64 len) {
-    (void) len;
-    const SP_Str* _a = a;
-    const SP_Str* _b = b;
-    return sp_str_equal(*_a, *_b);
+void sp_histogram_merge(SP_Histogram* dst, const SP_Histogram* src) {
+    for (u32 i = 0; i < src->bucket_count; i++) {
+        u64 count = _sp_histogram_bucket_count(src, i);
+        if (count != 0) {
+            sp_histogram_record_n(dst, _sp_histogram_bucket_lowest(src, i), count);
+        }
+    }
 }
 
-b8 sp_hash_map_helper_equal_generic(const void* a, const void* b, u64 len) {
-    return memcmp(a, b, len) == 0;
+void sp_histogram_reset(SP_Histogram* histogram) {
+    for (u32 i = 0; i < histogram->shard_count; i++) {
+        for (u32 j = 0; j < histogram->bucket_count; j++) {
+            _sp_atomic_store_u64(&histogram->counts[i * histogram->shard_stride + j], 0);
+        }
+    }
 }
 
-// -- Hash set -----------------------------------------------------------------
+// -- Profiling ----------------------------------------------------------------
 
-struct SP_HashSet {
-    SP_HashSetDesc desc;
-    u32 capacity;
-    // Count of active elements in set
-    u32 count;
-    union {
-        // Struct of Arrays
-        // Used for open addressing
-        struct {
-            u8* state;
-            u64* hashes;
-            void* values;
-            // Count of used or dead slots
-            u32 count;
-        } soa;
-        // Array of Structs
-        // Used for separate chaining
-        struct {
-            _SP_HashContainerChainNode* nodes;
-            _SP_HashContainerChainNode* free_list;
-        } aos;
-    };
+typedef enum _SP_ProfEventType {
+    _SP_PROF_EVENT_BEGIN,
+    _SP_PROF_EVENT_END,
+} _SP_ProfEventType;
+
+typedef struct _SP_ProfEvent _SP_ProfEvent;
+struct _SP_ProfEvent {
+    const char* name;
+    u64 time_ns;
+    _SP_ProfEventType type;
 };
 
-static void _sp_hash_set_grow(SP_HashSet* set) {
-    const f32 GROWTH_FACTOR = 2.0f;
-    u32 new_cap = set->capacity * GROWTH_FACTOR;
+// Single producer ring buffer. Only the owning thread writes events, the
+// flushing thread reads them without stopping it.
+struct _SP_ProfBuffer {
+    _SP_ProfBuffer* next;
+    u32 thread_index;
+    u32 mask;
+    // Events written so far. Only the last 'mask + 1' are still in the buffer.
+    volatile u64 head;
+    // Events already written by 'sp_prof_flush'.
+    u64 flushed;
+    _SP_ProfEvent events[];
+};
 
-    u8* new_state = sp_alloc(set->desc.allocator, new_cap * sizeof(u8));
-    u64* new_hashes = sp_alloc(set->desc.allocator, new_cap * sizeof(u64));
-    void* new_values = sp_alloc(set->desc.allocator, new_cap * set->desc.value_size);
-    memset(new_state, 0, new_cap * sizeof(u8));
+static SP_THREAD_LOCAL _SP_ProfBuffer* _sp_prof_buffer = NULL;
+// Set while the thread creates its buffer. Growing the profiler arena records
+// zones of its own which are dropped.
+static SP_THREAD_LOCAL b8 _sp_prof_busy = false;
 
-    for (u32 i = 0; i < set->capacity; i++) {
-        if (set->soa.state[i] == _SP_HASH_BUCKET_STATE_ALIVE) {
-            const void* value = (u8*) set->soa.values + set->desc.value_size * i;
-            u32 new_index = _sp_hash_container_get_index(value,
-                    set->desc.value_size,
-                    set->soa.hashes[i],
-                    new_state,
-                    new_hashes,
-                    new_values,
-                    true,
-                    new_cap,
-                    set->desc.equal);
-            u64 value_size = set->desc.value_size;
+static _SP_ProfBuffer* _sp_prof_get_buffer(void) {
+    if (_sp_prof_buffer != NULL || _sp_prof_busy || _sp_state.prof.arena == NULL) {
+        return _sp_prof_buffer;
+    }
 
-            new_state[new_index] = _SP_HASH_BUCKET_STATE_ALIVE;
-            new_hashes[new_index] = set->soa.hashes[i];
-            memcpy((u8*) new_values + value_size * new_index,
-                    (u8*) set->soa.values + value_size * i,
-                    value_size);
-        }
+    _sp_prof_busy = true;
+    // A recycled context brings the buffer of the thread that used it before.
+    // Its events stay until they're flushed or overwritten.
+    SP_ThreadCtx* ctx = _sp_thread_ctx_get();
+    if (ctx->prof_buffer == NULL) {
+        u32 capacity = _sp_next_pow2(_sp_state.cfg.profiler.events_per_thread);
+        _sp_platform_lock();
+        _SP_ProfBuffer* buffer = sp_arena_push(_sp_state.prof.arena, sizeof(_SP_ProfBuffer) + capacity * sizeof(_SP_ProfEvent));
+        buffer->thread_index = _sp_state.prof.thread_count++;
+        buffer->mask = capacity - 1;
+        buffer->next = _sp_state.prof.buffers;
+        _sp_state.prof.buffers = buffer;
+        _sp_platform_unlock();
+        ctx->prof_buffer = buffer;
     }
+    _sp_prof_busy = false;
 
-    sp_free(set->desc.allocator, set->soa.state, set->capacity * sizeof(u8));
-    sp_free(set->desc.allocator, set->soa.hashes, set->capacity * sizeof(u64));
-    sp_free(set->desc.allocator, set->soa.values, set->capacity * set->desc.value_size);
+    _sp_prof_buffer = ctx->prof_buffer;
+    return _sp_prof_buffer;
+}
 
-    set->soa.state = new_state;
-    set->soa.hashes = new_hashes;
-    set->soa.values = new_values;
-    set->capacity = new_cap;
+static void _sp_prof_record(const char* name, _SP_ProfEventType type) {
+    _SP_ProfBuffer* buffer = _sp_prof_get_buffer();
+    if (buffer == NULL) {
+        return;
+    }
+
+    u64 head = buffer->head;
+    buffer->events[head & buffer->mask] = (_SP_ProfEvent) {
+        .name = name,
+        .time_ns = sp_os_get_time_ns(),
+        .type = type,
+    };
+    _sp_atomic_store_u64(&buffer->head, head + 1);
 }
 
-static inline _SP_HashContainerChainNode* _sp_hash_set_get_node(SP_HashSet* set, u32 index) {
-    u64 node_size = sizeof(_SP_HashContainerChainNode) + set->desc.value_size;
-    return (_SP_HashContainerChainNode*) ((u8*) set->aos.nodes + node_size * index);
+void _sp_prof_zone_begin(const char* name) {
+    _sp_prof_record(name, _SP_PROF_EVENT_BEGIN);
 }
 
-SP_HashSet* sp_hash_set_create(SP_HashSetDesc desc) {
-    SP_HashSet* set = sp_alloc(desc.allocator, sizeof(SP_HashSet));
+void _sp_prof_zone_end(void) {
+    _sp_prof_record(NULL, _SP_PROF_EVENT_END);
+}
 
-    u32 cap = desc.capacity;
-    switch (desc.collision_resolution) {
-        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING:
-            *set = (SP_HashSet) {
-                .desc = desc,
-                .capacity = cap,
-                .soa = {
-                    .state = sp_alloc(desc.allocator, cap * sizeof(u8)),
-                    .hashes = sp_alloc(desc.allocator, cap * sizeof(u64)),
-                    .values = sp_alloc(desc.allocator, cap * desc.value_size),
-                }
-            };
-            memset(set->soa.state, 0, cap * sizeof(u8));
-            break;
-        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
-            u64 node_size = sizeof(_SP_HashContainerChainNode) + desc.value_size;
-            *set = (SP_HashSet) {
-                .desc = desc,
-                .capacity = cap,
-                .aos = {
-                    .nodes = sp_alloc(desc.allocator, cap * node_size),
-                    .free_list = NULL,
-                },
-            };
-            memset(set->aos.nodes, 0, cap * node_size);
-        } break;
+b8 sp_prof_flush(const char* path) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        sp_error("Failed to write profile to '%s'.", path);
+        return false;
     }
 
-    return set;
-}
+    // Buffers are only ever added to the front of the list, so the rest of it
+    // can be walked without holding the lock.
+    _sp_platform_lock();
+    _SP_ProfBuffer* buffers = _sp_state.prof.buffers;
+    _sp_platform_unlock();
+
+    SP_Allocator allocator = sp_libc_allocator();
+    fprintf(file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    b8 first = true;
+    for (_SP_ProfBuffer* buffer = buffers; buffer != NULL; buffer = buffer->next) {
+        fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": \"Thread %u\"}}",
+                first ? "" : ",\n", buffer->thread_index, buffer->thread_index);
+        first = false;
+
+        u64 capacity = (u64) buffer->mask + 1;
+        u64 head = _sp_atomic_load_u64(&buffer->head);
+        u64 start = sp_max(buffer->flushed, head > capacity ? head - capacity : 0);
+        u64 count = head - start;
+        if (count == 0) {
+            continue;
+        }
 
-void sp_hash_set_destroy(SP_HashSet* set) {
-    switch (set->desc.collision_resolution) {
-        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING:
-            sp_free(set->desc.allocator, set->soa.state, set->capacity * sizeof(u8));
-            sp_free(set->desc.allocator, set->soa.hashes, set->capacity * sizeof(u64));
-            sp_free(set->desc.allocator, set->soa.values, set->capacity * set->desc.value_size);
-            break;
-        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
-            u64 node_size = sizeof(_SP_HashContainerChainNode) + set->desc.value_size;
-            for (u32 i = 0; i < set->capacity; i++) {
-                _SP_HashContainerChainNode* node = _sp_hash_set_get_node(set, i);
-                while (node != NULL) {
-                    sp_free(set->desc.allocator, node, node_size);
-                    node = node->next;
+        _SP_ProfEvent* events = sp_alloc(allocator, count * sizeof(_SP_ProfEvent));
+        for (u64 i = 0; i < count; i++) {
+            events[i] = buffer->events[(start + i) & buffer->mask];
+        }
+        // Anything the thread wrapped around to while copying may be torn.
+        u64 head_after = _sp_atomic_load_u64(&buffer->head);
+        u64 first_valid = head_after > capacity ? head_after - capacity + 1 : 0;
+
+        // End events whose begin was overwritten or flushed earlier are
+        // skipped.
+        u32 depth = 0;
+        const char* names[64];
+        for (u64 i = 0; i < count; i++) {
+            if (start + i < first_valid) {
+                continue;
+            }
+            _SP_ProfEvent event = events[i];
+            f64 ts = (f64) (event.time_ns - _sp_state.clock.start_ns) / 1000.0;
+            if (event.type == _SP_PROF_EVENT_BEGIN) {
+                if (depth < sp_arrlen(names)) {
+                    names[depth] = event.name;
                 }
+                depth++;
+                fprintf(file, ",\n{\"name\": ");
+                _sp_json_write_str(file, sp_cstr(event.name));
+                fprintf(file, ", \"ph\": \"B\", \"ts\": %.3f, \"pid\": 1, \"tid\": %u}", ts, buffer->thread_index);
+            } else if (depth > 0) {
+                depth--;
+                fprintf(file, ",\n{\"name\": ");
+                _sp_json_write_str(file, sp_cstr(depth < sp_arrlen(names) ? names[depth] : ""));
+                fprintf(file, ", \"ph\": \"E\", \"ts\": %.3f, \"pid\": 1, \"tid\": %u}", ts, buffer->thread_index);
             }
+        }
 
-            _SP_HashContainerChainNode* node = set->aos.free_list;
-            while (node != NULL) {
-                sp_free(set->desc.allocator, node, node_size);
-                node = node->next;
-            }
+        sp_free(allocator, events, count * sizeof(_SP_ProfEvent));
+        buffer->flushed = head;
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    return true;
+}
 
-            sp_free(set->desc.allocator, set->aos.nodes, set->capacity * node_size);
-        } break;
+static void _sp_prof_terminate(void) {
+    if (_sp_state.prof.arena != NULL) {
+        sp_arena_destroy(_sp_state.prof.arena);
     }
-    *set = (SP_HashSet) {0};
+    _sp_state.prof.arena = NULL;
+    _sp_state.prof.buffers = NULL;
+    _sp_state.prof.thread_count = 0;
+    _sp_prof_buffer = NULL;
 }
 
-b8 sp_hash_set_insert(SP_HashSet* set, const void* value) {
-    const f32 LOAD_FACTOR = 0.75f;
-    u64 hash = set->desc.hash(value, set->desc.value_size);
-    switch (set->desc.collision_resolution) {
-        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING: {
-            u32 index = _sp_hash_container_get_index(value,
-                    set->desc.value_size,
-                    hash,
-                    set->soa.state,
-                    set->soa.hashes,
-                    set->soa.values,
-                    true,
-                    set->capacity,
-                    set->desc.equal);
-            u8 state = set->soa.state[index];
-            if (state == _SP_HASH_BUCKET_STATE_ALIVE) {
-                return false;
-            }
+// -- OS -----------------------------------------------------------------------
+// Platform specific implementation
+// :platform
 
-            if (set->soa.count == set->capacity * LOAD_FACTOR) {
-                _sp_hash_set_grow(set);
-                index = _sp_hash_container_get_index(value,
-                        set->desc.value_size,
-                        hash,
-                        set->soa.state,
-                        set->soa.hashes,
-                        set->soa.values,
-                        true,
-                        set->capacity,
-                        set->desc.equal);
-            }
+f32 sp_os_get_time(void) {
+    return (f64) (sp_os_get_time_ns() - _sp_state.clock.start_ns) / 1e9;
+}
 
-            if (state == _SP_HASH_BUCKET_STATE_EMPTY) {
-                set->soa.count++;
-            }
+u64 sp_os_get_cycle_frequency(void) {
+    if (_sp_state.clock.cycle_frequency != 0) {
+        return _sp_state.clock.cycle_frequency;
+    }
 
-            set->soa.state[index] = _SP_HASH_BUCKET_STATE_ALIVE;
-            set->soa.hashes[index] = hash;
-            u64 value_size = set->desc.value_size;
-            memcpy((u8*) set->soa.values + value_size * index, value, value_size);
-            set->count++;
-            return true;
-        }
-        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
-            u64 node_size = sizeof(_SP_HashContainerChainNode) + set->desc.value_size;
-            _SP_HashContainerGetNodeResult result = _sp_hash_container_get_node(value,
-                    set->desc.value_size,
-                    hash,
-                    set->aos.nodes,
-                    node_size,
-                    set->capacity,
-                    set->desc.equal,
-                    true,
-                    &set->aos.free_list,
-                    set->desc.allocator);
-            if (result.new_key) {
-                result.node->state = _SP_HASH_BUCKET_STATE_ALIVE;
-                result.node->hash = hash;
-                void* node_value = &result.node[1];
-                memcpy(node_value, value, set->desc.value_size);
-                set->count++;
-                return true;
-            }
-            return false;
-        }
+#if defined(__aarch64__) && defined(SP_COMP_GCC)
+    u64 frequency;
+    __asm__ __volatile__("mrs %0, cntfrq_el0" : "=r"(frequency));
+#else
+    // Measure the counter against the monotonic clock since initialization,
+    // sleeping until enough time has passed for a precise result.
+    const u64 CALIBRATION_NS = 10000000;
+    u64 now_ns = sp_os_get_time_ns();
+    while (now_ns - _sp_state.clock.start_ns < CALIBRATION_NS) {
+        u64 remaining_ns = CALIBRATION_NS - (now_ns - _sp_state.clock.start_ns);
+        _sp_platform_sleep_ms(remaining_ns / 1000000 + 1);
+        now_ns = sp_os_get_time_ns();
     }
+    u64 cycles = sp_os_get_cycles() - _sp_state.clock.start_cycles;
+    u64 elapsed_ns = now_ns - _sp_state.clock.start_ns;
+    u64 frequency = (f64) cycles * 1e9 / (f64) elapsed_ns;
+#endif
 
-    sp_assert(false, "Unreachable!");
-    return false;
+    _sp_state.clock.cycle_frequency = frequency;
+    return frequency;
 }
 
-b8 sp_hash_set_remove(SP_HashSet* set, const void* value) {
-    u64 hash = set->desc.hash(value, set->desc.value_size);
-    switch (set->desc.collision_resolution) {
-        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING: {
-            u32 index = _sp_hash_container_get_index(value,
-                    set->desc.value_size,
-                    hash,
-                    set->soa.state,
-                    set->soa.hashes,
-                    set->soa.values,
-                    false,
-                    set->capacity,
-                    set->desc.equal);
-            if (set->soa.state[index] == _SP_HASH_BUCKET_STATE_ALIVE) {
-                set->soa.state[index] = _SP_HASH_BUCKET_STATE_DEAD;
-                set->count--;
-                return true;
-            }
-            return false;
+u64 sp_os_cycles_to_ns(u64 cycles) {
+    return (f64) cycles * 1e9 / (f64) sp_os_get_cycle_frequency();
+}
+
+SP_PerfCounters sp_os_read_perf_counters(void) {
+    SP_ThreadCtx* ctx = _sp_thread_ctx_get();
+    if (!ctx->perf_opened) {
+        _sp_platform_perf_open(ctx->perf_handles);
+        ctx->perf_opened = true;
+    }
+
+    SP_PerfCounters counters = {0};
+    _sp_platform_perf_read(ctx->perf_handles, &counters);
+    return counters;
+}
+
+const char* sp_os_perf_counter_name(SP_PerfCounter counter) {
+    const char* const names[SP_PERF_COUNTER_COUNT] = {
+        "cycles",
+        "instructions",
+        "cache references",
+        "cache misses",
+        "branch misses",
+        "page faults",
+    };
+    sp_assert(counter < SP_PERF_COUNTER_COUNT, "Invalid performance counter %u.", counter);
+    return names[counter];
+}
+
+b8 sp_os_perf_counter_available(SP_PerfCounter counter) {
+    sp_assert(counter < SP_PERF_COUNTER_COUNT, "Invalid performance counter %u.", counter);
+    return sp_os_read_perf_counters().available[counter];
+}
+
+void _sp_perf_scope_end(_SP_PerfScope* scope, SP_PerfCounters* out) {
+    SP_PerfCounters end = sp_os_read_perf_counters();
+    for (u32 i = 0; i < SP_PERF_COUNTER_COUNT; i++) {
+        if (scope->start.available[i] && end.available[i]) {
+            out->values[i] += end.values[i] - scope->start.values[i];
         }
-        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
-            u64 node_size = sizeof(_SP_HashContainerChainNode) + set->desc.value_size;
-            _SP_HashContainerGetNodeResult result = _sp_hash_container_get_node(value,
-                    set->desc.value_size,
-                    hash,
-                    set->aos.nodes,
-                    node_size,
-                    set->capacity,
-                    set->desc.equal,
-                    false,
-                    &set->aos.free_list,
-                    set->desc.allocator);
-            if (result.new_key) {
-                return false;
-            }
+    }
+    scope->done = true;
+}
 
-            _SP_HashContainerChainNode* node = result.node;
-            // Root node
-            if (node->prev == NULL) {
-                if (node->next == NULL) {
-                    node->state = _SP_HASH_BUCKET_STATE_EMPTY;
-                } else {
-                    _SP_HashContainerChainNode* free_node = node->next;
-                    memcpy(node, node->next, node_size);
-                    node->prev = NULL;
-                    if (node->next != NULL) {
-                        node->next->prev = node;
-                    }
+static void _sp_os_count_memory_call(void) {
+    _sp_atomic_add_u64(&_sp_state.os.memory_calls, 1);
+}
 
-                    free_node->next = set->aos.free_list;
-                    set->aos.free_list = free_node;
-                }
-            } else {
-                node->prev->next = node->next;
-                if (node->next != NULL) {
-                    node->next->prev = node->prev;
-                }
+static u64 _sp_os_get_memory_calls(void) {
+    return _sp_atomic_load_u64(&_sp_state.os.memory_calls);
+}
 
-                node->next = set->aos.free_list;
-                set->aos.free_list = node;
-            }
+static void _sp_probe_simd(SP_SystemInfo* info) {
+#if defined(SP_COMP_GCC) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    info->simd.sse2 = __builtin_cpu_supports("sse2") != 0;
+    info->simd.sse42 = __builtin_cpu_supports("sse4.2") != 0;
+    info->simd.avx2 = __builtin_cpu_supports("avx2") != 0;
+    info->simd.avx512f = __builtin_cpu_supports("avx512f") != 0;
+#elif defined(SP_COMP_MSVC) && (defined(_M_X64) || defined(_M_IX86))
+    i32 regs[4];
+    __cpuid(regs, 1);
+    info->simd.sse2 = (regs[3] >> 26) & 1;
+    info->simd.sse42 = (regs[2] >> 20) & 1;
+    b8 osxsave = (regs[2] >> 27) & 1;
+    u64 xcr0 = osxsave ? _xgetbv(0) : 0;
+    __cpuidex(regs, 7, 0);
+    // The OS has to save the YMM (and ZMM) registers for AVX to be usable.
+    info->simd.avx2 = ((regs[1] >> 5) & 1) && (xcr0 & 0x06) == 0x06;
+    info->simd.avx512f = ((regs[1] >> 16) & 1) && (xcr0 & 0xe6) == 0xe6;
+#endif
+#if defined(__aarch64__) || defined(__ARM_NEON) || defined(_M_ARM64)
+    info->simd.neon = true;
+#endif
+    (void) info;
+}
+
+#ifdef SP_POSIX
+
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#ifdef SP_OS_LINUX
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+// Only declared with _GNU_SOURCE.
+#ifndef RUSAGE_THREAD
+#define RUSAGE_THREAD 1
+#endif
+#endif
+#include <pthread.h>
+
+struct _SP_PlatformState {
+    pthread_mutex_t lock;
+    pthread_key_t thread_ctx_key;
+    pthread_t log_thread;
+    // Wakes the log writer, 'log_signaled' is set until it does.
+    pthread_mutex_t log_lock;
+    pthread_cond_t log_cond;
+    b8 log_signaled;
+    SP_SystemInfo system_info;
+};
+
+// Read a small text file, like the ones in /proc and /sys, into a null
+// terminated buffer.
+static b8 _sp_posix_read_file(const char* path, char* buffer, u32 size) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    u64 len = fread(buffer, 1, size - 1, file);
+    buffer[len] = 0;
+    fclose(file);
+    return true;
+}
 
-            set->count--;
-            return true;
-        }
+// Read the next range of a sysfs list like "0-3,8,10-11", advancing 'list'
+// past it. Single entries are a range with 'first' equal to 'last'.
+static b8 _sp_posix_list_next(const char** list, u32* first, u32* last) {
+    if (**list < '0' || **list > '9') {
+        return false;
+    }
+    char* end;
+    *first = strtoul(*list, &end, 10);
+    *last = *first;
+    if (*end == '-') {
+        *last = strtoul(end + 1, &end, 10);
     }
+    *list = *end == ',' ? end + 1 : end;
+    return true;
+}
 
-    sp_assert(false, "Unreachable!");
-    return false;
+// Count the entries of a sysfs list.
+static u32 _sp_posix_count_list(const char* list) {
+    u32 count = 0;
+    u32 first, last;
+    while (_sp_posix_list_next(&list, &first, &last)) {
+        count += last - first + 1;
+    }
+    return count;
 }
 
-b8 sp_hash_set_has(SP_HashSet* set, const void* value) {
-    u64 hash = set->desc.hash(value, set->desc.value_size);
-    switch (set->desc.collision_resolution) {
-        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING: {
-            u32 index = _sp_hash_container_get_index(value,
-                    set->desc.value_size,
-                    hash,
-                    set->soa.state,
-                    set->soa.hashes,
-                    set->soa.values,
-                    false,
-                    set->capacity,
-                    set->desc.equal);
-            if (index == ~0u) {
-                return false;
-            }
-            return set->soa.state[index] == _SP_HASH_BUCKET_STATE_ALIVE;
-        }
-        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
-            u64 node_size = sizeof(_SP_HashContainerChainNode) + set->desc.value_size;
-            _SP_HashContainerGetNodeResult result = _sp_hash_container_get_node(value,
-                    set->desc.value_size,
-                    hash,
-                    set->aos.nodes,
-                    node_size,
-                    set->capacity,
-                    set->desc.equal,
-                    false,
-                    &set->aos.free_list,
-                    set->desc.allocator);
-            return !result.new_key;
+static b8 _sp_posix_list_contains(const char* list, u32 value) {
+    u32 first, last;
+    while (_sp_posix_list_next(&list, &first, &last)) {
+        if (value >= first && value <= last) {
+            return true;
         }
     }
-
-    sp_assert(false, "Unreachable!");
     return false;
 }
 
-u32 sp_hash_set_count(const SP_HashSet* set) {
-    return set->count;
-}
-
-// Iteration
-SP_HashSetIter sp_hash_set_iter_init(SP_HashSet* set) {
-    SP_HashSetIter iter = {
-        .set = set,
-        .index = ~0u,
-        .node = NULL,
-    };
+// Count cores with at least one online CPU. CPU numbers can have gaps and
+// CPUs can be offline, so only the CPUs in the online list are visited. A
+// core is counted once, by the lowest online CPU among its siblings.
+static u32 _sp_posix_count_physical_cores(void) {
+    char online[1024];
+    char siblings[1024];
+    char path[128];
+    if (!_sp_posix_read_file("/sys/devices/system/cpu/online", online, sizeof(online))) {
+        return 0;
+    }
 
-    switch (set->desc.collision_resolution) {
-        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING:
-            for (u32 i = 0; i < set->capacity; i++) {
-                if (set->soa.state[i] == _SP_HASH_BUCKET_STATE_ALIVE) {
-                    iter.index = i;
-                    break;
-                }
+    u32 cores = 0;
+    const char* list = online;
+    u32 first, last;
+    while (_sp_posix_list_next(&list, &first, &last)) {
+        for (u32 cpu = first; cpu <= last; cpu++) {
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/topology/thread_siblings_list", cpu);
+            if (!_sp_posix_read_file(path, siblings, sizeof(siblings))) {
+                return 0;
             }
-            break;
-        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING:
-            for (u32 i = 0; i < set->capacity; i++) {
-                _SP_HashContainerChainNode* node = _sp_hash_set_get_node(set, i);
-                if (node->state == _SP_HASH_BUCKET_STATE_ALIVE) {
-                    iter.index = i;
-                    iter.node = node;
-                    break;
+
+            const char* sibling_list = siblings;
+            u32 sibling_first, sibling_last;
+            u32 lowest = cpu;
+            while (lowest == cpu && _sp_posix_list_next(&sibling_list, &sibling_first, &sibling_last)) {
+                for (u32 sibling = sibling_first; sibling <= sibling_last && sibling < cpu; sibling++) {
+                    if (_sp_posix_list_contains(online, sibling)) {
+                        lowest = sibling;
+                        break;
+                    }
                 }
             }
-            break;
+            cores += lowest == cpu;
+        }
     }
-    return iter;
+    return cores;
 }
 
-b8 sp_hash_set_iter_valid(SP_HashSetIter iter) {
-    return iter.set != NULL && iter.index < iter.set->capacity;
-}
+static SP_SystemInfo _sp_posix_probe_system(void) {
+    SP_SystemInfo info = {
+        .page_size = sp_os_get_page_size(),
+        .cache_line_size = 64,
+        .logical_cores = sysconf(_SC_NPROCESSORS_ONLN),
+        .numa_nodes = 1,
+    };
+    char buffer[4096];
+    char path[128];
 
-SP_HashSetIter sp_hash_set_iter_next(SP_HashSetIter iter) {
-    sp_assert(sp_hash_set_iter_valid(iter), "Hash set iterator must be valid!");
+    if (_sp_posix_read_file("/proc/meminfo", buffer, sizeof(buffer))) {
+        const char* huge = strstr(buffer, "Hugepagesize:");
+        if (huge != NULL) {
+            info.huge_page_size = sp_kib(strtoull(huge + sizeof("Hugepagesize:") - 1, NULL, 10));
+        }
+    }
 
-    SP_HashSet* set = iter.set;
-    switch (set->desc.collision_resolution) {
-        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING:
-            for (u32 i = iter.index + 1; i < set->capacity; i++) {
-                if (set->soa.state[i] == _SP_HASH_BUCKET_STATE_ALIVE) {
-                    iter.index = i;
-                    return iter;
-                }
-            }
-        break;
-        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
-            _SP_HashContainerChainNode* node = iter.node;
-            if (node->next != NULL) {
-                iter.node = node->next;
-                return iter;
-            }
+    for (u32 i = 0; ; i++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%u/level", i);
+        if (!_sp_posix_read_file(path, buffer, sizeof(buffer))) {
+            break;
+        }
+        u32 level = strtoul(buffer, NULL, 10);
 
-            for (u32 i = iter.index + 1; i < set->capacity; i++) {
-                _SP_HashContainerChainNode* node = _sp_hash_set_get_node(set, i);
-                if (node->state == _SP_HASH_BUCKET_STATE_ALIVE) {
-                    iter.index = i;
-                    iter.node = node;
-                    return iter;
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%u/type", i);
+        if (!_sp_posix_read_file(path, buffer, sizeof(buffer)) || strncmp(buffer, "Instruction", 11) == 0) {
+            continue;
+        }
+
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%u/size", i);
+        if (!_sp_posix_read_file(path, buffer, sizeof(buffer))) {
+            continue;
+        }
+        char* unit;
+        u64 size = strtoull(buffer, &unit, 10);
+        if (*unit == 'K') { size = sp_kib(size); }
+        else if (*unit == 'M') { size = sp_mib(size); }
+        else if (*unit == 'G') { size = sp_gib(size); }
+
+        switch (level) {
+            case 1: {
+                info.l1_cache_size = size;
+                snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%u/coherency_line_size", i);
+                if (_sp_posix_read_file(path, buffer, sizeof(buffer)) && strtoul(buffer, NULL, 10) != 0) {
+                    info.cache_line_size = strtoul(buffer, NULL, 10);
                 }
-            }
-        } break;
+            } break;
+            case 2: info.l2_cache_size = size; break;
+            case 3: info.l3_cache_size = size; break;
+        }
     }
-    return (SP_HashSetIter) {0};
-}
 
-void sp_hash_set_iter_get_value(SP_HashSetIter iter, void* out_value) {
-    sp_assert(sp_hash_set_iter_valid(iter), "Hash set iterator must be valid!");
+    info.physical_cores = _sp_posix_count_physical_cores();
+    if (info.physical_cores == 0) {
+        info.physical_cores = info.logical_cores;
+    }
 
-    SP_HashSet* set = iter.set;
-    switch (set->desc.collision_resolution) {
-        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING:
-            memcpy(out_value, (u8*) set->soa.values + iter.index * set->desc.value_size, set->desc.value_size);
-            break;
-        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
-            _SP_HashContainerChainNode* node = iter.node;
-            memcpy(out_value, (u8*) &node[1], set->desc.value_size);
-        } break;
+    if (_sp_posix_read_file("/sys/devices/system/node/online", buffer, sizeof(buffer))) {
+        info.numa_nodes = sp_max(_sp_posix_count_list(buffer), 1);
     }
+
+    _sp_probe_simd(&info);
+    return info;
 }
 
-void* sp_hash_set_iter_get_valuep(SP_HashSetIter iter) {
-    sp_assert(sp_hash_set_iter_valid(iter), "Hash set iterator must be valid!");
+static void _sp_posix_thread_ctx_destructor(void* ctx) {
+    _sp_thread_ctx_release(ctx);
+}
 
-    SP_HashSet* set = iter.set;
-    switch (set->desc.collision_resolution) {
-        case SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING:
-            return (u8*) set->soa.values + iter.index * set->desc.value_size;
-        case SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING: {
-            _SP_HashContainerChainNode* node = iter.node;
-            return (u8*) &node[1];
-        }
+b8 _sp_platform_init(void) {
+    _SP_PlatformState* platform = sp_os_reserve_memory(sizeof(_SP_PlatformState));
+    if (platform == NULL) {
+        return false;
+    }
+    sp_os_commit_memory(platform, sizeof(_SP_PlatformState));
+
+    *platform = (_SP_PlatformState) {
+        .system_info = _sp_posix_probe_system(),
+    };
+    if (pthread_mutex_init(&platform->lock, NULL) != 0 ||
+        pthread_mutex_init(&platform->log_lock, NULL) != 0 ||
+        pthread_cond_init(&platform->log_cond, NULL) != 0 ||
+        pthread_key_create(&platform->thread_ctx_key, _sp_posix_thread_ctx_destructor) != 0) {
+        sp_os_release_memory(platform, sizeof(_SP_PlatformState));
+        return false;
     }
+    _sp_state.platform = platform;
 
-    return NULL;
+    return true;
 }
 
-// -- Color --------------------------------------------------------------------
-
-SP_Color sp_color_rgba_f(f32 r, f32 g, f32 b, f32 a) {
-    return (SP_Color) {r, g, b, a};
+b8 _sp_platform_termiante(void) {
+    pthread_key_delete(_sp_state.platform->thread_ctx_key);
+    pthread_cond_destroy(&_sp_state.platform->log_cond);
+    pthread_mutex_destroy(&_sp_state.platform->log_lock);
+    pthread_mutex_destroy(&_sp_state.platform->lock);
+    sp_os_release_memory(_sp_state.platform, sizeof(_SP_PlatformState));
+    _sp_state.platform = NULL;
+    return true;
 }
 
-SP_Color sp_color_rgba_i(u8 r, u8 g, u8 b, u8 a) {
-    return (SP_Color) {r/255.0f, g/255.0f, b/255.0f, a/255.0f};
+// Before 'sp_init' there's no lock to take. Spire is only used from one
+// thread at that point.
+void _sp_platform_lock(void) {
+    if (_sp_state.platform != NULL) {
+        pthread_mutex_lock(&_sp_state.platform->lock);
+    }
 }
 
-SP_Color sp_color_rgba_hex(u32 hex) {
-    return (SP_Color) {
-        .r = (f32) (hex >> 8 * 3 & 0xff) / 0xff,
-        .g = (f32) (hex >> 8 * 2 & 0xff) / 0xff,
-        .b = (f32) (hex >> 8 * 1 & 0xff) / 0xff,
-        .a = (f32) (hex >> 8 * 0 & 0xff) / 0xff,
-    };
+void _sp_platform_unlock(void) {
+    if (_sp_state.platform != NULL) {
+        pthread_mutex_unlock(&_sp_state.platform->lock);
+    }
 }
 
-SP_Color sp_color_rgb_f(f32 r, f32 g, f32 b) {
-    return (SP_Color) {r, g, b, 1.0f};
+void _sp_platform_thread_ctx_register(SP_ThreadCtx* ctx) {
+    if (_sp_state.platform != NULL) {
+        pthread_setspecific(_sp_state.platform->thread_ctx_key, ctx);
+    }
 }
 
-SP_Color sp_color_rgb_i(u8 r, u8 g, u8 b) {
-    return (SP_Color) {r/255.0f, g/255.0f, b/255.0f, 1.0f};
+static i64 _sp_platform_log_open(const char* path, b8 truncate) {
+    if (path == NULL) {
+        return STDOUT_FILENO;
+    }
+    return open(path, O_WRONLY | O_CREAT | (truncate ? O_TRUNC : O_APPEND), 0644);
 }
 
-SP_Color sp_color_rgb_hex(u32 hex) {
-    return (SP_Color) {
-        .r = (f32) (hex >> 8 * 2 & 0xff) / 0xff,
-        .g = (f32) (hex >> 8 * 1 & 0xff) / 0xff,
-        .b = (f32) (hex >> 8 * 0 & 0xff) / 0xff,
-        .a = 1.0f,
-    };
+static void _sp_platform_log_close(i64 handle) {
+    if (handle != STDOUT_FILENO) {
+        close(handle);
+    }
 }
 
-SP_Color sp_color_hsl(f32 hue, f32 saturation, f32 lightness) {
-    // https://en.wikipedia.org/wiki/HSL_and_HSV#HSL_to_RGB
-    SP_Color color = {0};
-    f32 chroma = (1 - fabsf(2 * lightness - 1)) * saturation;
-    f32 hue_prime = fabsf(fmodf(hue, 360.0f)) / 60.0f;
-    f32 x = chroma * (1.0f - fabsf(fmodf(hue_prime, 2.0f) - 1.0f));
-    if (hue_prime < 1.0f) { color = (SP_Color) { chroma, x, 0.0f, 1.0f, }; }
-    else if (hue_prime < 2.0f) { color = (SP_Color) { x, chroma, 0.0f, 1.0f, }; }
-    else if (hue_prime < 3.0f) { color = (SP_Color) { 0.0f, chroma, x, 1.0f, }; }
-    else if (hue_prime < 4.0f) { color = (SP_Color) { 0.0f, x, chroma, 1.0f, }; }
-    else if (hue_prime < 5.0f) { color = (SP_Color) { x, 0.0f, chroma, 1.0f, }; }
-    else if (hue_prime < 6.0f) { color = (SP_Color) { chroma, 0.0f, x, 1.0f, }; }
-    f32 m = lightness-chroma / 2.0f;
-    color.r += m;
-    color.g += m;
-    color.b += m;
-    return color;
+static void _sp_platform_log_write(i64 handle, const _SP_LogSegment* segments, u32 count) {
+    struct iovec iov[64];
+    count = sp_min(count, sp_arrlen(iov));
+    for (u32 i = 0; i < count; i++) {
+        iov[i] = (struct iovec) {(void*) segments[i].data, segments[i].size};
+    }
+
+    // Keep going after partial writes.
+    struct iovec* curr = iov;
+    while (count > 0) {
+        ssize_t written = writev(handle, curr, count);
+        if (written < 0) {
+            return;
+        }
+        while (count > 0 && (size_t) written >= curr->iov_len) {
+            written -= curr->iov_len;
+            curr++;
+            count--;
+        }
+        if (count > 0) {
+            curr->iov_base = (u8*) curr->iov_base + written;
+            curr->iov_len -= written;
+        }
+    }
 }
 
-SP_Color sp_color_hsv(f32 hue, f32 saturation, f32 value) {
-    // https://en.wikipedia.org/wiki/HSL_and_HSV#HSV_to_RGB
-    SP_Color color = {0};
-    f32 chroma = value * saturation;
-    f32 hue_prime = fabsf(fmodf(hue, 360.0f)) / 60.0f;
-    f32 x = chroma * (1.0f - fabsf(fmodf(hue_prime, 2.0f) - 1.0f));
-    if (hue_prime < 1.0f) { color = (SP_Color) { chroma, x, 0.0f, 1.0f, }; }
-    else if (hue_prime < 2.0f) { color = (SP_Color) { x, chroma, 0.0f, 1.0f, }; }
-    else if (hue_prime < 3.0f) { color = (SP_Color) { 0.0f, chroma, x, 1.0f, }; }
-    else if (hue_prime < 4.0f) { color = (SP_Color) { 0.0f, x, chroma, 1.0f, }; }
-    else if (hue_prime < 5.0f) { color = (SP_Color) { x, 0.0f, chroma, 1.0f, }; }
-    else if (hue_prime < 6.0f) { color = (SP_Color) { chroma, 0.0f, x, 1.0f, }; }
-    f32 m = value - chroma;
-    color.r += m;
-    color.g += m;
-    color.b += m;
-    return color;
+static void* _sp_posix_log_thread(void* userdata) {
+    (void) userdata;
+    _sp_log_writer_main();
+    return NULL;
 }
 
-// -- Testing ------------------------------------------------------------------
+static b8 _sp_platform_log_thread_start(void) {
+    return pthread_create(&_sp_state.platform->log_thread, NULL, _sp_posix_log_thread, NULL) == 0;
+}
 
-typedef struct SP_Test SP_Test;
-struct SP_Test {
-    SP_Str name;
-    SP_TestFunc func;
-    void* userdata;
-};
+static void _sp_platform_log_thread_join(void) {
+    pthread_join(_sp_state.platform->log_thread, NULL);
+}
 
-typedef struct SP_TestGroup SP_TestGroup;
-struct SP_TestGroup {
-    SP_Str name;
-    SP_Test* tests;
-    u32 test_capacity;
-    u32 test_count;
-};
+static void _sp_platform_log_wait(void) {
+    _SP_PlatformState* platform = _sp_state.platform;
+    pthread_mutex_lock(&platform->log_lock);
+    while (!platform->log_signaled) {
+        pthread_cond_wait(&platform->log_cond, &platform->log_lock);
+    }
+    platform->log_signaled = false;
+    pthread_mutex_unlock(&platform->log_lock);
+}
 
-struct SP_TestSuite {
-    SP_Allocator allocator;
-    SP_TestGroup* groups;
-    u32 group_capacity;
-    u32 group_count;
-};
+static void _sp_platform_log_wake(void) {
+    _SP_PlatformState* platform = _sp_state.platform;
+    pthread_mutex_lock(&platform->log_lock);
+    platform->log_signaled = true;
+    pthread_cond_signal(&platform->log_cond);
+    pthread_mutex_unlock(&platform->log_lock);
+}
 
-SP_TestSuite* sp_test_suite_create(SP_Allocator allocator) {
-    SP_TestSuite* suite = sp_alloc(allocator, sizeof(SP_TestSuite));
-    *suite = (SP_TestSuite) {
-        .allocator = allocator,
-        .groups = sp_alloc(allocator, 8 * sizeof(SP_TestGroup)),
-        .group_capacity = 8,
-        .group_count = 0,
+static void _sp_platform_sleep_ms(u32 ms) {
+    struct timespec duration = {
+        .tv_sec = ms / 1000,
+        .tv_nsec = (long) (ms % 1000) * 1000000,
     };
-    return suite;
+    nanosleep(&duration, NULL);
 }
 
-void sp_test_suite_destroy(SP_TestSuite* suite) {
-    for (u32 i = 0; i < suite->group_count; i++) {
-        SP_TestGroup* group = &suite->groups[i];
-        sp_free(suite->allocator, group->tests, group->test_capacity * sizeof(SP_Test));
-    }
-    sp_free(suite->allocator, suite->groups, suite->group_capacity * sizeof(SP_TestGroup));
+static void _sp_platform_yield(void) {
+    sched_yield();
 }
 
-void sp_test_suite_run(SP_TestSuite* suite) {
-    u32 tests_run = 0;
-    u32 successfully_run_tests = 0;
-    for (u32 i = 0; i < suite->group_count; i++) {
-        SP_TestGroup group = suite->groups[i];
-        printf("--- Running %u tests in group %.*s ---\n", group.test_count, group.name.len, group.name.data);
-        u32 successful = 0;
-        for (u32 j = 0; j < suite->groups[i].test_count; j++) {
-            SP_Test test = group.tests[j];
-            SP_TestResult result = test.func(test.userdata);
-            if (result.successful) {
-                printf("%.*s ... \033[0;92mOK\033[0m\n", test.name.len, test.name.data);
-                successful++;
-            } else {
-                printf("%.*s ... \033[1;91mFAILED\033[0m\n", test.name.len, test.name.data);
-                printf("    %s:%u: '%s'\n", result.file, result.line, result.reason);
+static b8 _sp_platform_random(void* buffer, u64 size) {
+    i32 fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    u64 filled = 0;
+    while (filled < size) {
+        ssize_t n = read(fd, (u8*) buffer + filled, size - filled);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
             }
+            break;
         }
-        tests_run += group.test_count;
-        successfully_run_tests += successful;
+        filled += n;
+    }
+    close(fd);
+    return filled == size;
+}
 
-        printf("\n");
+// Sent from a worker to the runner for every finished test. Small enough for
+// one atomic pipe write.
+typedef struct _SP_PosixTestMessage _SP_PosixTestMessage;
+struct _SP_PosixTestMessage {
+    u32 index;
+    b8 successful;
+    b8 skipped;
+    u32 line;
+    u64 duration_ns;
+    u64 allocs;
+    u64 alloc_bytes;
+    char file[256];
+    char reason[512];
+};
 
-        if (successful == group.test_count) {
-            printf("Result: \033[0;92m%u/%u\033[0m\n", successful, group.test_count);
-        } else {
-            printf("Result: \033[1;91m%u/%u\033[0m\n", successful, group.test_count);
+typedef struct _SP_PosixTestWorker _SP_PosixTestWorker;
+struct _SP_PosixTestWorker {
+    pid_t pid;
+    // Runner to worker: test indices. Worker to runner: messages.
+    int command_fd;
+    int result_fd;
+    // Test being run or -1 when idle.
+    i64 test;
+    u64 start_ns;
+};
+
+static b8 _sp_posix_read_all(int fd, void* data, u64 size) {
+    u8* bytes = data;
+    while (size > 0) {
+        ssize_t n = read(fd, bytes, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
         }
+        bytes += n;
+        size -= n;
+    }
+    return true;
+}
 
-        printf("\n");
+static void _sp_posix_test_worker_main(SP_TestSuite* suite, int command_fd, int result_fd) {
+    u32 index;
+    while (_sp_posix_read_all(command_fd, &index, sizeof(index))) {
+        _SP_TestOutcome outcome = _sp_test_run_one(_sp_test_get(suite, index));
+        _SP_PosixTestMessage message = {
+            .index = index,
+            .successful = outcome.result.successful,
+            .skipped = outcome.result.skipped,
+            .line = outcome.result.line,
+            .duration_ns = outcome.duration_ns,
+            .allocs = outcome.allocs,
+            .alloc_bytes = outcome.alloc_bytes,
+        };
+        if (!outcome.result.successful || outcome.result.skipped) {
+            snprintf(message.file, sizeof(message.file), "%s", outcome.result.file != NULL ? outcome.result.file : "");
+            snprintf(message.reason, sizeof(message.reason), "%s", outcome.result.reason != NULL ? outcome.result.reason : "");
+        }
+        sp_log_flush();
+        fflush(NULL);
+        if (write(result_fd, &message, sizeof(message)) != sizeof(message)) {
+            break;
+        }
     }
+    sp_log_flush();
+    fflush(NULL);
+    _exit(0);
+}
 
-    printf("--- SUITE RESULT ---\n");
-    const char *status_color;
-    if (successfully_run_tests == tests_run) {
-        status_color = "\033[0;92m";
-    } else {
-        status_color = "\033[0;91m";
+static b8 _sp_posix_test_worker_spawn(SP_TestSuite* suite, _SP_PosixTestWorker* workers, u32 count, u32 slot) {
+    int command[2];
+    int result[2];
+    if (pipe(command) != 0) {
+        return false;
+    }
+    if (pipe(result) != 0) {
+        close(command[0]);
+        close(command[1]);
+        return false;
     }
 
-    printf("Tests run: \033[0;94m%u\033[0m\n", tests_run);
-    printf("Tests passed: %s%u\033[0m\n", status_color, successfully_run_tests);
-    printf("Tests failed: %s%u\033[0m\n", status_color, tests_run - successfully_run_tests);
-    printf("Summary: %s%u/%u\033[0m\n", status_color, successfully_run_tests, tests_run);
-}
+    // Anything still buffered would be printed by the worker as well.
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(command[0]);
+        close(command[1]);
+        close(result[0]);
+        close(result[1]);
+        return false;
+    }
 
-u32 sp_test_group_register(SP_TestSuite* suite, SP_Str name) {
-    if (suite->group_count == suite->group_capacity) {
-        suite->groups = sp_realloc(suite->allocator,
-                suite->groups,
-                suite->group_capacity * sizeof(SP_TestGroup),
-                suite->group_capacity * 2 * sizeof(SP_TestGroup));
-        suite->group_capacity *= 2;
+    if (pid == 0) {
+        if (_sp_state.log.async || _sp_state.log.binary) {
+            _sp_log_fork_end();
+        }
+        // The other workers' pipes must only be open in the runner, or they
+        // never see the runner closing them.
+        for (u32 i = 0; i < count; i++) {
+            if (i != slot && workers[i].pid > 0) {
+                close(workers[i].command_fd);
+                close(workers[i].result_fd);
+            }
+        }
+        close(command[1]);
+        close(result[0]);
+        _sp_posix_test_worker_main(suite, command[0], result[1]);
     }
 
-    u32 group = suite->group_count;
-    suite->groups[group] = (SP_TestGroup) {
-        .name = name,
-        .tests = sp_alloc(suite->allocator, 8 * sizeof(SP_Test)),
-        .test_capacity = 8,
-        .test_count = 0,
+    close(command[0]);
+    close(result[1]);
+    workers[slot] = (_SP_PosixTestWorker) {
+        .pid = pid,
+        .command_fd = command[1],
+        .result_fd = result[0],
+        .test = -1,
     };
-
-    suite->group_count++;
-    return group;
+    return true;
 }
 
-void _sp_test_register(SP_TestSuite* suite, u32 group, SP_TestFunc func, SP_Str name, void* userdata) {
-    sp_assert(group < suite->group_count, "Group %u not registered in suite!", group);
-    SP_TestGroup* _group = &suite->groups[group];
-    if (_group->test_count == _group->test_capacity) {
-        _group->tests = sp_realloc(suite->allocator,
-                _group->tests,
-                _group->test_capacity * sizeof(SP_TestGroup),
-                _group->test_capacity * 2 * sizeof(SP_TestGroup));
-        _group->test_capacity *= 2;
+// Fail the worker's current test with 'reason' and replace the worker.
+static b8 _sp_posix_test_worker_fail(SP_TestSuite* suite, _SP_PosixTestWorker* workers, u32 count, u32 slot, _SP_TestOutcome* outcomes, const char* reason) {
+    _SP_PosixTestWorker* worker = &workers[slot];
+    close(worker->command_fd);
+    close(worker->result_fd);
+
+    int status = 0;
+    waitpid(worker->pid, &status, 0);
+    worker->pid = 0;
+
+    // Whatever the test measured died with the worker.
+    _SP_TestOutcome* outcome = &outcomes[worker->test];
+    *outcome = (_SP_TestOutcome) {0};
+    char buffer[128];
+    if (reason == NULL) {
+        if (WIFSIGNALED(status)) {
+            snprintf(buffer, sizeof(buffer), "crashed with signal %d", WTERMSIG(status));
+        } else {
+            snprintf(buffer, sizeof(buffer), "exited with status %d", WEXITSTATUS(status));
+        }
+        reason = buffer;
     }
+    outcome->result.successful = false;
+    outcome->finished = true;
+    outcome->duration_ns = sp_os_get_time_ns() - worker->start_ns;
+    _sp_test_outcome_own(outcome, "", 0, reason);
 
-    u32 test = _group->test_count;
-    _group->tests[test] = (SP_Test) {
-        .name = name,
-        .func = func,
-        .userdata = userdata,
-    };
-
-    _group->test_count++;
+    return _sp_posix_test_worker_spawn(suite, workers, count, slot);
 }
 
-// -- OS -----------------------------------------------------------------------
-// Platform specific implementation
-// :platform
+static b8 _sp_platform_test_run_isolated(SP_TestSuite* suite, SP_TestConfig config, _SP_TestOutcome* outcomes) {
+    u32 test_count = _sp_test_count(suite);
+    u32 worker_count = sp_min(config.workers, test_count);
+    _SP_PosixTestWorker* workers = sp_alloc(suite->allocator, worker_count * sizeof(_SP_PosixTestWorker));
+    struct pollfd* fds = sp_alloc(suite->allocator, worker_count * sizeof(struct pollfd));
+    memset(workers, 0, worker_count * sizeof(_SP_PosixTestWorker));
 
-#ifdef SP_POSIX
+    // A worker dying between two tests mustn't kill the runner when it's
+    // handed its next test.
+    void (*sigpipe)(int) = signal(SIGPIPE, SIG_IGN);
 
-#include <unistd.h>
-#include <time.h>
-#include <sys/mman.h>
-#include <dlfcn.h>
+    b8 ok = true;
+    for (u32 i = 0; i < worker_count && ok; i++) {
+        ok = _sp_posix_test_worker_spawn(suite, workers, worker_count, i);
+    }
+    b8 started = ok;
+
+    u32 next = 0;
+    u32 done = 0;
+    while (ok && done < test_count) {
+        u64 now = sp_os_get_time_ns();
+        i32 timeout_ms = -1;
+        u32 busy = 0;
+        for (u32 i = 0; i < worker_count; i++) {
+            _SP_PosixTestWorker* worker = &workers[i];
+            if (worker->test == -1 && next < test_count) {
+                worker->test = next++;
+                worker->start_ns = now;
+                u32 index = worker->test;
+                if (write(worker->command_fd, &index, sizeof(index)) != sizeof(index)) {
+                    ok = _sp_posix_test_worker_fail(suite, workers, worker_count, i, outcomes, NULL);
+                    done++;
+                    continue;
+                }
+            }
+            if (worker->test == -1) {
+                continue;
+            }
+            if (config.timeout_ns != 0) {
+                u64 elapsed = now - worker->start_ns;
+                u64 left = elapsed < config.timeout_ns ? config.timeout_ns - elapsed : 0;
+                i32 left_ms = sp_min(left / 1000000 + 1, 1000000);
+                timeout_ms = timeout_ms == -1 ? left_ms : sp_min(timeout_ms, left_ms);
+            }
+            fds[busy++] = (struct pollfd) {
+                .fd = worker->result_fd,
+                .events = POLLIN,
+            };
+        }
+        if (!ok || busy == 0) {
+            continue;
+        }
 
-struct _SP_PlatformState {
-    f32 start_time;
-};
+        if (poll(fds, busy, timeout_ms) < 0 && errno != EINTR) {
+            ok = false;
+            break;
+        }
 
-static f32 _sp_posix_time_stamp(void)  {
-    struct timespec tp;
-    clock_gettime(CLOCK_MONOTONIC, &tp);
-    return (f32) tp.tv_sec + (f32) tp.tv_nsec / 1e9;
-}
+        now = sp_os_get_time_ns();
+        for (u32 i = 0; i < worker_count && ok; i++) {
+            _SP_PosixTestWorker* worker = &workers[i];
+            if (worker->test == -1) {
+                continue;
+            }
 
-b8 _sp_platform_init(void) {
-    _SP_PlatformState* platform = sp_os_reserve_memory(sizeof(_SP_PlatformState));
-    if (platform == NULL) {
-        return false;
+            struct pollfd* fd = NULL;
+            for (u32 j = 0; j < busy; j++) {
+                if (fds[j].fd == worker->result_fd) {
+                    fd = &fds[j];
+                }
+            }
+            if (fd != NULL && fd->revents != 0) {
+                _SP_PosixTestMessage message;
+                if (!_sp_posix_read_all(worker->result_fd, &message, sizeof(message))) {
+                    ok = _sp_posix_test_worker_fail(suite, workers, worker_count, i, outcomes, NULL);
+                } else {
+                    _SP_TestOutcome* outcome = &outcomes[message.index];
+                    outcome->result.successful = message.successful;
+                    outcome->result.skipped = message.skipped;
+                    outcome->duration_ns = message.duration_ns;
+                    outcome->allocs = message.allocs;
+                    outcome->alloc_bytes = message.alloc_bytes;
+                    outcome->finished = true;
+                    _sp_test_outcome_own(outcome, message.file, message.line, message.reason);
+                    worker->test = -1;
+                }
+                done++;
+            } else if (config.timeout_ns != 0 && now - worker->start_ns >= config.timeout_ns) {
+                char reason[64];
+                snprintf(reason, sizeof(reason), "timed out after %.3f ms", config.timeout_ns / 1e6);
+                kill(worker->pid, SIGKILL);
+                ok = _sp_posix_test_worker_fail(suite, workers, worker_count, i, outcomes, reason);
+                done++;
+            }
+        }
     }
-    sp_os_commit_memory(platform, sizeof(_SP_PlatformState));
-
-    *platform = (_SP_PlatformState) {
-        .start_time = _sp_posix_time_stamp(),
-    };
-    _sp_state.platform = platform;
 
-    return true;
-}
+    // Closing the command pipes lets idle workers exit. Busy ones are only
+    // left when the run was cut short, their tests aren't waited for.
+    for (u32 i = 0; i < worker_count; i++) {
+        if (workers[i].pid > 0) {
+            if (workers[i].test != -1) {
+                kill(workers[i].pid, SIGKILL);
+            }
+            close(workers[i].command_fd);
+            close(workers[i].result_fd);
+            waitpid(workers[i].pid, NULL, 0);
+        }
+    }
+    signal(SIGPIPE, sigpipe);
+    sp_free(suite->allocator, fds, worker_count * sizeof(struct pollfd));
+    sp_free(suite->allocator, workers, worker_count * sizeof(_SP_PosixTestWorker));
+    if (!started) {
+        return false;
+    }
 
-b8 _sp_platform_termiante(void) {
-    sp_os_release_memory(_sp_state.platform, sizeof(_SP_PlatformState));
+    // Results collected before the run was cut short are kept. Running the
+    // rest in process could bring down the runner, so they fail instead.
+    for (u32 i = 0; i < test_count; i++) {
+        if (!outcomes[i].finished) {
+            outcomes[i].result.successful = false;
+            outcomes[i].finished = true;
+            _sp_test_outcome_own(&outcomes[i], "", 0, "not run, the test workers stopped");
+        }
+    }
     return true;
 }
 
 void* sp_os_reserve_memory(u64 size) {
+    _sp_os_count_memory_call();
     void* ptr = mmap(NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
     return ptr;
 }
 
 void  sp_os_commit_memory(void* ptr, u64 size) {
+    _sp_os_count_memory_call();
     mprotect(ptr, size, PROT_READ | PROT_WRITE);
 }
 
 void  sp_os_decommit_memory(void* ptr, u64 size) {
+    _sp_os_count_memory_call();
+    // Protecting the pages alone keeps them resident, drop them first so the
+    // memory is actually given back.
+    madvise(ptr, size, MADV_DONTNEED);
     mprotect(ptr, size, PROT_NONE);
 }
 
 void  sp_os_release_memory(void* ptr, u64 size) {
+    _sp_os_count_memory_call();
     munmap(ptr, size);
 }
 
-f32 sp_os_get_time(void) {
-    return _sp_posix_time_stamp() - _sp_state.platform->start_time;
+u64 sp_os_get_time_ns(void) {
+    struct timespec tp;
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return (u64) tp.tv_sec * 1000000000llu + tp.tv_nsec;
 }
 
 u32 sp_os_get_page_size(void) {
-    return sysconf(_SC_PAGESIZE);
+    // Cached on first use instead of in the system info so arenas can be
+    // created before 'sp_init'.
+    static u32 page_size = 0;
+    if (page_size == 0) {
+        page_size = sysconf(_SC_PAGESIZE);
+    }
+    return page_size;
+}
+
+SP_SystemInfo sp_os_get_system_info(void) {
+    if (_sp_state.platform == NULL) {
+        return _sp_posix_probe_system();
+    }
+    return _sp_state.platform->system_info;
+}
+
+SP_ProcessMemory sp_os_get_process_memory(void) {
+    SP_ProcessMemory memory = {
+        .memory_calls = _sp_os_get_memory_calls(),
+    };
+
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        memory.minor_faults = usage.ru_minflt;
+        memory.major_faults = usage.ru_majflt;
+#ifdef SP_OS_LINUX
+        memory.peak_resident = (u64) usage.ru_maxrss * 1024;
+#else
+        memory.peak_resident = usage.ru_maxrss;
+#endif
+    }
+
+#ifdef SP_OS_LINUX
+    char buffer[4096];
+    if (_sp_posix_read_file("/proc/self/statm", buffer, sizeof(buffer))) {
+        unsigned long long pages = 0;
+        unsigned long long resident = 0;
+        if (sscanf(buffer, "%llu %llu", &pages, &resident) == 2) {
+            memory.resident = resident * sp_os_get_page_size();
+        }
+    }
+    // Unlike ru_maxrss, VmHWM follows resets through /proc/self/clear_refs.
+    if (_sp_posix_read_file("/proc/self/status", buffer, sizeof(buffer))) {
+        const char* hwm = strstr(buffer, "VmHWM:");
+        if (hwm != NULL) {
+            memory.peak_resident = strtoull(hwm + strlen("VmHWM:"), NULL, 10) * 1024;
+        }
+    }
+#endif
+
+    return memory;
+}
+
+void sp_os_reset_peak_resident(void) {
+#ifdef SP_OS_LINUX
+    FILE* file = fopen("/proc/self/clear_refs", "wb");
+    if (file != NULL) {
+        fputs("5", file);
+        fclose(file);
+    }
+#endif
+}
+
+u64 sp_os_get_resident_memory(const void* ptr, u64 size) {
+    if (size == 0) {
+        return 0;
+    }
+
+    u64 page_size = sp_os_get_page_size();
+    u64 start = (u64) ptr / page_size * page_size;
+    u64 end = _align_value((u64) ptr + size, page_size);
+
+    // Query in chunks to keep the page vector on the stack, reservations can
+    // be gigabytes large.
+    unsigned char pages[4096];
+    u64 resident = 0;
+    for (u64 chunk = start; chunk < end; chunk += sizeof(pages) * page_size) {
+        u64 count = sp_min((end - chunk) / page_size, sizeof(pages));
+        if (mincore((void*) chunk, count * page_size, (void*) pages) != 0) {
+            continue;
+        }
+        for (u64 i = 0; i < count; i++) {
+            resident += pages[i] & 1;
+        }
+    }
+    return resident * page_size;
+}
+
+static void _sp_platform_perf_open(i64* handles) {
+    for (u32 i = 0; i < SP_PERF_COUNTER_COUNT; i++) {
+        handles[i] = -1;
+    }
+
+#ifdef SP_OS_LINUX
+    const u32 types[SP_PERF_COUNTER_COUNT] = {
+        PERF_TYPE_HARDWARE,
+        PERF_TYPE_HARDWARE,
+        PERF_TYPE_HARDWARE,
+        PERF_TYPE_HARDWARE,
+        PERF_TYPE_HARDWARE,
+        PERF_TYPE_SOFTWARE,
+    };
+    const u64 configs[SP_PERF_COUNTER_COUNT] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_REFERENCES,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES,
+        PERF_COUNT_SW_PAGE_FAULTS,
+    };
+
+    // Separate events instead of a group so one missing counter doesn't take
+    // the others with it.
+    for (u32 i = 0; i < SP_PERF_COUNTER_COUNT; i++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = types[i];
+        attr.config = configs[i];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        handles[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (handles[i] < 0) {
+            handles[i] = -1;
+        }
+    }
+#endif
+}
+
+static void _sp_platform_perf_close(i64* handles) {
+    for (u32 i = 0; i < SP_PERF_COUNTER_COUNT; i++) {
+        if (handles[i] >= 0) {
+            close(handles[i]);
+            handles[i] = -1;
+        }
+    }
+}
+
+static void _sp_platform_perf_read(const i64* handles, SP_PerfCounters* counters) {
+    for (u32 i = 0; i < SP_PERF_COUNTER_COUNT; i++) {
+        if (handles[i] < 0) {
+            continue;
+        }
+        // Value, time enabled and time running. The kernel multiplexes
+        // counters when there are more than the hardware has, so the value is
+        // scaled up to the whole time.
+        u64 data[3];
+        if (read(handles[i], data, sizeof(data)) != sizeof(data) || data[2] == 0) {
+            continue;
+        }
+        counters->values[i] = data[2] == data[1] ? data[0] : (u64) ((f64) data[0] * data[1] / data[2]);
+        counters->available[i] = true;
+    }
+
+#ifdef SP_OS_LINUX
+    if (!counters->available[SP_PERF_COUNTER_PAGE_FAULTS]) {
+        struct rusage usage;
+        if (getrusage(RUSAGE_THREAD, &usage) == 0) {
+            counters->values[SP_PERF_COUNTER_PAGE_FAULTS] = usage.ru_minflt + usage.ru_majflt;
+            counters->available[SP_PERF_COUNTER_PAGE_FAULTS] = true;
+        }
+    }
+#endif
 }
 
 // -- Library ------------------------------------------------------------------
@@ -1979,17 +7031,79 @@ SP_LibFunc sp_lib_func(SP_Lib* lib, const char* func_name) {
 
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
+// GetProcessMemoryInfo lives in kernel32 since Windows 7.
+#include <psapi.h>
+#include <bcrypt.h>
 
 struct _SP_PlatformState {
-    f32 start_time;
+    LARGE_INTEGER counter_frequency;
+    SRWLOCK lock;
+    DWORD thread_ctx_index;
+    HANDLE log_thread;
+    // Auto reset event waking the log writer.
+    HANDLE log_event;
+    SP_SystemInfo system_info;
 };
 
-static f32 _sp_win32_time_stamp(void) {
-    LARGE_INTEGER freq;
-    LARGE_INTEGER time;
-    QueryPerformanceFrequency(&freq);
-    QueryPerformanceCounter(&time);
-    return (f32) time.QuadPart / (f32) freq.QuadPart;
+static SP_SystemInfo _sp_win32_probe_system(void) {
+    SYSTEM_INFO system;
+    GetSystemInfo(&system);
+    SP_SystemInfo info = {
+        .page_size = sp_os_get_page_size(),
+        .huge_page_size = GetLargePageMinimum(),
+        .cache_line_size = 64,
+        .logical_cores = system.dwNumberOfProcessors,
+    };
+
+    DWORD size = 0;
+    GetLogicalProcessorInformation(NULL, &size);
+    SYSTEM_LOGICAL_PROCESSOR_INFORMATION* processors = malloc(size);
+    if (processors != NULL && GetLogicalProcessorInformation(processors, &size)) {
+        for (u32 i = 0; i < size / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION); i++) {
+            SYSTEM_LOGICAL_PROCESSOR_INFORMATION processor = processors[i];
+            switch (processor.Relationship) {
+                case RelationProcessorCore:
+                    info.physical_cores++;
+                    break;
+                case RelationNumaNode:
+                    info.numa_nodes++;
+                    break;
+                case RelationCache: {
+                    CACHE_DESCRIPTOR cache = processor.Cache;
+                    if (cache.Type == CacheInstruction) {
+                        break;
+                    }
+                    switch (cache.Level) {
+                        case 1:
+                            info.l1_cache_size = cache.Size;
+                            info.cache_line_size = cache.LineSize;
+                            break;
+                        case 2: info.l2_cache_size = cache.Size; break;
+                        case 3: info.l3_cache_size = cache.Size; break;
+                    }
+                } break;
+                default:
+                    break;
+            }
+        }
+    }
+    free(processors);
+
+    if (info.physical_cores == 0) {
+        info.physical_cores = info.logical_cores;
+    }
+    if (info.numa_nodes == 0) {
+        info.numa_nodes = 1;
+    }
+
+    _sp_probe_simd(&info);
+    return info;
+}
+
+static VOID WINAPI _sp_win32_thread_ctx_destructor(PVOID ctx) {
+    if (ctx != NULL) {
+        _sp_thread_ctx_release(ctx);
+    }
 }
 
 b8 _sp_platform_init(void) {
@@ -2000,43 +7114,251 @@ b8 _sp_platform_init(void) {
     sp_os_commit_memory(platform, sizeof(_SP_PlatformState));
 
     *platform = (_SP_PlatformState){
-        .start_time = _sp_win32_time_stamp(),
+        .lock = SRWLOCK_INIT,
+        // Fiber local storage is used for its destructor which runs on thread
+        // exit, unlike thread local storage.
+        .thread_ctx_index = FlsAlloc(_sp_win32_thread_ctx_destructor),
+        .log_event = CreateEventA(NULL, FALSE, FALSE, NULL),
+        .system_info = _sp_win32_probe_system(),
     };
+    QueryPerformanceFrequency(&platform->counter_frequency);
+    if (platform->thread_ctx_index == FLS_OUT_OF_INDEXES || platform->log_event == NULL) {
+        if (platform->thread_ctx_index != FLS_OUT_OF_INDEXES) {
+            FlsFree(platform->thread_ctx_index);
+        }
+        if (platform->log_event != NULL) {
+            CloseHandle(platform->log_event);
+        }
+        sp_os_release_memory(platform, sizeof(_SP_PlatformState));
+        return false;
+    }
     _sp_state.platform = platform;
 
     return true;
 }
 
 b8 _sp_platform_termiante(void) {
+    // FlsFree runs the destructor for the calling thread, which no longer owns
+    // a context at this point.
+    FlsSetValue(_sp_state.platform->thread_ctx_index, NULL);
+    FlsFree(_sp_state.platform->thread_ctx_index);
+    CloseHandle(_sp_state.platform->log_event);
     sp_os_release_memory(_sp_state.platform, sizeof(_SP_PlatformState));
+    _sp_state.platform = NULL;
     return true;
 }
 
+// Before 'sp_init' there's no lock to take. Spire is only used from one
+// thread at that point.
+void _sp_platform_lock(void) {
+    if (_sp_state.platform != NULL) {
+        AcquireSRWLockExclusive(&_sp_state.platform->lock);
+    }
+}
+
+void _sp_platform_unlock(void) {
+    if (_sp_state.platform != NULL) {
+        ReleaseSRWLockExclusive(&_sp_state.platform->lock);
+    }
+}
+
+void _sp_platform_thread_ctx_register(SP_ThreadCtx* ctx) {
+    if (_sp_state.platform != NULL) {
+        FlsSetValue(_sp_state.platform->thread_ctx_index, ctx);
+    }
+}
+
+static i64 _sp_platform_log_open(const char* path, b8 truncate) {
+    HANDLE handle;
+    if (path == NULL) {
+        handle = GetStdHandle(STD_OUTPUT_HANDLE);
+    } else if (truncate) {
+        handle = CreateFileA(path, GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    } else {
+        handle = CreateFileA(path, FILE_APPEND_DATA, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    }
+    if (handle == INVALID_HANDLE_VALUE || handle == NULL) {
+        return -1;
+    }
+    return (i64) (intptr_t) handle;
+}
+
+static void _sp_platform_log_close(i64 handle) {
+    HANDLE win_handle = (HANDLE) (intptr_t) handle;
+    if (win_handle != GetStdHandle(STD_OUTPUT_HANDLE)) {
+        CloseHandle(win_handle);
+    }
+}
+
+// There's no gather write for regular files, one call per segment it is.
+static void _sp_platform_log_write(i64 handle, const _SP_LogSegment* segments, u32 count) {
+    for (u32 i = 0; i < count; i++) {
+        const u8* data = segments[i].data;
+        u64 remaining = segments[i].size;
+        while (remaining > 0) {
+            DWORD written = 0;
+            if (!WriteFile((HANDLE) (intptr_t) handle, data, (DWORD) remaining, &written, NULL)) {
+                return;
+            }
+            data += written;
+            remaining -= written;
+        }
+    }
+}
+
+static DWORD WINAPI _sp_win32_log_thread(LPVOID userdata) {
+    (void) userdata;
+    _sp_log_writer_main();
+    return 0;
+}
+
+static b8 _sp_platform_log_thread_start(void) {
+    _sp_state.platform->log_thread = CreateThread(NULL, 0, _sp_win32_log_thread, NULL, 0, NULL);
+    return _sp_state.platform->log_thread != NULL;
+}
+
+static void _sp_platform_log_thread_join(void) {
+    WaitForSingleObject(_sp_state.platform->log_thread, INFINITE);
+    CloseHandle(_sp_state.platform->log_thread);
+}
+
+static void _sp_platform_log_wait(void) {
+    WaitForSingleObject(_sp_state.platform->log_event, INFINITE);
+}
+
+static void _sp_platform_log_wake(void) {
+    SetEvent(_sp_state.platform->log_event);
+}
+
+static void _sp_platform_sleep_ms(u32 ms) {
+    Sleep(ms);
+}
+
+static void _sp_platform_yield(void) {
+    SwitchToThread();
+}
+
+static b8 _sp_platform_random(void* buffer, u64 size) {
+    return BCRYPT_SUCCESS(BCryptGenRandom(NULL, buffer, (ULONG) size, BCRYPT_USE_SYSTEM_PREFERRED_RNG));
+}
+
+// No fork on Windows, the suite runs in process.
+static b8 _sp_platform_test_run_isolated(SP_TestSuite* suite, SP_TestConfig config, _SP_TestOutcome* outcomes) {
+    (void) suite;
+    (void) config;
+    (void) outcomes;
+    return false;
+}
+
 void* sp_os_reserve_memory(u64 size) {
+    _sp_os_count_memory_call();
     void* ptr = VirtualAlloc(NULL, size, MEM_RESERVE, PAGE_NOACCESS);
     return ptr;
 }
 
 void  sp_os_commit_memory(void* ptr, u64 size) {
+    _sp_os_count_memory_call();
     VirtualAlloc(ptr, size, MEM_COMMIT, PAGE_READWRITE);
 }
 
 void  sp_os_decommit_memory(void* ptr, u64 size) {
+    _sp_os_count_memory_call();
     VirtualFree(ptr, MEM_DECOMMIT, size);
 }
 
 void  sp_os_release_memory(void* ptr, u64 size) {
+    _sp_os_count_memory_call();
     VirtualFree(ptr, MEM_RELEASE, size);
 }
 
-f32 sp_os_get_time(void) {
-    return _sp_win32_time_stamp() - _sp_state.platform->start_time;
+u64 sp_os_get_time_ns(void) {
+    LARGE_INTEGER time;
+    QueryPerformanceCounter(&time);
+    u64 freq = _sp_state.platform->counter_frequency.QuadPart;
+    u64 counter = time.QuadPart;
+    // Split in two to not overflow the multiplication.
+    return counter / freq * 1000000000llu + counter % freq * 1000000000llu / freq;
 }
 
 u32 sp_os_get_page_size(void) {
-    SYSTEM_INFO info;
-    GetSystemInfo(&info);
-    return info.dwPageSize;
+    // Cached on first use instead of in the system info so arenas can be
+    // created before 'sp_init'.
+    static u32 page_size = 0;
+    if (page_size == 0) {
+        SYSTEM_INFO system;
+        GetSystemInfo(&system);
+        page_size = system.dwPageSize;
+    }
+    return page_size;
+}
+
+SP_SystemInfo sp_os_get_system_info(void) {
+    if (_sp_state.platform == NULL) {
+        return _sp_win32_probe_system();
+    }
+    return _sp_state.platform->system_info;
+}
+
+SP_ProcessMemory sp_os_get_process_memory(void) {
+    SP_ProcessMemory memory = {
+        .memory_calls = _sp_os_get_memory_calls(),
+    };
+
+    PROCESS_MEMORY_COUNTERS counters = {0};
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        memory.resident = counters.WorkingSetSize;
+        memory.peak_resident = counters.PeakWorkingSetSize;
+        // Windows doesn't tell soft and hard faults apart.
+        memory.minor_faults = counters.PageFaultCount;
+    }
+
+    return memory;
+}
+
+void sp_os_reset_peak_resident(void) {
+    // The peak working set can't be reset.
+}
+
+u64 sp_os_get_resident_memory(const void* ptr, u64 size) {
+    if (size == 0) {
+        return 0;
+    }
+
+    u64 page_size = sp_os_get_page_size();
+    u64 start = (u64) ptr / page_size * page_size;
+    u64 end = _align_value((u64) ptr + size, page_size);
+
+    PSAPI_WORKING_SET_EX_INFORMATION pages[512];
+    u64 resident = 0;
+    for (u64 chunk = start; chunk < end; chunk += sp_arrlen(pages) * page_size) {
+        u64 count = sp_min((end - chunk) / page_size, sp_arrlen(pages));
+        for (u64 i = 0; i < count; i++) {
+            pages[i].VirtualAddress = (void*) (chunk + i * page_size);
+        }
+        if (!QueryWorkingSetEx(GetCurrentProcess(), pages, count * sizeof(pages[0]))) {
+            continue;
+        }
+        for (u64 i = 0; i < count; i++) {
+            resident += pages[i].VirtualAttributes.Valid;
+        }
+    }
+    return resident * page_size;
+}
+
+// No hardware counters on Windows without a kernel driver.
+static void _sp_platform_perf_open(i64* handles) {
+    for (u32 i = 0; i < SP_PERF_COUNTER_COUNT; i++) {
+        handles[i] = -1;
+    }
+}
+
+static void _sp_platform_perf_close(i64* handles) {
+    (void) handles;
+}
+
+static void _sp_platform_perf_read(const i64* handles, SP_PerfCounters* counters) {
+    (void) handles;
+    (void) counters;
 }
 
 // -- Library ------------------------------------------------------------------
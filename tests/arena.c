@@ -0,0 +1,109 @@
+#include "spire.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// The arena profile is loaded in 'sp_init' and saved in 'sp_terminate' so
+// these tests restart Spire and restore the suite's config afterwards.
+static const SP_Config* config = NULL;
+
+static b8 restart_profiling(const char* path) {
+    SP_Config profile_config = *config;
+    profile_config.arena_profile.enabled = true;
+    profile_config.arena_profile.path = path;
+    sp_terminate();
+    return sp_init(profile_config);
+}
+
+// Longer than any fixed size line buffer would hold.
+static SP_Str long_tag(char* buffer, u32 len) {
+    for (u32 i = 0; i < len; i++) {
+        buffer[i] = 'a' + i % 26;
+    }
+    return sp_str((const u8*) buffer, len);
+}
+
+SP_TestResult test_arena_profile_presize(void* userdata) {
+    (void) userdata;
+
+    const char* path = "spire_test_arena_profile_presize.txt";
+    char buffer[300];
+    SP_Str tag = long_tag(buffer, sizeof(buffer));
+    FILE* file = fopen(path, "wb");
+    sp_test_assert(file != NULL);
+    fprintf(file, "%llu %.*s\n", (unsigned long long) sp_mib(2), tag.len, tag.data);
+    fprintf(file, "%llu short\n", (unsigned long long) sp_mib(1));
+    fclose(file);
+
+    sp_test_assert(restart_profiling(path));
+    SP_Arena* long_arena = sp_arena_create();
+    sp_arena_tag(long_arena, tag);
+    SP_ArenaMetrics long_metrics = sp_arena_get_metrics(long_arena);
+    SP_Arena* short_arena = sp_arena_create();
+    sp_arena_tag(short_arena, sp_str_lit("short"));
+    SP_ArenaMetrics short_metrics = sp_arena_get_metrics(short_arena);
+    SP_Arena* unknown_arena = sp_arena_create();
+    sp_arena_tag(unknown_arena, sp_str_lit("unknown"));
+    SP_ArenaMetrics unknown_metrics = sp_arena_get_metrics(unknown_arena);
+    sp_arena_destroy(long_arena);
+    sp_arena_destroy(short_arena);
+    sp_arena_destroy(unknown_arena);
+
+    sp_terminate();
+    sp_init(*config);
+    remove(path);
+    sp_test_assert(long_metrics.committed_bytes >= sp_mib(2));
+    sp_test_assert(short_metrics.committed_bytes >= sp_mib(1));
+    sp_test_assert(short_metrics.committed_bytes < sp_mib(2));
+    sp_test_assert(unknown_metrics.committed_bytes < sp_mib(1));
+    sp_test_success();
+}
+
+SP_TestResult test_arena_profile_save(void* userdata) {
+    (void) userdata;
+
+    const char* path = "spire_test_arena_profile_save.txt";
+    char buffer[300];
+    SP_Str tag = long_tag(buffer, sizeof(buffer));
+    remove(path);
+
+    // Two runs, the second one has to replace the peak of the first.
+    u64 peaks[2] = {0};
+    for (u32 run = 0; run < 2; run++) {
+        sp_test_assert(restart_profiling(path));
+        SP_Arena* arena = sp_arena_create();
+        sp_arena_tag(arena, tag);
+        sp_arena_push(arena, sp_kib(64) * (run + 1));
+        peaks[run] = sp_arena_get_metrics(arena).peak_usage;
+        sp_arena_destroy(arena);
+    }
+    sp_terminate();
+    sp_init(*config);
+
+    FILE* file = fopen(path, "rb");
+    sp_test_assert(file != NULL);
+    unsigned long long saved = 0;
+    u32 matches = 0;
+    char line[512];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char* space = strchr(line, ' ');
+        if (space != NULL && strncmp(space + 1, buffer, sizeof(buffer)) == 0) {
+            sscanf(line, "%llu", &saved);
+            matches++;
+        }
+    }
+    fclose(file);
+    remove(path);
+
+    sp_test_assert(matches == 1);
+    sp_test_assert(peaks[1] > peaks[0]);
+    sp_test_assert(saved == peaks[1]);
+    sp_test_success();
+}
+
+void test_arena(SP_TestSuite* suite, const SP_Config* suite_config) {
+    config = suite_config;
+    u32 group = sp_test_group_register(suite, sp_str_lit("Arena"));
+    sp_test_register(suite, group, test_arena_profile_presize, NULL);
+    sp_test_register(suite, group, test_arena_profile_save, NULL);
+}
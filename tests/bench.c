@@ -0,0 +1,77 @@
+#include "spire.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef SP_POSIX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static void bench_nothing(SP_Bench* bench, void* userdata) {
+    (void) userdata;
+    for (u64 i = 0; i < sp_bench_iterations(bench); i++) {
+        sp_bench_do_not_optimize(i);
+    }
+}
+
+// Run a tiny suite with its report hidden, it would only clutter the test
+// output.
+static void run_quietly(SP_BenchSuite* suite, SP_BenchConfig config) {
+    fflush(stdout);
+#ifdef SP_POSIX
+    i32 saved = dup(STDOUT_FILENO);
+    i32 null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    close(null);
+#endif
+    sp_bench_suite_run(suite, config);
+    fflush(stdout);
+#ifdef SP_POSIX
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+#endif
+}
+
+SP_TestResult test_bench_json_escape(void* userdata) {
+    (void) userdata;
+
+    const char* path = "spire_test_bench.json";
+    SP_BenchSuite* suite = sp_bench_suite_create(sp_libc_allocator());
+    u32 group = sp_bench_group_register(suite, sp_str_lit("quote\" back\\slash"));
+    sp_bench_register_named(suite, group, bench_nothing, sp_str_lit("tab\tname"), NULL);
+    run_quietly(suite, (SP_BenchConfig) {
+            .warmup_ns = 1000000,
+            .min_sample_ns = 100000,
+            .samples = 3,
+            .json_path = path,
+        });
+    sp_bench_suite_destroy(suite);
+
+    char buffer[4096] = {0};
+    FILE* file = fopen(path, "rb");
+    sp_test_assert(file != NULL);
+    fread(buffer, 1, sizeof(buffer) - 1, file);
+    fclose(file);
+    remove(path);
+
+    sp_test_assert(strstr(buffer, "\"group\": \"quote\\\" back\\\\slash\"") != NULL);
+    sp_test_assert(strstr(buffer, "\"name\": \"tab\\u0009name\"") != NULL);
+
+    // Every quote outside an escape opens or closes a string.
+    u32 quotes = 0;
+    for (const char* c = buffer; *c != 0; c++) {
+        if (*c == '\\') {
+            c++;
+        } else if (*c == '"') {
+            quotes++;
+        }
+    }
+    sp_test_assert(quotes % 2 == 0);
+    sp_test_success();
+}
+
+void test_bench(SP_TestSuite* suite) {
+    u32 group = sp_test_group_register(suite, sp_str_lit("Benchmark harness"));
+    sp_test_register(suite, group, test_bench_json_escape, NULL);
+}
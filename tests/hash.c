@@ -0,0 +1,219 @@
+#include "spire.h"
+
+#include <string.h>
+
+typedef struct HashCase HashCase;
+struct HashCase {
+    SP_HashFunc hash;
+    u64 len;
+};
+
+static const HashCase HASH_CASES[] = {
+    {sp_hash_u32, 4},
+    {sp_hash_u64, 8},
+    {sp_hash_bytes, 3},
+    {sp_hash_bytes, 8},
+    {sp_hash_bytes, 16},
+    {sp_hash_bytes, 24},
+    {sp_hash_bytes, 64},
+    {sp_hash_bytes, 100},
+};
+
+static u64 splitmix64(u64* state) {
+    u64 x = (*state += 0x9e3779b97f4a7c15ull);
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+static u32 popcount64(u64 x) {
+    u32 count = 0;
+    for (; x != 0; x &= x - 1) {
+        count++;
+    }
+    return count;
+}
+
+// Pearson's chi-squared of 'count' hashes spread over 'buckets' buckets by
+// the bits at 'shift'.
+static f64 bucket_chi_squared(const u64* hashes, u32 count, u32 buckets, u32 shift) {
+    u32* counts = sp_alloc(sp_libc_allocator(), buckets * sizeof(u32));
+    memset(counts, 0, buckets * sizeof(u32));
+    for (u32 i = 0; i < count; i++) {
+        counts[(hashes[i] >> shift) & (buckets - 1)]++;
+    }
+
+    f64 expected = (f64) count / buckets;
+    f64 chi_squared = 0.0;
+    for (u32 i = 0; i < buckets; i++) {
+        f64 diff = counts[i] - expected;
+        chi_squared += diff * diff / expected;
+    }
+    sp_free(sp_libc_allocator(), counts, buckets * sizeof(u32));
+    return chi_squared;
+}
+
+SP_TestResult test_hash_known_answers(void* userdata) {
+    (void) userdata;
+
+    // The messages of wyhash's test vectors, each hashed with its index as
+    // the seed. Covers every length path, up to the 48 byte loop.
+    static const struct {
+        const char* message;
+        u64 hash;
+    } cases[] = {
+        {"", 0x93228a4de0eec5a2ull},
+        {"a", 0xc5bac3db178713c4ull},
+        {"abc", 0xa97f2f7b1d9b3314ull},
+        {"message digest", 0x786d1f1df3801df4ull},
+        {"abcdefghijklmnopqrstuvwxyz", 0xdca5a8138ad37c87ull},
+        {"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789", 0xb9e734f117cfaf70ull},
+        {"12345678901234567890123456789012345678901234567890123456789012345678901234567890", 0x6cc5eab49a92d617ull},
+    };
+    for (u32 i = 0; i < sp_arrlen(cases); i++) {
+        sp_test_assert(sp_hash_bytes(cases[i].message, strlen(cases[i].message), i) == cases[i].hash);
+    }
+
+    // Integer keys go through wyhash64 with the same secret.
+    sp_test_assert(sp_hash_int(0, 0) == 0xfa303abc2b1d7630ull);
+    sp_test_assert(sp_hash_int(42, 7) == 0xf9181832d775dd1dull);
+    sp_test_assert(sp_hash_int(~0ull, 0x5eed) == 0x21b83b6d5a857a1cull);
+    u64 key = 42;
+    sp_test_assert(sp_hash_u64(&key, sizeof(key), 7) == 0xf9181832d775dd1dull);
+
+    sp_test_success();
+}
+
+SP_TestResult test_hash_avalanche(void* userdata) {
+    (void) userdata;
+
+    // Flipping any input bit should flip every output bit half the time.
+    const u32 samples = 1000;
+    u64 state = 42;
+    u8 input[100];
+    u32 flips[64];
+    for (u32 c = 0; c < sp_arrlen(HASH_CASES); c++) {
+        HashCase hash_case = HASH_CASES[c];
+        for (u32 bit = 0; bit < hash_case.len * 8; bit++) {
+            memset(flips, 0, sizeof(flips));
+            for (u32 i = 0; i < samples; i++) {
+                for (u32 j = 0; j < sizeof(input); j += sizeof(u64)) {
+                    u64 word = splitmix64(&state);
+                    memcpy(input + j, &word, sp_min(sizeof(u64), sizeof(input) - j));
+                }
+                u64 before = hash_case.hash(input, hash_case.len, 0x5eed);
+                input[bit / 8] ^= 1 << (bit % 8);
+                u64 diff = before ^ hash_case.hash(input, hash_case.len, 0x5eed);
+                for (u32 out = 0; out < 64; out++) {
+                    flips[out] += (diff >> out) & 1;
+                }
+            }
+            for (u32 out = 0; out < 64; out++) {
+                sp_test_assert(flips[out] > samples * 4 / 10 && flips[out] < samples * 6 / 10);
+            }
+        }
+    }
+
+    sp_test_success();
+}
+
+SP_TestResult test_hash_distribution(void* userdata) {
+    (void) userdata;
+
+    // Sequential and strided keys are where weak hashes clump. The low bits
+    // pick buckets, the bits after the 7 bit Swiss table tag pick groups.
+    const u32 count = 1 << 16;
+    const u32 buckets = 1024;
+    // Mean plus six standard deviations of a chi-squared with buckets - 1
+    // degrees of freedom.
+    const f64 limit = (buckets - 1) + 6.0 * sqrt(2.0 * (buckets - 1));
+    const u64 strides[] = {1, 1024, 1ull << 32};
+
+    u64* hashes = sp_alloc(sp_libc_allocator(), count * sizeof(u64));
+    for (u32 c = 0; c < sp_arrlen(HASH_CASES); c++) {
+        HashCase hash_case = HASH_CASES[c];
+        for (u32 s = 0; s < sp_arrlen(strides); s++) {
+            // Skip strides which would wrap around short keys.
+            if (hash_case.len < sizeof(u64) && ((count - 1) * strides[s]) >> (hash_case.len * 8) != 0) {
+                continue;
+            }
+
+            u8 input[100] = {0};
+            for (u32 i = 0; i < count; i++) {
+                u64 key = i * strides[s];
+                memcpy(input, &key, sp_min(hash_case.len, sizeof(u64)));
+                hashes[i] = hash_case.hash(input, hash_case.len, 0x5eed);
+            }
+            sp_test_assert(bucket_chi_squared(hashes, count, buckets, 0) < limit);
+            sp_test_assert(bucket_chi_squared(hashes, count, buckets, 7) < limit);
+        }
+    }
+    sp_free(sp_libc_allocator(), hashes, count * sizeof(u64));
+
+    sp_test_success();
+}
+
+SP_TestResult test_hash_seed(void* userdata) {
+    (void) userdata;
+
+    // Hashes under different seeds should look unrelated, about half their
+    // bits apart.
+    u64 state = 7;
+    for (u32 c = 0; c < sp_arrlen(HASH_CASES); c++) {
+        HashCase hash_case = HASH_CASES[c];
+        u64 distance = 0;
+        const u32 samples = 1000;
+        for (u32 i = 0; i < samples; i++) {
+            u8 input[100];
+            for (u32 j = 0; j < sizeof(input); j++) {
+                input[j] = (u8) splitmix64(&state);
+            }
+            u64 a = hash_case.hash(input, hash_case.len, 1);
+            sp_test_assert(a == hash_case.hash(input, hash_case.len, 1));
+            distance += popcount64(a ^ hash_case.hash(input, hash_case.len, 2));
+        }
+        sp_test_assert(distance > samples * 30 && distance < samples * 34);
+    }
+
+    // Random seeds differ even for the same salt.
+    u64 seeds[8];
+    for (u32 i = 0; i < sp_arrlen(seeds); i++) {
+        seeds[i] = sp_hash_random_seed(NULL);
+        sp_test_assert(seeds[i] != 0);
+        for (u32 j = 0; j < i; j++) {
+            sp_test_assert(seeds[i] != seeds[j]);
+        }
+    }
+
+    // Maps with their own random seeds still find their keys.
+    SP_HashMap* a = sp_hash_map_create(sp_hash_map_desc_generic(sp_libc_allocator(),
+                8,
+                SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING,
+                u64,
+                u64));
+    SP_HashMap* b = sp_hash_map_create(sp_hash_map_desc_generic(sp_libc_allocator(),
+                8,
+                SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING,
+                u64,
+                u64));
+    for (u64 key = 0; key < 1000; key++) {
+        sp_test_assert(sp_hash_map_insert(a, &key, &key));
+        sp_test_assert(sp_hash_map_insert(b, &key, &key));
+    }
+    for (u64 key = 0; key < 2000; key++) {
+        sp_test_assert(sp_hash_map_get(a, &key, NULL) == (key < 1000));
+        sp_test_assert(sp_hash_map_get(b, &key, NULL) == (key < 1000));
+    }
+    sp_hash_map_destroy(a);
+    sp_hash_map_destroy(b);
+
+    sp_test_success();
+}
+
+void test_hash(SP_TestSuite* suite) {
+    u32 group = sp_test_group_register(suite, sp_str_lit("Hash"));
+    sp_test_register(suite, group, test_hash_known_answers, NULL);
+    sp_test_register(suite, group, test_hash_avalanche, NULL);
+    sp_test_register(suite, group, test_hash_distribution, NULL);
+    sp_test_register(suite, group, test_hash_seed, NULL);
+}
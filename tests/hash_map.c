@@ -1,5 +1,31 @@
 #include "spire.h"
 
+// Counts the bytes currently allocated through it in the 'u64' its userdata
+// points to, so tests can check that memory is given back.
+static void* tracking_alloc(u64 size, void* userdata) {
+    *(u64*) userdata += size;
+    return sp_alloc(sp_libc_allocator(), size);
+}
+
+static void tracking_free(void* ptr, u64 size, void* userdata) {
+    *(u64*) userdata -= size;
+    sp_free(sp_libc_allocator(), ptr, size);
+}
+
+static void* tracking_realloc(void* ptr, u64 old_size, u64 new_size, void* userdata) {
+    *(u64*) userdata += new_size - old_size;
+    return sp_libc_allocator().realloc(ptr, old_size, new_size, NULL);
+}
+
+static SP_Allocator tracking_allocator(u64* live_bytes) {
+    return (SP_Allocator) {
+        .alloc = tracking_alloc,
+        .free = tracking_free,
+        .realloc = tracking_realloc,
+        .userdata = live_bytes,
+    };
+}
+
 SP_TestResult test_hash_map_insert_get(void* userdata) {
     SP_HashMap* map = sp_hash_map_create((SP_HashMapDesc) {
             .allocator = sp_libc_allocator(),
@@ -308,17 +334,618 @@ SP_TestResult test_hash_map_get_pointer(void* userdata) {
     sp_test_success();
 }
 
+static u64 colliding_hash(const void* data, u64 len, u64 seed) {
+    (void) data;
+    (void) len;
+    (void) seed;
+    return 0x2a;
+}
+
+SP_TestResult test_hash_map_colliding_hashes(void* userdata) {
+    SP_HashMap* map = sp_hash_map_create((SP_HashMapDesc) {
+            .allocator = sp_libc_allocator(),
+            .capacity = 8,
+            .collision_resolution = (u64) userdata,
+            .hash = colliding_hash,
+            .equal = sp_hash_map_helper_equal_generic,
+            .key_size = sizeof(u32),
+            .value_size = sizeof(u32),
+        });
+    const u32 count = 100;
+
+    for (u32 i = 0; i < count; i++) {
+        u32 value = i + 1;
+        sp_test_assert(sp_hash_map_insert(map, &i, &value));
+    }
+
+    for (u32 i = 0; i < count; i += 3) {
+        sp_test_assert(sp_hash_map_remove(map, &i, NULL));
+    }
+
+    for (u32 i = 0; i < count; i++) {
+        u32 output = 0;
+        b8 result = sp_hash_map_get(map, &i, &output);
+        if (i % 3 == 0) {
+            sp_test_assert(!result);
+        } else {
+            sp_test_assert(result);
+            sp_test_assert(output == i + 1);
+        }
+    }
+    sp_test_assert(sp_hash_map_count(map) == count - (count + 2) / 3);
+
+    sp_hash_map_destroy(map);
+    sp_test_success();
+}
+
+SP_TestResult test_hash_map_churn(void* userdata) {
+    u64 live_bytes = 0;
+    SP_HashMap* map = sp_hash_map_create((SP_HashMapDesc) {
+            .allocator = tracking_allocator(&live_bytes),
+            .capacity = 8,
+            .collision_resolution = (u64) userdata,
+            .hash = sp_fvn1a_hash,
+            .equal = sp_hash_map_helper_equal_generic,
+            .key_size = sizeof(u32),
+            .value_size = sizeof(u32),
+        });
+    const u32 live = 256;
+    const u32 rounds = 64;
+
+    for (u32 i = 0; i < live; i++) {
+        sp_test_assert(sp_hash_map_insert(map, &i, &i));
+    }
+
+    // Replace every key once to let the map settle, then again while
+    // counting allocations. A steady live count must not keep growing the
+    // map.
+    SP_TestBudget budget = {0};
+    u64 settled_bytes = 0;
+    for (u32 round = 0; round < rounds; round++) {
+        if (round == 2) {
+            budget = sp_test_budget_begin();
+            settled_bytes = live_bytes;
+        }
+        for (u32 i = 0; i < live; i++) {
+            u32 old_key = round * live + i;
+            u32 new_key = old_key + live;
+            sp_test_assert(sp_hash_map_remove(map, &old_key, NULL));
+            sp_test_assert(sp_hash_map_insert(map, &new_key, &new_key));
+        }
+        sp_test_assert(live_bytes <= settled_bytes || round < 2);
+    }
+    // Open addressing clears tombstones in place, the other modes may
+    // allocate a little.
+    b8 in_place = (u64) userdata == SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING;
+    sp_test_assert_max_allocs(budget, in_place ? 0 : rounds * 4);
+    sp_test_assert(sp_hash_map_count(map) == live);
+
+    for (u32 i = 0; i < live; i++) {
+        u32 key = rounds * live + i;
+        u32 output = 0;
+        sp_test_assert(sp_hash_map_get(map, &key, &output));
+        sp_test_assert(output == key);
+    }
+
+    sp_hash_map_destroy(map);
+    sp_test_assert(live_bytes == 0);
+    sp_test_success();
+}
+
+SP_TestResult test_hash_map_reserve_shrink(void* userdata) {
+    SP_HashCollisionResolution resolution = (u64) userdata;
+    u64 live_bytes = 0;
+    SP_HashMap* map = sp_hash_map_create((SP_HashMapDesc) {
+            .allocator = tracking_allocator(&live_bytes),
+            .capacity = 8,
+            .collision_resolution = resolution,
+            .hash = sp_fvn1a_hash,
+            .equal = sp_hash_map_helper_equal_generic,
+            .key_size = sizeof(u32),
+            .value_size = sizeof(u32),
+        });
+    const u32 count = 4096;
+
+    sp_hash_map_reserve(map, count);
+    SP_TestBudget budget = sp_test_budget_begin();
+    for (u32 i = 0; i < count; i++) {
+        sp_test_assert(sp_hash_map_insert(map, &i, &i));
+    }
+    sp_test_assert_max_allocs(budget, 0);
+    u64 full_bytes = live_bytes;
+
+    // Removing never gives memory back, shrink_to_fit drops nearly all of it.
+    for (u32 i = 16; i < count; i++) {
+        sp_test_assert(sp_hash_map_remove(map, &i, NULL));
+    }
+    sp_test_assert(live_bytes == full_bytes);
+    sp_hash_map_shrink_to_fit(map);
+    sp_test_assert(live_bytes < full_bytes / 32);
+    u64 fit_bytes = live_bytes;
+    sp_hash_map_shrink_to_fit(map);
+    sp_test_assert(live_bytes == fit_bytes);
+    sp_test_assert(sp_hash_map_count(map) == 16);
+
+    u32 iterated = 0;
+    for (SP_HashMapIter iter = sp_hash_map_iter_init(map);
+            sp_hash_map_iter_valid(iter);
+            iter = sp_hash_map_iter_next(iter)) {
+        u32 key = 0;
+        sp_hash_map_iter_get_key(iter, &key);
+        sp_test_assert(key < 16);
+        sp_test_assert(*(u32*) sp_hash_map_iter_get_valuep(iter) == key);
+        iterated++;
+    }
+    sp_test_assert(iterated == 16);
+
+    for (u32 i = 0; i < count; i++) {
+        sp_test_assert(sp_hash_map_get(map, &i, NULL) == (i < 16));
+    }
+
+    sp_hash_map_destroy(map);
+    sp_test_assert(live_bytes == 0);
+    sp_test_success();
+}
+
+SP_TestResult test_hash_map_remove_keeps_layout(void* userdata) {
+    SP_HashCollisionResolution resolution = (u64) userdata;
+    u64 live_bytes = 0;
+    SP_HashMap* map = sp_hash_map_create((SP_HashMapDesc) {
+            .allocator = tracking_allocator(&live_bytes),
+            .capacity = 8,
+            .collision_resolution = resolution,
+            .hash = sp_fvn1a_hash,
+            .equal = sp_hash_map_helper_equal_generic,
+            .key_size = sizeof(u32),
+            .value_size = sizeof(u32),
+        });
+    const u32 count = 1024;
+
+    for (u32 i = 0; i < count; i++) {
+        sp_test_assert(sp_hash_map_insert(map, &i, &i));
+    }
+    u64 full_bytes = live_bytes;
+
+    // Remove every element while iterating. Without a resize every key is
+    // visited once and the untouched ones stay where they are. Robin Hood
+    // hashing shifts elements back into the removed slot, so it's skipped.
+    u32* kept = sp_hash_map_getp(map, &(u32) {0});
+    u32 visited = 0;
+    if (resolution != SP_HASH_COLLISION_RESOLUTION_ROBIN_HOOD) {
+        SP_HashMapIter iter = sp_hash_map_iter_init(map);
+        while (sp_hash_map_iter_valid(iter)) {
+            u32 key = 0;
+            sp_hash_map_iter_get_key(iter, &key);
+            iter = sp_hash_map_iter_next(iter);
+            if (key != 0) {
+                sp_test_assert(sp_hash_map_remove(map, &key, NULL));
+            }
+            visited++;
+        }
+        sp_test_assert(visited == count);
+        sp_test_assert(sp_hash_map_getp(map, &(u32) {0}) == kept);
+    } else {
+        for (u32 i = 1; i < count; i++) {
+            sp_test_assert(sp_hash_map_remove(map, &i, NULL));
+        }
+    }
+    sp_test_assert(sp_hash_map_count(map) == 1);
+    sp_test_assert(live_bytes == full_bytes);
+
+    // The next insert shrinks the map instead.
+    sp_test_assert(sp_hash_map_insert(map, &count, &count));
+    sp_test_assert(live_bytes < full_bytes);
+    sp_test_assert(*(u32*) sp_hash_map_getp(map, &(u32) {0}) == 0);
+    sp_test_assert(*(u32*) sp_hash_map_getp(map, &count) == count);
+
+    sp_hash_map_destroy(map);
+    sp_test_assert(live_bytes == 0);
+    sp_test_success();
+}
+
+SP_TestResult test_hash_map_load_factor(void* userdata) {
+    // Full tables still need an empty slot to stop probing at.
+    const f32 load_factors[] = {0.3f, 1.0f};
+    for (u32 i = 0; i < sp_arrlen(load_factors); i++) {
+        SP_HashMap* map = sp_hash_map_create((SP_HashMapDesc) {
+                .allocator = sp_libc_allocator(),
+                .capacity = 5,
+                .load_factor = load_factors[i],
+                .collision_resolution = (u64) userdata,
+                .hash = sp_fvn1a_hash,
+                .equal = sp_hash_map_helper_equal_generic,
+                .key_size = sizeof(u32),
+                .value_size = sizeof(u32),
+            });
+        const u32 count = 1000;
+
+        for (u32 key = 0; key < count; key++) {
+            sp_test_assert(sp_hash_map_insert(map, &key, &key));
+        }
+        for (u32 key = 0; key < 2 * count; key++) {
+            sp_test_assert(sp_hash_map_get(map, &key, NULL) == (key < count));
+        }
+        sp_hash_map_destroy(map);
+    }
+
+    sp_test_success();
+}
+
+SP_TestResult test_hash_map_incremental_resize(void* userdata) {
+    SP_HashMap* map = sp_hash_map_create((SP_HashMapDesc) {
+            .allocator = sp_libc_allocator(),
+            .capacity = 8,
+            .incremental_resize = true,
+            .collision_resolution = (u64) userdata,
+            .hash = sp_fvn1a_hash,
+            .equal = sp_hash_map_helper_equal_generic,
+            .key_size = sizeof(u32),
+            .value_size = sizeof(u32),
+        });
+    const u32 count = 20000;
+
+    // Older keys are likely still in the table being drained, so sets and
+    // removes hit both tables.
+    for (u32 key = 0; key < count; key++) {
+        sp_test_assert(sp_hash_map_insert(map, &key, &key));
+        sp_test_assert(!sp_hash_map_insert(map, &key, &key));
+        if (key % 2 != 0) {
+            continue;
+        }
+
+        u32 older = key / 2;
+        if (older % 2 == 0) {
+            u32 value = older + count;
+            sp_test_assert(!sp_hash_map_set(map, &older, &value));
+            sp_test_assert(*(u32*) sp_hash_map_getp(map, &older) == value);
+        } else {
+            u32 value = 0;
+            sp_test_assert(sp_hash_map_remove(map, &older, &value));
+            sp_test_assert(value == older);
+            sp_test_assert(!sp_hash_map_get(map, &older, NULL));
+        }
+    }
+    sp_test_assert(sp_hash_map_count(map) == count - count / 4);
+
+    for (u32 key = 0; key < count; key++) {
+        u32 value = 0;
+        b8 removed = key < count / 2 && key % 2 == 1;
+        sp_test_assert(sp_hash_map_get(map, &key, &value) == !removed);
+        if (!removed) {
+            sp_test_assert(value == (key < count / 2 ? key + count : key));
+        }
+    }
+
+    u32 iterated = 0;
+    for (SP_HashMapIter iter = sp_hash_map_iter_init(map);
+            sp_hash_map_iter_valid(iter);
+            iter = sp_hash_map_iter_next(iter)) {
+        iterated++;
+    }
+    sp_test_assert(iterated == count - count / 4);
+
+    sp_hash_map_destroy(map);
+    sp_test_success();
+}
+
+SP_TestResult test_hash_map_incremental_step(void* userdata) {
+    u64 live_bytes = 0;
+    SP_HashMap* map = sp_hash_map_create((SP_HashMapDesc) {
+            .allocator = tracking_allocator(&live_bytes),
+            .capacity = 1024,
+            .incremental_resize = true,
+            .collision_resolution = (u64) userdata,
+            .hash = sp_fvn1a_hash,
+            .equal = sp_hash_map_helper_equal_generic,
+            .key_size = sizeof(u32),
+            .value_size = sizeof(u32),
+        });
+
+    // Fill up to the load limit of 768 slots, the next insert grows.
+    u32 key = 0;
+    u64 before_bytes = live_bytes;
+    while (live_bytes == before_bytes) {
+        sp_test_assert(sp_hash_map_insert(map, &key, &key));
+        key++;
+    }
+    sp_test_assert(key == 769);
+
+    // Iterating covers both tables without draining the old one.
+    u32 iterated = 0;
+    u64 sum = 0;
+    for (SP_HashMapIter iter = sp_hash_map_iter_init(map);
+            sp_hash_map_iter_valid(iter);
+            iter = sp_hash_map_iter_next(iter)) {
+        u32 value = 0;
+        sp_hash_map_iter_get_key(iter, &value);
+        sp_test_assert(*(u32*) sp_hash_map_iter_get_valuep(iter) == value);
+        sum += value;
+        iterated++;
+    }
+    sp_test_assert(iterated == key);
+    sp_test_assert(sum == (u64) key * (key - 1) / 2);
+
+    // Removing doesn't move elements between the tables, so removing the odd
+    // keys while iterating still visits every key once.
+    u64 both_bytes = live_bytes;
+    iterated = 0;
+    sum = 0;
+    SP_HashMapIter iter = sp_hash_map_iter_init(map);
+    while (sp_hash_map_iter_valid(iter)) {
+        u32 value = 0;
+        sp_hash_map_iter_get_key(iter, &value);
+        iter = sp_hash_map_iter_next(iter);
+        if (value % 2 == 1) {
+            sp_test_assert(sp_hash_map_remove(map, &value, NULL));
+        }
+        sum += value;
+        iterated++;
+    }
+    sp_test_assert(iterated == key);
+    sp_test_assert(sum == (u64) key * (key - 1) / 2);
+    sp_test_assert(sp_hash_map_count(map) == (key + 1) / 2);
+    sp_test_assert(live_bytes == both_bytes);
+
+    // Every insert moves 8 slots of the old table, so draining its 1024
+    // slots takes 128 of them before it is freed.
+    u32 inserts = 0;
+    while (live_bytes == both_bytes) {
+        sp_test_assert(sp_hash_map_insert(map, &key, &key));
+        key++;
+        inserts++;
+    }
+    sp_test_assert(inserts == 1024 / 8);
+    for (u32 i = 0; i < key; i++) {
+        b8 removed = i < 769 && i % 2 == 1;
+        u32* value = sp_hash_map_getp(map, &i);
+        sp_test_assert(removed ? value == NULL : *value == i);
+    }
+
+    sp_hash_map_destroy(map);
+    sp_test_assert(live_bytes == 0);
+    sp_test_success();
+}
+
+SP_TestResult test_hash_map_chaining_stable_values(void* userdata) {
+    u64 live_bytes = 0;
+    SP_HashMap* map = sp_hash_map_create((SP_HashMapDesc) {
+            .allocator = tracking_allocator(&live_bytes),
+            .capacity = 8,
+            .collision_resolution = (u64) userdata,
+            .hash = sp_fvn1a_hash,
+            .equal = sp_hash_map_helper_equal_generic,
+            .key_size = sizeof(u32),
+            .value_size = sizeof(u64),
+        });
+    const u32 count = 64;
+    u64* values[64] = {0};
+
+    for (u32 key = 0; key < count; key++) {
+        u64 value = key;
+        sp_test_assert(sp_hash_map_insert(map, &key, &value));
+        values[key] = sp_hash_map_getp(map, &key);
+        sp_test_assert((u64) values[key] % sizeof(u64) == 0);
+    }
+
+    // Growing the buckets relinks the nodes without moving them.
+    for (u32 key = count; key < 64 * count; key++) {
+        u64 value = key;
+        sp_test_assert(sp_hash_map_insert(map, &key, &value));
+    }
+    for (u32 key = 0; key < count; key++) {
+        sp_test_assert(sp_hash_map_getp(map, &key) == values[key]);
+        sp_test_assert(*values[key] == key);
+    }
+
+    // So does shrinking them, which removing the newer keys while iterating
+    // leaves to the next insert. Every key is still visited exactly once.
+    u32 visited = 0;
+    SP_HashMapIter iter = sp_hash_map_iter_init(map);
+    while (sp_hash_map_iter_valid(iter)) {
+        u32 key = 0;
+        sp_hash_map_iter_get_key(iter, &key);
+        iter = sp_hash_map_iter_next(iter);
+        if (key >= count) {
+            sp_test_assert(sp_hash_map_remove(map, &key, NULL));
+        }
+        visited++;
+    }
+    sp_test_assert(visited == 64 * count);
+    u32 extra = 64 * count;
+    u64 sparse_bytes = live_bytes;
+    sp_test_assert(sp_hash_map_insert(map, &extra, &(u64) {extra}));
+    sp_test_assert(live_bytes < sparse_bytes);
+    for (u32 key = 0; key < count; key++) {
+        sp_test_assert(sp_hash_map_getp(map, &key) == values[key]);
+        sp_test_assert(*values[key] == key);
+    }
+
+    // Only shrink_to_fit packs the nodes, the values survive the move.
+    sp_hash_map_shrink_to_fit(map);
+    for (u32 key = 0; key < count; key++) {
+        sp_test_assert(*(u64*) sp_hash_map_getp(map, &key) == key);
+    }
+
+    sp_hash_map_destroy(map);
+    sp_test_success();
+}
+
+SP_HASH_MAP_DEFINE(TestU32Map, u32, u32, sp_hash_int, sp_equal_value)
+
+static u64 test_hash_str(SP_Str key, u64 seed) {
+    return sp_hash_bytes(key.data, key.len, seed);
+}
+
+SP_HASH_MAP_DEFINE(TestStrMap, SP_Str, u32, test_hash_str, sp_str_equal)
+
+SP_TestResult test_hash_map_typed_matches_generic(void* userdata) {
+    (void) userdata;
+    SP_HashMap* generic = sp_hash_map_create(sp_hash_map_desc_generic(sp_libc_allocator(),
+                8,
+                SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING,
+                u32,
+                u32));
+    TestU32Map typed = TestU32Map_create(sp_libc_allocator(), 0, 0);
+
+    // Random operations on a small key range hit duplicates, misses and
+    // tombstone reuse. Both maps must answer the same.
+    u32 state = 1;
+    for (u32 i = 0; i < 200000; i++) {
+        state = state * 1664525 + 1013904223;
+        u32 key = (state >> 8) % 2048;
+        u32 value = i;
+        u32 generic_out = 0, typed_out = 0;
+        switch (state >> 29) {
+            case 0:
+            case 1:
+                sp_test_assert(sp_hash_map_insert(generic, &key, &value) == TestU32Map_insert(&typed, key, value));
+                break;
+            case 2:
+                sp_test_assert(sp_hash_map_set(generic, &key, &value) == TestU32Map_set(&typed, key, value));
+                break;
+            case 3:
+            case 4:
+                sp_test_assert(sp_hash_map_remove(generic, &key, &generic_out) == TestU32Map_remove(&typed, key, &typed_out));
+                sp_test_assert(generic_out == typed_out);
+                break;
+            default:
+                sp_test_assert(sp_hash_map_get(generic, &key, &generic_out) == TestU32Map_get(&typed, key, &typed_out));
+                sp_test_assert(generic_out == typed_out);
+                break;
+        }
+        sp_test_assert(sp_hash_map_count(generic) == TestU32Map_count(&typed));
+    }
+
+    // Iteration visits every live key once.
+    u32 visited = 0;
+    for (u32 i = TestU32Map_iter_begin(&typed); i < typed.capacity; i = TestU32Map_iter_next(&typed, i)) {
+        u32* value = sp_hash_map_getp(generic, &typed.keys[i]);
+        sp_test_assert(value != NULL && *value == typed.values[i]);
+        visited++;
+    }
+    sp_test_assert(visited == TestU32Map_count(&typed));
+
+    sp_hash_map_destroy(generic);
+    TestU32Map_destroy(&typed);
+    sp_test_success();
+}
+
+SP_TestResult test_hash_map_typed_str(void* userdata) {
+    (void) userdata;
+    TestStrMap map = TestStrMap_create(sp_libc_allocator(), 0, 0);
+    const u32 count = 4096;
+    SP_Str* keys = sp_alloc(sp_libc_allocator(), count * sizeof(SP_Str));
+    for (u32 i = 0; i < count; i++) {
+        keys[i] = sp_str_pushf(sp_libc_allocator(), "k%u", i);
+    }
+
+    TestStrMap_reserve(&map, count);
+    SP_TestBudget budget = sp_test_budget_begin();
+    for (u32 i = 0; i < count; i++) {
+        sp_test_assert(TestStrMap_insert(&map, keys[i], i));
+        sp_test_assert(!TestStrMap_insert(&map, keys[i], 0));
+    }
+    sp_test_assert_max_allocs(budget, 0);
+
+    // Keys compare by content, not by pointer.
+    sp_test_assert(*TestStrMap_getp(&map, sp_str_lit("k42")) == 42);
+    sp_test_assert(TestStrMap_getp(&map, sp_str_lit("nope")) == NULL);
+    sp_test_assert(!TestStrMap_set(&map, sp_str_lit("k42"), 7));
+    sp_test_assert(*TestStrMap_getp(&map, keys[42]) == 7);
+
+    for (u32 i = 0; i < count - 64; i++) {
+        sp_test_assert(TestStrMap_remove(&map, keys[i], NULL));
+    }
+    u32 capacity = map.capacity;
+    TestStrMap_shrink_to_fit(&map);
+    sp_test_assert(map.capacity < capacity);
+    sp_test_assert(TestStrMap_count(&map) == 64);
+    for (u32 i = 0; i < count; i++) {
+        u32 value = 0;
+        b8 present = i >= count - 64;
+        sp_test_assert(TestStrMap_get(&map, keys[i], &value) == present);
+        sp_test_assert(!present || value == i);
+    }
+
+    TestStrMap_destroy(&map);
+    for (u32 i = 0; i < count; i++) {
+        sp_free(sp_libc_allocator(), (void*) keys[i].data, keys[i].len);
+    }
+    sp_free(sp_libc_allocator(), keys, count * sizeof(SP_Str));
+    sp_test_success();
+}
+
+SP_TestResult test_hash_map_typed_churn(void* userdata) {
+    (void) userdata;
+    TestU32Map map = TestU32Map_create(sp_libc_allocator(), 0, 0);
+    const u32 live = 256;
+    const u32 rounds = 64;
+
+    for (u32 i = 0; i < live; i++) {
+        sp_test_assert(TestU32Map_insert(&map, i, i));
+    }
+
+    // Same as the generic churn test, tombstones get cleared by same-size
+    // rehashes instead of growing the map.
+    SP_TestBudget budget = {0};
+    for (u32 round = 0; round < rounds; round++) {
+        if (round == 2) {
+            budget = sp_test_budget_begin();
+        }
+        for (u32 i = 0; i < live; i++) {
+            u32 old_key = round * live + i;
+            sp_test_assert(TestU32Map_remove(&map, old_key, NULL));
+            sp_test_assert(TestU32Map_insert(&map, old_key + live, old_key + live));
+        }
+    }
+    sp_test_assert_max_allocs(budget, rounds * 6);
+    sp_test_assert(map.capacity <= 1024);
+    sp_test_assert(TestU32Map_count(&map) == live);
+
+    TestU32Map_destroy(&map);
+    sp_test_success();
+}
+
+SP_TestResult test_hash_map_typed_seeds(void* userdata) {
+    (void) userdata;
+
+    // Maps created at the same call site, back to back, still get their own
+    // random seeds.
+    TestU32Map maps[4];
+    for (u32 i = 0; i < sp_arrlen(maps); i++) {
+        maps[i] = TestU32Map_create(sp_libc_allocator(), 0, 0);
+    }
+    for (u32 i = 0; i < sp_arrlen(maps); i++) {
+        sp_test_assert(maps[i].seed != 0);
+        for (u32 j = 0; j < i; j++) {
+            sp_test_assert(maps[i].seed != maps[j].seed);
+        }
+    }
+    for (u32 i = 0; i < sp_arrlen(maps); i++) {
+        TestU32Map_destroy(&maps[i]);
+    }
+
+    TestU32Map fixed = TestU32Map_create(sp_libc_allocator(), 0, 1234);
+    sp_test_assert(fixed.seed == 1234);
+    TestU32Map_destroy(&fixed);
+    sp_test_success();
+}
+
 void test_hash_map(SP_TestSuite* suite) {
-    u32 hash_map_groups[2] = {
+    u32 hash_map_groups[4] = {
         sp_test_group_register(suite, sp_str_lit("Hash Map (Open Adressing)")),
         sp_test_group_register(suite, sp_str_lit("Hash Map (Separate Chaining)")),
+        sp_test_group_register(suite, sp_str_lit("Hash Map (Swiss Table)")),
+        sp_test_group_register(suite, sp_str_lit("Hash Map (Robin Hood)")),
     };
-    void* hash_map_resolution_type[2] = {
+    void* hash_map_resolution_type[4] = {
         (void*) SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING,
         (void*) SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING,
+        (void*) SP_HASH_COLLISION_RESOLUTION_SWISS_TABLE,
+        (void*) SP_HASH_COLLISION_RESOLUTION_ROBIN_HOOD,
     };
 
-    for (u32 i = 0; i < 2; i++) {
+    for (u32 i = 0; i < sp_arrlen(hash_map_groups); i++) {
         u32 group = hash_map_groups[i];
         void* resolution_type = hash_map_resolution_type[i];
         sp_test_register(suite, group, test_hash_map_insert_get, resolution_type);
@@ -328,5 +955,21 @@ void test_hash_map(SP_TestSuite* suite) {
         sp_test_register(suite, group, test_hash_map_reinsertion, resolution_type);
         sp_test_register(suite, group, test_hash_map_iteration, resolution_type);
         sp_test_register(suite, group, test_hash_map_get_pointer, resolution_type);
+        sp_test_register(suite, group, test_hash_map_colliding_hashes, resolution_type);
+        sp_test_register(suite, group, test_hash_map_churn, resolution_type);
+        sp_test_register(suite, group, test_hash_map_reserve_shrink, resolution_type);
+        sp_test_register(suite, group, test_hash_map_remove_keeps_layout, resolution_type);
+        sp_test_register(suite, group, test_hash_map_load_factor, resolution_type);
     }
+    // Only open addressing resizes incrementally.
+    sp_test_register(suite, hash_map_groups[0], test_hash_map_incremental_resize, hash_map_resolution_type[0]);
+    sp_test_register(suite, hash_map_groups[0], test_hash_map_incremental_step, hash_map_resolution_type[0]);
+    // Only chained nodes promise to stay put.
+    sp_test_register(suite, hash_map_groups[1], test_hash_map_chaining_stable_values, hash_map_resolution_type[1]);
+
+    u32 typed_group = sp_test_group_register(suite, sp_str_lit("Hash Map (Typed)"));
+    sp_test_register(suite, typed_group, test_hash_map_typed_matches_generic, NULL);
+    sp_test_register(suite, typed_group, test_hash_map_typed_str, NULL);
+    sp_test_register(suite, typed_group, test_hash_map_typed_churn, NULL);
+    sp_test_register(suite, typed_group, test_hash_map_typed_seeds, NULL);
 }
@@ -1,5 +1,31 @@
 #include "spire.h"
 
+// Counts the bytes currently allocated through it in the 'u64' its userdata
+// points to, so tests can check that memory is given back.
+static void* tracking_alloc(u64 size, void* userdata) {
+    *(u64*) userdata += size;
+    return sp_alloc(sp_libc_allocator(), size);
+}
+
+static void tracking_free(void* ptr, u64 size, void* userdata) {
+    *(u64*) userdata -= size;
+    sp_free(sp_libc_allocator(), ptr, size);
+}
+
+static void* tracking_realloc(void* ptr, u64 old_size, u64 new_size, void* userdata) {
+    *(u64*) userdata += new_size - old_size;
+    return sp_libc_allocator().realloc(ptr, old_size, new_size, NULL);
+}
+
+static SP_Allocator tracking_allocator(u64* live_bytes) {
+    return (SP_Allocator) {
+        .alloc = tracking_alloc,
+        .free = tracking_free,
+        .realloc = tracking_realloc,
+        .userdata = live_bytes,
+    };
+}
+
 SP_TestResult test_hash_set_insert_has(void* userdata) {
     SP_HashSet* set = sp_hash_set_create((SP_HashSetDesc) {
             .allocator = sp_libc_allocator(),
@@ -141,22 +167,122 @@ SP_TestResult test_hash_set_reinsertion(void* userdata) {
     sp_test_success();
 }
 
+SP_TestResult test_hash_set_reserve_shrink(void* userdata) {
+    SP_HashCollisionResolution resolution = (u64) userdata;
+    u64 live_bytes = 0;
+    SP_HashSet* set = sp_hash_set_create((SP_HashSetDesc) {
+            .allocator = tracking_allocator(&live_bytes),
+            .capacity = 8,
+            .collision_resolution = resolution,
+            .hash = sp_fvn1a_hash,
+            .equal = sp_hash_map_helper_equal_generic,
+            .value_size = sizeof(u32),
+        });
+    const u32 count = 4096;
+
+    sp_hash_set_reserve(set, count);
+    SP_TestBudget budget = sp_test_budget_begin();
+    for (u32 i = 0; i < count; i++) {
+        sp_test_assert(sp_hash_set_insert(set, &i));
+    }
+    sp_test_assert_max_allocs(budget, 0);
+    u64 full_bytes = live_bytes;
+
+    // Removing keeps the memory until the next insert shrinks the set,
+    // shrink_to_fit drops what's left of the slack.
+    for (u32 i = 0; i < count; i += 2) {
+        sp_test_assert(sp_hash_set_remove(set, &i));
+    }
+    for (u32 i = 1; i < count - 64; i += 2) {
+        sp_test_assert(sp_hash_set_remove(set, &i));
+    }
+    sp_test_assert(live_bytes == full_bytes);
+    u32 extra = count;
+    sp_test_assert(sp_hash_set_insert(set, &extra));
+    sp_test_assert(live_bytes < full_bytes);
+    sp_test_assert(sp_hash_set_remove(set, &extra));
+    sp_hash_set_shrink_to_fit(set);
+    sp_test_assert(live_bytes < full_bytes / 16);
+    sp_test_assert(sp_hash_set_count(set) == 32);
+
+    for (u32 i = 0; i < count; i++) {
+        b8 expected = i >= count - 64 && i % 2 == 1;
+        sp_test_assert(sp_hash_set_has(set, &i) == expected);
+    }
+
+    sp_hash_set_destroy(set);
+    sp_test_assert(live_bytes == 0);
+    sp_test_success();
+}
+
+SP_TestResult test_hash_set_incremental_resize(void* userdata) {
+    SP_HashSet* set = sp_hash_set_create((SP_HashSetDesc) {
+            .allocator = sp_libc_allocator(),
+            .capacity = 8,
+            .incremental_resize = true,
+            .collision_resolution = (u64) userdata,
+            .hash = sp_fvn1a_hash,
+            .equal = sp_hash_map_helper_equal_generic,
+            .value_size = sizeof(u32),
+        });
+    const u32 count = 20000;
+
+    for (u32 i = 0; i < count; i++) {
+        sp_test_assert(sp_hash_set_insert(set, &i));
+        sp_test_assert(!sp_hash_set_insert(set, &i));
+        u32 older = i / 2;
+        if (i % 2 == 0 && older % 2 == 1) {
+            sp_test_assert(sp_hash_set_remove(set, &older));
+            sp_test_assert(!sp_hash_set_has(set, &older));
+        }
+    }
+    sp_test_assert(sp_hash_set_count(set) == count - count / 4);
+
+    for (u32 i = 0; i < count; i++) {
+        b8 removed = i < count / 2 && i % 2 == 1;
+        sp_test_assert(sp_hash_set_has(set, &i) == !removed);
+    }
+
+    // The last growth is likely still being drained, iteration covers both
+    // tables.
+    u32 iterated = 0;
+    for (SP_HashSetIter iter = sp_hash_set_iter_init(set);
+            sp_hash_set_iter_valid(iter);
+            iter = sp_hash_set_iter_next(iter)) {
+        u32 value = *(u32*) sp_hash_set_iter_get_valuep(iter);
+        sp_test_assert(value < count);
+        sp_test_assert(!(value < count / 2 && value % 2 == 1));
+        iterated++;
+    }
+    sp_test_assert(iterated == count - count / 4);
+
+    sp_hash_set_destroy(set);
+    sp_test_success();
+}
+
 void test_hash_set(SP_TestSuite* suite) {
-    u32 hash_set_groups[2] = {
+    u32 hash_set_groups[4] = {
         sp_test_group_register(suite, sp_str_lit("Hash Set (Open Adressing)")),
         sp_test_group_register(suite, sp_str_lit("Hash Set (Separate Chaining)")),
+        sp_test_group_register(suite, sp_str_lit("Hash Set (Swiss Table)")),
+        sp_test_group_register(suite, sp_str_lit("Hash Set (Robin Hood)")),
     };
-    void* hash_set_resolution_type[2] = {
+    void* hash_set_resolution_type[4] = {
         (void*) SP_HASH_COLLISION_RESOLUTION_OPEN_ADDRESSING,
         (void*) SP_HASH_COLLISION_RESOLUTION_SEPARATE_CHAINING,
+        (void*) SP_HASH_COLLISION_RESOLUTION_SWISS_TABLE,
+        (void*) SP_HASH_COLLISION_RESOLUTION_ROBIN_HOOD,
     };
 
-    for (u32 i = 0; i < 2; i++) {
+    for (u32 i = 0; i < sp_arrlen(hash_set_groups); i++) {
         u32 group = hash_set_groups[i];
         void* resolution_type = hash_set_resolution_type[i];
         sp_test_register(suite, group, test_hash_set_insert_has, resolution_type);
         sp_test_register(suite, group, test_hash_set_remove, resolution_type);
         sp_test_register(suite, group, test_hash_set_mass_insert_remove, resolution_type);
         sp_test_register(suite, group, test_hash_set_reinsertion, resolution_type);
+        sp_test_register(suite, group, test_hash_set_reserve_shrink, resolution_type);
     }
+    // See 'test_hash_map'.
+    sp_test_register(suite, hash_set_groups[0], test_hash_set_incremental_resize, hash_set_resolution_type[0]);
 }
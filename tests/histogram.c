@@ -0,0 +1,105 @@
+#include "spire.h"
+
+SP_TestResult test_histogram_exact_values(void* userdata) {
+    (void) userdata;
+
+    SP_Arena* arena = sp_arena_create();
+    SP_Histogram* histogram = sp_histogram_create(arena, (SP_HistogramDesc) {0});
+    sp_test_assert(sp_histogram_count(histogram) == 0);
+    sp_test_assert(sp_histogram_percentile(histogram, 50.0) == 0);
+
+    // Small values get a bucket each.
+    for (u64 i = 1; i <= 100; i++) {
+        sp_histogram_record(histogram, i);
+    }
+    sp_test_assert(sp_histogram_count(histogram) == 100);
+    sp_test_assert(sp_histogram_min(histogram) == 1);
+    sp_test_assert(sp_histogram_max(histogram) == 100);
+    sp_test_assert(sp_histogram_percentile(histogram, 0.0) == 1);
+    sp_test_assert(sp_histogram_percentile(histogram, 50.0) == 50);
+    sp_test_assert(sp_histogram_percentile(histogram, 99.0) == 99);
+    sp_test_assert(sp_histogram_percentile(histogram, 100.0) == 100);
+    sp_test_assert(sp_histogram_mean(histogram) == 50.5);
+
+    sp_arena_destroy(arena);
+    sp_test_success();
+}
+
+SP_TestResult test_histogram_precision(void* userdata) {
+    (void) userdata;
+
+    SP_Arena* arena = sp_arena_create();
+    SP_Histogram* histogram = sp_histogram_create(arena, (SP_HistogramDesc) {
+            .precision = 7,
+        });
+
+    // Every value must come back within the promised relative error.
+    u64 value = 1;
+    while (value < UINT64_MAX / 3) {
+        sp_histogram_reset(histogram);
+        sp_histogram_record(histogram, value);
+        u64 lowest = sp_histogram_min(histogram);
+        u64 highest = sp_histogram_max(histogram);
+        sp_test_assert(lowest <= value && value <= highest);
+        sp_test_assert((f64) (highest - lowest) <= (f64) value / 128.0);
+        value = value * 3 + 1;
+    }
+
+    sp_histogram_reset(histogram);
+    sp_histogram_record(histogram, UINT64_MAX);
+    sp_test_assert(sp_histogram_max(histogram) == UINT64_MAX);
+
+    sp_arena_destroy(arena);
+    sp_test_success();
+}
+
+SP_TestResult test_histogram_max_value(void* userdata) {
+    (void) userdata;
+
+    SP_Arena* arena = sp_arena_create();
+    SP_Histogram* histogram = sp_histogram_create(arena, (SP_HistogramDesc) {
+            .max_value = 1000,
+        });
+    sp_histogram_record(histogram, 10);
+    sp_histogram_record(histogram, 1000000);
+    sp_test_assert(sp_histogram_count(histogram) == 2);
+    sp_test_assert(sp_histogram_max(histogram) == 1000);
+
+    sp_arena_destroy(arena);
+    sp_test_success();
+}
+
+SP_TestResult test_histogram_merge(void* userdata) {
+    (void) userdata;
+
+    SP_Arena* arena = sp_arena_create();
+    SP_Histogram* a = sp_histogram_create(arena, (SP_HistogramDesc) {0});
+    SP_Histogram* b = sp_histogram_create(arena, (SP_HistogramDesc) {
+            .precision = 4,
+            .shards = 1,
+        });
+
+    sp_histogram_record_n(a, 10, 90);
+    sp_histogram_record_n(b, 5000, 10);
+    sp_histogram_merge(a, b);
+    sp_test_assert(sp_histogram_count(a) == 100);
+    sp_test_assert(sp_histogram_percentile(a, 90.0) == 10);
+    u64 p99 = sp_histogram_percentile(a, 99.0);
+    // Kept to the precision of the coarser histogram.
+    sp_test_assert(p99 >= 5000 - 5000 / 16 && p99 <= 5000 + 5000 / 16);
+
+    sp_histogram_reset(a);
+    sp_test_assert(sp_histogram_count(a) == 0);
+    sp_test_assert(sp_histogram_count(b) == 10);
+
+    sp_arena_destroy(arena);
+    sp_test_success();
+}
+
+void test_histogram(SP_TestSuite* suite) {
+    u32 group = sp_test_group_register(suite, sp_str_lit("Histogram"));
+    sp_test_register(suite, group, test_histogram_exact_values, NULL);
+    sp_test_register(suite, group, test_histogram_precision, NULL);
+    sp_test_register(suite, group, test_histogram_max_value, NULL);
+    sp_test_register(suite, group, test_histogram_merge, NULL);
+}
@@ -0,0 +1,447 @@
+#include "spire.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef SP_POSIX
+#include <pthread.h>
+#endif
+
+// Logging is configured in 'sp_init' so these tests restart Spire and restore
+// the suite's config afterwards.
+static const SP_Config* config = NULL;
+
+static u32 count_lines(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+    u32 lines = 0;
+    i32 c;
+    while ((c = fgetc(file)) != EOF) {
+        lines += c == '\n';
+    }
+    fclose(file);
+    return lines;
+}
+
+// Copy of the first line containing 'needle' into 'line', empty if there's
+// none.
+static void find_line(const char* path, const char* needle, char* line, u32 size) {
+    FILE* file = fopen(path, "rb");
+    line[0] = 0;
+    if (file == NULL) {
+        return;
+    }
+    while (fgets(line, size, file) != NULL) {
+        if (strstr(line, needle) != NULL) {
+            fclose(file);
+            return;
+        }
+    }
+    line[0] = 0;
+    fclose(file);
+}
+
+static b8 restart_logging(b8 async, SP_LogOverflow overflow, u32 buffer_size, const char* path) {
+    SP_Config log_config = *config;
+    // Left on to check that files never get color codes.
+    log_config.logging.colorful = true;
+    log_config.logging.async = async;
+    log_config.logging.overflow = overflow;
+    log_config.logging.buffer_size = buffer_size;
+    log_config.logging.path = path;
+    sp_terminate();
+    return sp_init(log_config);
+}
+
+static b8 restart_binary_logging(const char* binary_path, const char* path) {
+    SP_Config log_config = *config;
+    log_config.logging.binary_path = binary_path;
+    log_config.logging.path = path;
+    sp_terminate();
+    return sp_init(log_config);
+}
+
+SP_TestResult test_log_file(void* userdata) {
+    (void) userdata;
+
+    const char* path = "spire_test_log_file.txt";
+    remove(path);
+    sp_test_assert(restart_logging(false, SP_LOG_OVERFLOW_DROP, 0, path));
+    for (u32 i = 0; i < 100; i++) {
+        sp_info("line %u", i);
+    }
+    sp_log_flush();
+    u32 lines = count_lines(path);
+    char line[256];
+    find_line(path, "\033", line, sizeof(line));
+
+    sp_terminate();
+    sp_init(*config);
+    remove(path);
+    sp_test_assert(lines == 100);
+    sp_test_assert(line[0] == 0);
+    sp_test_success();
+}
+
+SP_TestResult test_log_async_block(void* userdata) {
+    (void) userdata;
+
+    const char* path = "spire_test_log_async.txt";
+    remove(path);
+    // A small buffer makes the writer fall behind.
+    sp_test_assert(restart_logging(true, SP_LOG_OVERFLOW_BLOCK, 256, path));
+    for (u32 i = 0; i < 10000; i++) {
+        sp_info("line %u", i);
+    }
+    sp_log_flush();
+    u32 lines = count_lines(path);
+    u64 dropped = sp_log_get_dropped();
+
+    sp_terminate();
+    sp_init(*config);
+    remove(path);
+    sp_test_assert(lines == 10000);
+    sp_test_assert(dropped == 0);
+    sp_test_success();
+}
+
+SP_TestResult test_log_async_drop(void* userdata) {
+    (void) userdata;
+
+    const char* path = "spire_test_log_drop.txt";
+    remove(path);
+    sp_test_assert(restart_logging(true, SP_LOG_OVERFLOW_DROP, 256, path));
+    for (u32 i = 0; i < 10000; i++) {
+        sp_info("line %u", i);
+    }
+    sp_log_flush();
+    u64 dropped = sp_log_get_dropped();
+
+    // Terminating writes the notice about the dropped lines.
+    sp_terminate();
+    u32 lines = count_lines(path);
+    char notice[256];
+    find_line(path, "log lines dropped", notice, sizeof(notice));
+    sp_init(*config);
+    remove(path);
+    sp_test_assert(lines + dropped >= 10000);
+    sp_test_assert(dropped == 0 || lines > 10000 - dropped);
+    // Formatted like every other line.
+    sp_test_assert(dropped == 0 || strncmp(notice, "WARN  ", 6) == 0);
+    sp_test_assert(dropped == 0 || strstr(notice, ".c:") != NULL);
+    sp_test_success();
+}
+
+#ifdef SP_POSIX
+static void* logging_thread(void* userdata) {
+    u64* arena_bytes = userdata;
+    for (u32 i = 0; i < 10; i++) {
+        sp_info("thread line %u", i);
+    }
+    *arena_bytes = sp_get_thread_alloc_stats().arena_bytes;
+    return NULL;
+}
+#endif
+
+SP_TestResult test_log_thread_recycling(void* userdata) {
+    (void) userdata;
+
+#ifndef SP_POSIX
+    sp_test_skip("needs POSIX threads");
+#else
+    const char* path = "spire_test_log_threads.txt";
+    remove(path);
+    sp_test_assert(restart_logging(true, SP_LOG_OVERFLOW_BLOCK, 4096, path));
+    // Threads run one after the other, so only the first one may push a ring
+    // onto the logging arena. The rest reuse it along with its context.
+    u64 arena_bytes[32] = {0};
+    b8 started = true;
+    for (u32 i = 0; i < sp_arrlen(arena_bytes); i++) {
+        pthread_t handle;
+        if (pthread_create(&handle, NULL, logging_thread, &arena_bytes[i]) != 0) {
+            started = false;
+            break;
+        }
+        pthread_join(handle, NULL);
+    }
+    sp_log_flush();
+    u32 lines = count_lines(path);
+
+    sp_terminate();
+    sp_init(*config);
+    remove(path);
+    sp_test_assert(started);
+    sp_test_assert(arena_bytes[0] > 0);
+    for (u32 i = 1; i < sp_arrlen(arena_bytes); i++) {
+        sp_test_assert(arena_bytes[i] == 0);
+    }
+    sp_test_assert(lines == sp_arrlen(arena_bytes) * 10);
+    sp_test_success();
+#endif
+}
+
+SP_TestResult test_log_binary(void* userdata) {
+    (void) userdata;
+
+    const char* binary_path = "spire_test_log.bin";
+    const char* text_path = "spire_test_log_decoded.txt";
+    SP_Str str = sp_str_lit("length based string");
+    char expected[5][256];
+
+    sp_test_assert(restart_binary_logging(binary_path, NULL));
+    for (u32 i = 0; i < 2; i++) {
+        sp_info("plain");
+        sp_debug("%d %u %x %c %%", -12, 42u, 255, 'q');
+        sp_trace("%lld %llu %zu %ld", -5ll, 18446744073709551615llu, (size_t) 77, 123456789l);
+        sp_info("%.3f|%8.2f|%-6.1e|%g", 3.14159, -2.5, 1234.5, 0.0001);
+        sp_info("[%.*s] [%s] [%.4s] [%10s] [%-*d]", str.len, str.data, "cstr", "truncated", "right", 5, 7);
+    }
+    sp_log_flush();
+    snprintf(expected[0], sizeof(expected[0]), "plain");
+    snprintf(expected[1], sizeof(expected[1]), "%d %u %x %c %%", -12, 42u, 255, 'q');
+    snprintf(expected[2], sizeof(expected[2]), "%lld %llu %zu %ld", -5ll, 18446744073709551615llu, (size_t) 77, 123456789l);
+    snprintf(expected[3], sizeof(expected[3]), "%.3f|%8.2f|%-6.1e|%g", 3.14159, -2.5, 1234.5, 0.0001);
+    snprintf(expected[4], sizeof(expected[4]), "[%.*s] [%s] [%.4s] [%10s] [%-*d]", str.len, str.data, "cstr", "truncated", "right", 5, 7);
+    sp_terminate();
+    sp_init(*config);
+
+    b8 decoded = sp_log_decode(binary_path, text_path);
+    FILE* file = fopen(text_path, "rb");
+    char line[512];
+    u32 lines = 0;
+    b8 matched = true;
+    while (file != NULL && fgets(line, sizeof(line), file) != NULL) {
+        // Skip the timestamp, level, file and line.
+        char* message = strstr(line, ".c:");
+        message = message != NULL ? strstr(message, ": ") : NULL;
+        if (message == NULL) {
+            matched = false;
+            break;
+        }
+        message += 2;
+        message[strcspn(message, "\n")] = 0;
+        matched &= strcmp(message, expected[lines % 5]) == 0;
+        lines++;
+    }
+    if (file != NULL) {
+        fclose(file);
+    }
+    remove(binary_path);
+    remove(text_path);
+
+    sp_test_assert(decoded);
+    sp_test_assert(matched);
+    sp_test_assert(lines == 10);
+    sp_test_success();
+}
+
+SP_TestResult test_log_binary_long_double(void* userdata) {
+    (void) userdata;
+
+    const char* binary_path = "spire_test_log_ld.bin";
+    const char* path = "spire_test_log_ld.txt";
+    const char* decoded_path = "spire_test_log_ld_decoded.txt";
+    remove(path);
+    sp_test_assert(restart_binary_logging(binary_path, path));
+    sp_info("long %.2Lf", 1.25L);
+    sp_info("double %.2f", 1.25);
+    sp_log_flush();
+    sp_terminate();
+    sp_init(*config);
+
+    // The long double line is written as text, the other one in binary.
+    sp_log_decode(binary_path, decoded_path);
+    char text_line[256];
+    char decoded_line[256];
+    find_line(path, "long 1.25", text_line, sizeof(text_line));
+    find_line(decoded_path, "double 1.25", decoded_line, sizeof(decoded_line));
+    u32 decoded_lines = count_lines(decoded_path);
+    remove(binary_path);
+    remove(path);
+    remove(decoded_path);
+
+    sp_test_assert(text_line[0] != 0);
+    sp_test_assert(decoded_line[0] != 0);
+    sp_test_assert(decoded_lines == 1);
+    sp_test_success();
+}
+
+// Handwritten binary logs, laid out like the records 'sp_log_decode' reads.
+typedef struct LogBytes LogBytes;
+struct LogBytes {
+    u8 data[16384];
+    u32 len;
+};
+
+static void log_bytes_put(LogBytes* bytes, const void* data, u32 len) {
+    memcpy(bytes->data + bytes->len, data, len);
+    bytes->len += len;
+}
+
+static void log_bytes_header(LogBytes* bytes, u16 size, u8 type, u32 id) {
+    log_bytes_put(bytes, &size, sizeof(size));
+    log_bytes_put(bytes, &type, sizeof(type));
+    log_bytes_put(bytes, &id, sizeof(id));
+}
+
+static void log_bytes_callsite(LogBytes* bytes, u32 id, const char* msg) {
+    const char* file = "log.c";
+    u8 level = SP_LOG_LEVEL_INFO;
+    u32 line = 1;
+    u16 file_len = (u16) strlen(file);
+    u16 msg_len = (u16) strlen(msg) + 1;
+    log_bytes_header(bytes, 3 + 4 + 1 + 4 + 2 + 2 + file_len + msg_len, 1, id);
+    log_bytes_put(bytes, &level, sizeof(level));
+    log_bytes_put(bytes, &line, sizeof(line));
+    log_bytes_put(bytes, &file_len, sizeof(file_len));
+    log_bytes_put(bytes, &msg_len, sizeof(msg_len));
+    log_bytes_put(bytes, file, file_len);
+    log_bytes_put(bytes, msg, msg_len);
+}
+
+// An entry of a "%s" callsite, whose string claims 'claimed_len' bytes but
+// comes with 'len' of them.
+static void log_bytes_str_entry(LogBytes* bytes, u32 id, u16 claimed_len, u16 len) {
+    u64 time_ns = 0;
+    log_bytes_header(bytes, 3 + 4 + 8 + 2 + len, 2, id);
+    log_bytes_put(bytes, &time_ns, sizeof(time_ns));
+    log_bytes_put(bytes, &claimed_len, sizeof(claimed_len));
+    memset(bytes->data + bytes->len, 'x', len);
+    bytes->len += len;
+}
+
+static b8 decode_bytes(const LogBytes* bytes) {
+    const char* binary_path = "spire_test_log_malformed.bin";
+    const char* text_path = "spire_test_log_malformed.txt";
+    FILE* file = fopen(binary_path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    fwrite("SPLOGB01", 1, 8, file);
+    fwrite(bytes->data, 1, bytes->len, file);
+    fclose(file);
+    b8 decoded = sp_log_decode(binary_path, text_path);
+    remove(binary_path);
+    remove(text_path);
+    return decoded;
+}
+
+SP_TestResult test_log_decode_malformed(void* userdata) {
+    (void) userdata;
+    static LogBytes bytes;
+
+    // Well formed to begin with.
+    bytes.len = 0;
+    log_bytes_callsite(&bytes, 1, "%s");
+    log_bytes_str_entry(&bytes, 1, 16, 16);
+    sp_test_assert(decode_bytes(&bytes));
+
+    // A string longer than any record the writer produces.
+    bytes.len = 0;
+    log_bytes_callsite(&bytes, 1, "%s");
+    log_bytes_str_entry(&bytes, 1, 8000, 8000);
+    sp_test_assert(!decode_bytes(&bytes));
+
+    // A string filling a record of the maximum size exactly.
+    bytes.len = 0;
+    log_bytes_callsite(&bytes, 1, "%s");
+    log_bytes_str_entry(&bytes, 1, 1024 - 17, 1024 - 17);
+    sp_test_assert(decode_bytes(&bytes));
+
+    // Callsite ids far past any the writer hands out.
+    const u32 ids[] = {0xFFFFFFFFu, 0x80000001u, 1u << 28};
+    for (u32 i = 0; i < sp_arrlen(ids); i++) {
+        bytes.len = 0;
+        log_bytes_callsite(&bytes, ids[i], "%s");
+        sp_test_assert(!decode_bytes(&bytes));
+    }
+
+    // A record cut short by the end of the file.
+    bytes.len = 0;
+    log_bytes_callsite(&bytes, 1, "%s");
+    log_bytes_str_entry(&bytes, 1, 16, 16);
+    bytes.len -= 4;
+    sp_test_assert(!decode_bytes(&bytes));
+
+    sp_test_success();
+}
+
+SP_TestResult test_log_expressions(void* userdata) {
+    (void) userdata;
+
+#ifndef SP_COMP_GCC
+    sp_test_skip("the log macros are statements with MSVC");
+#else
+    SP_LogLevel level = sp_log_get_level();
+    sp_log_set_level(SP_LOG_LEVEL_FATAL);
+    // Like any void expression.
+    u32 evaluated = 0;
+    b8 verbose = true;
+    verbose ? sp_info("%u", evaluated++) : (void) 0;
+    (sp_debug("%u", evaluated++), sp_trace("%u", evaluated++), evaluated++);
+    verbose ? sp_warn("%u", evaluated++) : sp_error("%u", evaluated++);
+    (sp_warn_every_n(2, "%u", evaluated++), sp_warn_per_second("%u", evaluated++));
+    sp_log_set_level(level);
+
+    sp_test_assert(evaluated == 1);
+    sp_test_success();
+#endif
+}
+
+SP_TestResult test_log_level(void* userdata) {
+    (void) userdata;
+
+    SP_LogLevel level = sp_log_get_level();
+    sp_log_set_level(SP_LOG_LEVEL_WARN);
+    // Filtered lines don't evaluate their arguments.
+    u32 evaluated = 0;
+    sp_info("%u", evaluated++);
+    sp_trace("%u", evaluated++);
+    sp_log_set_level(level);
+
+    sp_test_assert(evaluated == 0);
+    sp_test_assert(!sp_log_set_level(SP_LOG_LEVEL_COUNT));
+    sp_test_assert(!sp_log_set_level((SP_LogLevel) -1));
+    sp_test_assert(sp_log_get_level() == level);
+    sp_test_success();
+}
+
+SP_TestResult test_log_rate_limit(void* userdata) {
+    (void) userdata;
+
+    const char* path = "spire_test_log_rate.txt";
+    remove(path);
+    sp_test_assert(restart_logging(false, SP_LOG_OVERFLOW_DROP, 0, path));
+    for (u32 i = 0; i < 100; i++) {
+        sp_warn_every_n(10, "every 10th %u", i);
+    }
+    // Runs well within a second.
+    for (u32 i = 0; i < 100; i++) {
+        sp_warn_per_second("once %u", i);
+    }
+    sp_log_flush();
+    u32 lines = count_lines(path);
+
+    sp_terminate();
+    sp_init(*config);
+    remove(path);
+    sp_test_assert(lines == 11);
+    sp_test_success();
+}
+
+void test_log(SP_TestSuite* suite, const SP_Config* suite_config) {
+    config = suite_config;
+    u32 group = sp_test_group_register(suite, sp_str_lit("Logging"));
+    sp_test_register(suite, group, test_log_file, NULL);
+    sp_test_register(suite, group, test_log_async_block, NULL);
+    sp_test_register(suite, group, test_log_async_drop, NULL);
+    sp_test_register(suite, group, test_log_thread_recycling, NULL);
+    sp_test_register(suite, group, test_log_binary, NULL);
+    sp_test_register(suite, group, test_log_binary_long_double, NULL);
+    sp_test_register(suite, group, test_log_decode_malformed, NULL);
+    sp_test_register(suite, group, test_log_expressions, NULL);
+    sp_test_register(suite, group, test_log_level, NULL);
+    sp_test_register(suite, group, test_log_rate_limit, NULL);
+}
@@ -0,0 +1,58 @@
+// Everything less severe than warnings is compiled out of this file.
+#define SP_LOG_MIN_LEVEL 2
+#include "spire.h"
+
+#include <stdio.h>
+
+static const SP_Config* config = NULL;
+
+static u32 count_lines(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+    u32 lines = 0;
+    i32 c;
+    while ((c = fgetc(file)) != EOF) {
+        lines += c == '\n';
+    }
+    fclose(file);
+    return lines;
+}
+
+SP_TestResult test_log_min_level_compiled_out(void* userdata) {
+    (void) userdata;
+
+    const char* path = "spire_test_log_min_level.txt";
+    remove(path);
+    SP_Config log_config = *config;
+    log_config.logging.level = SP_LOG_LEVEL_TRACE;
+    log_config.logging.path = path;
+    sp_terminate();
+    sp_test_assert(sp_init(log_config));
+
+    // The runtime level lets everything through, only the kept levels log
+    // and evaluate their arguments.
+    u32 evaluated = 0;
+    sp_error("%u", evaluated++);
+    sp_warn("%u", evaluated++);
+    sp_warn_every_n(1, "%u", evaluated++);
+    sp_info("%u", evaluated++);
+    sp_debug("%u", evaluated++);
+    sp_trace("%u", evaluated++);
+    sp_log_flush();
+    u32 lines = count_lines(path);
+
+    sp_terminate();
+    sp_init(*config);
+    remove(path);
+    sp_test_assert(evaluated == 3);
+    sp_test_assert(lines == 3);
+    sp_test_success();
+}
+
+void test_log_min_level(SP_TestSuite* suite, const SP_Config* suite_config) {
+    config = suite_config;
+    u32 group = sp_test_group_register(suite, sp_str_lit("Compile time log filtering"));
+    sp_test_register(suite, group, test_log_min_level_compiled_out, NULL);
+}
@@ -1,17 +1,41 @@
 #include "spire.h"
 
+extern void test_arena(SP_TestSuite* suite, const SP_Config* config);
+extern void test_bench(SP_TestSuite* suite);
+extern void test_hash(SP_TestSuite* suite);
 extern void test_hash_map(SP_TestSuite* suite);
 extern void test_hash_set(SP_TestSuite* suite);
+extern void test_scratch(SP_TestSuite* suite);
+extern void test_os(SP_TestSuite* suite, const SP_Config* config);
+extern void test_histogram(SP_TestSuite* suite);
+extern void test_profile(SP_TestSuite* suite);
+extern void test_log(SP_TestSuite* suite, const SP_Config* config);
+extern void test_log_min_level(SP_TestSuite* suite, const SP_Config* config);
+extern void test_runner(SP_TestSuite* suite, const SP_Config* config);
 
 i32 main(void) {
-    sp_init(SP_CONFIG_DEFAULT);
+    SP_Config config = SP_CONFIG_DEFAULT;
+    config.scratch.arena_count = 4;
+    sp_init(config);
     SP_TestSuite* suite = sp_test_suite_create(sp_libc_allocator());
 
+    test_arena(suite, &config);
+    test_bench(suite);
+    test_hash(suite);
     test_hash_map(suite);
     test_hash_set(suite);
+    test_scratch(suite);
+    test_os(suite, &config);
+    test_histogram(suite);
+    test_profile(suite);
+    test_log(suite, &config);
+    test_log_min_level(suite, &config);
+    test_runner(suite, &config);
 
-    sp_test_suite_run(suite);
+    SP_TestConfig test_config = SP_TEST_CONFIG_DEFAULT;
+    test_config.workers = sp_os_get_system_info().logical_cores;
+    b8 passed = sp_test_suite_run_configurable(suite, test_config);
     sp_test_suite_destroy(suite);
     sp_terminate();
-    return 0;
+    return passed ? 0 : 1;
 }
@@ -0,0 +1,220 @@
+#include "spire.h"
+
+// Some tests check behavior before 'sp_init', so they stop Spire and restore
+// the suite's config afterwards.
+static const SP_Config* config = NULL;
+
+static b8 is_pow2(u64 value) {
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+SP_TestResult test_perf_counters_scope(void* userdata) {
+    (void) userdata;
+
+    // Hardware counters are often missing in containers and virtual machines.
+    if (!sp_os_perf_counter_available(SP_PERF_COUNTER_INSTRUCTIONS)) {
+        sp_test_skip("instruction counter unavailable");
+    }
+
+    // Two scopes add up into the same counters.
+    SP_PerfCounters counters = {0};
+    volatile u64 sum = 0;
+    for (u32 scope = 0; scope < 2; scope++) {
+        sp_perf_scope(counters) {
+            for (u64 i = 0; i < 100000; i++) {
+                sum += i;
+            }
+        }
+    }
+
+    sp_test_assert(counters.values[SP_PERF_COUNTER_INSTRUCTIONS] >= 200000);
+    if (sp_os_perf_counter_available(SP_PERF_COUNTER_CYCLES)) {
+        sp_test_assert(counters.values[SP_PERF_COUNTER_CYCLES] > 0);
+    }
+
+    sp_test_success();
+}
+
+SP_TestResult test_perf_counters_page_faults(void* userdata) {
+    (void) userdata;
+
+    if (!sp_os_perf_counter_available(SP_PERF_COUNTER_PAGE_FAULTS)) {
+        sp_test_skip("page fault counter unavailable");
+    }
+
+    const u32 PAGES = 64;
+    u32 page_size = sp_os_get_page_size();
+    u8* memory = sp_os_reserve_memory(PAGES * page_size);
+    sp_os_commit_memory(memory, PAGES * page_size);
+
+    SP_PerfCounters counters = {0};
+    sp_perf_scope(counters) {
+        for (u32 i = 0; i < PAGES; i++) {
+            memory[i * page_size] = 1;
+        }
+    }
+    sp_os_release_memory(memory, PAGES * page_size);
+
+    sp_test_assert(counters.values[SP_PERF_COUNTER_PAGE_FAULTS] >= PAGES);
+    sp_test_success();
+}
+
+SP_TestResult test_resident_memory(void* userdata) {
+    (void) userdata;
+
+    const u32 PAGES = 64;
+    u32 page_size = sp_os_get_page_size();
+    u8* memory = sp_os_reserve_memory(PAGES * page_size);
+    sp_os_commit_memory(memory, PAGES * page_size);
+    sp_test_assert(sp_os_get_resident_memory(memory, PAGES * page_size) == 0);
+
+    for (u32 i = 0; i < PAGES / 2; i++) {
+        memory[i * page_size] = 1;
+    }
+    sp_test_assert(sp_os_get_resident_memory(memory, PAGES * page_size) == PAGES / 2 * page_size);
+
+    // Decommitting has to give the pages back.
+    sp_os_decommit_memory(memory, PAGES * page_size);
+    sp_test_assert(sp_os_get_resident_memory(memory, PAGES * page_size) == 0);
+    sp_os_release_memory(memory, PAGES * page_size);
+
+    SP_ProcessMemory process = sp_os_get_process_memory();
+    sp_test_assert(process.resident > 0);
+    sp_test_assert(process.peak_resident >= process.resident);
+
+    sp_test_success();
+}
+
+SP_TestResult test_arena_resident_memory(void* userdata) {
+    (void) userdata;
+
+    SP_Arena* arena = sp_arena_create_configurable((SP_ArenaDesc) {
+            .block_size = sp_gib(1),
+            .virtual_memory = true,
+            .alignment = sizeof(void*),
+        });
+    u64 base = sp_arena_get_metrics(arena).resident_bytes;
+
+    u64 size = 64 * sp_os_get_page_size();
+    SP_Temp temp = sp_temp_begin(arena);
+    sp_arena_push(arena, size);
+    SP_ArenaMetrics metrics = sp_arena_get_metrics(arena);
+    sp_test_assert(metrics.committed_bytes >= size);
+    sp_test_assert(metrics.resident_bytes >= base + size);
+    sp_test_assert(metrics.reserved_bytes >= metrics.committed_bytes);
+
+    // Popping decommits, which should show up as resident memory going down.
+    sp_temp_end(temp);
+    metrics = sp_arena_get_metrics(arena);
+    sp_test_assert(metrics.resident_bytes < base + size);
+
+    sp_arena_destroy(arena);
+    sp_test_success();
+}
+
+SP_TestResult test_system_info(void* userdata) {
+    (void) userdata;
+
+    SP_SystemInfo info = sp_os_get_system_info();
+    sp_test_assert(info.page_size == sp_os_get_page_size());
+    sp_test_assert(is_pow2(info.page_size));
+    sp_test_assert(info.huge_page_size == 0 || info.huge_page_size > info.page_size);
+    sp_test_assert(is_pow2(info.cache_line_size));
+    sp_test_assert(info.logical_cores >= 1);
+    sp_test_assert(info.physical_cores >= 1);
+    sp_test_assert(info.physical_cores <= info.logical_cores);
+    sp_test_assert(info.numa_nodes >= 1);
+    if (info.l1_cache_size != 0 && info.l2_cache_size != 0) {
+        sp_test_assert(info.l2_cache_size >= info.l1_cache_size);
+    }
+#if defined(__x86_64__) || defined(_M_X64)
+    sp_test_assert(info.simd.sse2);
+#endif
+
+    sp_test_success();
+}
+
+SP_TestResult test_before_init(void* userdata) {
+    (void) userdata;
+
+    SP_SystemInfo initialized = sp_os_get_system_info();
+    sp_terminate();
+
+    u32 page_size = sp_os_get_page_size();
+    SP_SystemInfo probed = sp_os_get_system_info();
+    SP_Arena* arena = sp_arena_create_configurable((SP_ArenaDesc) {
+            .block_size = sp_mib(1),
+            .virtual_memory = true,
+            .alignment = sizeof(void*),
+        });
+    u8* memory = sp_arena_push(arena, 4 * page_size);
+    memory[4 * page_size - 1] = 1;
+    sp_arena_destroy(arena);
+
+    sp_init(*config);
+    sp_test_assert(page_size == initialized.page_size);
+    sp_test_assert(probed.logical_cores == initialized.logical_cores);
+    sp_test_assert(probed.physical_cores == initialized.physical_cores);
+    sp_test_success();
+}
+
+SP_TestResult test_clock(void* userdata) {
+    (void) userdata;
+
+    u64 frequency = sp_os_get_cycle_frequency();
+    sp_test_assert(frequency > 0);
+    sp_test_assert(sp_os_get_cycle_frequency() == frequency);
+
+    // Both clocks have to agree over a few milliseconds, give or take a
+    // quarter for noisy machines.
+    const u64 WAIT_NS = 20000000;
+    u64 start_ns = sp_os_get_time_ns();
+    u64 start_cycles = sp_os_get_cycles();
+    u64 now_ns = start_ns;
+    while (now_ns - start_ns < WAIT_NS) {
+        u64 next_ns = sp_os_get_time_ns();
+        sp_test_assert(next_ns >= now_ns);
+        now_ns = next_ns;
+    }
+    u64 cycles = sp_os_get_cycles() - start_cycles;
+    u64 elapsed_ns = now_ns - start_ns;
+    u64 converted_ns = sp_os_cycles_to_ns(cycles);
+    sp_test_assert(converted_ns > elapsed_ns * 3 / 4);
+    sp_test_assert(converted_ns < elapsed_ns * 5 / 4);
+
+    sp_test_success();
+}
+
+SP_TestResult test_time_scope(void* userdata) {
+    (void) userdata;
+
+    const u64 WAIT_NS = 1000000;
+    u64 elapsed_ns = 0;
+    u64 elapsed_cycles = 0;
+    for (u32 i = 0; i < 2; i++) {
+        sp_time_scope_cycles(elapsed_cycles) {
+            sp_time_scope_ns(elapsed_ns) {
+                u64 start_ns = sp_os_get_time_ns();
+                while (sp_os_get_time_ns() - start_ns < WAIT_NS) {}
+            }
+        }
+    }
+
+    // Scopes add to what's already there.
+    sp_test_assert(elapsed_ns >= 2 * WAIT_NS);
+    sp_test_assert(sp_os_cycles_to_ns(elapsed_cycles) >= elapsed_ns / 2);
+    sp_test_success();
+}
+
+void test_os(SP_TestSuite* suite, const SP_Config* suite_config) {
+    config = suite_config;
+    u32 group = sp_test_group_register(suite, sp_str_lit("OS"));
+    sp_test_register(suite, group, test_perf_counters_scope, NULL);
+    sp_test_register(suite, group, test_perf_counters_page_faults, NULL);
+    sp_test_register(suite, group, test_resident_memory, NULL);
+    sp_test_register(suite, group, test_arena_resident_memory, NULL);
+    sp_test_register(suite, group, test_system_info, NULL);
+    sp_test_register(suite, group, test_before_init, NULL);
+    sp_test_register(suite, group, test_clock, NULL);
+    sp_test_register(suite, group, test_time_scope, NULL);
+}
@@ -0,0 +1,84 @@
+#include "spire.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef SP_PROFILE
+#ifdef SP_POSIX
+#include <pthread.h>
+
+static void* profiling_thread(void* userdata) {
+    u64* arena_bytes = userdata;
+    sp_prof_zone("thread") {
+        sp_prof_zone("nested") {}
+    }
+    *arena_bytes = sp_get_thread_alloc_stats().arena_bytes;
+    return NULL;
+}
+#endif // SP_POSIX
+
+static b8 file_contains(const char* path, const char* needle) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    static char buffer[1 << 16];
+    u64 len = fread(buffer, 1, sizeof(buffer) - 1, file);
+    buffer[len] = 0;
+    fclose(file);
+    return strstr(buffer, needle) != NULL;
+}
+#endif // SP_PROFILE
+
+SP_TestResult test_prof_flush(void* userdata) {
+    (void) userdata;
+
+#ifndef SP_PROFILE
+    sp_test_skip("zones are compiled out without SP_PROFILE");
+#else
+    const char* path = "spire_test_prof_flush.json";
+    sp_prof_zone("outer \"quoted\"") {
+        sp_prof_zone_begin("inner");
+        sp_prof_zone_end();
+    }
+    b8 flushed = sp_prof_flush(path);
+    b8 outer = file_contains(path, "{\"name\": \"outer \\\"quoted\\\"\", \"ph\": \"B\"");
+    b8 inner = file_contains(path, "{\"name\": \"inner\", \"ph\": \"E\"");
+    remove(path);
+
+    sp_test_assert(flushed);
+    sp_test_assert(outer);
+    sp_test_assert(inner);
+    sp_test_success();
+#endif
+}
+
+SP_TestResult test_prof_thread_recycling(void* userdata) {
+    (void) userdata;
+
+#if !defined(SP_PROFILE) || !defined(SP_POSIX)
+    sp_test_skip("needs SP_PROFILE and POSIX threads");
+#else
+    // Threads run one after the other, so only the first one may push an
+    // event buffer onto the profiler arena. The rest reuse it.
+    u64 arena_bytes[32] = {0};
+    for (u32 i = 0; i < sp_arrlen(arena_bytes); i++) {
+        pthread_t handle;
+        sp_test_assert(pthread_create(&handle, NULL, profiling_thread, &arena_bytes[i]) == 0);
+        pthread_join(handle, NULL);
+    }
+    sp_prof_flush("spire_test_prof_threads.json");
+    remove("spire_test_prof_threads.json");
+
+    for (u32 i = 1; i < sp_arrlen(arena_bytes); i++) {
+        sp_test_assert(arena_bytes[i] == 0);
+    }
+    sp_test_success();
+#endif
+}
+
+void test_profile(SP_TestSuite* suite) {
+    u32 group = sp_test_group_register(suite, sp_str_lit("Profiling"));
+    sp_test_register(suite, group, test_prof_flush, NULL);
+    sp_test_register(suite, group, test_prof_thread_recycling, NULL);
+}
@@ -0,0 +1,187 @@
+#include "spire.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef SP_POSIX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Logging is configured in 'sp_init', the logging test restarts Spire and
+// restores the suite's config afterwards.
+static const SP_Config* config = NULL;
+
+static SP_TestResult passing_test(void* userdata) {
+    (void) userdata;
+    sp_test_success();
+}
+
+static SP_TestResult crashing_test(void* userdata) {
+    (void) userdata;
+    abort();
+}
+
+static SP_TestResult hanging_test(void* userdata) {
+    (void) userdata;
+    volatile b8 running = true;
+    volatile u64 spins = 0;
+    while (running) {
+        spins++;
+    }
+    sp_test_success();
+}
+
+static b8 run_isolated(SP_TestFunc func) {
+    SP_TestSuite* suite = sp_test_suite_create(sp_libc_allocator());
+    u32 group = sp_test_group_register(suite, sp_str_lit("Isolated"));
+    sp_test_register(suite, group, passing_test, NULL);
+    _sp_test_register(suite, group, func, sp_str_lit("isolated_test"), NULL);
+
+    // The inner suite's report, failures included, would only clutter the
+    // test output. The workers inherit the redirection.
+    fflush(stdout);
+#ifdef SP_POSIX
+    i32 saved = dup(STDOUT_FILENO);
+    i32 null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    close(null);
+#endif
+    b8 passed = sp_test_suite_run_configurable(suite, (SP_TestConfig) {
+            .workers = 2,
+            .timeout_ns = 200000000,
+        });
+    fflush(stdout);
+#ifdef SP_POSIX
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+#endif
+    sp_test_suite_destroy(suite);
+    return passed;
+}
+
+SP_TestResult test_runner_isolates_crash(void* userdata) {
+    (void) userdata;
+    sp_test_assert(run_isolated(passing_test));
+    // Reaching the asserts at all means the runner survived.
+    sp_test_assert(!run_isolated(crashing_test));
+    sp_test_success();
+}
+
+SP_TestResult test_runner_timeout(void* userdata) {
+    (void) userdata;
+    sp_test_assert(!run_isolated(hanging_test));
+    sp_test_success();
+}
+
+static SP_TestResult allocating_test(void* userdata) {
+    (void) userdata;
+    SP_TestBudget budget = sp_test_budget_begin();
+    void* ptr = sp_alloc(sp_libc_allocator(), 64);
+    sp_free(sp_libc_allocator(), ptr, 64);
+    sp_test_assert_max_allocs(budget, 0);
+    sp_test_success();
+}
+
+static u32 budget_evaluations = 0;
+
+static u64 counted_budget(void) {
+    budget_evaluations++;
+    return 0;
+}
+
+static SP_TestResult counted_budget_test(void* userdata) {
+    (void) userdata;
+    SP_TestBudget budget = sp_test_budget_begin();
+    void* ptr = sp_alloc(sp_libc_allocator(), 64);
+    sp_free(sp_libc_allocator(), ptr, 64);
+    sp_test_assert_max_allocs(budget, counted_budget());
+    sp_test_success();
+}
+
+SP_TestResult test_runner_budget(void* userdata) {
+    (void) userdata;
+
+    // Warm up the thread's scratch arenas so they are not counted below.
+    sp_scratch_end(sp_scratch_begin(NULL, 0));
+
+    SP_TestBudget budget = sp_test_budget_begin();
+    SP_Allocator allocator = sp_libc_allocator();
+    void* ptr = sp_alloc(allocator, 100);
+    sp_free(allocator, ptr, 100);
+    SP_Scratch scratch = sp_scratch_begin(NULL, 0);
+    sp_arena_push_no_zero(scratch.arena, 28);
+    sp_scratch_end(scratch);
+
+    sp_test_assert(_sp_test_budget_allocs(budget) == 2);
+    sp_test_assert(_sp_test_budget_bytes(budget) >= 128);
+    sp_test_assert_max_allocs(budget, 2);
+    sp_test_assert_max_bytes(budget, 1024);
+    sp_test_assert_max_ns(budget, 1000000000);
+
+    // Going over budget fails the test instead of passing silently, in a
+    // worker as well as in-process.
+    sp_test_assert(!run_isolated(allocating_test));
+    SP_TestResult result = allocating_test(NULL);
+    sp_test_assert(!result.successful);
+    sp_test_assert(sp_str_equal(sp_cstr(result.reason), sp_str_lit("used 1 allocations, budget is 0")));
+
+    // The budget is evaluated once, even when it's exceeded.
+    budget_evaluations = 0;
+    sp_test_assert(!counted_budget_test(NULL).successful);
+    sp_test_assert(budget_evaluations == 1);
+    sp_test_success();
+}
+
+static SP_TestResult logging_test(void* userdata) {
+    (void) userdata;
+    for (u32 i = 0; i < 100; i++) {
+        sp_info("worker line %u", i);
+    }
+    sp_test_success();
+}
+
+SP_TestResult test_runner_async_logging(void* userdata) {
+    (void) userdata;
+
+    const char* path = "spire_test_runner_log.txt";
+    remove(path);
+    SP_Config log_config = *config;
+    log_config.logging.async = true;
+    log_config.logging.path = path;
+    sp_terminate();
+    sp_test_assert(sp_init(log_config));
+
+    // Workers are forked while the parent logs asynchronously. They need a
+    // writer of their own, and the parent's has to keep working afterwards.
+    sp_info("before");
+    b8 passed = run_isolated(logging_test);
+    sp_info("after");
+    sp_log_flush();
+
+    u32 lines = 0;
+    FILE* file = fopen(path, "rb");
+    i32 c;
+    while (file != NULL && (c = fgetc(file)) != EOF) {
+        lines += c == '\n';
+    }
+    if (file != NULL) {
+        fclose(file);
+    }
+    sp_terminate();
+    sp_init(*config);
+    remove(path);
+
+    sp_test_assert(passed);
+    sp_test_assert(lines == 102);
+    sp_test_success();
+}
+
+void test_runner(SP_TestSuite* suite, const SP_Config* suite_config) {
+    config = suite_config;
+    u32 group = sp_test_group_register(suite, sp_str_lit("Test runner"));
+    sp_test_register(suite, group, test_runner_isolates_crash, NULL);
+    sp_test_register(suite, group, test_runner_timeout, NULL);
+    sp_test_register(suite, group, test_runner_budget, NULL);
+    sp_test_register(suite, group, test_runner_async_logging, NULL);
+}
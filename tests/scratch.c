@@ -0,0 +1,130 @@
+#include "spire.h"
+
+#ifdef SP_POSIX
+#include <pthread.h>
+#endif
+
+SP_TestResult test_scratch_reuse(void* userdata) {
+    (void) userdata;
+
+    SP_Scratch a = sp_scratch_begin(NULL, 0);
+    sp_arena_push(a.arena, 64);
+    sp_scratch_end(a);
+
+    SP_Scratch b = sp_scratch_begin(NULL, 0);
+    sp_test_assert(b.arena == a.arena);
+    sp_test_assert(sp_arena_get_pos(b.arena) == a.pos);
+    sp_scratch_end(b);
+
+    sp_test_success();
+}
+
+SP_TestResult test_scratch_conflicts(void* userdata) {
+    (void) userdata;
+
+    SP_Scratch a = sp_scratch_begin(NULL, 0);
+    SP_Scratch b = sp_scratch_begin(&a.arena, 1);
+    SP_Arena* conflicts[] = {a.arena, b.arena};
+    SP_Scratch c = sp_scratch_begin(conflicts, sp_arrlen(conflicts));
+
+    sp_test_assert(a.arena != NULL && b.arena != NULL && c.arena != NULL);
+    sp_test_assert(a.arena != b.arena);
+    sp_test_assert(c.arena != a.arena);
+    sp_test_assert(c.arena != b.arena);
+
+    sp_scratch_end(c);
+    sp_scratch_end(b);
+    sp_scratch_end(a);
+
+    sp_test_success();
+}
+
+SP_TestResult test_scratch_nested_unlisted_conflict(void* userdata) {
+    (void) userdata;
+
+    // 'c' only lists 'b' as a conflict, but 'a' is still in use further up
+    // the stack and there are spare scratch arenas.
+    SP_Scratch a = sp_scratch_begin(NULL, 0);
+    SP_Scratch b = sp_scratch_begin(&a.arena, 1);
+    SP_Scratch c = sp_scratch_begin(&b.arena, 1);
+
+    sp_test_assert(c.arena != a.arena);
+    sp_test_assert(c.arena != b.arena);
+
+    sp_scratch_end(c);
+    sp_scratch_end(b);
+    sp_scratch_end(a);
+
+    sp_test_success();
+}
+
+SP_TestResult test_scratch_nested_pop(void* userdata) {
+    (void) userdata;
+
+    SP_Scratch a = sp_scratch_begin(NULL, 0);
+    u32* outer = sp_arena_push(a.arena, sizeof(u32));
+    *outer = 42;
+
+    for (u32 i = 0; i < 16; i++) {
+        SP_Scratch b = sp_scratch_begin(&a.arena, 1);
+        u8* inner = sp_arena_push(b.arena, sp_kib(64));
+        inner[0] = 1;
+        sp_scratch_end(b);
+    }
+
+    sp_test_assert(*outer == 42);
+    sp_scratch_end(a);
+    sp_test_assert(sp_arena_get_pos(a.arena) == a.pos);
+
+    sp_test_success();
+}
+
+#ifdef SP_POSIX
+typedef struct ScratchThread ScratchThread;
+struct ScratchThread {
+    SP_Arena* arena;
+    u64 heap_allocs;
+};
+
+static void* scratch_thread(void* userdata) {
+    ScratchThread* thread = userdata;
+    SP_Scratch scratch = sp_scratch_begin(NULL, 0);
+    sp_arena_push(scratch.arena, sp_kib(4));
+    sp_scratch_end(scratch);
+    thread->arena = scratch.arena;
+    thread->heap_allocs = sp_get_thread_alloc_stats().heap_allocs;
+    return NULL;
+}
+#endif
+
+SP_TestResult test_scratch_thread_recycling(void* userdata) {
+    (void) userdata;
+
+#ifndef SP_POSIX
+    sp_test_skip("needs POSIX threads");
+#else
+    // Threads run one after the other, so each one has to pick up the
+    // context the previous one left behind instead of allocating its own.
+    ScratchThread threads[16] = {0};
+    for (u32 i = 0; i < sp_arrlen(threads); i++) {
+        pthread_t handle;
+        sp_test_assert(pthread_create(&handle, NULL, scratch_thread, &threads[i]) == 0);
+        pthread_join(handle, NULL);
+    }
+
+    for (u32 i = 1; i < sp_arrlen(threads); i++) {
+        sp_test_assert(threads[i].arena == threads[0].arena);
+        sp_test_assert(threads[i].heap_allocs == 0);
+    }
+    sp_test_success();
+#endif
+}
+
+void test_scratch(SP_TestSuite* suite) {
+    u32 group = sp_test_group_register(suite, sp_str_lit("Scratch Arena"));
+    sp_test_register(suite, group, test_scratch_reuse, NULL);
+    sp_test_register(suite, group, test_scratch_conflicts, NULL);
+    sp_test_register(suite, group, test_scratch_nested_unlisted_conflict, NULL);
+    sp_test_register(suite, group, test_scratch_nested_pop, NULL);
+    sp_test_register(suite, group, test_scratch_thread_recycling, NULL);
+}